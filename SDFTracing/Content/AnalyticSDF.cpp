@@ -0,0 +1,231 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "AnalyticSDF.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+AnalyticSDF::AnalyticSDF() :
+	m_stats()
+{
+}
+
+AnalyticSDF::~AnalyticSDF()
+{
+}
+
+void AnalyticSDF::Init(const AnalyticPrimitive* pPrimitives, uint32_t primitiveCount)
+{
+	m_primitives.resize(primitiveCount);
+	for (auto i = 0u; i < primitiveCount; ++i)
+	{
+		m_primitives[i].Size = pPrimitives[i].Size;
+		m_primitives[i].Type = pPrimitives[i].Type;
+		Update(i, pPrimitives[i].World);
+	}
+}
+
+void AnalyticSDF::Update(uint32_t primitiveId, const XMFLOAT3X4& world)
+{
+	auto& primitive = m_primitives[primitiveId];
+	const auto worldMatrix = XMLoadFloat3x4(&world);
+	XMFLOAT4X4 worldI;
+	XMStoreFloat4x4(&worldI, XMMatrixInverse(nullptr, worldMatrix));
+	for (uint8_t i = 0; i < 3; ++i)
+		primitive.WorldI[i] = XMFLOAT4(worldI.m[0][i], worldI.m[1][i], worldI.m[2][i], worldI.m[3][i]);
+	primitive.Scale = XMVectorGetX(XMVector3Length(worldMatrix.r[0]));
+}
+
+//--------------------------------------------------------------------------------------
+// Exact distances in primitive space, as in https://iquilezles.org/articles/distfunctions
+//--------------------------------------------------------------------------------------
+XMVECTOR AnalyticSDF::Evaluate(FXMVECTOR x, FXMVECTOR y, FXMVECTOR z) const
+{
+	const auto zero = XMVectorZero();
+	auto dist = XMVectorReplicate(FLT_MAX);
+	for (const auto& primitive : m_primitives)
+	{
+		XMVECTOR p[3];
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto col = XMLoadFloat4(&primitive.WorldI[i]);
+			p[i] = XMVectorMultiplyAdd(x, XMVectorSplatX(col), XMVectorMultiplyAdd(y, XMVectorSplatY(col),
+				XMVectorMultiplyAdd(z, XMVectorSplatZ(col), XMVectorSplatW(col))));
+		}
+
+		XMVECTOR d;
+		switch (primitive.Type)
+		{
+		case PRIMITIVE_SPHERE:
+			d = XMVectorSqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]) - XMVectorReplicate(primitive.Size.x);
+			break;
+		case PRIMITIVE_CAPSULE:
+		{
+			const auto h = XMVectorReplicate(primitive.Size.y);
+			const auto py = p[1] - XMVectorClamp(p[1], -h, h);
+			d = XMVectorSqrt(p[0] * p[0] + py * py + p[2] * p[2]) - XMVectorReplicate(primitive.Size.x);
+			break;
+		}
+		default:
+		{
+			const auto qx = XMVectorAbs(p[0]) - XMVectorReplicate(primitive.Size.x);
+			const auto qy = XMVectorAbs(p[1]) - XMVectorReplicate(primitive.Size.y);
+			const auto qz = XMVectorAbs(p[2]) - XMVectorReplicate(primitive.Size.z);
+			const auto ox = XMVectorMax(qx, zero), oy = XMVectorMax(qy, zero), oz = XMVectorMax(qz, zero);
+			d = XMVectorSqrt(ox * ox + oy * oy + oz * oz) + XMVectorMin(XMVectorMax(qx, XMVectorMax(qy, qz)), zero);
+		}
+		}
+
+		dist = XMVectorMin(d * XMVectorReplicate(primitive.Scale), dist);
+	}
+
+	return dist;
+}
+
+void AnalyticSDF::Evaluate(const XMFLOAT3* pPositions, uint32_t count, float* pDistances) const
+{
+	for (auto i = 0u; i < count; i += 4)
+	{
+		// Gather 4 positions into SoA, repeating the last one past the end
+		XMFLOAT4 soa[3];
+		float* pSoA[] = { &soa[0].x, &soa[1].x, &soa[2].x };
+		for (uint8_t j = 0; j < 4; ++j)
+		{
+			const auto& pos = pPositions[(min)(i + j, count - 1)];
+			pSoA[0][j] = pos.x;
+			pSoA[1][j] = pos.y;
+			pSoA[2][j] = pos.z;
+		}
+
+		XMFLOAT4 dist;
+		XMStoreFloat4(&dist, Evaluate(XMLoadFloat4(&soa[0]), XMLoadFloat4(&soa[1]), XMLoadFloat4(&soa[2])));
+		const float* pDist = &dist.x;
+		for (uint8_t j = 0; j < 4 && i + j < count; ++j) pDistances[i + j] = pDist[j];
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Rows of voxels in groups of 4; primitives carry no material yet, so voxels they win
+// lose the mesh id
+//--------------------------------------------------------------------------------------
+void AnalyticSDF::Combine(const float* pMeshSDF, SDFVolume& volume)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	const auto gridSize = volume.GetGridSize();
+	const auto pSDF = volume.GetSDF();
+	const auto pIds = volume.GetIds();
+
+	atomic<uint32_t> primitiveVoxelCount(0);
+	ParallelFor(gridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t count = 0;
+		for (auto z = begin; z < end; ++z)
+			for (auto y = 0u; y < gridSize; ++y)
+			{
+				// Voxel centers are affine in x along a row
+				const auto rowStart = volume.GetVoxelIndex(0, y, z);
+				const auto p0 = volume.GetVoxelCenter(0, y, z);
+				const auto step = volume.GetVoxelCenter(1, y, z) - p0;
+				for (auto x = 0u; x < gridSize; x += 4)
+				{
+					const auto xs = XMVectorSet(static_cast<float>(x), static_cast<float>(x + 1),
+						static_cast<float>(x + 2), static_cast<float>(x + 3));
+					const auto px = XMVectorMultiplyAdd(XMVectorSplatX(step), xs, XMVectorSplatX(p0));
+					const auto py = XMVectorMultiplyAdd(XMVectorSplatY(step), xs, XMVectorSplatY(p0));
+					const auto pz = XMVectorMultiplyAdd(XMVectorSplatZ(step), xs, XMVectorSplatZ(p0));
+					XMFLOAT4 dist;
+					XMStoreFloat4(&dist, Evaluate(px, py, pz));
+					const float* pDist = &dist.x;
+					for (uint8_t j = 0; j < 4 && x + j < gridSize; ++j)
+					{
+						const auto i = rowStart + x + j;
+						const auto meshDist = pMeshSDF[i];
+						if (pDist[j] < meshDist)
+						{
+							pSDF[i] = pDist[j];
+							pIds[i] = 0;
+							++count;
+						}
+						else pSDF[i] = meshDist;
+					}
+				}
+			}
+
+		primitiveVoxelCount += count;
+	});
+
+	m_stats.PrimitiveVoxelCount = primitiveVoxelCount;
+	m_stats.CombineTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+const AnalyticSDF::Stats& AnalyticSDF::GetStats() const
+{
+	return m_stats;
+}
+
+//--------------------------------------------------------------------------------------
+// "Type" is "Box", "Sphere" or "Capsule", with a "Size" of 3, 1 or 2 components matching
+// AnalyticPrimitive::Size; "Rotation" is an optional quaternion
+//--------------------------------------------------------------------------------------
+bool AnalyticSDF::LoadPrimitives(tiny::TinyJson& sceneReader, vector<AnalyticPrimitive>& primitives)
+{
+	float vecData[4];
+	auto primitiveArray = sceneReader.Get<tiny::xarray>("Primitives");
+	const auto primitiveCount = static_cast<uint32_t>(primitiveArray.Count());
+	primitives.resize(primitiveCount);
+	for (auto i = 0u; i < primitiveCount; ++i)
+	{
+		if (primitiveArray.Enter(i))
+		{
+			auto& primitive = primitives[i];
+			const auto type = primitiveArray.Get<string>("Type");
+			uint8_t sizeCount;
+			if (type == "Box")
+			{
+				primitive.Type = PRIMITIVE_BOX;
+				sizeCount = 3;
+			}
+			else if (type == "Sphere")
+			{
+				primitive.Type = PRIMITIVE_SPHERE;
+				sizeCount = 1;
+			}
+			else if (type == "Capsule")
+			{
+				primitive.Type = PRIMITIVE_CAPSULE;
+				sizeCount = 2;
+			}
+			else return false;
+
+			auto size = primitiveArray.Get<tiny::xarray>("Size");
+			if (size.Count() != sizeCount) return false;
+			vecData[1] = vecData[2] = 0.0f;
+			for (uint8_t j = 0; j < sizeCount; ++j) if (size.Enter(j)) vecData[j] = size.Get<float>();
+			primitive.Size = XMFLOAT3(vecData[0], vecData[1], vecData[2]);
+
+			auto pos = primitiveArray.Get<tiny::xarray>("Position");
+			if (pos.Count() != 3) return false;
+			for (uint8_t j = 0; j < 3; ++j) if (pos.Enter(j)) vecData[j] = pos.Get<float>();
+			const auto translation = XMVectorSet(vecData[0], vecData[1], vecData[2], 0.0f);
+
+			auto rotation = XMQuaternionIdentity();
+			auto rot = primitiveArray.Get<tiny::xarray>("Rotation");
+			if (rot.Count() == 4)
+			{
+				for (uint8_t j = 0; j < 4; ++j) if (rot.Enter(j)) vecData[j] = rot.Get<float>();
+				rotation = XMQuaternionNormalize(XMVectorSet(vecData[0], vecData[1], vecData[2], vecData[3]));
+			}
+
+			const auto scaling = primitiveArray.Get<float>("Scaling", 1.0f);
+			XMStoreFloat3x4(&primitive.World, XMMatrixAffineTransformation(XMVectorReplicate(scaling),
+				XMVectorZero(), rotation, translation));
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SDFVolume.h"
+
+//--------------------------------------------------------------------------------------
+// Exact SDFs of analytic primitives (boxes, spheres and capsules), evaluated 4 points at
+// a time in SoA form and combined with the mesh SDF by min; moving a primitive only
+// needs Combine() again instead of re-voxelizing any triangles
+//--------------------------------------------------------------------------------------
+class AnalyticSDF
+{
+public:
+	struct Stats
+	{
+		double CombineTime;	// ms
+		uint32_t PrimitiveVoxelCount;	// Voxels where a primitive is closer than the meshes
+	};
+
+	AnalyticSDF();
+	virtual ~AnalyticSDF();
+
+	void Init(const AnalyticPrimitive* pPrimitives, uint32_t primitiveCount);
+	void Update(uint32_t primitiveId, const DirectX::XMFLOAT3X4& world);
+
+	// Distances of 4 points given as x, y and z vectors
+	DirectX::XMVECTOR Evaluate(DirectX::FXMVECTOR x, DirectX::FXMVECTOR y, DirectX::FXMVECTOR z) const;
+	void Evaluate(const DirectX::XMFLOAT3* pPositions, uint32_t count, float* pDistances) const;
+
+	// Writes min(pMeshSDF, primitives) into the volume; pMeshSDF may be the volume's own SDF
+	void Combine(const float* pMeshSDF, SDFVolume& volume);
+
+	const Stats& GetStats() const;
+
+	// The "Primitives" array of a scene; fails on an unknown type or a size of the wrong arity
+	static bool LoadPrimitives(tiny::TinyJson& sceneReader, std::vector<AnalyticPrimitive>& primitives);
+
+protected:
+	// Inverse world matrix in columns for the SoA transform, and the scale back to world units
+	struct Primitive
+	{
+		DirectX::XMFLOAT4 WorldI[3];
+		DirectX::XMFLOAT3 Size;
+		float Scale;
+		uint32_t Type;
+	};
+
+	std::vector<Primitive> m_primitives;
+
+	Stats m_stats;
+};
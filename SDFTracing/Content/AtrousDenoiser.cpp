@@ -0,0 +1,307 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "AtrousDenoiser.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+const float AtrousDenoiser::DepthSigma = 0.01f;
+const float AtrousDenoiser::LuminanceSigma = 4.0f;
+
+static XMVECTOR loadPixels(const vector<float>& plane, uint32_t i)
+{
+	return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&plane[i]));
+}
+
+static void storePixels(vector<float>& plane, uint32_t i, FXMVECTOR v)
+{
+	XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&plane[i]), v);
+}
+
+static XMVECTOR calcLuminance(FXMVECTOR r, FXMVECTOR g, FXMVECTOR b)
+{
+	return XMVectorMultiplyAdd(r, XMVectorReplicate(0.2126f),
+		XMVectorMultiplyAdd(g, XMVectorReplicate(0.7152f), b * XMVectorReplicate(0.0722f)));
+}
+
+AtrousDenoiser::AtrousDenoiser() :
+	m_width(0),
+	m_height(0),
+	m_stride(0),
+	m_padding(0),
+	m_stats()
+{
+}
+
+AtrousDenoiser::~AtrousDenoiser()
+{
+}
+
+void AtrousDenoiser::Init(uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+	m_padding = 2u << (MaxIterationCount - 1);
+	m_stride = ((width + 3) & ~3u) + 2 * m_padding;
+
+	// Padding texels stay zero, and so never match a mesh
+	const auto planeSize = m_stride * height;
+	for (auto pPlane : { &m_guides.NrmX, &m_guides.NrmY, &m_guides.NrmZ, &m_guides.InvDepth,
+		&m_guides.InvDepthGradX, &m_guides.InvDepthGradY })
+		pPlane->assign(planeSize, 0.0f);
+	m_guides.MeshIds.assign(planeSize, 0);
+
+	for (auto& planes : m_planes)
+		for (auto pPlane : { &planes.R, &planes.G, &planes.B, &planes.A, &planes.Variance })
+			pPlane->assign(planeSize, 0.0f);
+}
+
+void AtrousDenoiser::Denoise(const VisibilityBuffer& visibility, XMFLOAT4* pImage, uint8_t iterationCount)
+{
+	// The row padding only covers the taps of MaxIterationCount passes
+	assert(iterationCount <= MaxIterationCount);
+	if (iterationCount > MaxIterationCount) iterationCount = MaxIterationCount;
+
+	auto start = chrono::high_resolution_clock::now();
+	buildGuides(visibility);
+	m_stats.GuideTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	// Background pixels are kept zero in the planes and left untouched in the image
+	start = chrono::high_resolution_clock::now();
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		auto& planes = m_planes[0];
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = m_stride * y + m_padding + x;
+				const auto& color = pImage[m_width * y + x];
+				const auto isForeground = m_guides.MeshIds[i] != 0;
+				planes.R[i] = isForeground ? color.x : 0.0f;
+				planes.G[i] = isForeground ? color.y : 0.0f;
+				planes.B[i] = isForeground ? color.z : 0.0f;
+				planes.A[i] = isForeground ? color.w : 0.0f;
+			}
+	});
+	estimateVariance(m_planes[0]);
+
+	// Ping-pong between the planes with step sizes 1, 2, 4, ...
+	for (uint8_t i = 0; i < iterationCount; ++i)
+		filter(m_planes[i & 1], m_planes[(i + 1) & 1], 1u << i);
+
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		const auto& planes = m_planes[iterationCount & 1];
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = m_stride * y + m_padding + x;
+				if (m_guides.MeshIds[i])
+					pImage[m_width * y + x] = XMFLOAT4(planes.R[i], planes.G[i], planes.B[i], planes.A[i]);
+			}
+	});
+	m_stats.FilterTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+const AtrousDenoiser::Stats& AtrousDenoiser::GetStats() const
+{
+	return m_stats;
+}
+
+void AtrousDenoiser::buildGuides(const VisibilityBuffer& visibility)
+{
+	const auto pVisibility = visibility.GetVisibility();
+	const auto pNormals = visibility.GetNormals();
+	const auto pDepths = visibility.GetDepths();
+	auto& guides = m_guides;
+
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = m_stride * y + m_padding + x;
+				const auto j = m_width * y + x;
+				guides.NrmX[i] = pNormals[j].x;
+				guides.NrmY[i] = pNormals[j].y;
+				guides.NrmZ[i] = pNormals[j].z;
+				guides.MeshIds[i] = pVisibility[j] ? DecodeVisibility(pVisibility[j]).MeshId + 1 : 0;
+				guides.InvDepth[i] = pDepths[j] > 0.0f ? 1.0f / pDepths[j] : 0.0f;
+			}
+	});
+
+	// Screen-space gradient of 1/depth, taking the smaller one-sided difference on the same mesh
+	// so that silhouettes do not leak into it
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		const auto calcGradient = [&guides](uint32_t i, uint32_t iPrev, uint32_t iNext, bool hasPrev, bool hasNext)
+		{
+			const auto meshId = guides.MeshIds[i];
+			hasPrev = hasPrev && guides.MeshIds[iPrev] == meshId;
+			hasNext = hasNext && guides.MeshIds[iNext] == meshId;
+			const auto dPrev = hasPrev ? guides.InvDepth[i] - guides.InvDepth[iPrev] : 0.0f;
+			const auto dNext = hasNext ? guides.InvDepth[iNext] - guides.InvDepth[i] : 0.0f;
+			if (hasPrev && hasNext) return fabsf(dPrev) < fabsf(dNext) ? dPrev : dNext;
+
+			return hasPrev ? dPrev : dNext;
+		};
+
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = m_stride * y + m_padding + x;
+				if (!guides.MeshIds[i])
+				{
+					guides.InvDepthGradX[i] = 0.0f;
+					guides.InvDepthGradY[i] = 0.0f;
+					continue;
+				}
+
+				guides.InvDepthGradX[i] = calcGradient(i, i - 1, i + 1, x > 0, x + 1 < m_width);
+				guides.InvDepthGradY[i] = calcGradient(i, i - m_stride, i + m_stride, y > 0, y + 1 < m_height);
+			}
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Spatial luminance variance over the 5x5 neighborhood on the same mesh, which covers
+// the 4x2 interleaving of the samples
+//--------------------------------------------------------------------------------------
+void AtrousDenoiser::estimateVariance(Planes& planes) const
+{
+	const auto& guides = m_guides;
+	const auto height = static_cast<int32_t>(m_height);
+
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+			for (auto x = 0u; x < m_width; x += 4)
+			{
+				const auto i = m_stride * y + m_padding + x;
+				const auto meshId = XMLoadInt4(&guides.MeshIds[i]);
+				const auto isBackground = XMVectorEqualInt(meshId, XMVectorZero());
+				if (XMVector4EqualInt(isBackground, XMVectorTrueInt())) continue;
+
+				auto sum = XMVectorZero();
+				auto sqSum = XMVectorZero();
+				auto count = XMVectorZero();
+				for (auto ky = -2; ky <= 2; ++ky)
+				{
+					const auto ty = y + ky;
+					if (ty < 0 || ty >= height) continue;
+
+					for (auto kx = -2; kx <= 2; ++kx)
+					{
+						const auto j = static_cast<uint32_t>(static_cast<int32_t>(i) + ky * static_cast<int32_t>(m_stride) + kx);
+						const auto isSameMesh = XMVectorEqualInt(XMLoadInt4(&guides.MeshIds[j]), meshId);
+						const auto lum = XMVectorAndInt(calcLuminance(loadPixels(planes.R, j),
+							loadPixels(planes.G, j), loadPixels(planes.B, j)), isSameMesh);
+						sum += lum;
+						sqSum = XMVectorMultiplyAdd(lum, lum, sqSum);
+						count += XMVectorAndInt(XMVectorSplatOne(), isSameMesh);
+					}
+				}
+
+				// The center always counts, so count > 0
+				const auto mean = sum / count;
+				const auto variance = XMVectorMax(sqSum / count - mean * mean, XMVectorZero());
+				storePixels(planes.Variance, i, XMVectorAndCInt(variance, isBackground));
+			}
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// One a-trous pass over 4 pixels at a time: 5x5 B3-spline taps spread by stepSize, weighted
+// by same mesh, max(dot(n_p, n_q), 0)^NormalPower, the deviation of 1/depth from the plane
+// of p, and the luminance difference scaled by the standard deviation at p. The variance is
+// filtered with the squared weights, so that the luminance term tightens as noise drops.
+//--------------------------------------------------------------------------------------
+void AtrousDenoiser::filter(const Planes& src, Planes& dst, uint32_t stepSize) const
+{
+	static const float kernel[] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+	const auto& guides = m_guides;
+	const auto step = static_cast<int32_t>(stepSize);
+	const auto stride = static_cast<int32_t>(m_stride);
+	const auto height = static_cast<int32_t>(m_height);
+
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+			for (auto x = 0u; x < m_width; x += 4)
+			{
+				const auto i = m_stride * y + m_padding + x;
+				const auto meshId = XMLoadInt4(&guides.MeshIds[i]);
+				const auto isBackground = XMVectorEqualInt(meshId, XMVectorZero());
+				if (XMVector4EqualInt(isBackground, XMVectorTrueInt()))
+				{
+					for (auto pPlane : { &dst.R, &dst.G, &dst.B, &dst.A, &dst.Variance })
+						storePixels(*pPlane, i, XMVectorZero());
+					continue;
+				}
+
+				const auto nrmX = loadPixels(guides.NrmX, i);
+				const auto nrmY = loadPixels(guides.NrmY, i);
+				const auto nrmZ = loadPixels(guides.NrmZ, i);
+				const auto invDepth = loadPixels(guides.InvDepth, i);
+				const auto invDepthGradX = loadPixels(guides.InvDepthGradX, i);
+				const auto invDepthGradY = loadPixels(guides.InvDepthGradY, i);
+				const auto lum = calcLuminance(loadPixels(src.R, i), loadPixels(src.G, i), loadPixels(src.B, i));
+
+				// Background lanes may go non-finite here; they are zeroed at the end
+				const auto depthScale = -XMVectorReciprocal(invDepth * DepthSigma);
+				const auto lumScale = -XMVectorReciprocal(XMVectorSqrt(loadPixels(src.Variance, i)) *
+					LuminanceSigma + XMVectorReplicate(1e-6f));
+
+				auto sumR = XMVectorZero(), sumG = XMVectorZero(), sumB = XMVectorZero(), sumA = XMVectorZero();
+				auto varianceSum = XMVectorZero();
+				auto weightSum = XMVectorZero();
+				for (auto ky = -2; ky <= 2; ++ky)
+				{
+					const auto ty = y + ky * step;
+					if (ty < 0 || ty >= height) continue;
+
+					for (auto kx = -2; kx <= 2; ++kx)
+					{
+						const auto j = static_cast<uint32_t>(static_cast<int32_t>(i) + ky * step * stride + kx * step);
+						const auto isSameMesh = XMVectorEqualInt(XMLoadInt4(&guides.MeshIds[j]), meshId);
+						if (XMVector4EqualInt(isSameMesh, XMVectorFalseInt())) continue;
+
+						// Repeated squaring for the normal power
+						auto normalWeight = XMVectorMultiplyAdd(nrmX, loadPixels(guides.NrmX, j),
+							XMVectorMultiplyAdd(nrmY, loadPixels(guides.NrmY, j), nrmZ * loadPixels(guides.NrmZ, j)));
+						normalWeight = XMVectorMax(normalWeight, XMVectorZero());
+						for (auto p = 1u; p < NormalPower; p <<= 1) normalWeight *= normalWeight;
+
+						const auto expectedInvDepth = XMVectorMultiplyAdd(invDepthGradX, XMVectorReplicate(static_cast<float>(kx * step)),
+							XMVectorMultiplyAdd(invDepthGradY, XMVectorReplicate(static_cast<float>(ky * step)), invDepth));
+						const auto r = loadPixels(src.R, j);
+						const auto g = loadPixels(src.G, j);
+						const auto b = loadPixels(src.B, j);
+						const auto exponent = XMVectorAbs(loadPixels(guides.InvDepth, j) - expectedInvDepth) * depthScale +
+							XMVectorAbs(calcLuminance(r, g, b) - lum) * lumScale;
+
+						auto weight = normalWeight * XMVectorExpE(exponent) * (kernel[kx + 2] * kernel[ky + 2]);
+						weight = XMVectorAndInt(weight, isSameMesh);
+						sumR = XMVectorMultiplyAdd(r, weight, sumR);
+						sumG = XMVectorMultiplyAdd(g, weight, sumG);
+						sumB = XMVectorMultiplyAdd(b, weight, sumB);
+						sumA = XMVectorMultiplyAdd(loadPixels(src.A, j), weight, sumA);
+						varianceSum = XMVectorMultiplyAdd(loadPixels(src.Variance, j), weight * weight, varianceSum);
+						weightSum += weight;
+					}
+				}
+
+				// The center tap always contributes, so weightSum > 0 on foreground lanes
+				const auto invWeightSum = XMVectorReciprocal(weightSum);
+				storePixels(dst.R, i, XMVectorAndCInt(sumR * invWeightSum, isBackground));
+				storePixels(dst.G, i, XMVectorAndCInt(sumG * invWeightSum, isBackground));
+				storePixels(dst.B, i, XMVectorAndCInt(sumB * invWeightSum, isBackground));
+				storePixels(dst.A, i, XMVectorAndCInt(sumA * invWeightSum, isBackground));
+				storePixels(dst.Variance, i, XMVectorAndCInt(varianceSum * invWeightSum * invWeightSum, isBackground));
+			}
+	});
+}
@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VisibilityBuffer.h"
+
+//--------------------------------------------------------------------------------------
+// Edge-aware a-trous wavelet filter for the shaded image: 5x5 B3-spline kernels with
+// step sizes 1, 2, 4, ..., stopped at mesh-id, normal and depth discontinuities of the
+// visibility buffer, and at luminance differences relative to the local noise level
+//--------------------------------------------------------------------------------------
+class AtrousDenoiser
+{
+public:
+	struct Stats
+	{
+		double GuideTime;	// ms
+		double FilterTime;	// ms
+	};
+
+	AtrousDenoiser();
+	virtual ~AtrousDenoiser();
+
+	void Init(uint32_t width, uint32_t height);
+	void Denoise(const VisibilityBuffer& visibility, DirectX::XMFLOAT4* pImage, uint8_t iterationCount = 4);
+
+	const Stats& GetStats() const;
+
+	static const uint8_t MaxIterationCount = 5;
+	static const uint32_t NormalPower = 128;	// Normal weight: max(dot(n_p, n_q), 0)^NormalPower
+	static const float DepthSigma;				// Tolerance relative to 1/depth
+	static const float LuminanceSigma;			// Tolerance in standard deviations of the luminance
+
+protected:
+	// Per-pixel guides: normal, 1/depth (affine in screen space on planes) and its gradient
+	struct Guides
+	{
+		std::vector<float> NrmX, NrmY, NrmZ;
+		std::vector<float> InvDepth;
+		std::vector<float> InvDepthGradX, InvDepthGradY;
+		std::vector<uint32_t> MeshIds;
+	};
+
+	// Color channels and luminance variance
+	struct Planes
+	{
+		std::vector<float> R, G, B, A;
+		std::vector<float> Variance;
+	};
+
+	void buildGuides(const VisibilityBuffer& visibility);
+	void estimateVariance(Planes& planes) const;
+	void filter(const Planes& src, Planes& dst, uint32_t stepSize) const;
+
+	// All planes are stored per pixel in rows of m_stride, filtered 4 pixels at a time. Rows
+	// are padded on both sides by the widest tap offset, with mesh id 0 so that taps never
+	// need bounds checks in x
+	Guides		m_guides;
+	Planes		m_planes[2];	// Ping-pong
+
+	uint32_t	m_width;
+	uint32_t	m_height;
+	uint32_t	m_stride;
+	uint32_t	m_padding;
+
+	Stats m_stats;
+};
@@ -0,0 +1,554 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "Benchmark.h"
+#include "VolumeShader.h"
+#include "IrradianceMipBuilder.h"
+#include "Optional/XUSGGltfLoader.h"
+
+using namespace std;
+using namespace DirectX;
+
+bool Benchmark::Run(ostream& os, const vector<string>& names)
+{
+	// In running order; glTF staging goes first, before the volumes of the others raise the peak working set
+	static const struct
+	{
+		const char* Name;
+		const char* Title;
+		void (*Run)(ostream& os);
+	} benchmarks[] =
+	{
+		{ "gltfStaging", "glTF staging: peak working set with the loader's buffers retained or detached and freed once staged",
+			[](ostream& os) { gltfStaging(os, 72, 512, true); gltfStaging(os, 72, 512, false); } },
+		{ "volumeShading", "Volume shading: dense id scan + compaction, then shading of surface voxels",
+			[](ostream& os) { volumeShading(os, 128); volumeShading(os, 256); } },
+		{ "irradianceScheduling", "Irradiance-volume scheduling: per-frame refresh work with an orbiting dynamic mesh",
+			[](ostream& os) { irradianceScheduling(os, 128, 8); irradianceScheduling(os, 128, 16); } },
+		{ "irradianceMips", "Irradiance mips: dirty-brick propagation versus full-chain regeneration",
+			[](ostream& os) { irradianceMips(os, 128, 8); irradianceMips(os, 256, 8); } },
+		{ "lightClustering", "Clustered light lists: impact-range and normal-hemisphere culling on 8^3-voxel clusters",
+			[](ostream& os)
+			{
+				lightClustering(os, 128, 16, GetImpactDistance());
+				lightClustering(os, 128, 64, GetImpactDistance());
+				lightClustering(os, 128, 256, GetImpactDistance());
+				lightClustering(os, 128, 256, GetImpactDistance() * 0.5f);
+			} },
+		{ "lightSampling", "Light BVH: stochastic light selection versus the full light loop of CSShade on the pixels of a view",
+			[](ostream& os) { lightSampling(os, 128, 256); } },
+		{ "shadowCaching", "Shadow cache: per-(voxel, light) visibility with a spinning dynamic mesh",
+			[](ostream& os) { shadowCaching(os, 128, 8, 0.8f); shadowCaching(os, 128, 8, 0.6f); } },
+		{ "shIrradiance", "L1 SH irradiance volume: per-pixel evaluation versus TraceIndirect() on the Cornell box",
+			[](ostream& os) { shIrradiance(os, 128); } },
+		{ "irradianceProbes", "Sparse irradiance probes: relocated octahedral probes versus the dense irradiance volume",
+			[](ostream& os) { irradianceProbes(os, 128, 8); irradianceProbes(os, 128, 4); } },
+		{ "temporalReuse", "Temporal reuse: reprojected indirect lighting with visibility-buffer rejection on camera paths",
+			[](ostream& os) { temporalReuse(os, 320, 180, 4); temporalReuse(os, 320, 180, 2); } },
+		{ "atrousDenoising", "A-trous denoising: edge-aware filtering of 4-sample interleaved indirect lighting",
+			[](ostream& os)
+			{
+				atrousDenoising(os, 480, 270, 3);
+				atrousDenoising(os, 480, 270, 5);
+				atrousDenoising(os, 1920, 1080, 4);
+				atrousDenoising(os, 3840, 2160, 4);
+			} },
+		{ "reducedRateIndirect", "Reduced-rate indirect: 2x2 and 4x4 block tracing with joint-bilateral upsampling",
+			[](ostream& os) { reducedRateIndirect(os, 480, 270, 2); reducedRateIndirect(os, 480, 270, 4); } },
+		{ "sphereTracing", "Sphere tracing: plain and over-relaxed TraceCone() on Cornell-box shadow rays",
+			[](ostream& os) { sphereTracing(os, 128); sphereTracing(os, 256); } },
+		{ "occupancySkipping", "Occupancy pyramid: DDA empty-space skipping for shadow and AO rays",
+			[](ostream& os) { occupancySkipping(os, 128, true); occupancySkipping(os, 256, true); occupancySkipping(os, 256, false); } },
+		{ "analyticPrimitives", "Analytic primitives: Cornell-box walls and boxes as exact box SDFs versus triangle voxelization",
+			[](ostream& os) { analyticPrimitives(os, 128); analyticPrimitives(os, 256); } },
+		{ "rigidSDFTransfer", "Rigid SDF transfer: Cornell-box boxes moving as dynamic meshes, resampled from local volumes versus re-voxelized",
+			[](ostream& os) { rigidSDFTransfer(os, 128, 32); rigidSDFTransfer(os, 128, 64); rigidSDFTransfer(os, 256, 64); } },
+		{ "gltfLoading", "glTF loading: serial versus threaded image decoding on a synthetic scene with 3 textures per material",
+			[](ostream& os) { gltfLoading(os, 72, 256); gltfLoading(os, 72, 512); } },
+		{ "gltfAccessors", "glTF accessors: vertex and index streams read into the interleaved vertices by Import",
+			[](ostream& os)
+			{
+				gltfAccessors(os, "Assets/bunny_uv.gltf", 0);
+				gltfAccessors(os, "Assets/cornell_box.gltf", 0);
+				gltfAccessors(os, nullptr, 2236);
+			} },
+		{ "base64Decoding", "Base64 decoding: data-URI buffers as cgltf decodes them versus GltfLoader::DecodeBase64()",
+			[](ostream& os) { base64Decoding(os, 1 << 20); base64Decoding(os, (64 << 20) + 1); } },
+		{ "gltfMapping", "glTF buffers: external .bin and .glb mapped into memory versus an embedded base64 data URI",
+			[](ostream& os) { gltfMapping(os, 1024); gltfMapping(os, 2236); } },
+		{ "gltfCaching", "glTF mesh cache: import with normal generation and light-map atlases versus a warm cache",
+			[](ostream& os)
+			{
+				gltfCaching(os, "Assets/bunny_uv.gltf", 0, 0);
+				gltfCaching(os, "Assets/cornell_box.gltf", 0, 0);
+				gltfCaching(os, nullptr, 72, 256);
+			} },
+		{ "gltfUnwrapping", "glTF light-map atlases: xatlas per primitive, one after another versus concurrently",
+			[](ostream& os) { gltfUnwrapping(os, 256, 8, 0); gltfUnwrapping(os, 1024, 4, 0); gltfUnwrapping(os, 64, 32, 0); } },
+		{ "indexReordering", "Index reordering: post-transform vertex cache misses per triangle (ACMR) and per vertex (ATVR)",
+			[](ostream& os)
+			{
+				indexReordering(os, "Assets/bunny_uv.gltf", 0, false);
+				indexReordering(os, "Assets/cornell_box.gltf", 0, false);
+				indexReordering(os, nullptr, 2236, false);
+				indexReordering(os, nullptr, 2236, true);
+			} },
+		{ "vertexWelding", "Vertex deduplication: imported meshes and their triangle soups, hashed in parallel and merged",
+			[](ostream& os)
+			{
+				vertexWelding(os, "Assets/bunny_uv.gltf", 0);
+				vertexWelding(os, "Assets/cornell_box.gltf", 0);
+				vertexWelding(os, nullptr, 1024);
+			} },
+		{ "vertexQuantization", "Vertex quantization: 32-byte vertices decoded against the 64-byte ones, and attribute fetches of random triangles",
+			[](ostream& os)
+			{
+				vertexQuantization(os, "Assets/bunny_uv.gltf", 0);
+				vertexQuantization(os, "Assets/cornell_box.gltf", 0);
+				vertexQuantization(os, nullptr, 1024);
+			} }
+	};
+
+	os << fixed << setprecision(3);
+
+	// Every benchmark without names, otherwise the named ones in running order
+	auto isFound = true;
+	for (const auto& name : names)
+	{
+		const auto isKnown = any_of(cbegin(benchmarks), cend(benchmarks),
+			[&name](const auto& benchmark) { return name == benchmark.Name; });
+		if (!isKnown)
+		{
+			os << "Unknown benchmark: " << name << endl;
+			isFound = false;
+		}
+	}
+
+	if (!isFound)
+	{
+		os << "Available benchmarks:";
+		for (const auto& benchmark : benchmarks) os << " " << benchmark.Name;
+		os << endl;
+
+		return false;
+	}
+
+	auto isFirst = true;
+	for (const auto& benchmark : benchmarks)
+	{
+		if (!names.empty() && find(names.cbegin(), names.cend(), benchmark.Name) == names.cend()) continue;
+		os << (isFirst ? "[" : "\n[") << benchmark.Title << "]" << endl;
+		benchmark.Run(os);
+		isFirst = false;
+	}
+
+	return true;
+}
+
+void Benchmark::createScene(Scene& scene, uint32_t gridSize, uint32_t lightSourceCount,
+	uint32_t dynamicMeshCount, float worldScale)
+{
+	const auto radius = 0.6f;
+
+	// Octahedron, one triangle per octant
+	const XMFLOAT3 positions[] =
+	{
+		XMFLOAT3(-radius, 0.0f, 0.0f), XMFLOAT3(radius, 0.0f, 0.0f),
+		XMFLOAT3(0.0f, -radius, 0.0f), XMFLOAT3(0.0f, radius, 0.0f),
+		XMFLOAT3(0.0f, 0.0f, -radius), XMFLOAT3(0.0f, 0.0f, radius)
+	};
+	scene.Vertices.resize(size(positions));
+	for (size_t i = 0; i < scene.Vertices.size(); ++i)
+	{
+		auto& vertex = scene.Vertices[i];
+		memset(&vertex, 0, sizeof(Vertex));
+		vertex.Pos = positions[i];
+		XMStoreFloat3(&vertex.Nrm, XMVector3Normalize(XMLoadFloat3(&positions[i])));
+		vertex.Color = 0xffffffff;
+	}
+
+	scene.Indices.resize(24);
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		scene.Indices[i * 3] = i & 1;
+		scene.Indices[i * 3 + 1] = 2 + ((i >> 1) & 1);
+		scene.Indices[i * 3 + 2] = 4 + ((i >> 2) & 1);
+	}
+
+	// All meshes share the octahedron
+	const auto meshCount = 1 + dynamicMeshCount;
+	scene.Meshes.assign(meshCount, { scene.Vertices.data(), scene.Indices.data(), static_cast<uint32_t>(scene.Indices.size()) });
+	scene.Matrices.resize(meshCount);
+	scene.DynamicMeshIds.resize(meshCount);
+	scene.WorldScale = worldScale;
+	for (auto i = 0u; i < meshCount; ++i)
+	{
+		const auto world = XMMatrixScaling(worldScale, worldScale, worldScale);
+		XMStoreFloat3x4(&scene.Matrices[i].World, world);
+		XMStoreFloat3x4(&scene.Matrices[i].WorldIT, XMMatrixTranspose(XMMatrixInverse(nullptr, world)));
+		scene.DynamicMeshIds[i] = i > 0 ? i - 1 : UINT32_MAX;
+	}
+
+	// Area lights on a ring above the shell
+	scene.LightSources.resize(lightSourceCount);
+	for (auto i = 0u; i < lightSourceCount; ++i)
+	{
+		const auto angle = XM_2PI * i / lightSourceCount;
+		const auto x = 0.5f * cosf(angle), z = 0.5f * sinf(angle);
+		auto& lightSource = scene.LightSources[i];
+		lightSource.Min = XMFLOAT4(x - 0.05f, 0.9f, z - 0.05f, 1.0f);
+		lightSource.Max = XMFLOAT4(x + 0.05f, 0.91f, z + 0.05f, 1.0f);
+		lightSource.Emissive = XMFLOAT4(1.0f, 1.0f, 1.0f, 16.0f / lightSourceCount);
+		XMStoreFloat3x4(&lightSource.World, XMMatrixScaling(worldScale, worldScale, worldScale));
+	}
+
+	XMFLOAT3X4 volumeWorld;
+	XMStoreFloat3x4(&volumeWorld, XMMatrixScaling(worldScale, worldScale, worldScale));
+	scene.Volume.Init(gridSize, volumeWorld);
+	voxelizeMesh(scene, 0);
+	animateScene(scene, 0.0f);
+}
+
+//--------------------------------------------------------------------------------------
+// Emissive panels spread over a sphere around the shell, facing it
+//--------------------------------------------------------------------------------------
+void Benchmark::placePanelLights(Scene& scene)
+{
+	const auto lightSourceCount = static_cast<uint32_t>(scene.LightSources.size());
+	for (auto i = 0u; i < lightSourceCount; ++i)
+	{
+		const auto y = 1.0f - 2.0f * (i + 0.5f) / lightSourceCount;
+		const auto r = sqrtf(1.0f - y * y);
+		const auto phi = XM_PI * (3.0f - sqrtf(5.0f)) * i;
+		const auto pos = XMVectorSet(r * cosf(phi), y, r * sinf(phi), 0.0f) * 0.75f;
+
+		XMFLOAT3 absPos;
+		XMStoreFloat3(&absPos, XMVectorAbs(pos));
+		const auto thin = XMVectorSet(absPos.x >= absPos.y && absPos.x >= absPos.z,
+			absPos.y > absPos.x && absPos.y >= absPos.z, absPos.z > absPos.x && absPos.z > absPos.y, 0.0f);
+		const auto ext = XMVectorReplicate(0.05f) - thin * 0.045f;
+
+		auto& lightSource = scene.LightSources[i];
+		XMStoreFloat4(&lightSource.Min, XMVectorSetW(pos - ext, 1.0f));
+		XMStoreFloat4(&lightSource.Max, XMVectorSetW(pos + ext, 1.0f));
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Dynamic meshes spin in place like the bunny in Renderer::getWorldMatrix(), optionally
+// orbiting the center
+//--------------------------------------------------------------------------------------
+void Benchmark::animateScene(Scene& scene, float time, float orbitRadius, float orbitSpeed)
+{
+	auto& volume = scene.Volume;
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+
+	// Clear the footprints at the previous poses, then restore the static mesh in them
+	vector<XMUINT3> footprints(2 * (meshCount - 1));
+	for (auto i = 1u; i < meshCount; ++i)
+	{
+		auto& lo = footprints[2 * (i - 1)];
+		auto& hi = footprints[2 * (i - 1) + 1];
+		getVoxelRange(scene, i, lo, hi);
+		for (auto z = lo.z; z <= hi.z; ++z)
+			for (auto y = lo.y; y <= hi.y; ++y)
+				for (auto x = lo.x; x <= hi.x; ++x)
+				{
+					const auto j = volume.GetVoxelIndex(x, y, z);
+					volume.GetSDF()[j] = FLT_MAX;
+					volume.GetIds()[j] = 0;
+				}
+	}
+
+	for (auto i = 1u; i < meshCount; ++i)
+		voxelizeMesh(scene, 0, footprints[2 * (i - 1)], footprints[2 * (i - 1) + 1]);
+
+	for (auto i = 1u; i < meshCount; ++i)
+	{
+		const auto angle = XM_2PI * (i - 1) / (meshCount - 1) + time * orbitSpeed;
+		const auto rot = XMMatrixRotationQuaternion(XMQuaternionRotationAxis(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), time * 0.5f + i));
+		const auto world = XMMatrixScaling(0.25f, 0.25f, 0.25f) * rot * XMMatrixTranslation(orbitRadius * cosf(angle), 0.0f, orbitRadius * sinf(angle)) *
+			XMMatrixScaling(scene.WorldScale, scene.WorldScale, scene.WorldScale);
+		XMStoreFloat3x4(&scene.Matrices[i].World, world);
+		XMStoreFloat3x4(&scene.Matrices[i].WorldIT, XMMatrixTranspose(XMMatrixInverse(nullptr, world)));
+		voxelizeMesh(scene, i);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Voxel range of the bounding sphere of a mesh, padded by the surface band
+//--------------------------------------------------------------------------------------
+void Benchmark::getVoxelRange(const Scene& scene, uint32_t meshId, XMUINT3& lo, XMUINT3& hi)
+{
+	const auto& volume = scene.Volume;
+	const auto gridSize = volume.GetGridSize();
+	const auto world = XMLoadFloat3x4(&scene.Matrices[meshId].World);
+	const auto scale = XMVectorGetX(XMVector3Length(world.r[0]));
+	const auto radius = scene.Vertices[1].Pos.x;
+	const auto surfaceDist = volume.GetVoxelSize() * 0.5f * sqrtf(2.0f);
+
+	XMFLOAT3 center;
+	XMStoreFloat3(&center, XMVector3Transform(world.r[3], XMLoadFloat3x4(&volume.GetVolumeWorldI())));
+	const auto extent = (radius * scale + 2.0f * surfaceDist) / volume.GetVolumeWorld().m[1][1];
+	const auto toVoxel = [&](float v, float offset)
+	{
+		const auto coord = static_cast<int32_t>(((v + offset) * 0.5f + 0.5f) * gridSize);
+		return static_cast<uint32_t>((min)((max)(coord, 0), static_cast<int32_t>(gridSize) - 1));
+	};
+	lo = XMUINT3(toVoxel(center.x, -extent), toVoxel(center.y, -extent), toVoxel(center.z, -extent));
+	hi = XMUINT3(toVoxel(center.x, extent), toVoxel(center.y, extent), toVoxel(center.z, extent));
+}
+
+//--------------------------------------------------------------------------------------
+// Octahedron distance, id and barycentrics of the octant triangle near the surface, within
+// the voxel range clipLo to clipHi
+//--------------------------------------------------------------------------------------
+void Benchmark::voxelizeMesh(Scene& scene, uint32_t meshId, const XMUINT3& clipLo, const XMUINT3& clipHi)
+{
+	auto& volume = scene.Volume;
+	const auto world = XMLoadFloat3x4(&scene.Matrices[meshId].World);
+	const auto worldI = XMMatrixInverse(nullptr, world);
+	const auto scale = XMVectorGetX(XMVector3Length(world.r[0]));
+	const auto radius = scene.Vertices[1].Pos.x;
+	const auto surfaceDist = volume.GetVoxelSize() * 0.5f * sqrtf(2.0f);
+
+	XMUINT3 lo, hi;
+	getVoxelRange(scene, meshId, lo, hi);
+	lo = XMUINT3((max)(lo.x, clipLo.x), (max)(lo.y, clipLo.y), (max)(lo.z, clipLo.z));
+	hi = XMUINT3((min)(hi.x, clipHi.x), (min)(hi.y, clipHi.y), (min)(hi.z, clipHi.z));
+
+	for (auto z = lo.z; z <= hi.z; ++z)
+		for (auto y = lo.y; y <= hi.y; ++y)
+			for (auto x = lo.x; x <= hi.x; ++x)
+			{
+				XMFLOAT3 pos;
+				XMStoreFloat3(&pos, XMVector3Transform(volume.GetVoxelCenter(x, y, z), worldI));
+				const auto i = volume.GetVoxelIndex(x, y, z);
+				const auto l1 = fabsf(pos.x) + fabsf(pos.y) + fabsf(pos.z);
+				const auto dist = (l1 - radius) * scale / sqrtf(3.0f);
+				if (fabsf(dist) < fabsf(volume.GetSDF()[i])) volume.GetSDF()[i] = dist;
+
+				if (fabsf(dist) < surfaceDist)
+				{
+					const auto primId = (pos.x > 0.0f ? 1 : 0) | (pos.y > 0.0f ? 2 : 0) | (pos.z > 0.0f ? 4 : 0);
+					volume.GetIds()[i] = EncodeVisibility(meshId, primId);
+					volume.GetBarycs()[i] = XMFLOAT2(fabsf(pos.y) / l1, fabsf(pos.z) / l1);
+				}
+			}
+}
+
+//--------------------------------------------------------------------------------------
+// Cornell-like box: 10-unit room open at -z with red and green side walls, two rotated
+// boxes and an area light under the ceiling; unlike Assets/cornell_box.gltf, the boxes are
+// unit cubes placed as separate meshes, which the analytic and rigid-motion benchmarks need
+//--------------------------------------------------------------------------------------
+void Benchmark::createCornellBox(Scene& scene, uint32_t gridSize)
+{
+	const uint32_t white = 0xffbfbfbf, red = 0xff0d11a1, green = 0xff177324;
+
+	// Quad facing along u x v
+	const auto addQuad = [&scene](FXMVECTOR center, FXMVECTOR u, FXMVECTOR v, uint32_t color)
+	{
+		const auto baseVertex = static_cast<uint32_t>(scene.Vertices.size());
+		const auto nrm = XMVector3Normalize(XMVector3Cross(u, v));
+		const XMVECTOR corners[] = { center - u - v, center + u - v, center + u + v, center - u + v };
+		for (const auto& corner : corners)
+		{
+			Vertex vertex;
+			memset(&vertex, 0, sizeof(Vertex));
+			XMStoreFloat3(&vertex.Pos, corner);
+			XMStoreFloat3(&vertex.Nrm, nrm);
+			vertex.Color = color;
+			scene.Vertices.emplace_back(vertex);
+		}
+
+		for (const auto& i : { 0u, 1u, 2u, 0u, 2u, 3u }) scene.Indices.emplace_back(baseVertex + i);
+	};
+
+	const auto x = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+	const auto y = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	const auto z = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+	const auto size = 5.0f;
+
+	// Mesh 0: room with inward-facing walls; ranges are (base vertex, base index)
+	vector<XMUINT2> ranges(1, XMUINT2(0, 0));
+	addQuad(-y * size, z * size, x * size, white);
+	addQuad(y * size, x * size, z * size, white);
+	addQuad(z * size, y * size, x * size, white);
+	addQuad(-x * size, y * size, z * size, red);
+	addQuad(x * size, z * size, y * size, green);
+
+	// Meshes 1 and 2: unit cubes placed by their World matrices
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto baseVertex = static_cast<uint32_t>(scene.Vertices.size());
+		const auto baseIndex = static_cast<uint32_t>(scene.Indices.size());
+		ranges.emplace_back(baseVertex, baseIndex);
+		addQuad(x, y, z, white);
+		addQuad(-x, z, y, white);
+		addQuad(y, z, x, white);
+		addQuad(-y, x, z, white);
+		addQuad(z, x, y, white);
+		addQuad(-z, y, x, white);
+		for (auto j = baseIndex; j < scene.Indices.size(); ++j) scene.Indices[j] -= baseVertex;
+	}
+
+	const XMMATRIX worlds[] =
+	{
+		XMMatrixIdentity(),
+		XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationY(-0.3f) * XMMatrixTranslation(1.8f, -3.5f, -1.0f),
+		XMMatrixScaling(1.5f, 3.0f, 1.5f) * XMMatrixRotationY(0.3f) * XMMatrixTranslation(-1.6f, -2.0f, 1.5f)
+	};
+
+	const auto meshCount = static_cast<uint32_t>(ranges.size());
+	scene.Meshes.resize(meshCount);
+	scene.Matrices.resize(meshCount);
+	scene.DynamicMeshIds.assign(meshCount, UINT32_MAX);
+	scene.WorldScale = 1.0f;
+	for (auto i = 0u; i < meshCount; ++i)
+	{
+		const auto endIndex = i + 1 < meshCount ? ranges[i + 1].y : static_cast<uint32_t>(scene.Indices.size());
+		scene.Meshes[i] = { scene.Vertices.data() + ranges[i].x, scene.Indices.data() + ranges[i].y, endIndex - ranges[i].y };
+		XMStoreFloat3x4(&scene.Matrices[i].World, worlds[i]);
+		XMStoreFloat3x4(&scene.Matrices[i].WorldIT, XMMatrixTranspose(XMMatrixInverse(nullptr, worlds[i])));
+	}
+
+	scene.LightSources.resize(1);
+	auto& lightSource = scene.LightSources[0];
+	lightSource.Min = XMFLOAT4(-1.0f, 4.85f, -1.0f, 1.0f);
+	lightSource.Max = XMFLOAT4(1.0f, 4.95f, 1.0f, 1.0f);
+	lightSource.Emissive = XMFLOAT4(1.0f, 0.85f, 0.6f, 16.0f);
+	XMStoreFloat3x4(&lightSource.World, XMMatrixIdentity());
+
+	XMFLOAT3X4 volumeWorld;
+	XMStoreFloat3x4(&volumeWorld, XMMatrixScaling(5.4f, 5.4f, 5.4f));
+	scene.Volume.Init(gridSize, volumeWorld);
+	scene.Volume.Voxelize(scene.Meshes.data(), scene.Matrices.data(), meshCount);
+}
+
+//--------------------------------------------------------------------------------------
+// Assets/cornell_box.gltf as GltfLoader imports it for the renderer, centered in the same
+// volume as createCornellBox(); the room and both boxes come as a single mesh
+//--------------------------------------------------------------------------------------
+bool Benchmark::loadCornellBox(Scene& scene, uint32_t gridSize)
+{
+	XUSG::GltfLoader loader;
+	if (!loader.Import("Assets/cornell_box.gltf")) return false;
+	assert(loader.GetVertexStride() == sizeof(Vertex));
+
+	const auto pVertices = reinterpret_cast<const Vertex*>(loader.GetVertices());
+	scene.Vertices.assign(pVertices, pVertices + loader.GetNumVertices());
+	scene.Indices.assign(loader.GetIndices(), loader.GetIndices() + loader.GetNumIndices());
+	scene.Meshes.assign(1, { scene.Vertices.data(), scene.Indices.data(), static_cast<uint32_t>(scene.Indices.size()) });
+	scene.DynamicMeshIds.assign(1, UINT32_MAX);
+	scene.WorldScale = 1.0f;
+
+	const auto& aabb = loader.GetAABB();
+	const auto world = XMMatrixTranslation(-0.5f * (aabb.Min.x + aabb.Max.x),
+		-0.5f * (aabb.Min.y + aabb.Max.y), -0.5f * (aabb.Min.z + aabb.Max.z));
+	scene.Matrices.resize(1);
+	XMStoreFloat3x4(&scene.Matrices[0].World, world);
+	XMStoreFloat3x4(&scene.Matrices[0].WorldIT, XMMatrixTranspose(XMMatrixInverse(nullptr, world)));
+
+	const auto& lightSources = loader.GetLightSources();
+	scene.LightSources.resize(lightSources.size());
+	for (size_t i = 0; i < lightSources.size(); ++i)
+	{
+		const auto& src = lightSources[i];
+		auto& lightSource = scene.LightSources[i];
+		lightSource.Min = XMFLOAT4(src.Min.x, src.Min.y, src.Min.z, src.Min.w);
+		lightSource.Max = XMFLOAT4(src.Max.x, src.Max.y, src.Max.z, src.Max.w);
+		lightSource.Emissive = XMFLOAT4(src.Emissive.x, src.Emissive.y, src.Emissive.z, src.Emissive.w);
+		XMStoreFloat3x4(&lightSource.World, world);
+	}
+
+	XMFLOAT3X4 volumeWorld;
+	XMStoreFloat3x4(&volumeWorld, XMMatrixScaling(5.4f, 5.4f, 5.4f));
+	scene.Volume.Init(gridSize, volumeWorld);
+	scene.Volume.Voxelize(scene.Meshes.data(), scene.Matrices.data(), 1);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// World-space surface point and normal recorded in a voxel, as GetPixelAttrib() does
+//--------------------------------------------------------------------------------------
+void Benchmark::getSurfacePoint(const Scene& scene, uint32_t voxel, XMVECTOR& pos, XMVECTOR& nrm)
+{
+	const auto vis = DecodeVisibility(scene.Volume.GetIds()[voxel]);
+	const auto& baryc = scene.Volume.GetBarycs()[voxel];
+	const auto& mesh = scene.Meshes[vis.MeshId];
+	const auto& matrices = scene.Matrices[vis.MeshId];
+	const auto& v0 = mesh.Vertices[mesh.Indices[vis.PrimId * 3]];
+	const auto& v1 = mesh.Vertices[mesh.Indices[vis.PrimId * 3 + 1]];
+	const auto& v2 = mesh.Vertices[mesh.Indices[vis.PrimId * 3 + 2]];
+
+	const auto w0 = 1.0f - baryc.x - baryc.y;
+	pos = XMLoadFloat3(&v0.Pos) * w0 + XMLoadFloat3(&v1.Pos) * baryc.x + XMLoadFloat3(&v2.Pos) * baryc.y;
+	nrm = XMLoadFloat3(&v0.Nrm) * w0 + XMLoadFloat3(&v1.Nrm) * baryc.x + XMLoadFloat3(&v2.Nrm) * baryc.y;
+	pos = XMVector3Transform(pos, XMLoadFloat3x4(&matrices.World));
+	nrm = XMVector3Normalize(XMVector3TransformNormal(nrm, XMLoadFloat3x4(&matrices.WorldIT)));
+}
+
+//--------------------------------------------------------------------------------------
+// Direct lighting into level 0 and its mips, as CSShade does before the indirect pass
+//--------------------------------------------------------------------------------------
+void Benchmark::shadeCornellBox(Scene& scene, VolumeShader& volumeShader, IrradianceMipBuilder& mipBuilder)
+{
+	volumeShader.Compact(scene.Volume);
+	mipBuilder.Init(scene.Volume.GetGridSize());
+	volumeShader.Shade(scene.Volume, scene.Meshes.data(), scene.Matrices.data(), scene.LightSources.data(),
+		static_cast<uint32_t>(scene.LightSources.size()), mipBuilder.GetLevel(0));
+	mipBuilder.Build();
+}
+
+//--------------------------------------------------------------------------------------
+// Every 16th surface voxel stands for a pixel
+//--------------------------------------------------------------------------------------
+void Benchmark::getPixels(const Scene& scene, const vector<uint32_t>& surfaceVoxels,
+	vector<XMFLOAT3>& positions, vector<XMFLOAT3>& normals)
+{
+	positions.clear();
+	normals.clear();
+	for (size_t i = 0; i < surfaceVoxels.size(); i += 16)
+	{
+		XMVECTOR pos, nrm;
+		getSurfacePoint(scene, surfaceVoxels[i], pos, nrm);
+		positions.emplace_back();
+		normals.emplace_back();
+		XMStoreFloat3(&positions.back(), pos);
+		XMStoreFloat3(&normals.back(), nrm);
+	}
+}
+
+double Benchmark::traceIndirect(const Scene& scene, const IrradianceMipBuilder& mipBuilder,
+	const vector<XMFLOAT3>& positions, const vector<XMFLOAT3>& normals,
+	uint32_t sampleCount, vector<XMFLOAT3>& results)
+{
+	// Same ray extent as CSShade
+	const auto tMin = scene.Volume.GetVoxelSize();
+	const auto tMax = XMVectorGetX(XMVector3Length(XMLoadFloat3x4(&scene.Volume.GetVolumeWorld()).r[1])) * 0.5f;
+
+	results.resize(positions.size());
+	const auto start = chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < positions.size(); ++i)
+		XMStoreFloat3(&results[i], scene.Volume.TraceIndirect(XMLoadFloat3(&positions[i]),
+			XMLoadFloat3(&normals[i]), tMin, tMax, mipBuilder, sampleCount));
+
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+double Benchmark::getRelativeRMSE(const vector<XMFLOAT3>& refResults, const vector<XMFLOAT3>& results)
+{
+	auto refSqSum = 0.0, errorSqSum = 0.0;
+	for (size_t i = 0; i < refResults.size(); ++i)
+	{
+		const auto ref = XMLoadFloat3(&refResults[i]);
+		refSqSum += XMVectorGetX(XMVector3LengthSq(ref));
+		errorSqSum += XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&results[i]) - ref));
+	}
+
+	return sqrt(errorSqSum / refSqSum);
+}
@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SDFVolume.h"
+
+class VolumeShader;
+class IrradianceMipBuilder;
+
+//--------------------------------------------------------------------------------------
+// CPU benchmarks of the reference implementations, run with -benchmark [name,...]
+// instead of the renderer; the benchmarks of each module live in their own file
+//--------------------------------------------------------------------------------------
+class Benchmark
+{
+public:
+	// Synthetic scene: octahedral meshes voxelized into narrow-band distance fields, lit by area lights;
+	// mesh 0 is static and the others spin next to it as dynamic meshes
+	struct Scene
+	{
+		SDFVolume Volume;
+		std::vector<Vertex> Vertices;
+		std::vector<uint32_t> Indices;
+		std::vector<MeshView> Meshes;
+		std::vector<PerObject> Matrices;
+		std::vector<LightSource> LightSources;
+		std::vector<uint32_t> DynamicMeshIds;
+		float WorldScale;
+	};
+
+	// Runs the named benchmarks, or all of them without names; false on unknown names
+	static bool Run(std::ostream& os, const std::vector<std::string>& names);
+
+protected:
+	static void volumeShading(std::ostream& os, uint32_t gridSize);
+	static void irradianceScheduling(std::ostream& os, uint32_t gridSize, uint8_t period);
+	static void irradianceMips(std::ostream& os, uint32_t gridSize, uint8_t period);
+
+	static void lightClustering(std::ostream& os, uint32_t gridSize, uint32_t lightSourceCount, float impactRange);
+
+	static void lightSampling(std::ostream& os, uint32_t gridSize, uint32_t lightSourceCount);
+	static void shadowCaching(std::ostream& os, uint32_t gridSize, uint32_t lightSourceCount, float orbitRadius);
+
+	static void shIrradiance(std::ostream& os, uint32_t gridSize);
+	static void irradianceProbes(std::ostream& os, uint32_t gridSize, uint32_t probeSpacing);
+	static void temporalReuse(std::ostream& os, uint32_t width, uint32_t height, uint32_t samplesPerFrame);
+	static void atrousDenoising(std::ostream& os, uint32_t width, uint32_t height, uint8_t iterationCount);
+	static void reducedRateIndirect(std::ostream& os, uint32_t width, uint32_t height, uint8_t downsampleFactor);
+	static void sphereTracing(std::ostream& os, uint32_t gridSize);
+	static void occupancySkipping(std::ostream& os, uint32_t gridSize, bool isCornellBox);
+	static void analyticPrimitives(std::ostream& os, uint32_t gridSize);
+	static void rigidSDFTransfer(std::ostream& os, uint32_t gridSize, uint32_t localGridSize);
+	static void gltfLoading(std::ostream& os, uint32_t materialCount, uint32_t textureSize);
+	static void gltfStaging(std::ostream& os, uint32_t materialCount, uint32_t textureSize, bool detachesBuffers);
+	static void gltfAccessors(std::ostream& os, const char* fileName, uint32_t patchSize);
+	static void base64Decoding(std::ostream& os, size_t byteCount);
+	static void gltfMapping(std::ostream& os, uint32_t patchSize);
+	static void gltfCaching(std::ostream& os, const char* fileName, uint32_t materialCount, uint32_t textureSize);
+	static void gltfUnwrapping(std::ostream& os, uint32_t primitiveCount, uint32_t patchSize, uint32_t threadCount);
+	static void indexReordering(std::ostream& os, const char* fileName, uint32_t patchSize, bool isShuffled);
+	static void vertexWelding(std::ostream& os, const char* fileName, uint32_t patchSize);
+	static void vertexQuantization(std::ostream& os, const char* fileName, uint32_t patchSize);
+
+	static void createScene(Scene& scene, uint32_t gridSize, uint32_t lightSourceCount,
+		uint32_t dynamicMeshCount = 0, float worldScale = 1.0f);
+	static void placePanelLights(Scene& scene);
+	static void animateScene(Scene& scene, float time, float orbitRadius = 0.8f, float orbitSpeed = 0.0f);
+	static void getVoxelRange(const Scene& scene, uint32_t meshId, DirectX::XMUINT3& lo, DirectX::XMUINT3& hi);
+	static void voxelizeMesh(Scene& scene, uint32_t meshId, const DirectX::XMUINT3& clipLo = DirectX::XMUINT3(0, 0, 0),
+		const DirectX::XMUINT3& clipHi = DirectX::XMUINT3(UINT32_MAX, UINT32_MAX, UINT32_MAX));
+	static void createCornellBox(Scene& scene, uint32_t gridSize);
+	static bool loadCornellBox(Scene& scene, uint32_t gridSize);
+	static void shadeCornellBox(Scene& scene, VolumeShader& volumeShader, IrradianceMipBuilder& mipBuilder);
+	static void getSurfacePoint(const Scene& scene, uint32_t voxel, DirectX::XMVECTOR& pos, DirectX::XMVECTOR& nrm);
+	static void getPixels(const Scene& scene, const std::vector<uint32_t>& surfaceVoxels,
+		std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& normals);
+	static double traceIndirect(const Scene& scene, const IrradianceMipBuilder& mipBuilder,
+		const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& normals,
+		uint32_t sampleCount, std::vector<DirectX::XMFLOAT3>& results);
+	static double getRelativeRMSE(const std::vector<DirectX::XMFLOAT3>& refResults,
+		const std::vector<DirectX::XMFLOAT3>& results);
+	static void writeTexturedGltf(const std::string& name, uint32_t materialCount, uint32_t textureSize, uint32_t patchSize);
+	static void removeTexturedGltf(const std::string& name, uint32_t materialCount);
+	static std::string encodeBase64(const uint8_t* pData, size_t size);
+	static void simulateVertexCache(const uint32_t* pIndices, uint32_t indexCount, uint32_t cacheSize,
+		double& acmr, double& atvr);
+};
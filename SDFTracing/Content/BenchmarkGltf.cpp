@@ -0,0 +1,943 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <array>
+#include "Benchmark.h"
+#include "MonteCarlo.h"
+#include "Optional/XUSGGltfLoader.h"
+#include "cgltf.h"
+#include "stb_image.h"
+#include "stb_image_write.h"
+#if defined(_WIN32)
+#include <psapi.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace DirectX;
+
+struct MemoryCounters
+{
+	size_t WorkingSetSize;
+	size_t PeakWorkingSetSize;
+	size_t PrivateSize;
+};
+
+//--------------------------------------------------------------------------------------
+// Working set and private bytes of the process; all zeros where psapi is unavailable
+//--------------------------------------------------------------------------------------
+static MemoryCounters getMemoryCounters()
+{
+	MemoryCounters memoryCounters = {};
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		memoryCounters.WorkingSetSize = counters.WorkingSetSize;
+		memoryCounters.PeakWorkingSetSize = counters.PeakWorkingSetSize;
+		memoryCounters.PrivateSize = counters.PagefileUsage;
+	}
+#endif
+
+	return memoryCounters;
+}
+
+//--------------------------------------------------------------------------------------
+// The generated assets go into a directory under the temp path instead of the working one
+//--------------------------------------------------------------------------------------
+static string getScratchPath(const char* fileName)
+{
+	static const auto directory = []()
+	{
+#if defined(_WIN32)
+		char tempPath[MAX_PATH];
+		const auto length = GetTempPathA(MAX_PATH, tempPath);
+		const auto directory = string(tempPath, length < MAX_PATH ? length : 0) + "SDFTracingBenchmark\\";
+		CreateDirectoryA(directory.c_str(), nullptr);
+#else
+		const string directory = "/tmp/SDFTracingBenchmark/";
+		mkdir(directory.c_str(), 0755);
+#endif
+
+		return directory;
+	}();
+
+	return directory + fileName;
+}
+
+//--------------------------------------------------------------------------------------
+// Import plus staging as in Renderer::loadMesh(), where the staged copies stay alive until
+// the command list executes; either the loader keeps its buffers until the end, or they
+// are detached and freed one by one as soon as each has been staged
+//--------------------------------------------------------------------------------------
+void Benchmark::gltfStaging(ostream& os, uint32_t materialCount, uint32_t textureSize, bool detachesBuffers)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	writeTexturedGltf(name, materialCount, textureSize, 16);
+
+	const auto workingSetSize = getMemoryCounters().WorkingSetSize;
+
+	const auto start = chrono::high_resolution_clock::now();
+	vector<vector<uint8_t>> staging;
+	const auto stage = [&staging](const void* pData, size_t size)
+	{
+		staging.emplace_back(size);
+		memcpy(staging.back().data(), pData, size);
+	};
+
+	{
+		XUSG::GltfLoader loader;
+		loader.Import((name + ".gltf").c_str());
+		if (detachesBuffers)
+		{
+			{
+				const auto vertices = loader.DetachVertices();
+				stage(vertices.data(), vertices.size());
+			}
+
+			{
+				const auto indices = loader.DetachIndices();
+				stage(indices.data(), sizeof(uint32_t) * indices.size());
+			}
+
+			auto textures = loader.DetachTextures();
+			for (auto& texture : textures)
+			{
+				stage(texture.Data.get(), texture.Width * texture.Height * texture.Channels);
+				texture.Data.reset();
+			}
+		}
+		else
+		{
+			stage(loader.GetVertices(), loader.GetVertexStride() * loader.GetNumVertices());
+			stage(loader.GetIndices(), sizeof(uint32_t) * loader.GetNumIndices());
+			for (auto i = 0u; i < loader.GetNumTextures(); ++i)
+			{
+				const auto& texture = loader.GetTextures()[i];
+				stage(texture.Data.get(), texture.Width * texture.Height * texture.Channels);
+			}
+		}
+	}
+	const auto loadTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	const auto peakWorkingSetSize = getMemoryCounters().PeakWorkingSetSize;
+	removeTexturedGltf(name, materialCount);
+
+	size_t stagedByteCount = 0;
+	for (const auto& buffer : staging) stagedByteCount += buffer.size();
+	os << (detachesBuffers ? "detached buffers: " : "retained buffers: ") << stagedByteCount / (1024.0 * 1024.0)
+		<< " MB staged in " << loadTime << " ms, peak working set +"
+		<< (peakWorkingSetSize - workingSetSize) / (1024.0 * 1024.0) << " MB" << endl;
+}
+
+void Benchmark::gltfLoading(ostream& os, uint32_t materialCount, uint32_t textureSize)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	writeTexturedGltf(name, materialCount, textureSize, 16);
+
+	// Fresh loaders for every import; the first one warms the file cache
+	double importTimes[2] = { DBL_MAX, DBL_MAX };
+	vector<XUSG::GltfLoader::Texture> textures[2];
+	auto triangleCount = 0u;
+	for (uint8_t i = 0; i < 2; ++i)
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			XUSG::GltfLoader loader;
+			loader.SetThreadCount(i ? 0 : 1);
+			const auto start = chrono::high_resolution_clock::now();
+			loader.Import((name + ".gltf").c_str());
+			const auto importTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+			if (j > 0) importTimes[i] = (min)(importTime, importTimes[i]);
+			triangleCount = loader.GetNumIndices() / 3;
+			textures[i] = loader.DetachTextures();
+		}
+
+	// Decoding alone, which the threaded import overlaps with the geometry and atlas work
+	const auto textureCount = static_cast<uint32_t>(textures[0].size());
+	auto start = chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < textureCount; ++i)
+	{
+		int width, height, channels;
+		stbi_image_free(stbi_load((name + to_string(i) + ".png").c_str(), &width, &height, &channels, 4));
+	}
+	const auto decodeTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	removeTexturedGltf(name, materialCount);
+
+	size_t byteCount = 0;
+	auto isIdentical = textures[1].size() == textureCount;
+	for (auto i = 0u; i < textureCount && isIdentical; ++i)
+	{
+		const auto& texture = textures[0][i];
+		const auto size = texture.Width * texture.Height * texture.Channels;
+		isIdentical = memcmp(texture.Data.get(), textures[1][i].Data.get(), size) == 0;
+		byteCount += size;
+	}
+
+	os << textureCount << " textures of " << textureSize << "^2 (" << byteCount / (1024.0 * 1024.0) << " MB decoded), "
+		<< triangleCount << " triangles, " << thread::hardware_concurrency() << " hardware threads: serial "
+		<< importTimes[0] << " ms (decoding " << decodeTime << " ms), threaded " << importTimes[1] << " ms ("
+		<< importTimes[0] / importTimes[1] << "x), " << (isIdentical ? "identical" : "different") << " texels" << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// Import throughput of an asset, or of a synthetic single patch of patchSize^2 quads
+// without materials, so that neither decoding nor xatlas is involved
+//--------------------------------------------------------------------------------------
+void Benchmark::gltfAccessors(ostream& os, const char* fileName, uint32_t patchSize)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	if (!fileName) writeTexturedGltf(name, 1, 0, patchSize);
+	const auto path = fileName ? string(fileName) : name + ".gltf";
+
+	// Fresh loaders for every import; the first one warms the file cache
+	auto importTime = DBL_MAX;
+	auto vertexCount = 0u, triangleCount = 0u;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		XUSG::GltfLoader loader;
+		const auto start = chrono::high_resolution_clock::now();
+		if (!loader.Import(path.c_str()))
+		{
+			os << path << ": not found" << endl;
+			return;
+		}
+		const auto time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		if (i > 0) importTime = (min)(time, importTime);
+		vertexCount = loader.GetNumVertices();
+		triangleCount = loader.GetNumIndices() / 3;
+	}
+	if (!fileName) removeTexturedGltf(name, 0);
+
+	os << path << ": " << vertexCount << " vertices, " << triangleCount << " triangles, import " << importTime
+		<< " ms (" << vertexCount / (importTime * 1000.0) << "M vertices/s)" << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// Base64 of pseudo-random bytes decoded by cgltf_load_buffer_base64() and by the loader's
+// vectorized decoder; the outputs must match, also for every short length up to 64 bytes,
+// which only take the scalar tail
+//--------------------------------------------------------------------------------------
+void Benchmark::base64Decoding(ostream& os, size_t byteCount)
+{
+	vector<uint8_t> bytes(byteCount);
+	for (size_t i = 0; i < byteCount; ++i) bytes[i] = static_cast<uint8_t>(Hash(static_cast<float>(i % 65521) + i / 65521 * 0.37f) * 256.0f);
+
+	// Short lengths first
+	cgltf_options options = {};
+	auto isIdentical = true;
+	vector<uint8_t> result(byteCount);
+	for (size_t size = 0; size <= (min<size_t>)(64, byteCount) && isIdentical; ++size)
+	{
+		const auto base64 = encodeBase64(bytes.data(), size);
+		void* pRef = nullptr;
+		isIdentical = cgltf_load_buffer_base64(&options, size, base64.c_str(), &pRef) == cgltf_result_success &&
+			XUSG::GltfLoader::DecodeBase64(result.data(), size, base64.c_str(), base64.size()) && memcmp(pRef, result.data(), size) == 0;
+		free(pRef);
+	}
+
+	const auto base64 = encodeBase64(bytes.data(), byteCount);
+	double decodeTimes[2] = { DBL_MAX, DBL_MAX };
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		void* pRef = nullptr;
+		auto start = chrono::high_resolution_clock::now();
+		cgltf_load_buffer_base64(&options, byteCount, base64.c_str(), &pRef);
+		decodeTimes[0] = (min)(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), decodeTimes[0]);
+
+		start = chrono::high_resolution_clock::now();
+		const auto isDecoded = XUSG::GltfLoader::DecodeBase64(result.data(), byteCount, base64.c_str(), base64.size());
+		decodeTimes[1] = (min)(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), decodeTimes[1]);
+		isIdentical = isIdentical && isDecoded && memcmp(pRef, result.data(), byteCount) == 0;
+		free(pRef);
+	}
+
+	// A character outside of the alphabet must be rejected
+	auto corrupted = base64;
+	corrupted[corrupted.size() / 2] = '*';
+	const auto isRejected = !XUSG::GltfLoader::DecodeBase64(result.data(), byteCount, corrupted.c_str(), corrupted.size());
+
+	// So must text ending before the last quad, read only up to its end
+	const auto truncated = base64.substr(0, base64.size() / 2 + 1);
+	const auto isTruncationRejected = !XUSG::GltfLoader::DecodeBase64(result.data(), byteCount, truncated.c_str(), truncated.size());
+
+	const auto megabytes = byteCount / (1024.0 * 1024.0);
+	os << megabytes << " MB: cgltf " << decodeTimes[0] << " ms (" << megabytes * 1000.0 / decodeTimes[0] << " MB/s), vectorized "
+		<< decodeTimes[1] << " ms (" << megabytes * 1000.0 / decodeTimes[1] << " MB/s, " << decodeTimes[0] / decodeTimes[1]
+		<< "x), " << (isIdentical ? "identical" : "different") << " bytes, corruption " << (isRejected ? "rejected" : "missed")
+		<< ", truncation " << (isTruncationRejected ? "rejected" : "missed") << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// One synthetic patch stored as a .gltf with an external .bin, as a .glb and as a .gltf
+// with its buffer in a base64 data URI; a thread samples the working set and the private
+// bytes during each import for their peaks
+//--------------------------------------------------------------------------------------
+void Benchmark::gltfMapping(ostream& os, uint32_t patchSize)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	writeTexturedGltf(name, 1, 0, patchSize);
+
+	string json;
+	vector<char> bin;
+	{
+		ifstream jsonFile(name + ".gltf");
+		json.assign(istreambuf_iterator<char>(jsonFile), istreambuf_iterator<char>());
+		ifstream binFile(name + ".bin", ios::binary);
+		bin.assign(istreambuf_iterator<char>(binFile), istreambuf_iterator<char>());
+	}
+	const auto uri = "\"uri\":\"" + name.substr(name.find_last_of("/\\") + 1) + ".bin\",";
+	const auto uriPos = json.find(uri);
+	assert(uriPos != string::npos);
+
+	// GLB: header, then the JSON chunk padded with spaces and the BIN chunk padded with zeros
+	{
+		auto glbJson = json;
+		glbJson.erase(uriPos, uri.size());
+		glbJson.resize((glbJson.size() + 3) & ~3, ' ');
+		const auto binSize = (static_cast<uint32_t>(bin.size()) + 3) & ~3;
+		const uint32_t header[] = { 0x46546c67, 2, static_cast<uint32_t>(12 + 8 + glbJson.size() + 8 + binSize) };
+		const uint32_t jsonChunk[] = { static_cast<uint32_t>(glbJson.size()), 0x4e4f534a };
+		const uint32_t binChunk[] = { binSize, 0x004e4942 };
+
+		ofstream glb(name + ".glb", ios::binary);
+		glb.write(reinterpret_cast<const char*>(header), sizeof(header));
+		glb.write(reinterpret_cast<const char*>(jsonChunk), sizeof(jsonChunk));
+		glb.write(glbJson.data(), glbJson.size());
+		glb.write(reinterpret_cast<const char*>(binChunk), sizeof(binChunk));
+		glb.write(bin.data(), bin.size());
+		glb.write("\0\0\0", binSize - bin.size());
+	}
+
+	{
+		auto base64Json = json;
+		base64Json.replace(uriPos, uri.size(), "\"uri\":\"data:application/octet-stream;base64," +
+			encodeBase64(reinterpret_cast<const uint8_t*>(bin.data()), bin.size()) + "\",");
+		ofstream(name + "Base64.gltf") << base64Json;
+	}
+
+	const string fileNames[] = { name + ".gltf", name + ".glb", name + "Base64.gltf" };
+	const char* labels[] = { "external .bin", ".glb", "base64" };
+	os << (patchSize + 1) * (patchSize + 1) << " vertices, " << bin.size() / (1024.0 * 1024.0) << " MB of buffers:";
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		// Fresh loaders for every import; the first one warms the file cache
+		auto importTime = DBL_MAX;
+		double peakWorkingSet = 0.0, peakPrivate = 0.0;
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			const auto counters = getMemoryCounters();
+			const auto workingSetSize = counters.WorkingSetSize, privateSize = counters.PrivateSize;
+
+			atomic<bool> isImporting(true);
+			size_t maxWorkingSetSize = workingSetSize, maxPrivateSize = privateSize;
+			thread sampler([&]()
+			{
+				while (isImporting)
+				{
+					const auto counters = getMemoryCounters();
+					maxWorkingSetSize = (max)(counters.WorkingSetSize, maxWorkingSetSize);
+					maxPrivateSize = (max)(counters.PrivateSize, maxPrivateSize);
+					this_thread::sleep_for(chrono::milliseconds(1));
+				}
+			});
+
+			{
+				XUSG::GltfLoader loader;
+				const auto start = chrono::high_resolution_clock::now();
+				loader.Import(fileNames[i].c_str());
+				const auto time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+				if (j > 0) importTime = (min)(time, importTime);
+			}
+			isImporting = false;
+			sampler.join();
+
+			peakWorkingSet = (max)((maxWorkingSetSize - workingSetSize) / (1024.0 * 1024.0), peakWorkingSet);
+			peakPrivate = (max)((maxPrivateSize - privateSize) / (1024.0 * 1024.0), peakPrivate);
+		}
+
+		os << (i ? ";" : "") << " " << labels[i] << " " << importTime << " ms, peak working set +" << peakWorkingSet
+			<< " MB, private +" << peakPrivate << " MB";
+	}
+	os << endl;
+
+	removeTexturedGltf(name, 0);
+	remove((name + ".glb").c_str());
+	remove((name + "Base64.gltf").c_str());
+}
+
+//--------------------------------------------------------------------------------------
+// Import without the cache, with the cache enabled but missing (import plus writing it),
+// and from the warm cache, whose results must match the import; an asset, or a synthetic
+// textured scene, on which xatlas unwraps every primitive
+//--------------------------------------------------------------------------------------
+void Benchmark::gltfCaching(ostream& os, const char* fileName, uint32_t materialCount, uint32_t textureSize)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	if (!fileName) writeTexturedGltf(name, materialCount, textureSize, 16);
+	const auto path = fileName ? string(fileName) : name + ".gltf";
+	const auto cachePath = path + ".meshcache";
+	remove(cachePath.c_str());
+
+	unique_ptr<XUSG::GltfLoader> loaders[2];
+	double importTimes[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	for (uint8_t i = 0; i < 5; ++i)
+	{
+		// Uncached imports, the first one warming the file cache, then the cold-cache one
+		auto loader = make_unique<XUSG::GltfLoader>();
+		loader->SetCacheEnabled(i >= 2);
+		const auto start = chrono::high_resolution_clock::now();
+		if (!loader->Import(path.c_str()))
+		{
+			os << path << ": not found" << endl;
+			return;
+		}
+		const auto time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+		const auto slot = i < 2 ? 0 : (i < 3 ? 1 : 2);
+		if (i > 0) importTimes[slot] = (min)(time, importTimes[slot]);
+		if (i == 1) loaders[0] = move(loader);
+		if (i == 4) loaders[1] = move(loader);
+	}
+
+	ifstream cacheFile(cachePath, ios::binary | ios::ate);
+	const auto cacheSize = static_cast<double>(cacheFile.tellg()) / (1024.0 * 1024.0);
+	cacheFile.close();
+	remove(cachePath.c_str());
+	if (!fileName) removeTexturedGltf(name, materialCount);
+
+	const auto& ref = *loaders[0];
+	const auto& cached = *loaders[1];
+	auto isIdentical = ref.GetNumVertices() == cached.GetNumVertices() && ref.GetNumIndices() == cached.GetNumIndices() &&
+		ref.GetNumSubSets() == cached.GetNumSubSets() && ref.GetNumTextures() == cached.GetNumTextures() &&
+		ref.GetLightSources().size() == cached.GetLightSources().size();
+	isIdentical = isIdentical && memcmp(ref.GetVertices(), cached.GetVertices(), ref.GetVertexStride() * ref.GetNumVertices()) == 0 &&
+		memcmp(ref.GetIndices(), cached.GetIndices(), sizeof(uint32_t) * ref.GetNumIndices()) == 0 &&
+		memcmp(&ref.GetAABB(), &cached.GetAABB(), sizeof(XUSG::GltfLoader::AABB)) == 0;
+	for (auto i = 0u; isIdentical && i < ref.GetNumTextures(); ++i)
+	{
+		const auto& texture = ref.GetTextures()[i];
+		isIdentical = memcmp(texture.Data.get(), cached.GetTextures()[i].Data.get(), texture.Width * texture.Height * texture.Channels) == 0;
+	}
+
+	os << path << ": " << ref.GetNumVertices() << " vertices, " << ref.GetNumTextures() << " textures, cache " << cacheSize
+		<< " MB; import " << importTimes[0] << " ms, import + cache write " << importTimes[1] << " ms, warm cache "
+		<< importTimes[2] << " ms (" << importTimes[0] / importTimes[2] << "x), " << (isIdentical ? "identical" : "different") << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// Many small textured primitives, each unwrapped by xatlas, where parallelism within one
+// atlas has nothing to work with; tiny textures keep the image decoding out of the way
+//--------------------------------------------------------------------------------------
+void Benchmark::gltfUnwrapping(ostream& os, uint32_t primitiveCount, uint32_t patchSize, uint32_t threadCount)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	writeTexturedGltf(name, primitiveCount, 4, patchSize);
+
+	// Fresh loaders for every import; the first one warms the file cache
+	double importTimes[2] = { DBL_MAX, DBL_MAX };
+	vector<uint8_t> vertices[2];
+	vector<uint32_t> indices[2];
+	for (uint8_t i = 0; i < 2; ++i)
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			XUSG::GltfLoader loader;
+			loader.SetThreadCount(i ? threadCount : 1);
+			const auto start = chrono::high_resolution_clock::now();
+			loader.Import((name + ".gltf").c_str());
+			const auto importTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+			if (j > 0) importTimes[i] = (min)(importTime, importTimes[i]);
+			vertices[i] = loader.DetachVertices();
+			indices[i] = loader.DetachIndices();
+		}
+	removeTexturedGltf(name, primitiveCount);
+
+	const auto isIdentical = vertices[0] == vertices[1] && indices[0] == indices[1];
+	const auto workerCount = threadCount ? threadCount : thread::hardware_concurrency();
+	os << primitiveCount << " primitives of " << patchSize * patchSize * 2 << " triangles, " << workerCount
+		<< " threads: serial " << importTimes[0] << " ms, concurrent " << importTimes[1] << " ms ("
+		<< importTimes[0] / importTimes[1] << "x), " << (isIdentical ? "identical" : "different") << " output" << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// GltfLoader::ReorderIndices() on every subset as imported, or with the triangles shuffled
+// first; the misses are simulated with FIFO caches of 16 and 32 entries, and the reordered
+// triangles must be a permutation of the original ones with their windings kept
+//--------------------------------------------------------------------------------------
+void Benchmark::indexReordering(ostream& os, const char* fileName, uint32_t patchSize, bool isShuffled)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	if (!fileName) writeTexturedGltf(name, 1, 0, patchSize);
+	const auto path = fileName ? string(fileName) : name + ".gltf";
+
+	XUSG::GltfLoader loader;
+	const auto isLoaded = loader.Import(path.c_str());
+	if (!fileName) removeTexturedGltf(name, 0);
+	if (!isLoaded)
+	{
+		os << path << ": not found" << endl;
+		return;
+	}
+
+	const auto pSubsets = loader.GetSubsets();
+	const auto subsetCount = loader.GetNumSubSets();
+	vector<uint32_t> indices(loader.GetIndices(), loader.GetIndices() + loader.GetNumIndices());
+	const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (isShuffled)
+	{
+		// Fisher-Yates with xorshift32 over the triangles of each subset
+		auto state = 2463534242u;
+		for (auto s = 0u; s < subsetCount; ++s)
+		{
+			const auto pTriangles = &indices[pSubsets[s].IndexOffset];
+			for (auto i = pSubsets[s].NumIndices / 3; i > 1; --i)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				const auto j = state % i;
+				for (uint8_t k = 0; k < 3; ++k) swap(pTriangles[(i - 1) * 3 + k], pTriangles[j * 3 + k]);
+			}
+		}
+	}
+
+	double acmrs[2][2], atvrs[2][2];
+	for (uint8_t k = 0; k < 2; ++k) simulateVertexCache(indices.data(), static_cast<uint32_t>(indices.size()), 16u << k, acmrs[0][k], atvrs[0][k]);
+
+	auto reorderTime = DBL_MAX;
+	vector<uint32_t> reordered;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		reordered = indices;
+		const auto start = chrono::high_resolution_clock::now();
+		for (auto s = 0u; s < subsetCount; ++s)
+			XUSG::GltfLoader::ReorderIndices(&reordered[pSubsets[s].IndexOffset], pSubsets[s].NumIndices,
+				loader.GetVertices(), loader.GetVertexStride());
+		reorderTime = (min)(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), reorderTime);
+	}
+	for (uint8_t k = 0; k < 2; ++k) simulateVertexCache(reordered.data(), static_cast<uint32_t>(reordered.size()), 16u << k, acmrs[1][k], atvrs[1][k]);
+
+	// Compare the triangles as multisets, each rotated to start at its smallest index
+	auto isPermutation = true;
+	for (auto s = 0u; s < subsetCount && isPermutation; ++s)
+	{
+		vector<array<uint32_t, 3>> triangles[2];
+		for (uint8_t j = 0; j < 2; ++j)
+		{
+			const auto pIndices = &(j ? reordered : indices)[pSubsets[s].IndexOffset];
+			triangles[j].resize(pSubsets[s].NumIndices / 3);
+			for (auto i = 0u; i < triangles[j].size(); ++i)
+			{
+				const auto r = pIndices[i * 3] < pIndices[i * 3 + 1] ? (pIndices[i * 3] < pIndices[i * 3 + 2] ? 0 : 2) :
+					(pIndices[i * 3 + 1] < pIndices[i * 3 + 2] ? 1 : 2);
+				for (uint8_t k = 0; k < 3; ++k) triangles[j][i][k] = pIndices[i * 3 + (r + k) % 3];
+			}
+			sort(triangles[j].begin(), triangles[j].end());
+		}
+		isPermutation = triangles[0] == triangles[1];
+	}
+
+	os << path << (isShuffled ? " (shuffled)" : "") << ": " << triangleCount << " triangles in " << subsetCount
+		<< " subsets, reorder " << reorderTime << " ms (" << triangleCount / (reorderTime * 1000.0) << "M triangles/s)" << endl;
+	for (uint8_t k = 0; k < 2; ++k)
+		os << "  cache " << (16u << k) << ": ACMR " << acmrs[0][k] << " -> " << acmrs[1][k] << ", ATVR "
+		<< atvrs[0][k] << " -> " << atvrs[1][k] << endl;
+	os << "  " << (isPermutation ? "same" : "different") << " triangles" << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// GltfLoader::DeduplicateVertices() on the imported vertices, and on a triangle soup with a
+// vertex per index, which must come back to at most the imported count with every corner
+// unchanged; GltfLoader::WeldPositions() on the soup with its positions jittered by 1e-6 of
+// the bounding-box diagonal, as exact and as epsilon welds for normal generation
+//--------------------------------------------------------------------------------------
+void Benchmark::vertexWelding(ostream& os, const char* fileName, uint32_t patchSize)
+{
+	const auto name = getScratchPath("GltfBenchmark");
+	if (!fileName) writeTexturedGltf(name, 1, 0, patchSize);
+	const auto path = fileName ? string(fileName) : name + ".gltf";
+
+	XUSG::GltfLoader loader;
+	loader.SetNormalWelding(true);
+	const auto isLoaded = loader.Import(path.c_str());
+	if (!fileName) removeTexturedGltf(name, 0);
+	if (!isLoaded)
+	{
+		os << path << ": not found" << endl;
+		return;
+	}
+
+	const auto stride = loader.GetVertexStride();
+	const auto vertexCount = loader.GetNumVertices();
+	const auto indexCount = loader.GetNumIndices();
+	const auto pIndices = loader.GetIndices();
+	vector<uint8_t> soup(static_cast<size_t>(stride) * indexCount);
+	for (auto i = 0u; i < indexCount; ++i)
+		memcpy(&soup[static_cast<size_t>(stride) * i], &loader.GetVertices()[static_cast<size_t>(stride) * pIndices[i]], stride);
+
+	// Best of 3 runs on fresh copies
+	const auto deduplicate = [stride](const uint8_t* pSrcVertices, uint32_t srcVertexCount, const uint32_t* pSrcIndices,
+		uint32_t srcIndexCount, vector<uint8_t>& vertices, vector<uint32_t>& indices, double& time)
+	{
+		time = DBL_MAX;
+		auto uniqueCount = 0u;
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			vertices.assign(pSrcVertices, pSrcVertices + static_cast<size_t>(stride) * srcVertexCount);
+			if (pSrcIndices) indices.assign(pSrcIndices, pSrcIndices + srcIndexCount);
+			else for (auto j = 0u; j < srcIndexCount; ++j) indices[j] = j;
+			const auto start = chrono::high_resolution_clock::now();
+			uniqueCount = XUSG::GltfLoader::DeduplicateVertices(vertices.data(), srcVertexCount, stride, indices.data(), srcIndexCount);
+			time = (min)(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), time);
+		}
+
+		return uniqueCount;
+	};
+
+	vector<uint8_t> vertices;
+	vector<uint32_t> indices(indexCount);
+	double meshTime, soupTime;
+	const auto meshUniqueCount = deduplicate(loader.GetVertices(), vertexCount, pIndices, indexCount, vertices, indices, meshTime);
+	const auto soupUniqueCount = deduplicate(soup.data(), indexCount, nullptr, indexCount, vertices, indices, soupTime);
+
+	auto isIntact = soupUniqueCount <= vertexCount;
+	for (auto i = 0u; i < indexCount && isIntact; ++i)
+		isIntact = !memcmp(&vertices[static_cast<size_t>(stride) * indices[i]], &soup[static_cast<size_t>(stride) * i], stride);
+
+	// Jittered positions: the exact weld keeps them apart, the epsilon weld merges them again
+	const auto& aabb = loader.GetAABB();
+	const auto diagonal = sqrtf((aabb.Max.x - aabb.Min.x) * (aabb.Max.x - aabb.Min.x) +
+		(aabb.Max.y - aabb.Min.y) * (aabb.Max.y - aabb.Min.y) + (aabb.Max.z - aabb.Min.z) * (aabb.Max.z - aabb.Min.z));
+	for (auto i = 0u; i < indexCount; ++i)
+	{
+		const auto pPosition = reinterpret_cast<float*>(&soup[static_cast<size_t>(stride) * i]);
+		for (uint8_t k = 0; k < 3; ++k) pPosition[k] += (Hash(3.0f * (i % 65521) + k + 1.0f) - 0.5f) * 2e-6f * diagonal;
+	}
+
+	uint32_t weldCounts[2];
+	double weldTimes[2];
+	vector<uint32_t> remap(indexCount);
+	for (uint8_t j = 0; j < 2; ++j)
+	{
+		const auto start = chrono::high_resolution_clock::now();
+		XUSG::GltfLoader::WeldPositions(soup.data(), indexCount, stride, j ? 1e-5f * diagonal : 0.0f, remap.data());
+		weldTimes[j] = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		weldCounts[j] = 0;
+		for (auto i = 0u; i < indexCount; ++i) weldCounts[j] += remap[i] == i ? 1 : 0;
+	}
+
+	os << path << ": " << vertexCount << " -> " << meshUniqueCount << " vertices in " << meshTime << " ms ("
+		<< meshTime * 1000000.0 / vertexCount << " ms/M vertices)" << endl;
+	os << "  soup: " << indexCount << " -> " << soupUniqueCount << " vertices in " << soupTime << " ms ("
+		<< soupTime * 1000000.0 / indexCount << " ms/M vertices), " << (isIntact ? "intact" : "broken") << " corners" << endl;
+	os << "  jittered soup positions: exact weld " << weldCounts[0] << " in " << weldTimes[0] << " ms, 1e-5 weld "
+		<< weldCounts[1] << " in " << weldTimes[1] << " ms (" << weldTimes[1] * 1000000.0 / indexCount << " ms/M vertices)" << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// The same import with both vertex formats; the round-trip errors of the decoded vertices,
+// and the attributes of random triangles fetched as CSShade does, per pixel
+//--------------------------------------------------------------------------------------
+void Benchmark::vertexQuantization(ostream& os, const char* fileName, uint32_t patchSize)
+{
+	using Loader = XUSG::GltfLoader;
+
+	const auto name = getScratchPath("GltfBenchmark");
+	if (!fileName) writeTexturedGltf(name, 1, 0, patchSize);
+	const auto path = fileName ? string(fileName) : name + ".gltf";
+
+	Loader loader, quantizedLoader;
+	quantizedLoader.SetVertexQuantization(true);
+	const auto isLoaded = loader.Import(path.c_str()) && quantizedLoader.Import(path.c_str());
+	if (!fileName) removeTexturedGltf(name, 0);
+	if (!isLoaded)
+	{
+		os << path << ": not found" << endl;
+		return;
+	}
+
+	// Same layout as the Vertex of the shaders
+	struct Vertex
+	{
+		Loader::float3 Pos;
+		Loader::float3 Nrm;
+		Loader::float4 Texcoord;
+		Loader::float4 Tan;
+		uint32_t Color;
+		float Emissive;
+	};
+
+	const auto vertexCount = loader.GetNumVertices();
+	const auto pVertices = reinterpret_cast<const Vertex*>(loader.GetVertices());
+	const auto pQuantizedVertices = reinterpret_cast<const Loader::QuantizedVertex*>(quantizedLoader.GetVertices());
+	const auto& materials = quantizedLoader.GetMaterials();
+	const auto& aabb = quantizedLoader.GetAABB();
+	const auto extent = (max)((max)(aabb.Max.x - aabb.Min.x, aabb.Max.y - aabb.Min.y), aabb.Max.z - aabb.Min.z);
+
+	const auto getAngle = [](const Loader::float3& a, const Loader::float3& b)
+	{
+		const auto cosAngle = (a.x * b.x + a.y * b.y + a.z * b.z) /
+			sqrtf((a.x * a.x + a.y * a.y + a.z * a.z) * (b.x * b.x + b.y * b.y + b.z * b.z));
+
+		return XMConvertToDegrees(acosf((min)(cosAngle, 1.0f)));
+	};
+
+	auto posError = 0.0f, nrmError = 0.0f, tanError = 0.0f, uvError = 0.0f;
+	auto isMatched = quantizedLoader.GetNumVertices() == vertexCount;
+	for (auto i = 0u; i < vertexCount && isMatched; ++i)
+	{
+		const auto& vertex = pVertices[i];
+		Loader::float3 pos, nrm;
+		Loader::float4 texcoord, tangent;
+		uint16_t materialIdx;
+		Loader::DecodeVertex(pQuantizedVertices[i], aabb, pos, nrm, texcoord, tangent, materialIdx);
+
+		posError = (max)((max)((max)(fabsf(pos.x - vertex.Pos.x), fabsf(pos.y - vertex.Pos.y)), fabsf(pos.z - vertex.Pos.z)), posError);
+		nrmError = (max)(getAngle(nrm, vertex.Nrm), nrmError);
+		const Loader::float3 refTangent(vertex.Tan.x, vertex.Tan.y, vertex.Tan.z);
+		if (refTangent.x != 0.0f || refTangent.y != 0.0f || refTangent.z != 0.0f)
+			tanError = (max)(getAngle(Loader::float3(tangent.x, tangent.y, tangent.z), refTangent), tanError);
+		uvError = (max)((max)(fabsf(texcoord.x - vertex.Texcoord.x), fabsf(texcoord.y - vertex.Texcoord.y)), uvError);
+		uvError = (max)((max)(fabsf(texcoord.z - vertex.Texcoord.z), fabsf(texcoord.w - vertex.Texcoord.w)), uvError);
+		isMatched = materialIdx < materials.size() && materials[materialIdx].Color == vertex.Color &&
+			materials[materialIdx].Emissive == vertex.Emissive && (tangent.w < 0.0f) == (vertex.Tan.w < 0.0f);
+	}
+
+	// Position, normal, color and emissive strength of the 3 vertices of a random triangle
+	// per pixel; best of 3 runs
+	const auto indexCount = loader.GetNumIndices();
+	const auto pIndices = loader.GetIndices();
+	const auto pQuantizedIndices = quantizedLoader.GetIndices();
+	const auto pixelCount = 1u << 22;
+	vector<uint32_t> triangles(pixelCount);
+	auto state = 2463534242u;
+	for (auto& triangle : triangles)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		triangle = state % (indexCount / 3);
+	}
+
+	// Raw loads of the words that the shaders decode, then with the decoding by the CPU codec
+	enum FetchMode : uint8_t { FULL_PRECISION, QUANTIZED, QUANTIZED_DECODED };
+	const auto fetch = [&](FetchMode mode, float& checksum)
+	{
+		auto time = DBL_MAX;
+		for (uint8_t k = 0; k < 3; ++k)
+		{
+			auto sum = 0.0f;
+			auto bits = 0u;
+			const auto start = chrono::high_resolution_clock::now();
+			for (const auto& triangle : triangles)
+				for (uint8_t j = 0; j < 3; ++j)
+				{
+					if (mode == FULL_PRECISION)
+					{
+						const auto& vertex = pVertices[pIndices[triangle * 3 + j]];
+						sum += vertex.Pos.x + vertex.Nrm.y + vertex.Texcoord.x + vertex.Tan.z + (vertex.Color & 0xff) + vertex.Emissive;
+					}
+					else if (mode == QUANTIZED)
+					{
+						const auto& vertex = pQuantizedVertices[pQuantizedIndices[triangle * 3 + j]];
+						bits += vertex.Pos[0] + vertex.Nrm + vertex.Tan + vertex.UV0[0] + vertex.UV1[1] + materials[vertex.MaterialIdx & 0x7fff].Color;
+					}
+					else
+					{
+						Loader::float3 pos, nrm;
+						Loader::float4 texcoord, tangent;
+						uint16_t materialIdx;
+						Loader::DecodeVertex(pQuantizedVertices[pQuantizedIndices[triangle * 3 + j]], aabb, pos, nrm, texcoord, tangent, materialIdx);
+						const auto& material = materials[materialIdx];
+						sum += pos.x + nrm.y + texcoord.x + tangent.z + (material.Color & 0xff) + material.Emissive;
+					}
+				}
+			time = (min)(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), time);
+			checksum = sum + (bits & 0xffff);
+		}
+
+		return time;
+	};
+
+	float checksums[3];
+	const auto time = fetch(FULL_PRECISION, checksums[0]);
+	const auto quantizedTime = fetch(QUANTIZED, checksums[1]);
+	const auto decodedTime = fetch(QUANTIZED_DECODED, checksums[2]);
+	const auto stride = loader.GetVertexStride();
+	const auto quantizedStride = quantizedLoader.GetVertexStride();
+
+	os << path << ": " << vertexCount << " vertices, " << materials.size() << " materials, " << stride << " -> "
+		<< quantizedStride << " bytes per vertex, " << (isMatched ? "matched" : "mismatched") << " materials" << endl;
+	os << "  max errors: position " << posError / extent << " of the extent, normal " << nrmError << " deg, tangent "
+		<< tanError << " deg, texcoord " << uvError << endl;
+	os << "  " << pixelCount << " random triangles: " << 3 * stride << " -> " << 3 * quantizedStride << " bytes fetched per pixel, "
+		<< time << " -> " << quantizedTime << " ms, " << decodedTime << " ms with the CPU decoding (checksums "
+		<< checksums[0] << ", " << checksums[2] << ")" << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// glTF scene of materialCount patches with (patchSize + 1)^2 vertices each; every material
+// has its own base-color, metallic-roughness and normal PNGs, unless textureSize is 0,
+// which leaves the patches without materials
+//--------------------------------------------------------------------------------------
+void Benchmark::writeTexturedGltf(const string& name, uint32_t materialCount, uint32_t textureSize, uint32_t patchSize)
+{
+	// Smooth gradients with some noise, so that the PNGs neither blow up nor compress to nothing
+	const auto textureCount = textureSize ? materialCount * 3 : 0;
+	vector<uint8_t> texels(textureSize * textureSize * 4);
+	for (auto i = 0u; i < textureCount; ++i)
+	{
+		for (auto y = 0u; y < textureSize; ++y)
+			for (auto x = 0u; x < textureSize; ++x)
+			{
+				const auto j = (textureSize * y + x) * 4;
+				const auto noise = static_cast<uint32_t>(Hash(static_cast<float>(j + i * 7919)) * 16.0f);
+				texels[j] = static_cast<uint8_t>((x * 255 / textureSize + noise + i * 13) & 0xff);
+				texels[j + 1] = static_cast<uint8_t>((y * 255 / textureSize + noise) & 0xff);
+				texels[j + 2] = static_cast<uint8_t>(((x + y) * 127 / textureSize + i * 29) & 0xff);
+				texels[j + 3] = 0xff;
+			}
+
+		const auto fileName = name + to_string(i) + ".png";
+		stbi_write_png(fileName.c_str(), textureSize, textureSize, 4, texels.data(), textureSize * 4);
+	}
+
+	// Positions, normals and texcoords of all patches, then the indices
+	const auto vertexCount = (patchSize + 1) * (patchSize + 1);
+	const auto indexCount = patchSize * patchSize * 6;
+	vector<float> positions, normals, texcoords;
+	vector<uint32_t> indices;
+	for (auto i = 0u; i < materialCount; ++i)
+	{
+		for (auto y = 0u; y <= patchSize; ++y)
+			for (auto x = 0u; x <= patchSize; ++x)
+			{
+				const auto u = static_cast<float>(x) / patchSize, v = static_cast<float>(y) / patchSize;
+				positions.insert(positions.end(), { static_cast<float>(i % 16) + u, static_cast<float>(i / 16) + v, 0.1f * sinf(u * XM_2PI) });
+				normals.insert(normals.end(), { 0.0f, 0.0f, 1.0f });
+				texcoords.insert(texcoords.end(), { u, v });
+			}
+
+		for (auto y = 0u; y < patchSize; ++y)
+			for (auto x = 0u; x < patchSize; ++x)
+			{
+				const auto v0 = (patchSize + 1) * y + x, v1 = v0 + patchSize + 1;
+				indices.insert(indices.end(), { v0, v0 + 1, v1 + 1, v0, v1 + 1, v1 });
+			}
+	}
+
+	const auto positionBytes = positions.size() * sizeof(float);
+	const auto texcoordBytes = texcoords.size() * sizeof(float);
+	const auto indexBytes = indices.size() * sizeof(uint32_t);
+	ofstream buffer(name + ".bin", ios::binary);
+	buffer.write(reinterpret_cast<const char*>(positions.data()), positionBytes);
+	buffer.write(reinterpret_cast<const char*>(normals.data()), positionBytes);
+	buffer.write(reinterpret_cast<const char*>(texcoords.data()), texcoordBytes);
+	buffer.write(reinterpret_cast<const char*>(indices.data()), indexBytes);
+	buffer.close();
+
+	// 4 accessors per patch into the 4 attribute/index buffer views; the URIs are relative to the .gltf
+	const auto baseName = name.substr(name.find_last_of("/\\") + 1);
+	ofstream json(name + ".gltf");
+	json << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],";
+	json << "\"buffers\":[{\"uri\":\"" << baseName << ".bin\",\"byteLength\":" << positionBytes * 2 + texcoordBytes + indexBytes << "}],";
+	json << "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << positionBytes << "},";
+	json << "{\"buffer\":0,\"byteOffset\":" << positionBytes << ",\"byteLength\":" << positionBytes << "},";
+	json << "{\"buffer\":0,\"byteOffset\":" << positionBytes * 2 << ",\"byteLength\":" << texcoordBytes << "},";
+	json << "{\"buffer\":0,\"byteOffset\":" << positionBytes * 2 + texcoordBytes << ",\"byteLength\":" << indexBytes << "}],";
+	json << "\"accessors\":[";
+	for (auto i = 0u; i < materialCount; ++i)
+	{
+		const auto first = positions.begin() + i * vertexCount * 3;
+		XMFLOAT3 minPos(FLT_MAX, FLT_MAX, FLT_MAX), maxPos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (auto j = 0u; j < vertexCount; ++j)
+		{
+			minPos = XMFLOAT3((min)(minPos.x, first[j * 3]), (min)(minPos.y, first[j * 3 + 1]), (min)(minPos.z, first[j * 3 + 2]));
+			maxPos = XMFLOAT3((max)(maxPos.x, first[j * 3]), (max)(maxPos.y, first[j * 3 + 1]), (max)(maxPos.z, first[j * 3 + 2]));
+		}
+
+		json << (i ? "," : "") << "{\"bufferView\":0,\"byteOffset\":" << i * vertexCount * 12 << ",\"componentType\":5126,\"count\":"
+			<< vertexCount << ",\"type\":\"VEC3\",\"min\":[" << minPos.x << "," << minPos.y << "," << minPos.z
+			<< "],\"max\":[" << maxPos.x << "," << maxPos.y << "," << maxPos.z << "]},";
+		json << "{\"bufferView\":1,\"byteOffset\":" << i * vertexCount * 12 << ",\"componentType\":5126,\"count\":"
+			<< vertexCount << ",\"type\":\"VEC3\"},";
+		json << "{\"bufferView\":2,\"byteOffset\":" << i * vertexCount * 8 << ",\"componentType\":5126,\"count\":"
+			<< vertexCount << ",\"type\":\"VEC2\"},";
+		json << "{\"bufferView\":3,\"byteOffset\":" << i * indexCount * 4 << ",\"componentType\":5125,\"count\":"
+			<< indexCount << ",\"type\":\"SCALAR\"}";
+	}
+	json << "],\"meshes\":[{\"primitives\":[";
+	for (auto i = 0u; i < materialCount; ++i)
+	{
+		json << (i ? "," : "") << "{\"attributes\":{\"POSITION\":" << i * 4 << ",\"NORMAL\":" << i * 4 + 1
+			<< ",\"TEXCOORD_0\":" << i * 4 + 2 << "},\"indices\":" << i * 4 + 3;
+		if (textureCount) json << ",\"material\":" << i;
+		json << "}";
+	}
+	json << "]}]";
+	if (!textureCount)
+	{
+		json << "}";
+		return;
+	}
+
+	json << ",\"materials\":[";
+	for (auto i = 0u; i < materialCount; ++i)
+		json << (i ? "," : "") << "{\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":" << i * 3
+			<< "},\"metallicRoughnessTexture\":{\"index\":" << i * 3 + 1 << "}},\"normalTexture\":{\"index\":" << i * 3 + 2 << "}}";
+	json << "],\"textures\":[";
+	for (auto i = 0u; i < materialCount * 3; ++i) json << (i ? "," : "") << "{\"source\":" << i << "}";
+	json << "],\"images\":[";
+	for (auto i = 0u; i < materialCount * 3; ++i) json << (i ? "," : "") << "{\"uri\":\"" << baseName << i << ".png\"}";
+	json << "]}";
+}
+
+void Benchmark::removeTexturedGltf(const string& name, uint32_t materialCount)
+{
+	for (auto i = 0u; i < materialCount * 3; ++i) remove((name + to_string(i) + ".png").c_str());
+	remove((name + ".bin").c_str());
+	remove((name + ".gltf").c_str());
+}
+
+string Benchmark::encodeBase64(const uint8_t* pData, size_t size)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	string base64;
+	base64.reserve((size + 2) / 3 * 4);
+	for (size_t i = 0; i < size; i += 3)
+	{
+		const uint32_t bits = (pData[i] << 16) | (i + 1 < size ? pData[i + 1] << 8 : 0) | (i + 2 < size ? pData[i + 2] : 0);
+		for (uint8_t j = 0; j < 4; ++j) base64 += i + j <= size ? alphabet[(bits >> (18 - 6 * j)) & 0x3f] : '=';
+	}
+
+	return base64;
+}
+
+//--------------------------------------------------------------------------------------
+// FIFO post-transform cache: average misses per triangle (ACMR), and per referenced vertex
+// (ATVR), where 1 is the optimum
+//--------------------------------------------------------------------------------------
+void Benchmark::simulateVertexCache(const uint32_t* pIndices, uint32_t indexCount, uint32_t cacheSize,
+	double& acmr, double& atvr)
+{
+	uint32_t vertexCount = 0;
+	for (auto i = 0u; i < indexCount; ++i) vertexCount = (max)(pIndices[i] + 1, vertexCount);
+
+	// Vertices are in the cache if they were inserted within the last cacheSize misses
+	vector<uint32_t> insertions(vertexCount, UINT32_MAX);
+	uint32_t missCount = 0, usedVertexCount = 0;
+	for (auto i = 0u; i < indexCount; ++i)
+	{
+		auto& insertion = insertions[pIndices[i]];
+		if (insertion == UINT32_MAX) ++usedVertexCount;
+		if (insertion == UINT32_MAX || missCount - insertion >= cacheSize) insertion = missCount++;
+	}
+
+	acmr = indexCount ? missCount * 3.0 / indexCount : 0.0;
+	atvr = usedVertexCount ? missCount / static_cast<double>(usedVertexCount) : 0.0;
+}
@@ -0,0 +1,338 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "Benchmark.h"
+#include "VolumeShader.h"
+#include "IrradianceMipBuilder.h"
+#include "SHIrradianceVolume.h"
+#include "IrradianceProbeGrid.h"
+#include "TemporalAccumulator.h"
+#include "AtrousDenoiser.h"
+#include "IndirectUpsampler.h"
+#include "MonteCarlo.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+void Benchmark::shIrradiance(ostream& os, uint32_t gridSize)
+{
+	Scene scene;
+	VolumeShader volumeShader;
+	IrradianceMipBuilder mipBuilder;
+	if (!loadCornellBox(scene, gridSize))
+	{
+		os << "Assets/cornell_box.gltf not found" << endl;
+		return;
+	}
+	shadeCornellBox(scene, volumeShader, mipBuilder);
+
+	SHIrradianceVolume shVolume;
+	shVolume.Init(gridSize / 2);
+	shVolume.Build(scene.Volume, mipBuilder);
+
+	vector<XMFLOAT3> positions, normals, refResults, results, shResults;
+	getPixels(scene, volumeShader.GetSurfaceVoxels(), positions, normals);
+	traceIndirect(scene, mipBuilder, positions, normals, 1024, refResults);
+	const auto traceTime = traceIndirect(scene, mipBuilder, positions, normals, 32, results);
+
+	const auto pixelCount = static_cast<uint32_t>(positions.size());
+	shResults.resize(pixelCount);
+	const auto start = chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < pixelCount; ++i)
+		XMStoreFloat3(&shResults[i], shVolume.Evaluate(XMLoadFloat3(&positions[i]), XMLoadFloat3(&normals[i])));
+	const auto evalTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	const auto& stats = shVolume.GetStats();
+	os << gridSize << "^3, " << pixelCount << " pixels: TraceIndirect (32 samples) " << traceTime << " ms, relative RMSE "
+		<< getRelativeRMSE(refResults, results) << "; SH evaluation " << evalTime << " ms, relative RMSE "
+		<< getRelativeRMSE(refResults, shResults) << endl;
+	os << "SH volume " << shVolume.GetGridSize() << "^3: build " << stats.BuildTime << " ms, "
+		<< stats.ProjectedVoxelCount << " of " << stats.VoxelCount << " voxels projected, "
+		<< stats.ByteCount / (1024.0 * 1024.0) << " MB (" << sizeof(SHIrradianceVolume::PackedVoxel)
+		<< " bytes per voxel)" << endl;
+}
+
+void Benchmark::irradianceProbes(ostream& os, uint32_t gridSize, uint32_t probeSpacing)
+{
+	Scene scene;
+	VolumeShader volumeShader;
+	IrradianceMipBuilder mipBuilder;
+	createCornellBox(scene, gridSize);
+	shadeCornellBox(scene, volumeShader, mipBuilder);
+
+	IrradianceProbeGrid probeGrid;
+	probeGrid.Init(scene.Volume, probeSpacing);
+	probeGrid.Relocate(scene.Volume);
+	probeGrid.Update(scene.Volume, mipBuilder);
+
+	vector<XMFLOAT3> positions, normals, refResults, results, probeResults;
+	getPixels(scene, volumeShader.GetSurfaceVoxels(), positions, normals);
+	traceIndirect(scene, mipBuilder, positions, normals, 1024, refResults);
+	const auto traceTime = traceIndirect(scene, mipBuilder, positions, normals, 32, results);
+
+	const auto pixelCount = static_cast<uint32_t>(positions.size());
+	probeResults.resize(pixelCount);
+	const auto start = chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < pixelCount; ++i)
+		XMStoreFloat3(&probeResults[i], probeGrid.Sample(XMLoadFloat3(&positions[i]), XMLoadFloat3(&normals[i])));
+	const auto sampleTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	// Dense RGBA16F irradiance volume with its full mip chain
+	auto denseBytes = 0.0;
+	for (uint8_t i = 0; i < mipBuilder.GetLevelCount(); ++i)
+	{
+		const auto size = mipBuilder.GetLevelSize(i);
+		denseBytes += 8.0 * size * size * size;
+	}
+
+	const auto& stats = probeGrid.GetStats();
+	const auto probeGridSize = probeGrid.GetProbeGridSize();
+	os << gridSize << "^3, probe spacing " << probeSpacing << ": " << stats.ActiveProbeCount << " of "
+		<< stats.ProbeCount << " probes active (" << probeGridSize << "^3, " << stats.RelocatedProbeCount
+		<< " relocated), relocation " << stats.RelocateTime << " ms, update " << stats.UpdateTime << " ms" << endl;
+	os << "memory " << stats.ByteCount / (1024.0 * 1024.0) << " MB versus " << denseBytes / (1024.0 * 1024.0)
+		<< " MB dense; " << pixelCount << " pixels: TraceIndirect (32 samples) " << traceTime << " ms, relative RMSE "
+		<< getRelativeRMSE(refResults, results) << "; probe sampling " << sampleTime << " ms, relative RMSE "
+		<< getRelativeRMSE(refResults, probeResults) << endl;
+}
+
+void Benchmark::temporalReuse(ostream& os, uint32_t width, uint32_t height, uint32_t samplesPerFrame)
+{
+	Scene scene;
+	VolumeShader volumeShader;
+	IrradianceMipBuilder mipBuilder;
+	createCornellBox(scene, 128);
+	shadeCornellBox(scene, volumeShader, mipBuilder);
+
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto pixelCount = width * height;
+	const auto tMin = scene.Volume.GetVoxelSize();
+	const auto tMax = XMVectorGetX(XMVector3Length(XMLoadFloat3x4(&scene.Volume.GetVolumeWorld()).r[1])) * 0.5f;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, static_cast<float>(width) / height, 1.0f, 100.0f);
+
+	VisibilityBuffer visibility;
+	TemporalAccumulator accumulator;
+	visibility.Init(width, height);
+	accumulator.Init(width, height);
+
+	// Indirect lighting of the covered pixels from a subset of the 32-sample sequence
+	const auto shade = [&](uint32_t sampleCount, uint32_t firstSample, vector<XMFLOAT4>& image)
+	{
+		const auto pVisibility = visibility.GetVisibility();
+		const auto pPositions = visibility.GetPositions();
+		const auto pNormals = visibility.GetNormals();
+		const auto start = chrono::high_resolution_clock::now();
+		ParallelFor(height, 4, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto i = begin * width; i < end * width; ++i)
+				XMStoreFloat4(&image[i], pVisibility[i] ? scene.Volume.TraceIndirect(XMLoadFloat3(&pPositions[i]),
+					XMLoadFloat3(&pNormals[i]), tMin, tMax, mipBuilder, sampleCount, firstSample) : XMVectorZero());
+		});
+
+		return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	};
+
+	const auto getRelativeError = [&](const vector<XMFLOAT4>& refImage, const vector<XMFLOAT4>& image)
+	{
+		auto refSqSum = 0.0, errorSqSum = 0.0;
+		for (auto i = 0u; i < pixelCount; ++i)
+		{
+			const auto ref = XMVectorSetW(XMLoadFloat4(&refImage[i]), 0.0f);
+			refSqSum += XMVectorGetX(XMVector3LengthSq(ref));
+			errorSqSum += XMVectorGetX(XMVector3LengthSq(XMVectorSetW(XMLoadFloat4(&image[i]), 0.0f) - ref));
+		}
+
+		return sqrt(errorSqSum / refSqSum);
+	};
+
+	// Recorded paths around the box: a slow orbit and a fast strafe past the tall box
+	const char* pathNames[] = { "orbit", "strafe" };
+	const auto frameCount = 48u;
+	vector<XMFLOAT4> current(pixelCount), result(pixelCount), refImage(pixelCount);
+	for (uint8_t path = 0; path < 2; ++path)
+	{
+		accumulator.Reset();
+		auto prevViewProj = XMMatrixIdentity();
+		auto shadeTime = 0.0, refShadeTime = 0.0, accumulateTime = 0.0, disocclusionSum = 0.0, historySum = 0.0;
+		auto rawError = 0.0, error = 0.0;
+		auto evalCount = 0u;
+		for (auto i = 0u; i < frameCount; ++i)
+		{
+			const auto f = static_cast<float>(i) / (frameCount - 1);
+			const auto angle = path == 0 ? 0.6f * f - 0.3f : 0.0f;
+			const auto eyePt = path == 0 ? XMVectorSet(16.0f * sinf(angle), 1.0f, -16.0f * cosf(angle), 0.0f) :
+				XMVectorSet(12.0f * f - 6.0f, 0.0f, -12.0f, 0.0f);
+			const auto focusPt = path == 0 ? XMVectorZero() : XMVectorSet(12.0f * f - 6.0f, -1.0f, 0.0f, 0.0f);
+			const auto viewProj = XMMatrixLookAtLH(eyePt, focusPt, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj;
+
+			visibility.Render(scene.Meshes.data(), scene.Matrices.data(), meshCount, viewProj);
+			const auto firstSample = i * samplesPerFrame % 32;
+			const auto time = shade(samplesPerFrame, firstSample, current);
+			accumulator.Accumulate(visibility, scene.Matrices.data(), scene.Matrices.data(), meshCount,
+				prevViewProj, current.data(), result.data());
+			prevViewProj = viewProj;
+
+			if (i == 0) continue;
+
+			const auto& stats = accumulator.GetStats();
+			shadeTime += time;
+			accumulateTime += stats.AccumulateTime;
+			disocclusionSum += stats.DisoccludedPixelCount / static_cast<double>(stats.CoveredPixelCount);
+			historySum += stats.AverageHistoryLength;
+
+			// Against the full 32-sample estimate, once the history had time to fill
+			if (i >= 16 && i % 8 == 7)
+			{
+				refShadeTime += shade(32, 0, refImage);
+				rawError += getRelativeError(refImage, current);
+				error += getRelativeError(refImage, result);
+				++evalCount;
+			}
+		}
+
+		os << pathNames[path] << ", " << width << "x" << height << ", " << samplesPerFrame << " samples per frame: shading "
+			<< shadeTime / (frameCount - 1) << " ms (32 samples: " << refShadeTime / evalCount << " ms), reprojection "
+			<< accumulateTime / (frameCount - 1) << " ms, " << 100.0 * disocclusionSum / (frameCount - 1)
+			<< "% disoccluded, history " << historySum / (frameCount - 1) << " frames, relative RMSE "
+			<< rawError / evalCount << " -> " << error / evalCount << endl;
+	}
+}
+
+void Benchmark::atrousDenoising(ostream& os, uint32_t width, uint32_t height, uint8_t iterationCount)
+{
+	Scene scene;
+	VolumeShader volumeShader;
+	IrradianceMipBuilder mipBuilder;
+	createCornellBox(scene, 128);
+	shadeCornellBox(scene, volumeShader, mipBuilder);
+
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto pixelCount = width * height;
+	const auto tMin = scene.Volume.GetVoxelSize();
+	const auto tMax = XMVectorGetX(XMVector3Length(XMLoadFloat3x4(&scene.Volume.GetVolumeWorld()).r[1])) * 0.5f;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, static_cast<float>(width) / height, 1.0f, 100.0f);
+	const auto view = XMMatrixLookAtLH(XMVectorSet(2.0f, 1.0f, -15.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+	VisibilityBuffer visibility;
+	AtrousDenoiser denoiser;
+	visibility.Init(width, height);
+	denoiser.Init(width, height);
+	visibility.Render(scene.Meshes.data(), scene.Matrices.data(), meshCount, view * proj);
+
+	const auto pVisibility = visibility.GetVisibility();
+	const auto pPositions = visibility.GetPositions();
+	const auto pNormals = visibility.GetNormals();
+	vector<XMFLOAT4> image(pixelCount), refImage;
+
+	// Error is only measured at low resolutions, where tracing the 32-sample reference is affordable
+	const auto measureError = pixelCount <= 640 * 360;
+	if (measureError)
+	{
+		// 4 samples per pixel, interleaved over 4x2 tiles so that each tile covers the 32-sample sequence
+		refImage.resize(pixelCount);
+		ParallelFor(height, 4, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto y = begin; y < end; ++y)
+				for (auto x = 0u; x < width; ++x)
+				{
+					const auto i = width * y + x;
+					if (!pVisibility[i]) continue;
+
+					const auto pos = XMLoadFloat3(&pPositions[i]);
+					const auto nrm = XMLoadFloat3(&pNormals[i]);
+					XMStoreFloat4(&image[i], scene.Volume.TraceIndirect(pos, nrm, tMin, tMax, mipBuilder, 4, ((x & 3) + 4 * (y & 1)) * 4));
+					XMStoreFloat4(&refImage[i], scene.Volume.TraceIndirect(pos, nrm, tMin, tMax, mipBuilder, 32));
+				}
+		});
+	}
+	else
+	{
+		// Timing only: per-pixel noise stands in for the traced estimate
+		for (auto i = 0u; i < pixelCount; ++i)
+		{
+			const auto noise = Hash(static_cast<float>(i));
+			image[i] = XMFLOAT4(noise, 0.5f * noise, 0.25f * noise, 1.0f);
+		}
+	}
+
+	const auto getRelativeError = [&](const vector<XMFLOAT4>& result)
+	{
+		auto refSqSum = 0.0, errorSqSum = 0.0;
+		for (auto i = 0u; i < pixelCount; ++i)
+		{
+			const auto ref = XMVectorSetW(XMLoadFloat4(&refImage[i]), 0.0f);
+			refSqSum += XMVectorGetX(XMVector3LengthSq(ref));
+			errorSqSum += XMVectorGetX(XMVector3LengthSq(XMVectorSetW(XMLoadFloat4(&result[i]), 0.0f) - ref));
+		}
+
+		return sqrt(errorSqSum / refSqSum);
+	};
+
+	const auto rawError = measureError ? getRelativeError(image) : 0.0;
+	denoiser.Denoise(visibility, image.data(), iterationCount);
+	const auto& stats = denoiser.GetStats();
+
+	os << width << "x" << height << ", " << static_cast<uint32_t>(iterationCount) << " iterations: guides "
+		<< stats.GuideTime << " ms, filtering " << stats.FilterTime << " ms ("
+		<< stats.FilterTime / iterationCount << " ms per iteration)";
+	if (measureError) os << ", relative RMSE " << rawError << " -> " << getRelativeError(image);
+	os << endl;
+}
+
+void Benchmark::reducedRateIndirect(ostream& os, uint32_t width, uint32_t height, uint8_t downsampleFactor)
+{
+	Scene scene;
+	VolumeShader volumeShader;
+	IrradianceMipBuilder mipBuilder;
+	createCornellBox(scene, 128);
+	shadeCornellBox(scene, volumeShader, mipBuilder);
+
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto pixelCount = width * height;
+	const auto tMin = scene.Volume.GetVoxelSize();
+	const auto tMax = XMVectorGetX(XMVector3Length(XMLoadFloat3x4(&scene.Volume.GetVolumeWorld()).r[1])) * 0.5f;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, static_cast<float>(width) / height, 1.0f, 100.0f);
+	const auto view = XMMatrixLookAtLH(XMVectorSet(2.0f, 1.0f, -15.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+	VisibilityBuffer visibility;
+	IndirectUpsampler upsampler;
+	visibility.Init(width, height);
+	upsampler.Init(width, height, downsampleFactor);
+	visibility.Render(scene.Meshes.data(), scene.Matrices.data(), meshCount, view * proj);
+
+	// Full-rate reference, as CSShade evaluates it
+	const auto pVisibility = visibility.GetVisibility();
+	const auto pPositions = visibility.GetPositions();
+	const auto pNormals = visibility.GetNormals();
+	vector<XMFLOAT4> refImage(pixelCount), image(pixelCount);
+	const auto start = chrono::high_resolution_clock::now();
+	ParallelFor(height, 4, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin * width; i < end * width; ++i)
+			XMStoreFloat4(&refImage[i], pVisibility[i] ? scene.Volume.TraceIndirect(XMLoadFloat3(&pPositions[i]),
+				XMLoadFloat3(&pNormals[i]), tMin, tMax, mipBuilder) : XMVectorZero());
+	});
+	const auto refTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	upsampler.Trace(visibility, scene.Volume, mipBuilder, tMin, tMax);
+	upsampler.Upsample(visibility, image.data());
+	const auto& stats = upsampler.GetStats();
+
+	auto refSqSum = 0.0, errorSqSum = 0.0;
+	for (auto i = 0u; i < pixelCount; ++i)
+	{
+		const auto ref = XMVectorSetW(XMLoadFloat4(&refImage[i]), 0.0f);
+		refSqSum += XMVectorGetX(XMVector3LengthSq(ref));
+		errorSqSum += XMVectorGetX(XMVector3LengthSq(XMVectorSetW(XMLoadFloat4(&image[i]), 0.0f) - ref));
+	}
+
+	const auto coveredPixelCount = visibility.GetStats().CoveredPixelCount;
+	os << width << "x" << height << ", 1/" << static_cast<uint32_t>(downsampleFactor) << " rate: full-rate tracing "
+		<< refTime << " ms (" << coveredPixelCount << " pixels); block tracing " << stats.TraceTime << " ms ("
+		<< stats.TracedPixelCount << " pixels), upsampling " << stats.UpsampleTime << " ms, "
+		<< 100.0 * stats.FallbackPixelCount / coveredPixelCount << "% fallback pixels, relative RMSE "
+		<< sqrt(errorSqSum / refSqSum) << endl;
+}
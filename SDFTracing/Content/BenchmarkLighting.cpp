@@ -0,0 +1,347 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Benchmark.h"
+#include "VolumeShader.h"
+#include "IrradianceScheduler.h"
+#include "IrradianceMipBuilder.h"
+#include "LightClusters.h"
+#include "LightBVH.h"
+#include "ShadowCache.h"
+#include "VisibilityBuffer.h"
+
+using namespace std;
+using namespace DirectX;
+
+void Benchmark::volumeShading(ostream& os, uint32_t gridSize)
+{
+	Scene scene;
+	createScene(scene, gridSize, 2);
+
+	VolumeShader volumeShader;
+	volumeShader.Compact(scene.Volume);
+
+	vector<XMFLOAT4> irradiance(scene.Volume.GetVoxelCount());
+	volumeShader.Shade(scene.Volume, scene.Meshes.data(), scene.Matrices.data(), scene.LightSources.data(),
+		static_cast<uint32_t>(scene.LightSources.size()), irradiance.data());
+
+	const auto& stats = volumeShader.GetStats();
+	os << gridSize << "^3: " << stats.SurfaceVoxelCount << " of " << stats.VoxelCount << " voxels occupied ("
+		<< 100.0 * stats.SurfaceVoxelCount / stats.VoxelCount << "%), compaction " << stats.CompactTime
+		<< " ms, shading " << stats.ShadeTime << " ms" << endl;
+}
+
+void Benchmark::irradianceScheduling(ostream& os, uint32_t gridSize, uint8_t period)
+{
+	Scene scene;
+	createScene(scene, gridSize, 2, 1, 8.0f);
+
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto radius = scene.Vertices[1].Pos.x;
+	const vector<AABB> meshAABBs(meshCount, { XMFLOAT3(-radius, -radius, -radius), XMFLOAT3(radius, radius, radius) });
+
+	VolumeShader volumeShader;
+	IrradianceScheduler scheduler;
+	scheduler.Init(gridSize, period);
+
+	// Orbit the dynamic mesh by half a turn; one light is moved halfway through. Every
+	// surface voxel is also shaded each frame, to count the ones whose scheduled irradiance
+	// went stale since the fully shaded first frame
+	const auto frameCount = 64u;
+	vector<XMFLOAT4> irradiance(scene.Volume.GetVoxelCount()), refIrradiance(scene.Volume.GetVoxelCount());
+	auto refreshSum = 0.0, dirtyBrickSum = 0.0, updateTime = 0.0, staleSum = 0.0;
+	auto maxError = 0.0f;
+	for (auto i = 0u; i < frameCount; ++i)
+	{
+		if (i == frameCount / 2)
+			XMStoreFloat3x4(&scene.LightSources[0].World, XMMatrixScaling(scene.WorldScale, scene.WorldScale,
+				scene.WorldScale) * XMMatrixTranslation(0.0f, -0.05f * scene.WorldScale, 0.0f));
+		animateScene(scene, i / 60.0f, 0.8f, XM_PI);
+		volumeShader.Compact(scene.Volume);
+		const auto& surfaceVoxels = volumeShader.GetSurfaceVoxels();
+		scheduler.Update(scene.Volume, surfaceVoxels, scene.DynamicMeshIds.data(), meshAABBs.data(),
+			scene.Matrices.data(), meshCount, scene.LightSources.data(), static_cast<uint32_t>(scene.LightSources.size()));
+
+		volumeShader.Shade(scene.Volume, surfaceVoxels.data(), static_cast<uint32_t>(surfaceVoxels.size()),
+			scene.Meshes.data(), scene.Matrices.data(), scene.LightSources.data(),
+			static_cast<uint32_t>(scene.LightSources.size()), refIrradiance.data());
+		if (i == 0) irradiance = refIrradiance;
+		else for (const auto& j : scheduler.GetRefreshVoxels()) irradiance[j] = refIrradiance[j];
+
+		// Staleness is relative to the largest irradiance of the frame
+		auto maxIrradiance = 0.0f;
+		for (const auto& j : surfaceVoxels)
+			maxIrradiance = (max)(XMVectorGetX(XMVector3Length(XMLoadFloat4(&refIrradiance[j]))), maxIrradiance);
+		auto staleCount = 0u;
+		for (const auto& j : surfaceVoxels)
+		{
+			const auto error = XMVectorGetX(XMVector3Length(XMLoadFloat4(&irradiance[j]) -
+				XMLoadFloat4(&refIrradiance[j]))) / maxIrradiance;
+			if (i > 0 && error > 0.01f) ++staleCount;
+			if (i > 0) maxError = (max)(maxError, error);
+		}
+
+		const auto& stats = scheduler.GetStats();
+		if (i < 2 || i == frameCount / 2 || i + 1 == frameCount)
+			os << "frame " << i << ": " << stats.RefreshCount << " of " << stats.SurfaceVoxelCount
+				<< " surface voxels (aged " << stats.AgedCount << ", dynamic " << stats.DynamicCount
+				<< ", relit " << stats.RelitCount << ", motion " << stats.MotionCount << "), "
+				<< stats.DirtyBrickCount << " of " << stats.BrickCount << " bricks dirty, "
+				<< staleCount << " stale" << endl;
+
+		if (i > 0)
+		{
+			refreshSum += stats.RefreshCount / static_cast<double>(stats.SurfaceVoxelCount);
+			dirtyBrickSum += stats.DirtyBrickCount / static_cast<double>(stats.BrickCount);
+			updateTime += stats.UpdateTime;
+			staleSum += staleCount / static_cast<double>(stats.SurfaceVoxelCount);
+		}
+	}
+
+	os << gridSize << "^3, period " << static_cast<uint32_t>(period) << ": average "
+		<< 100.0 * refreshSum / (frameCount - 1) << "% of surface voxels and "
+		<< 100.0 * dirtyBrickSum / (frameCount - 1) << "% of bricks per frame, scheduling "
+		<< updateTime / (frameCount - 1) << " ms; " << 100.0 * staleSum / (frameCount - 1)
+		<< "% of surface voxels stale by more than 1% of the peak, max " << 100.0f * maxError << "%" << endl;
+}
+
+void Benchmark::irradianceMips(ostream& os, uint32_t gridSize, uint8_t period)
+{
+	Scene scene;
+	createScene(scene, gridSize, 2, 1, 8.0f);
+
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto radius = scene.Vertices[1].Pos.x;
+	const vector<AABB> meshAABBs(meshCount, { XMFLOAT3(-radius, -radius, -radius), XMFLOAT3(radius, radius, radius) });
+
+	VolumeShader volumeShader;
+	IrradianceScheduler scheduler;
+	IrradianceMipBuilder mipBuilder;
+	scheduler.Init(gridSize, period);
+	mipBuilder.Init(gridSize);
+
+	// Shade the refreshed voxels and regenerate the mips of their bricks every frame
+	const auto frameCount = 32u;
+	auto updateTime = 0.0, dirtyBrickSum = 0.0, texelSum = 0.0;
+	for (auto i = 0u; i < frameCount; ++i)
+	{
+		animateScene(scene, i / 60.0f);
+		volumeShader.Compact(scene.Volume);
+		scheduler.Update(scene.Volume, volumeShader.GetSurfaceVoxels(), scene.DynamicMeshIds.data(), meshAABBs.data(),
+			scene.Matrices.data(), meshCount, scene.LightSources.data(), static_cast<uint32_t>(scene.LightSources.size()));
+
+		const auto& refreshVoxels = scheduler.GetRefreshVoxels();
+		volumeShader.Shade(scene.Volume, refreshVoxels.data(), static_cast<uint32_t>(refreshVoxels.size()),
+			scene.Meshes.data(), scene.Matrices.data(), scene.LightSources.data(),
+			static_cast<uint32_t>(scene.LightSources.size()), mipBuilder.GetLevel(0));
+		mipBuilder.Update(scheduler.GetDirtyBricks().data());
+
+		if (i > 0)
+		{
+			const auto& stats = mipBuilder.GetStats();
+			updateTime += stats.UpdateTime;
+			dirtyBrickSum += stats.DirtyBrickCount / static_cast<double>(stats.BrickCount);
+			texelSum += stats.TexelCount;
+		}
+	}
+
+	// The incremental chain must match a full regeneration from the same level 0
+	vector<vector<XMFLOAT4>> levels(mipBuilder.GetLevelCount());
+	for (uint8_t i = 1; i < mipBuilder.GetLevelCount(); ++i)
+	{
+		const auto size = mipBuilder.GetLevelSize(i);
+		levels[i].assign(mipBuilder.GetLevel(i), mipBuilder.GetLevel(i) + size * size * size);
+	}
+	mipBuilder.Build();
+
+	auto maxError = 0.0f;
+	for (uint8_t i = 1; i < mipBuilder.GetLevelCount(); ++i)
+		for (size_t j = 0; j < levels[i].size(); ++j)
+		{
+			const auto error = XMVectorAbs(XMLoadFloat4(&levels[i][j]) - XMLoadFloat4(&mipBuilder.GetLevel(i)[j]));
+			maxError = (max)(maxError, XMVectorGetX(XMVector4Length(error)));
+		}
+
+	auto totalTexelCount = 0u;
+	for (uint8_t i = 1; i < mipBuilder.GetLevelCount(); ++i)
+	{
+		const auto size = mipBuilder.GetLevelSize(i);
+		totalTexelCount += size * size * size;
+	}
+
+	os << gridSize << "^3: incremental " << updateTime / (frameCount - 1) << " ms ("
+		<< 100.0 * dirtyBrickSum / (frameCount - 1) << "% of bricks, " << texelSum / (frameCount - 1)
+		<< " of " << totalTexelCount << " mip texels), full chain " << mipBuilder.GetStats().BuildTime
+		<< " ms, max error " << maxError << endl;
+}
+
+void Benchmark::lightClustering(ostream& os, uint32_t gridSize, uint32_t lightSourceCount, float impactRange)
+{
+	// Room-sized scene, so that the impact range covers part of the volume only
+	Scene scene;
+	const auto worldScale = 8.0f;
+	createScene(scene, gridSize, lightSourceCount, 0, worldScale);
+
+	placePanelLights(scene);
+
+	VolumeShader volumeShader;
+	volumeShader.Compact(scene.Volume);
+	const auto& surfaceVoxels = volumeShader.GetSurfaceVoxels();
+
+	// Reference: all lights per voxel
+	vector<XMFLOAT4> irradiance(scene.Volume.GetVoxelCount());
+	volumeShader.Shade(scene.Volume, surfaceVoxels.data(), static_cast<uint32_t>(surfaceVoxels.size()),
+		scene.Meshes.data(), scene.Matrices.data(), scene.LightSources.data(), lightSourceCount, irradiance.data());
+	const auto shadeTime = volumeShader.GetStats().ShadeTime;
+
+	LightClusters lightClusters;
+	lightClusters.Init(gridSize);
+	lightClusters.Build(scene.Volume, surfaceVoxels, scene.Meshes.data(), scene.Matrices.data(),
+		scene.LightSources.data(), lightSourceCount, impactRange);
+
+	vector<XMFLOAT4> clusteredIrradiance(scene.Volume.GetVoxelCount());
+	volumeShader.SetLightClusters(&lightClusters);
+	volumeShader.Shade(scene.Volume, surfaceVoxels.data(), static_cast<uint32_t>(surfaceVoxels.size()),
+		scene.Meshes.data(), scene.Matrices.data(), scene.LightSources.data(), lightSourceCount,
+		clusteredIrradiance.data());
+
+	// Energy dropped by the range culling
+	auto sum = 0.0, errorSum = 0.0;
+	for (const auto& i : surfaceVoxels)
+	{
+		const auto ref = XMLoadFloat4(&irradiance[i]);
+		sum += XMVectorGetX(XMVector3Length(ref));
+		errorSum += XMVectorGetX(XMVector3Length(ref - XMLoadFloat4(&clusteredIrradiance[i])));
+	}
+
+	const auto& stats = lightClusters.GetStats();
+	os << lightSourceCount << " lights, range " << impactRange << ": build " << stats.BuildTime << " ms, "
+		<< stats.OccupiedClusterCount << " of " << stats.ClusterCount << " clusters occupied, lights per voxel "
+		<< stats.AverageListLength << " (max " << stats.MaxListLength << "), shading " << shadeTime
+		<< " ms -> " << volumeShader.GetStats().ShadeTime << " ms, relative error "
+		<< (sum > 0.0 ? errorSum / sum : 0.0) << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// Direct lighting of the pixels of a 480x270 view, with the full light loop of CSShade and
+// with lights picked from the BVH
+//--------------------------------------------------------------------------------------
+void Benchmark::lightSampling(ostream& os, uint32_t gridSize, uint32_t lightSourceCount)
+{
+	Scene scene;
+	createScene(scene, gridSize, lightSourceCount, 0, 8.0f);
+	placePanelLights(scene);
+
+	const auto width = 480u, height = 270u;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, static_cast<float>(width) / height, 1.0f, 100.0f);
+	const auto view = XMMatrixLookAtLH(XMVectorSet(2.0f, 1.0f, -15.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	VisibilityBuffer visibility;
+	visibility.Init(width, height);
+	visibility.Render(scene.Meshes.data(), scene.Matrices.data(), static_cast<uint32_t>(scene.Meshes.size()), view * proj);
+
+	vector<XMFLOAT3> positions, normals;
+	for (auto i = 0u; i < width * height; ++i)
+	{
+		if (!visibility.GetVisibility()[i]) continue;
+		positions.emplace_back(visibility.GetPositions()[i]);
+		normals.emplace_back(visibility.GetNormals()[i]);
+	}
+	const auto pixelCount = static_cast<uint32_t>(positions.size());
+
+	VolumeShader volumeShader;
+	vector<XMFLOAT3> irradiance(pixelCount);
+	volumeShader.ShadePoints(scene.Volume, positions.data(), normals.data(), pixelCount,
+		scene.LightSources.data(), lightSourceCount, irradiance.data());
+	os << lightSourceCount << " lights, " << pixelCount << " pixels: full loop " << volumeShader.GetStats().ShadeTime << " ms" << endl;
+
+	LightBVH lightBVH;
+	lightBVH.Build(scene.LightSources.data(), lightSourceCount);
+	os << "BVH build " << lightBVH.GetBuildTime() << " ms, " << lightBVH.GetNodes().size() << " nodes" << endl;
+
+	vector<XMFLOAT3> sampledIrradiance(pixelCount);
+	for (const auto& sampleCount : { 1u, 4u, 16u })
+	{
+		volumeShader.SetLightBVH(&lightBVH, sampleCount);
+		volumeShader.ShadePoints(scene.Volume, positions.data(), normals.data(), pixelCount,
+			scene.LightSources.data(), lightSourceCount, sampledIrradiance.data());
+
+		// Relative RMS error and bias of the estimates
+		auto refSum = 0.0, errorSqSum = 0.0, refSqSum = 0.0, sum = 0.0;
+		for (auto i = 0u; i < pixelCount; ++i)
+		{
+			const auto ref = XMVectorGetX(XMVector3Length(XMLoadFloat3(&irradiance[i])));
+			const auto error = XMVectorGetX(XMVector3Length(XMLoadFloat3(&sampledIrradiance[i]) - XMLoadFloat3(&irradiance[i])));
+			refSum += ref;
+			refSqSum += ref * ref;
+			errorSqSum += error * error;
+			sum += XMVectorGetX(XMVector3Length(XMLoadFloat3(&sampledIrradiance[i])));
+		}
+
+		os << sampleCount << " sample(s) per pixel: " << volumeShader.GetStats().ShadeTime << " ms, relative RMSE "
+			<< sqrt(errorSqSum / refSqSum) << ", mean ratio " << sum / refSum << endl;
+	}
+}
+
+void Benchmark::shadowCaching(ostream& os, uint32_t gridSize, uint32_t lightSourceCount, float orbitRadius)
+{
+	Scene scene;
+	createScene(scene, gridSize, lightSourceCount, 1);
+
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto radius = scene.Vertices[1].Pos.x;
+	const vector<AABB> meshAABBs(meshCount, { XMFLOAT3(-radius, -radius, -radius), XMFLOAT3(radius, radius, radius) });
+
+	VolumeShader volumeShader, refShader;
+	ShadowCache shadowCache;
+	shadowCache.Init(scene.Volume.GetVoxelCount());
+	volumeShader.SetShadowCache(&shadowCache);
+
+	// Animate the dynamic mesh; one light is moved halfway through
+	vector<XMFLOAT4> irradiance(scene.Volume.GetVoxelCount()), refIrradiance(scene.Volume.GetVoxelCount());
+	const auto frameCount = 400u;
+	auto lookupSum = 0.0, hitSum = 0.0, shadeTime = 0.0, refShadeTime = 0.0, updateTime = 0.0;
+	auto maxError = 0.0f;
+	for (auto i = 0u; i < frameCount; ++i)
+	{
+		if (i == frameCount / 2)
+			XMStoreFloat3x4(&scene.LightSources[0].World, XMMatrixTranslation(0.0f, -0.05f, 0.0f));
+		animateScene(scene, i / 60.0f, orbitRadius);
+		volumeShader.Compact(scene.Volume);
+		const auto& surfaceVoxels = volumeShader.GetSurfaceVoxels();
+		const auto voxelCount = static_cast<uint32_t>(surfaceVoxels.size());
+
+		shadowCache.Update(scene.Volume, surfaceVoxels.data(), voxelCount, scene.DynamicMeshIds.data(),
+			meshAABBs.data(), scene.Matrices.data(), meshCount, scene.LightSources.data(), lightSourceCount);
+		volumeShader.Shade(scene.Volume, surfaceVoxels.data(), voxelCount, scene.Meshes.data(),
+			scene.Matrices.data(), scene.LightSources.data(), lightSourceCount, irradiance.data());
+		refShader.Shade(scene.Volume, surfaceVoxels.data(), voxelCount, scene.Meshes.data(),
+			scene.Matrices.data(), scene.LightSources.data(), lightSourceCount, refIrradiance.data());
+
+		const auto& stats = shadowCache.GetStats();
+		const auto hitRate = shadowCache.GetHitCount() / static_cast<double>(shadowCache.GetLookupCount());
+		if (i < 2 || i == frameCount / 2 || i + 1 == frameCount)
+			os << "frame " << i << ": hit rate " << 100.0 * hitRate << "%, " << stats.LightInvalidations
+				<< " invalidated by lights, " << stats.MotionInvalidations << " by motion, " << stats.SlotCount
+				<< " slots, update " << stats.UpdateTime << " ms, shading " << volumeShader.GetStats().ShadeTime << " ms" << endl;
+
+		for (const auto& j : surfaceVoxels)
+		{
+			const auto error = XMVectorGetX(XMVector3Length(XMLoadFloat4(&irradiance[j]) - XMLoadFloat4(&refIrradiance[j])));
+			maxError = (max)(maxError, error);
+		}
+
+		if (i > 0)
+		{
+			lookupSum += shadowCache.GetLookupCount();
+			hitSum += shadowCache.GetHitCount();
+			shadeTime += volumeShader.GetStats().ShadeTime;
+			refShadeTime += refShader.GetStats().ShadeTime;
+			updateTime += stats.UpdateTime;
+		}
+	}
+
+	os << gridSize << "^3, " << lightSourceCount << " lights, orbit " << orbitRadius << ": hit rate " << 100.0 * hitSum / lookupSum
+		<< "%, shading " << refShadeTime / (frameCount - 1) << " ms -> " << shadeTime / (frameCount - 1)
+		<< " ms + " << updateTime / (frameCount - 1) << " ms cache update, max error " << maxError << endl;
+}
@@ -0,0 +1,469 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <mutex>
+#include "Benchmark.h"
+#include "VolumeShader.h"
+#include "IrradianceMipBuilder.h"
+#include "SphereTracer.h"
+#include "OccupancyPyramid.h"
+#include "AnalyticSDF.h"
+#include "RigidSDFTransfer.h"
+#include "MonteCarlo.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+void Benchmark::sphereTracing(ostream& os, uint32_t gridSize)
+{
+	Scene scene;
+	VolumeShader volumeShader;
+	IrradianceMipBuilder mipBuilder;
+	createCornellBox(scene, gridSize);
+	shadeCornellBox(scene, volumeShader, mipBuilder);
+
+	vector<XMFLOAT3> positions, normals;
+	getPixels(scene, volumeShader.GetSurfaceVoxels(), positions, normals);
+
+	// Shadow rays to jittered points on the ceiling light, with the cone radius of CSShade
+	const auto rayCountPerPixel = 8u;
+	const auto pixelCount = static_cast<uint32_t>(positions.size());
+	const auto& lightSource = scene.LightSources[0];
+	const auto lightMin = XMLoadFloat4(&lightSource.Min), lightMax = XMLoadFloat4(&lightSource.Max);
+	const auto lightMaxDim = (max)(lightSource.Max.x - lightSource.Min.x, lightSource.Max.z - lightSource.Min.z) * 0.5f;
+	const auto tMin = scene.Volume.GetVoxelSize();
+
+	const auto traceShadows = [&](const auto& traceCone, vector<float>& shadows, SphereTracingStats& stats)
+	{
+		shadows.assign(pixelCount * rayCountPerPixel, 0.0f);
+		memset(&stats, 0, sizeof(SphereTracingStats));
+		mutex statsMutex;
+		const auto start = chrono::high_resolution_clock::now();
+		ParallelFor(pixelCount, 64, [&](uint32_t begin, uint32_t end)
+		{
+			SphereTracingStats chunkStats = {};
+			for (auto i = begin; i < end; ++i)
+			{
+				const auto origin = XMLoadFloat3(&positions[i]);
+				for (auto j = 0u; j < rayCountPerPixel; ++j)
+				{
+					const auto u = Hash(static_cast<float>(rayCountPerPixel * i + j) * 2.0f + 1.0f);
+					const auto v = Hash(static_cast<float>(rayCountPerPixel * i + j) * 2.0f + 2.0f);
+					const auto disp = XMVectorLerpV(lightMin, lightMax, XMVectorSet(u, 0.5f, v, 0.0f)) - origin;
+					const auto L = XMVector3Normalize(disp);
+					const auto coneRadius = fabsf(XMVectorGetY(L)) * lightMaxDim;
+					shadows[rayCountPerPixel * i + j] = traceCone(origin, L, tMin, XMVectorGetX(XMVector3Length(disp)),
+						coneRadius, chunkStats).z;
+				}
+			}
+
+			lock_guard<mutex> lock(statsMutex);
+			stats += chunkStats;
+		});
+
+		return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	};
+
+	const auto report = [&](const char* name, double time, const vector<float>& refShadows,
+		const vector<float>& shadows, const SphereTracingStats& stats)
+	{
+		// Shadow terms of single rays depend on where the samples land, so compare percentiles
+		vector<float> errors(shadows.size());
+		auto errorSum = 0.0;
+		for (size_t i = 0; i < shadows.size(); ++i)
+		{
+			errors[i] = fabsf(shadows[i] - refShadows[i]);
+			errorSum += errors[i];
+		}
+		sort(errors.begin(), errors.end());
+		const auto outlierCount = errors.end() - upper_bound(errors.begin(), errors.end(), 0.1f);
+
+		const auto rayCount = static_cast<double>(stats.RayCount);
+		os << name << ": " << time << " ms, " << stats.StepCount / rayCount << " steps per ray ("
+			<< stats.SampleCount / rayCount << " SDF samples, " << stats.RejectedStepCount / rayCount
+			<< " rejected), shadow error mean " << errorSum / errors.size()
+			<< ", 99th percentile " << errors[errors.size() * 99 / 100] << ", " << 100.0 * outlierCount / errors.size()
+			<< "% of rays off by more than 0.1" << endl;
+		os << "  steps histogram (bins of " << SphereTracingStats::HistogramBinWidth << ", %):";
+		for (const auto& count : stats.StepHistogram) os << " " << setprecision(1) << 100.0 * count / rayCount;
+		os << setprecision(3) << endl;
+	};
+
+	// Reference: SDFVolume::TraceCone(), the CPU copy of the shader
+	vector<float> refShadows, shadows;
+	SphereTracingStats stats;
+	const auto refTime = traceShadows([&](FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax,
+		float coneRadius, SphereTracingStats& stats)
+	{
+		++stats.RayCount;
+		return scene.Volume.TraceCone(origin, dir, tMin, tMax, coneRadius);
+	}, refShadows, stats);
+	os << gridSize << "^3, " << pixelCount * rayCountPerPixel << " shadow rays: SDFVolume::TraceCone() " << refTime << " ms" << endl;
+
+	SphereTracer<PLAIN_SPHERE_TRACING> plainTracer;
+	SphereTracer<OVER_RELAXED_SPHERE_TRACING> overRelaxedTracer;
+	plainTracer.Init(scene.Volume);
+	overRelaxedTracer.Init(scene.Volume);
+
+	auto time = traceShadows([&](FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax, float coneRadius,
+		SphereTracingStats& stats) { return plainTracer.TraceCone(origin, dir, tMin, tMax, coneRadius, stats); }, shadows, stats);
+	report("plain", time, refShadows, shadows, stats);
+
+	time = traceShadows([&](FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax, float coneRadius,
+		SphereTracingStats& stats) { return overRelaxedTracer.TraceCone(origin, dir, tMin, tMax, coneRadius, stats); }, shadows, stats);
+	report("over-relaxed", time, refShadows, shadows, stats);
+}
+
+void Benchmark::occupancySkipping(ostream& os, uint32_t gridSize, bool isCornellBox)
+{
+	// The Cornell box, or the shell with 64 panel lights in a volume 8 times larger
+	Scene scene;
+	if (isCornellBox) createCornellBox(scene, gridSize);
+	else
+	{
+		createScene(scene, gridSize, 64, 0, 8.0f);
+		placePanelLights(scene);
+	}
+
+	VolumeShader volumeShader;
+	volumeShader.Compact(scene.Volume);
+	vector<XMFLOAT3> positions, normals;
+	getPixels(scene, volumeShader.GetSurfaceVoxels(), positions, normals);
+
+	// Empty means at least two voxels away from any surface
+	const auto voxel = scene.Volume.GetVoxelSize();
+	OccupancyPyramid pyramid, fullPyramid;
+	pyramid.Build(scene.Volume, voxel * 2.0f);
+	fullPyramid.Build(scene.Volume, FLT_MAX);
+
+	// Per pixel: 4 shadow rays to jittered points on random lights, with the cone radius of
+	// CSShade, and 4 cosine-distributed AO rays over the range of CSShade
+	const auto rayCountPerPixel = 4u;
+	const auto pixelCount = static_cast<uint32_t>(positions.size());
+	const auto lightSourceCount = static_cast<uint32_t>(scene.LightSources.size());
+	const auto aoTMax = XMVectorGetX(XMVector3Length(XMLoadFloat3x4(&scene.Volume.GetVolumeWorld()).r[1])) * 0.5f;
+
+	const auto traceRays = [&](const OccupancyPyramid* pPyramid, vector<float>& shadows, vector<float>& hits,
+		SphereTracingStats& shadowStats, SphereTracingStats& aoStats)
+	{
+		shadows.assign(pixelCount * rayCountPerPixel, 0.0f);
+		hits.assign(pixelCount * rayCountPerPixel, 0.0f);
+		memset(&shadowStats, 0, sizeof(SphereTracingStats));
+		memset(&aoStats, 0, sizeof(SphereTracingStats));
+		mutex statsMutex;
+		const auto start = chrono::high_resolution_clock::now();
+		ParallelFor(pixelCount, 64, [&](uint32_t begin, uint32_t end)
+		{
+			SphereTracingStats chunkShadowStats = {}, chunkAOStats = {};
+			for (auto i = begin; i < end; ++i)
+			{
+				const auto origin = XMLoadFloat3(&positions[i]);
+				const auto nrm = XMLoadFloat3(&normals[i]);
+				for (auto j = 0u; j < rayCountPerPixel; ++j)
+				{
+					const auto rayIdx = rayCountPerPixel * i + j;
+					const auto u = Hash(3.0f * rayIdx + 1.0f), v = Hash(3.0f * rayIdx + 2.0f), w = Hash(3.0f * rayIdx + 3.0f);
+					const auto& lightSource = scene.LightSources[(min)(static_cast<uint32_t>(w * lightSourceCount), lightSourceCount - 1)];
+					const auto lightWorld = XMLoadFloat3x4(&lightSource.World);
+					const auto lMin = XMVector3Transform(XMLoadFloat4(&lightSource.Min), lightWorld);
+					const auto lMax = XMVector3Transform(XMLoadFloat4(&lightSource.Max), lightWorld);
+					const auto disp = XMVectorLerpV(lMin, lMax, XMVectorSet(u, 0.5f, v, 0.0f)) - origin;
+					const auto L = XMVector3Normalize(disp);
+
+					XMFLOAT3 lightExt;
+					XMStoreFloat3(&lightExt, (lMax - lMin) * 0.5f);
+					const auto lMinDim = (min)(lightExt.x, (min)(lightExt.y, lightExt.z));
+					const auto lMaxDim = (max)(lightExt.x, (max)(lightExt.y, lightExt.z));
+					const auto lOrient = XMVectorSet(lightExt.x <= lMinDim, lightExt.y <= lMinDim, lightExt.z <= lMinDim, 0.0f);
+					const auto coneRadius = fabsf(XMVectorGetX(XMVector3Dot(lOrient, L))) * lMaxDim;
+					const auto tMax = XMVectorGetX(XMVector3Length(disp));
+
+					const auto dir = ComputeDirectionCos(nrm, u, v);
+					auto t = 0.0f;
+					if (pPyramid)
+					{
+						shadows[rayIdx] = pPyramid->TraceCone(origin, L, voxel, tMax, coneRadius, chunkShadowStats).z;
+						hits[rayIdx] = pPyramid->Intersect(origin, dir, voxel, aoTMax, t, chunkAOStats) ? 1.0f : 0.0f;
+					}
+					else
+					{
+						shadows[rayIdx] = scene.Volume.TraceCone(origin, L, voxel, tMax, coneRadius).z;
+						hits[rayIdx] = scene.Volume.Intersect(origin, dir, voxel, aoTMax, t) ? 1.0f : 0.0f;
+					}
+				}
+			}
+
+			lock_guard<mutex> lock(statsMutex);
+			shadowStats += chunkShadowStats;
+			aoStats += chunkAOStats;
+		});
+
+		return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	};
+
+	const auto getMeanError = [](const vector<float>& refValues, const vector<float>& values, uint32_t& outlierCount)
+	{
+		auto errorSum = 0.0;
+		outlierCount = 0;
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			const auto error = fabsf(values[i] - refValues[i]);
+			errorSum += error;
+			if (error > 0.1f) ++outlierCount;
+		}
+
+		return errorSum / values.size();
+	};
+
+	vector<float> refShadows, refHits, fullShadows, fullHits, shadows, hits;
+	SphereTracingStats fullShadowStats, fullAOStats, shadowStats, aoStats;
+	const auto refTime = traceRays(nullptr, refShadows, refHits, shadowStats, aoStats);
+	traceRays(&fullPyramid, fullShadows, fullHits, fullShadowStats, fullAOStats);
+	const auto time = traceRays(&pyramid, shadows, hits, shadowStats, aoStats);
+
+	uint32_t fullOutlierCount, shadowOutlierCount, hitMismatchCount;
+	const auto fullError = getMeanError(refShadows, fullShadows, fullOutlierCount) + getMeanError(refHits, fullHits, hitMismatchCount);
+	const auto shadowError = getMeanError(refShadows, shadows, shadowOutlierCount);
+	getMeanError(refHits, hits, hitMismatchCount);
+
+	const auto& stats = pyramid.GetStats();
+	const auto rayCount = static_cast<double>(pixelCount * rayCountPerPixel);
+	os << (isCornellBox ? "Cornell box " : "shell, 8x volume ") << gridSize << "^3: build " << stats.BuildTime << " ms, "
+		<< stats.ByteCount / 1024.0 << " KB (SDF " << scene.Volume.GetVoxelCount() * sizeof(float) / (1024.0 * 1024.0)
+		<< " MB), " << 100.0 * stats.OccupiedBlockCount / stats.BlockCount << "% of blocks and "
+		<< 100.0 * stats.OccupiedSummaryCount / stats.SummaryCount << "% of summary cells occupied" << endl;
+	os << "  " << rayCount << " shadow and AO rays each: " << refTime << " ms -> " << time << " ms; SDF samples per shadow ray "
+		<< fullShadowStats.SampleCount / rayCount << " -> " << shadowStats.SampleCount / rayCount << " ("
+		<< shadowStats.CoarseStepCount / rayCount << " cells skipped), per AO ray " << fullAOStats.SampleCount / rayCount
+		<< " -> " << aoStats.SampleCount / rayCount << " (" << aoStats.CoarseStepCount / rayCount << " cells skipped)" << endl;
+	os << "  shadow error mean " << shadowError << " (" << 100.0 * shadowOutlierCount / rayCount << "% off by more than 0.1), "
+		<< 100.0 * hitMismatchCount / rayCount << "% AO hits differ; without skipping: error " << fullError << endl;
+}
+
+void Benchmark::analyticPrimitives(ostream& os, uint32_t gridSize)
+{
+	Scene scene;
+	createCornellBox(scene, gridSize);
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto voxelCount = scene.Volume.GetVoxelCount();
+	const auto& volumeWorld = scene.Volume.GetVolumeWorld();
+
+	// The same room as a scene's "Primitives": 5 wall slabs behind the quads, and the 2 boxes
+	// without their scaling
+	const auto size = 5.0f;
+	const char sceneString[] = R"({
+  "Primitives": [
+    { "Type": "Box", "Position": [ 0.0, -5.25, 0.0 ], "Size": [ 5.0, 0.25, 5.0 ] },
+    { "Type": "Box", "Position": [ 0.0, 5.25, 0.0 ], "Size": [ 5.0, 0.25, 5.0 ] },
+    { "Type": "Box", "Position": [ 0.0, 0.0, 5.25 ], "Size": [ 5.0, 5.0, 0.25 ] },
+    { "Type": "Box", "Position": [ -5.25, 0.0, 0.0 ], "Size": [ 0.25, 5.0, 5.0 ] },
+    { "Type": "Box", "Position": [ 5.25, 0.0, 0.0 ], "Size": [ 0.25, 5.0, 5.0 ] },
+    { "Type": "Box", "Position": [ 1.8, -3.5, -1.0 ], "Rotation": [ 0.0, -0.149438, 0.0, 0.988771 ], "Size": [ 1.5, 1.5, 1.5 ] },
+    { "Type": "Box", "Position": [ -1.6, -2.0, 1.5 ], "Rotation": [ 0.0, 0.149438, 0.0, 0.988771 ], "Size": [ 1.5, 3.0, 1.5 ] }
+  ]
+})";
+	tiny::TinyJson sceneReader;
+	vector<AnalyticPrimitive> primitives;
+	sceneReader.ReadJson(sceneString);
+	if (!AnalyticSDF::LoadPrimitives(sceneReader, primitives) || primitives.size() != 7)
+	{
+		os << "Invalid scene primitives" << endl;
+		return;
+	}
+
+	// Unknown types and sizes of the wrong arity are rejected
+	auto isValidationExact = true;
+	const char* const malformedStrings[] =
+	{
+		R"({ "Primitives": [ { "Type": "Cone", "Position": [ 0.0, 0.0, 0.0 ], "Size": [ 1.0, 1.0, 1.0 ] } ] })",
+		R"({ "Primitives": [ { "Type": "Sphere", "Position": [ 0.0, 0.0, 0.0 ], "Size": [ 1.0, 1.0, 1.0 ] } ] })",
+		R"({ "Primitives": [ { "Type": "Capsule", "Position": [ 0.0, 0.0, 0.0 ], "Size": [ 1.0 ] } ] })"
+	};
+	for (const auto& malformedString : malformedStrings)
+	{
+		tiny::TinyJson malformedReader;
+		vector<AnalyticPrimitive> malformedPrimitives;
+		malformedReader.ReadJson(malformedString);
+		if (AnalyticSDF::LoadPrimitives(malformedReader, malformedPrimitives)) isValidationExact = false;
+	}
+
+	// All triangles
+	SDFVolume meshVolume;
+	meshVolume.Init(gridSize, volumeWorld);
+	auto start = chrono::high_resolution_clock::now();
+	meshVolume.Voxelize(scene.Meshes.data(), scene.Matrices.data(), meshCount);
+	const auto meshTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	// All primitives
+	AnalyticSDF analyticSDF;
+	analyticSDF.Init(primitives.data(), static_cast<uint32_t>(primitives.size()));
+	SDFVolume primitiveVolume;
+	primitiveVolume.Init(gridSize, volumeWorld);
+	analyticSDF.Combine(primitiveVolume.GetSDF(), primitiveVolume);
+	const auto primitiveTime = analyticSDF.GetStats().CombineTime;
+
+	// Inside the room, where the quads and the slabs have the same closest points; signs are
+	// compared separately, since the triangle voxelizer's sign can leak along grid lines
+	auto errorSum = 0.0, maxError = 0.0;
+	auto comparedCount = 0u, signMismatchCount = 0u;
+	const auto voxel = scene.Volume.GetVoxelSize();
+	for (auto z = 0u; z < gridSize; ++z)
+		for (auto y = 0u; y < gridSize; ++y)
+			for (auto x = 0u; x < gridSize; ++x)
+			{
+				XMFLOAT3 pos;
+				XMStoreFloat3(&pos, meshVolume.GetVoxelCenter(x, y, z));
+				if (fabsf(pos.x) >= size - voxel || fabsf(pos.y) >= size - voxel || fabsf(pos.z) >= size - voxel) continue;
+
+				const auto i = meshVolume.GetVoxelIndex(x, y, z);
+				const auto meshDist = meshVolume.GetSDF()[i], primitiveDist = primitiveVolume.GetSDF()[i];
+				const auto error = fabsf(fabsf(primitiveDist) - fabsf(meshDist)) / voxel;
+				if ((meshDist < 0.0f) != (primitiveDist < 0.0f) && fabsf(meshDist) > voxel) ++signMismatchCount;
+				errorSum += error;
+				maxError = (max)(static_cast<double>(error), maxError);
+				++comparedCount;
+			}
+
+	os << gridSize << "^3: triangle voxelization " << meshTime << " ms, 7 box primitives " << primitiveTime
+		<< " ms; inside the room, |distance| error mean " << errorSum / comparedCount << " voxels, max " << maxError
+		<< " voxels, " << 100.0 * signMismatchCount / comparedCount << "% sign mismatches; malformed primitives "
+		<< (isValidationExact ? "rejected" : "accepted") << endl;
+
+	// Moving box: re-voxelizing every mesh, versus combining the static walls with the primitive again
+	SDFVolume wallVolume;
+	wallVolume.Init(gridSize, volumeWorld);
+	wallVolume.Voxelize(scene.Meshes.data(), scene.Matrices.data(), 1);
+	const vector<float> wallSDF(wallVolume.GetSDF(), wallVolume.GetSDF() + voxelCount);
+
+	AnalyticSDF boxSDF;
+	boxSDF.Init(primitives.data() + 5, 2);
+	auto worldMatrix = XMLoadFloat3x4(&scene.Matrices[1].World) * XMMatrixTranslation(0.5f, 0.0f, 0.0f);
+	XMStoreFloat3x4(&scene.Matrices[1].World, worldMatrix);
+	start = chrono::high_resolution_clock::now();
+	meshVolume.Voxelize(scene.Meshes.data(), scene.Matrices.data(), meshCount);
+	const auto revoxelizeTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	XMFLOAT3X4 world;
+	XMStoreFloat3x4(&world, XMLoadFloat3x4(&primitives[5].World) * XMMatrixTranslation(0.5f, 0.0f, 0.0f));
+	boxSDF.Update(0, world);
+	boxSDF.Combine(wallSDF.data(), wallVolume);
+	os << "moving box: re-voxelization " << revoxelizeTime << " ms, primitive update " << boxSDF.GetStats().CombineTime
+		<< " ms (" << boxSDF.GetStats().PrimitiveVoxelCount << " voxels closest to a box)" << endl;
+
+	// 4-wide batches versus one point per call, on random points in the room
+	const auto pointCount = 1u << 20;
+	vector<XMFLOAT3> points(pointCount);
+	vector<float> distances(pointCount), scalarDistances(pointCount);
+	for (auto i = 0u; i < pointCount; ++i)
+		points[i] = XMFLOAT3(Hash(3.0f * i + 1.0f) * 10.0f - 5.0f, Hash(3.0f * i + 2.0f) * 10.0f - 5.0f, Hash(3.0f * i + 3.0f) * 10.0f - 5.0f);
+
+	start = chrono::high_resolution_clock::now();
+	analyticSDF.Evaluate(points.data(), pointCount, distances.data());
+	const auto batchTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	start = chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < pointCount; ++i)
+	{
+		const auto& p = points[i];
+		scalarDistances[i] = XMVectorGetX(analyticSDF.Evaluate(XMVectorReplicate(p.x), XMVectorReplicate(p.y), XMVectorReplicate(p.z)));
+	}
+	const auto scalarTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	auto mismatchCount = 0u;
+	for (auto i = 0u; i < pointCount; ++i) if (distances[i] != scalarDistances[i]) ++mismatchCount;
+	os << pointCount << " points x 7 primitives: 4-wide batches " << batchTime << " ms, one point per call " << scalarTime
+		<< " ms, " << mismatchCount << " mismatches" << endl;
+}
+
+void Benchmark::rigidSDFTransfer(ostream& os, uint32_t gridSize, uint32_t localGridSize)
+{
+	Scene scene;
+	createCornellBox(scene, gridSize);
+	const auto meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	const auto& volumeWorld = scene.Volume.GetVolumeWorld();
+	const auto voxel = scene.Volume.GetVoxelSize();
+
+	// Static/dynamic split: the room is voxelized once, the 2 boxes go to local volumes
+	SDFVolume staticVolume;
+	staticVolume.Init(gridSize, volumeWorld);
+	staticVolume.Voxelize(scene.Meshes.data(), scene.Matrices.data(), 1);
+
+	RigidSDFTransfer transfer;
+	transfer.Init(staticVolume);
+	vector<XMFLOAT3X4> restWorlds(meshCount);
+	for (auto i = 1u; i < meshCount; ++i)
+	{
+		restWorlds[i] = scene.Matrices[i].World;
+		transfer.AddMesh(scene.Meshes[i], i, restWorlds[i], localGridSize);
+	}
+
+	SDFVolume volume = staticVolume;
+	SDFVolume reference;
+	const auto frameCount = 3u;
+	auto revoxelizeTime = 0.0, transferTime = 0.0, errorSum = 0.0, maxError = 0.0;
+	vector<double> objectTimes(meshCount - 1);
+	uint64_t comparedCount = 0, signMismatchCount = 0, surfaceCount = 0, idMatchCount = 0;
+	uint64_t farCount = 0, overestimateCount = 0;
+	for (auto frame = 1u; frame <= frameCount; ++frame)
+	{
+		// Each box spins about its own center and slides a little
+		for (auto i = 1u; i < meshCount; ++i)
+		{
+			const auto restWorld = XMLoadFloat3x4(&restWorlds[i]);
+			const auto center = restWorld.r[3];
+			const auto angle = (i & 1 ? 0.35f : -0.35f) * frame;
+			const auto world = restWorld * XMMatrixTranslationFromVector(-center) * XMMatrixRotationY(angle) *
+				XMMatrixTranslationFromVector(center + XMVectorSet(i & 1 ? -0.15f : 0.15f, 0.0f, 0.0f, 0.0f) * static_cast<float>(frame));
+			XMStoreFloat3x4(&scene.Matrices[i].World, world);
+			XMStoreFloat3x4(&scene.Matrices[i].WorldIT, XMMatrixTranspose(XMMatrixInverse(nullptr, world)));
+		}
+
+		auto start = chrono::high_resolution_clock::now();
+		reference.Init(gridSize, volumeWorld);
+		reference.Voxelize(scene.Meshes.data(), scene.Matrices.data(), meshCount);
+		revoxelizeTime += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+		transfer.Update(volume, scene.Matrices.data());
+		transferTime += transfer.GetStats().RestoreTime + transfer.GetStats().ResampleTime;
+		for (auto i = 1u; i < meshCount; ++i) objectTimes[i - 1] += transfer.GetObjectStats(i - 1).ResampleTime;
+
+		// Narrow band, where the tracers and the shading read the field; signs are compared
+		// separately, since min() keeps the inside of a box resting on the floor negative
+		// while the closest-triangle voxelization takes the floor's sign there
+		for (auto i = 0u; i < reference.GetVoxelCount(); ++i)
+		{
+			const auto refDist = reference.GetSDF()[i], dist = volume.GetSDF()[i];
+			if (fabsf(refDist) >= 4.0f * voxel)
+			{
+				// Away from the band, the field only has to stay a lower bound for sphere tracing
+				overestimateCount += fabsf(dist) > fabsf(refDist) + voxel ? 1 : 0;
+				++farCount;
+				continue;
+			}
+
+			const auto error = fabsf(fabsf(dist) - fabsf(refDist)) / voxel;
+			if ((dist < 0.0f) != (refDist < 0.0f)) ++signMismatchCount;
+			errorSum += error;
+			maxError = (max)(static_cast<double>(error), maxError);
+			++comparedCount;
+
+			if (!reference.GetIds()[i]) continue;
+			idMatchCount += volume.GetIds()[i] == reference.GetIds()[i] ? 1 : 0;
+			++surfaceCount;
+		}
+	}
+
+	os << gridSize << "^3 with " << localGridSize << "^3 local volumes: bake " << transfer.GetStats().BakeTime
+		<< " ms once; per frame, re-voxelization " << revoxelizeTime / frameCount << " ms, transfer "
+		<< transferTime / frameCount << " ms (";
+	for (auto i = 1u; i < meshCount; ++i) os << "box " << i << ": " << objectTimes[i - 1] / frameCount << " ms, ";
+	os << transfer.GetStats().ResampledVoxelCount << " voxels resampled, " << transfer.GetStats().ClampedVoxelCount
+		<< " clamped)" << endl;
+	os << "  narrow-band |distance| error mean " << errorSum / comparedCount << " voxels, max " << maxError << " voxels, "
+		<< 100.0 * signMismatchCount / comparedCount << "% sign mismatches; surface ids matching "
+		<< 100.0 * idMatchCount / surfaceCount << "%; beyond the band, " << 100.0 * overestimateCount / farCount
+		<< "% of voxels overestimate |distance| by more than a voxel" << endl;
+}
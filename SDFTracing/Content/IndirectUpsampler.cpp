@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "IndirectUpsampler.h"
+#include "SDFVolume.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+const float IndirectUpsampler::DepthSigma = 0.1f;
+
+IndirectUpsampler::IndirectUpsampler() :
+	m_width(0),
+	m_height(0),
+	m_lowResWidth(0),
+	m_lowResHeight(0),
+	m_downsampleFactor(2),
+	m_stats()
+{
+}
+
+IndirectUpsampler::~IndirectUpsampler()
+{
+}
+
+void IndirectUpsampler::Init(uint32_t width, uint32_t height, uint8_t downsampleFactor)
+{
+	m_width = width;
+	m_height = height;
+	m_downsampleFactor = downsampleFactor;
+	m_lowResWidth = (width + downsampleFactor - 1) / downsampleFactor;
+	m_lowResHeight = (height + downsampleFactor - 1) / downsampleFactor;
+
+	m_samples.resize(m_lowResWidth * m_lowResHeight);
+}
+
+void IndirectUpsampler::Trace(const VisibilityBuffer& visibility, const SDFVolume& volume,
+	const IrradianceMipBuilder& mipBuilder, float tMin, float tMax, uint32_t sampleCount)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	const auto pVisibility = visibility.GetVisibility();
+	const auto pPositions = visibility.GetPositions();
+	const auto pNormals = visibility.GetNormals();
+	const auto pDepths = visibility.GetDepths();
+	const auto factor = m_downsampleFactor;
+
+	atomic<uint32_t> tracedPixelCount(0);
+	ParallelFor(m_lowResHeight, 1, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t count = 0;
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_lowResWidth; ++x)
+			{
+				// The covered pixel of the block closest to its center
+				auto pixel = UINT32_MAX;
+				const auto center = (factor - 1) * 0.5f;
+				auto minDistSq = static_cast<float>(factor * factor);
+				for (auto j = 0u; j < factor; ++j)
+					for (auto k = 0u; k < factor; ++k)
+					{
+						const auto px = x * factor + k, py = y * factor + j;
+						if (px >= m_width || py >= m_height) continue;
+
+						const auto i = m_width * py + px;
+						const auto distSq = (k - center) * (k - center) + (j - center) * (j - center);
+						if (pVisibility[i] && distSq < minDistSq)
+						{
+							pixel = i;
+							minDistSq = distSq;
+						}
+					}
+
+				auto& sample = m_samples[m_lowResWidth * y + x];
+				if (pixel == UINT32_MAX)
+				{
+					sample.Irradiance = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+					sample.MeshId = 0;
+					continue;
+				}
+
+				XMStoreFloat4(&sample.Irradiance, volume.TraceIndirect(XMLoadFloat3(&pPositions[pixel]),
+					XMLoadFloat3(&pNormals[pixel]), tMin, tMax, mipBuilder, sampleCount));
+				sample.Nrm = pNormals[pixel];
+				sample.Depth = pDepths[pixel];
+				sample.MeshId = DecodeVisibility(pVisibility[pixel]).MeshId + 1;
+				++count;
+			}
+
+		tracedPixelCount += count;
+	});
+
+	m_stats.TracedPixelCount = tracedPixelCount;
+	m_stats.TraceTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+//--------------------------------------------------------------------------------------
+// Joint-bilateral upsampling: bilinear weights of the 4 nearest low-resolution samples,
+// times same mesh, max(dot(n_p, n_q), 0)^NormalPower and the relative depth difference;
+// pixels left without a compatible sample widen the search to the surrounding 4x4
+//--------------------------------------------------------------------------------------
+void IndirectUpsampler::Upsample(const VisibilityBuffer& visibility, XMFLOAT4* pResult)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	const auto pVisibility = visibility.GetVisibility();
+	const auto pNormals = visibility.GetNormals();
+	const auto pDepths = visibility.GetDepths();
+	const auto lowResWidth = static_cast<int32_t>(m_lowResWidth);
+	const auto lowResHeight = static_cast<int32_t>(m_lowResHeight);
+	const auto factorInv = 1.0f / m_downsampleFactor;
+
+	atomic<uint32_t> fallbackPixelCount(0);
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t count = 0;
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = m_width * y + x;
+				if (!pVisibility[i])
+				{
+					pResult[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+					continue;
+				}
+
+				const auto meshId = DecodeVisibility(pVisibility[i]).MeshId + 1;
+				const auto& nrm = pNormals[i];
+				const auto depth = pDepths[i];
+				const auto getWeight = [&](const Sample& sample)
+				{
+					if (sample.MeshId != meshId) return 0.0f;
+
+					auto normalWeight = (max)(nrm.x * sample.Nrm.x + nrm.y * sample.Nrm.y + nrm.z * sample.Nrm.z, 0.0f);
+					for (auto p = 1u; p < NormalPower; p <<= 1) normalWeight *= normalWeight;
+
+					return normalWeight * expf(-fabsf(sample.Depth - depth) / (DepthSigma * depth));
+				};
+
+				const auto u = (x + 0.5f) * factorInv - 0.5f;
+				const auto v = (y + 0.5f) * factorInv - 0.5f;
+				const auto x0 = static_cast<int32_t>(floorf(u)), y0 = static_cast<int32_t>(floorf(v));
+				const auto fu = u - x0, fv = v - y0;
+
+				auto sum = XMVectorZero();
+				auto weightSum = 0.0f;
+				for (uint8_t k = 0; k < 4; ++k)
+				{
+					const auto tx = (min)((max)(x0 + (k & 1), 0), lowResWidth - 1);
+					const auto ty = (min)((max)(y0 + (k >> 1), 0), lowResHeight - 1);
+					const auto& sample = m_samples[lowResWidth * ty + tx];
+					const auto bilinear = (k & 1 ? fu : 1.0f - fu) * (k & 2 ? fv : 1.0f - fv);
+					const auto weight = (max)(bilinear, 1e-3f) * getWeight(sample);
+					sum = XMVectorMultiplyAdd(XMLoadFloat4(&sample.Irradiance), XMVectorReplicate(weight), sum);
+					weightSum += weight;
+				}
+
+				if (weightSum < 1e-4f)
+				{
+					++count;
+					for (auto ty = (max)(y0 - 1, 0); ty <= (min)(y0 + 2, lowResHeight - 1); ++ty)
+						for (auto tx = (max)(x0 - 1, 0); tx <= (min)(x0 + 2, lowResWidth - 1); ++tx)
+						{
+							const auto& sample = m_samples[lowResWidth * ty + tx];
+							const auto weight = sample.MeshId == meshId ? (max)(getWeight(sample), 1e-4f) : 0.0f;
+							sum = XMVectorMultiplyAdd(XMLoadFloat4(&sample.Irradiance), XMVectorReplicate(weight), sum);
+							weightSum += weight;
+						}
+				}
+
+				XMStoreFloat4(&pResult[i], weightSum > 0.0f ? sum / weightSum : XMVectorZero());
+			}
+
+		fallbackPixelCount += count;
+	});
+
+	m_stats.FallbackPixelCount = fallbackPixelCount;
+	m_stats.UpsampleTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+uint32_t IndirectUpsampler::GetLowResWidth() const
+{
+	return m_lowResWidth;
+}
+
+uint32_t IndirectUpsampler::GetLowResHeight() const
+{
+	return m_lowResHeight;
+}
+
+const IndirectUpsampler::Stats& IndirectUpsampler::GetStats() const
+{
+	return m_stats;
+}
@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VisibilityBuffer.h"
+
+class SDFVolume;
+class IrradianceMipBuilder;
+
+//--------------------------------------------------------------------------------------
+// Reduced-rate indirect lighting: TraceIndirect() runs once per 2x2 or 4x4 pixel block
+// at a representative covered pixel, and the full-resolution result is upsampled
+// joint-bilaterally with same-mesh, normal and depth weights from the visibility buffer
+//--------------------------------------------------------------------------------------
+class IndirectUpsampler
+{
+public:
+	struct Stats
+	{
+		double TraceTime;		// ms
+		double UpsampleTime;	// ms
+		uint32_t TracedPixelCount;
+		uint32_t FallbackPixelCount;	// Full-resolution pixels without a compatible low-resolution sample
+	};
+
+	IndirectUpsampler();
+	virtual ~IndirectUpsampler();
+
+	void Init(uint32_t width, uint32_t height, uint8_t downsampleFactor = 2);
+	void Trace(const VisibilityBuffer& visibility, const SDFVolume& volume, const IrradianceMipBuilder& mipBuilder,
+		float tMin, float tMax, uint32_t sampleCount = 32);
+	void Upsample(const VisibilityBuffer& visibility, DirectX::XMFLOAT4* pResult);
+
+	uint32_t GetLowResWidth() const;
+	uint32_t GetLowResHeight() const;
+	const Stats& GetStats() const;
+
+	static const uint32_t NormalPower = 32;	// Normal weight: max(dot(n_p, n_q), 0)^NormalPower
+	static const float DepthSigma;			// Tolerance relative to the view depth
+
+protected:
+	// Low-resolution sample with the guide of the full-resolution pixel it was traced at
+	struct Sample
+	{
+		DirectX::XMFLOAT4 Irradiance;
+		DirectX::XMFLOAT3 Nrm;
+		float Depth;
+		uint32_t MeshId;	// 0 for background
+	};
+
+	std::vector<Sample> m_samples;
+
+	uint32_t	m_width;
+	uint32_t	m_height;
+	uint32_t	m_lowResWidth;
+	uint32_t	m_lowResHeight;
+	uint8_t		m_downsampleFactor;
+
+	Stats m_stats;
+};
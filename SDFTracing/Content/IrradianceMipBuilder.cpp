@@ -0,0 +1,220 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "IrradianceMipBuilder.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+IrradianceMipBuilder::IrradianceMipBuilder() :
+	m_gridSize(0),
+	m_stats()
+{
+}
+
+IrradianceMipBuilder::~IrradianceMipBuilder()
+{
+}
+
+void IrradianceMipBuilder::Init(uint32_t gridSize, uint8_t levelCount)
+{
+	m_gridSize = gridSize;
+
+	// Full mip chain by default
+	if (levelCount == 0)
+		for (auto size = gridSize; size > 0; size >>= 1) ++levelCount;
+
+	m_levels.resize(levelCount);
+	m_dirtyRegions.resize(levelCount);
+	for (uint8_t i = 0; i < levelCount; ++i)
+	{
+		const auto size = GetLevelSize(i);
+		m_levels[i].assign(size * size * size, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+		m_dirtyRegions[i].clear();
+	}
+
+	const auto brickGridSize = GetRegionGridSize(0);
+	m_stats.BrickCount = brickGridSize * brickGridSize * brickGridSize;
+	m_regionFlags.assign(m_stats.BrickCount, 0);
+}
+
+void IrradianceMipBuilder::Build()
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	const auto levelCount = GetLevelCount();
+	for (uint8_t i = 1; i < levelCount; ++i)
+	{
+		const auto regionGridSize = GetRegionGridSize(i);
+		ParallelFor(regionGridSize * regionGridSize * regionGridSize, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto j = begin; j < end; ++j) downsampleRegion(i, j);
+		});
+	}
+
+	m_stats.BuildTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void IrradianceMipBuilder::Update(const uint8_t* pDirtyBricks)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	auto& dirtyBricks = m_dirtyRegions[0];
+	dirtyBricks.clear();
+	for (auto i = 0u; i < m_stats.BrickCount; ++i)
+		if (pDirtyBricks[i]) dirtyBricks.emplace_back(i);
+
+	// Propagate the dirty regions of each level to the parent regions of the next one
+	m_stats.TexelCount = 0;
+	const auto levelCount = GetLevelCount();
+	for (uint8_t i = 1; i < levelCount; ++i)
+	{
+		const auto childRegionSize = GetRegionSize(i - 1);
+		const auto childRegionGridSize = GetRegionGridSize(i - 1);
+		const auto regionSize = GetRegionSize(i);
+		const auto regionGridSize = GetRegionGridSize(i);
+
+		auto& dirtyRegions = m_dirtyRegions[i];
+		dirtyRegions.clear();
+		fill_n(m_regionFlags.begin(), regionGridSize * regionGridSize * regionGridSize, 0);
+		for (const auto& childRegion : m_dirtyRegions[i - 1])
+		{
+			const auto x = childRegion % childRegionGridSize * childRegionSize / 2 / regionSize;
+			const auto y = childRegion / childRegionGridSize % childRegionGridSize * childRegionSize / 2 / regionSize;
+			const auto z = childRegion / (childRegionGridSize * childRegionGridSize) * childRegionSize / 2 / regionSize;
+			const auto region = (regionGridSize * z + y) * regionGridSize + x;
+			if (m_regionFlags[region]) continue;
+			m_regionFlags[region] = 1;
+			dirtyRegions.emplace_back(region);
+		}
+
+		// Regions of the same level are disjoint
+		ParallelFor(static_cast<uint32_t>(dirtyRegions.size()), 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto j = begin; j < end; ++j) downsampleRegion(i, dirtyRegions[j]);
+		});
+
+		const auto texelCount = (min)(regionSize, GetLevelSize(i));
+		m_stats.TexelCount += static_cast<uint32_t>(dirtyRegions.size()) * texelCount * texelCount * texelCount;
+	}
+
+	m_stats.DirtyBrickCount = static_cast<uint32_t>(dirtyBricks.size());
+	m_stats.UpdateTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+XMVECTOR IrradianceMipBuilder::SampleLevel(FXMVECTOR uvw, float level) const
+{
+	level = (min)((max)(level, 0.0f), static_cast<float>(GetLevelCount() - 1));
+	const auto level0 = static_cast<uint8_t>(level);
+	const auto level1 = static_cast<uint8_t>((min)(level0 + 1, GetLevelCount() - 1));
+
+	return XMVectorLerp(sampleTexel(level0, uvw), sampleTexel(level1, uvw), level - level0);
+}
+
+XMFLOAT4* IrradianceMipBuilder::GetLevel(uint8_t level)
+{
+	return m_levels[level].data();
+}
+
+const XMFLOAT4* IrradianceMipBuilder::GetLevel(uint8_t level) const
+{
+	return m_levels[level].data();
+}
+
+uint32_t IrradianceMipBuilder::GetLevelSize(uint8_t level) const
+{
+	return (max)(m_gridSize >> level, 1u);
+}
+
+uint8_t IrradianceMipBuilder::GetLevelCount() const
+{
+	return static_cast<uint8_t>(m_levels.size());
+}
+
+const vector<uint32_t>& IrradianceMipBuilder::GetDirtyRegions(uint8_t level) const
+{
+	return m_dirtyRegions[level];
+}
+
+uint32_t IrradianceMipBuilder::GetRegionSize(uint8_t level) const
+{
+	return (max)(BrickSize >> level, 1u);
+}
+
+uint32_t IrradianceMipBuilder::GetRegionGridSize(uint8_t level) const
+{
+	const auto regionSize = GetRegionSize(level);
+
+	return (GetLevelSize(level) + regionSize - 1) / regionSize;
+}
+
+const IrradianceMipBuilder::Stats& IrradianceMipBuilder::GetStats() const
+{
+	return m_stats;
+}
+
+//--------------------------------------------------------------------------------------
+// 2x2x2 box filter of the premultiplied irradiance: TraceIndirect() divides the result
+// by w, which makes it the alpha-weighted average of the covered child voxels
+//--------------------------------------------------------------------------------------
+void IrradianceMipBuilder::downsampleRegion(uint8_t level, uint32_t region)
+{
+	const auto size = GetLevelSize(level);
+	const auto childSize = GetLevelSize(level - 1);
+	const auto regionSize = GetRegionSize(level);
+	const auto regionGridSize = GetRegionGridSize(level);
+	const auto pChild = m_levels[level - 1].data();
+	const auto pParent = m_levels[level].data();
+
+	const auto x0 = region % regionGridSize * regionSize;
+	const auto y0 = region / regionGridSize % regionGridSize * regionSize;
+	const auto z0 = region / (regionGridSize * regionGridSize) * regionSize;
+	const auto x1 = (min)(x0 + regionSize, size);
+	const auto y1 = (min)(y0 + regionSize, size);
+	const auto z1 = (min)(z0 + regionSize, size);
+
+	for (auto z = z0; z < z1; ++z)
+		for (auto y = y0; y < y1; ++y)
+			for (auto x = x0; x < x1; ++x)
+			{
+				auto sum = XMVectorZero();
+				for (uint8_t i = 0; i < 8; ++i)
+				{
+					const auto cx = (min)(x * 2 + (i & 1), childSize - 1);
+					const auto cy = (min)(y * 2 + ((i >> 1) & 1), childSize - 1);
+					const auto cz = (min)(z * 2 + (i >> 2), childSize - 1);
+					sum += XMLoadFloat4(&pChild[(childSize * cz + cy) * childSize + cx]);
+				}
+
+				XMStoreFloat4(&pParent[(size * z + y) * size + x], sum * 0.125f);
+			}
+}
+
+XMVECTOR IrradianceMipBuilder::sampleTexel(uint8_t level, FXMVECTOR uvw) const
+{
+	const auto size = GetLevelSize(level);
+	const auto pTexels = m_levels[level].data();
+
+	XMFLOAT3 coord;
+	XMStoreFloat3(&coord, XMVectorClamp(uvw * static_cast<float>(size) - XMVectorReplicate(0.5f),
+		XMVectorZero(), XMVectorReplicate(static_cast<float>(size - 1))));
+
+	const uint32_t c0[] = { static_cast<uint32_t>(coord.x), static_cast<uint32_t>(coord.y), static_cast<uint32_t>(coord.z) };
+	const uint32_t c1[] = { (min)(c0[0] + 1, size - 1), (min)(c0[1] + 1, size - 1), (min)(c0[2] + 1, size - 1) };
+	const float f[] = { coord.x - c0[0], coord.y - c0[1], coord.z - c0[2] };
+
+	auto result = XMVectorZero();
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		const auto x = i & 1 ? c1[0] : c0[0];
+		const auto y = i & 2 ? c1[1] : c0[1];
+		const auto z = i & 4 ? c1[2] : c0[2];
+		const auto weight = (i & 1 ? f[0] : 1.0f - f[0]) * (i & 2 ? f[1] : 1.0f - f[1]) * (i & 4 ? f[2] : 1.0f - f[2]);
+		result += XMLoadFloat4(&pTexels[(size * z + y) * size + x]) * weight;
+	}
+
+	return result;
+}
@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SDFVolume.h"
+
+//--------------------------------------------------------------------------------------
+// Incremental mip chain of the irradiance volume: only the parents of dirty 8^3 bricks
+// at level 0 are regenerated, so the cost scales with the changed area
+//--------------------------------------------------------------------------------------
+class IrradianceMipBuilder
+{
+public:
+	struct Stats
+	{
+		double UpdateTime;	// ms
+		double BuildTime;	// ms
+		uint32_t DirtyBrickCount;
+		uint32_t BrickCount;
+		uint32_t TexelCount;
+	};
+
+	IrradianceMipBuilder();
+	virtual ~IrradianceMipBuilder();
+
+	void Init(uint32_t gridSize, uint8_t levelCount = 0);
+	void Build();
+	void Update(const uint8_t* pDirtyBricks);
+
+	// Trilinear filtering between the two nearest levels with LINEAR_CLAMP addressing
+	DirectX::XMVECTOR SampleLevel(DirectX::FXMVECTOR uvw, float level) const;
+
+	DirectX::XMFLOAT4* GetLevel(uint8_t level);
+	const DirectX::XMFLOAT4* GetLevel(uint8_t level) const;
+	uint32_t GetLevelSize(uint8_t level) const;
+	uint8_t GetLevelCount() const;
+
+	// Dirty regions of each level, for the GPU path to dispatch the same work
+	const std::vector<uint32_t>& GetDirtyRegions(uint8_t level) const;
+	uint32_t GetRegionSize(uint8_t level) const;
+	uint32_t GetRegionGridSize(uint8_t level) const;
+	const Stats& GetStats() const;
+
+	static const uint32_t BrickSize = 8;
+
+protected:
+	void downsampleRegion(uint8_t level, uint32_t region);
+	DirectX::XMVECTOR sampleTexel(uint8_t level, DirectX::FXMVECTOR uvw) const;
+
+	std::vector<std::vector<DirectX::XMFLOAT4>>	m_levels;
+	std::vector<std::vector<uint32_t>>			m_dirtyRegions;
+	std::vector<uint8_t>						m_regionFlags;
+
+	uint32_t m_gridSize;
+
+	Stats m_stats;
+};
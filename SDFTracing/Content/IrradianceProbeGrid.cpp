@@ -0,0 +1,373 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include "IrradianceProbeGrid.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace PackedVector;
+
+IrradianceProbeGrid::IrradianceProbeGrid() :
+	m_probeGridSize(0),
+	m_probeSpacing(0.0f),
+	m_stats()
+{
+}
+
+IrradianceProbeGrid::~IrradianceProbeGrid()
+{
+}
+
+void IrradianceProbeGrid::Init(const SDFVolume& volume, uint32_t probeSpacing)
+{
+	m_volumeWorld = volume.GetVolumeWorld();
+	m_volumeWorldI = volume.GetVolumeWorldI();
+	m_probeGridSize = (max)(volume.GetGridSize() / probeSpacing, 1u);
+	m_probeSpacing = volume.GetVoxelSize() * volume.GetGridSize() / m_probeGridSize;
+
+	const auto probeCount = m_probeGridSize * m_probeGridSize * m_probeGridSize;
+	m_probeIndices.assign(probeCount, UINT32_MAX);
+	m_offsets.assign(probeCount, XMHALF4());
+	m_irradiance.clear();
+	m_distances.clear();
+
+	m_stats = Stats();
+	m_stats.ProbeCount = probeCount;
+}
+
+//--------------------------------------------------------------------------------------
+// Pushes probes that are inside or too close to geometry out along the SDF gradient,
+// within 0.45 of the spacing, and allocates the probes near surfaces
+//--------------------------------------------------------------------------------------
+void IrradianceProbeGrid::Relocate(const SDFVolume& volume)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	const auto minDist = m_probeSpacing * 0.25f;
+	const auto maxOffset = XMVectorReplicate(m_probeSpacing * 0.45f);
+	const auto eps = volume.GetVoxelSize() * 0.5f;
+	const auto getGradient = [&](FXMVECTOR pos)
+	{
+		const auto dx = volume.Sample(pos + XMVectorSet(eps, 0.0f, 0.0f, 0.0f)) - volume.Sample(pos - XMVectorSet(eps, 0.0f, 0.0f, 0.0f));
+		const auto dy = volume.Sample(pos + XMVectorSet(0.0f, eps, 0.0f, 0.0f)) - volume.Sample(pos - XMVectorSet(0.0f, eps, 0.0f, 0.0f));
+		const auto dz = volume.Sample(pos + XMVectorSet(0.0f, 0.0f, eps, 0.0f)) - volume.Sample(pos - XMVectorSet(0.0f, 0.0f, eps, 0.0f));
+
+		return XMVector3Normalize(XMVectorSet(dx, dy, dz, 0.0f));
+	};
+
+	atomic<uint32_t> relocatedCount(0);
+	ParallelFor(m_probeGridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t count = 0;
+		for (auto z = begin; z < end; ++z)
+			for (auto y = 0u; y < m_probeGridSize; ++y)
+				for (auto x = 0u; x < m_probeGridSize; ++x)
+				{
+					const auto i = (m_probeGridSize * z + y) * m_probeGridSize + x;
+					m_offsets[i] = XMHALF4();
+					const auto basePos = GetProbePosition(x, y, z);
+
+					auto offset = XMVectorZero();
+					for (uint8_t j = 0; j < 4; ++j)
+					{
+						const auto pos = basePos + offset;
+						const auto dist = volume.Sample(pos);
+						if (dist >= minDist) break;
+						offset = XMVectorClamp(offset + getGradient(pos) * (minDist - dist), -maxOffset, maxOffset);
+					}
+
+					if (!XMVector3Equal(offset, XMVectorZero())) ++count;
+					XMStoreHalf4(&m_offsets[i], offset);
+				}
+
+		relocatedCount += count;
+	});
+
+	// Probes still inside geometry or away from any surface are never interpolated
+	auto activeProbeCount = 0u;
+	for (auto z = 0u; z < m_probeGridSize; ++z)
+		for (auto y = 0u; y < m_probeGridSize; ++y)
+			for (auto x = 0u; x < m_probeGridSize; ++x)
+			{
+				const auto i = (m_probeGridSize * z + y) * m_probeGridSize + x;
+				const auto dist = volume.Sample(GetProbePosition(x, y, z));
+				m_probeIndices[i] = dist >= 0.0f && dist < 2.0f * m_probeSpacing ? activeProbeCount++ : UINT32_MAX;
+			}
+
+	const auto irradianceSize = IrradianceTexels + 2;
+	const auto distanceSize = DistanceTexels + 2;
+	m_irradiance.assign(activeProbeCount * irradianceSize * irradianceSize, XMFLOAT3PK());
+	m_distances.assign(activeProbeCount * distanceSize * distanceSize, XMHALF2());
+
+	m_stats.ActiveProbeCount = activeProbeCount;
+	m_stats.RelocatedProbeCount = relocatedCount;
+	m_stats.ByteCount = sizeof(uint32_t) * m_probeIndices.size() + sizeof(XMHALF4) * m_offsets.size() +
+		sizeof(XMFLOAT3PK) * m_irradiance.size() + sizeof(XMHALF2) * m_distances.size();
+	m_stats.RelocateTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+//--------------------------------------------------------------------------------------
+// Evaluates TraceIndirect() at every active probe for each irradiance texel direction, and
+// sphere-traces the probe rays through the SDF to blend the hit distances (sharp lobes)
+// into the distance moments
+//--------------------------------------------------------------------------------------
+void IrradianceProbeGrid::Update(const SDFVolume& volume, const IrradianceMipBuilder& irradiance,
+	uint32_t rayCount, uint32_t sampleCount)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	// Same ray extent as CSShade
+	const auto tMin = volume.GetVoxelSize();
+	const auto tMax = XMVectorGetX(XMVector3Length(XMLoadFloat3x4(&m_volumeWorld).r[1])) * 0.5f;
+	const auto maxDist = m_probeSpacing * 2.0f;
+
+	// Fibonacci sphere directions
+	vector<XMFLOAT3> dirs(rayCount);
+	for (auto i = 0u; i < rayCount; ++i)
+	{
+		const auto z = 1.0f - 2.0f * (i + 0.5f) / rayCount;
+		const auto r = sqrtf(1.0f - z * z);
+		const auto phi = XM_PI * (3.0f - sqrtf(5.0f)) * i;
+		dirs[i] = XMFLOAT3(r * cosf(phi), r * sinf(phi), z);
+	}
+
+	// Texel directions of the irradiance map, and normalized texel-ray weights (cosine to
+	// the 50th) for the distances, shared by all probes
+	vector<XMFLOAT3> texelDirs(IrradianceTexels * IrradianceTexels);
+	for (auto k = 0u; k < IrradianceTexels * IrradianceTexels; ++k)
+		XMStoreFloat3(&texelDirs[k], DecodeOctahedron(XMFLOAT2((k % IrradianceTexels + 0.5f) / IrradianceTexels * 2.0f - 1.0f,
+			(k / IrradianceTexels + 0.5f) / IrradianceTexels * 2.0f - 1.0f)));
+
+	vector<float> distanceWeights(DistanceTexels * DistanceTexels * rayCount);
+	for (auto k = 0u; k < DistanceTexels * DistanceTexels; ++k)
+	{
+		const auto texelDir = DecodeOctahedron(XMFLOAT2((k % DistanceTexels + 0.5f) / DistanceTexels * 2.0f - 1.0f,
+			(k / DistanceTexels + 0.5f) / DistanceTexels * 2.0f - 1.0f));
+		const auto pWeights = &distanceWeights[k * rayCount];
+		auto weightSum = 0.0f;
+		for (auto i = 0u; i < rayCount; ++i)
+		{
+			const auto cosine = XMVectorGetX(XMVector3Dot(texelDir, XMLoadFloat3(&dirs[i])));
+			pWeights[i] = cosine > 0.0f ? powf(cosine, 50.0f) : 0.0f;
+			weightSum += pWeights[i];
+		}
+		if (weightSum > 0.0f) for (auto i = 0u; i < rayCount; ++i) pWeights[i] /= weightSum;
+	}
+
+	ParallelFor(m_probeGridSize * m_probeGridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		vector<float> distances(rayCount);
+		for (auto j = begin; j < end; ++j)
+			for (auto x = 0u; x < m_probeGridSize; ++x)
+			{
+				const auto probeIdx = m_probeIndices[j * m_probeGridSize + x];
+				if (probeIdx == UINT32_MAX) continue;
+
+				const auto y = j % m_probeGridSize;
+				const auto z = j / m_probeGridSize;
+				const auto origin = GetProbePosition(x, y, z);
+
+				// Irradiance: the same cosine-lobe estimate that the shade pass traces per pixel
+				const auto irradianceSize = IrradianceTexels + 2;
+				const auto pIrradiance = &m_irradiance[probeIdx * irradianceSize * irradianceSize];
+				for (auto k = 0u; k < IrradianceTexels * IrradianceTexels; ++k)
+					XMStoreFloat3PK(&pIrradiance[(k / IrradianceTexels + 1) * irradianceSize + k % IrradianceTexels + 1],
+						volume.TraceIndirect(origin, XMLoadFloat3(&texelDirs[k]), tMin, tMax, irradiance, sampleCount));
+				copyBorders(pIrradiance, IrradianceTexels);
+
+				for (auto i = 0u; i < rayCount; ++i)
+				{
+					auto t = 0.0f;
+					distances[i] = volume.Intersect(origin, XMLoadFloat3(&dirs[i]), 0.0f, maxDist, t) ? t : maxDist;
+				}
+
+				// Distance moments with a sharp lobe, for the Chebyshev visibility test
+				const auto distanceSize = DistanceTexels + 2;
+				const auto pDistances = &m_distances[probeIdx * distanceSize * distanceSize];
+				for (auto k = 0u; k < DistanceTexels * DistanceTexels; ++k)
+				{
+					const auto pWeights = &distanceWeights[k * rayCount];
+					auto mean = 0.0f, mean2 = 0.0f;
+					for (auto i = 0u; i < rayCount; ++i)
+					{
+						mean += distances[i] * pWeights[i];
+						mean2 += distances[i] * distances[i] * pWeights[i];
+					}
+					XMStoreHalf2(&pDistances[(k / DistanceTexels + 1) * distanceSize + k % DistanceTexels + 1],
+						XMVectorSet(mean, mean2, 0.0f, 0.0f));
+				}
+				copyBorders(pDistances, DistanceTexels);
+			}
+	});
+
+	m_stats.UpdateTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+//--------------------------------------------------------------------------------------
+// Trilinear interpolation of the 8 surrounding probes, weighted by the backface and
+// Chebyshev visibility terms
+//--------------------------------------------------------------------------------------
+XMVECTOR IrradianceProbeGrid::Sample(FXMVECTOR pos, FXMVECTOR nrm) const
+{
+	const auto biasedPos = pos + nrm * (m_probeSpacing * 0.25f);
+
+	// Grid coordinates with probes at the cell centers
+	XMFLOAT3 coord;
+	const auto uvw = XMVector3Transform(biasedPos, XMLoadFloat3x4(&m_volumeWorldI)) * 0.5f + XMVectorReplicate(0.5f);
+	XMStoreFloat3(&coord, XMVectorClamp(uvw * static_cast<float>(m_probeGridSize) - XMVectorReplicate(0.5f),
+		XMVectorZero(), XMVectorReplicate(static_cast<float>(m_probeGridSize - 1))));
+
+	const uint32_t c0[] = { static_cast<uint32_t>(coord.x), static_cast<uint32_t>(coord.y), static_cast<uint32_t>(coord.z) };
+	const float f[] = { coord.x - c0[0], coord.y - c0[1], coord.z - c0[2] };
+
+	const auto irradianceSize = IrradianceTexels + 2;
+	const auto distanceSize = DistanceTexels + 2;
+	auto sum = XMVectorZero();
+	auto weightSum = 0.0f;
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		const auto x = (min)(c0[0] + (i & 1), m_probeGridSize - 1);
+		const auto y = (min)(c0[1] + ((i >> 1) & 1), m_probeGridSize - 1);
+		const auto z = (min)(c0[2] + (i >> 2), m_probeGridSize - 1);
+		const auto probeIdx = m_probeIndices[(m_probeGridSize * z + y) * m_probeGridSize + x];
+		if (probeIdx == UINT32_MAX) continue;
+
+		const auto trilinear = (i & 1 ? f[0] : 1.0f - f[0]) * (i & 2 ? f[1] : 1.0f - f[1]) * (i & 4 ? f[2] : 1.0f - f[2]);
+		const auto probePos = GetProbePosition(x, y, z);
+
+		// Smooth backface test
+		const auto dirToProbe = XMVector3Normalize(probePos - pos);
+		const auto backface = (XMVectorGetX(XMVector3Dot(dirToProbe, nrm)) + 1.0f) * 0.5f;
+		auto weight = backface * backface + 0.2f;
+
+		// Chebyshev visibility from the distance moments
+		const auto probeToPoint = biasedPos - probePos;
+		const auto dist = XMVectorGetX(XMVector3Length(probeToPoint));
+		XMFLOAT2 moments;
+		XMStoreFloat2(&moments, sampleOctahedron(&m_distances[probeIdx * distanceSize * distanceSize],
+			DistanceTexels, XMVector3Normalize(probeToPoint)));
+		if (dist > moments.x)
+		{
+			const auto variance = fabsf(moments.x * moments.x - moments.y);
+			const auto d = dist - moments.x;
+			const auto chebyshev = variance / (variance + d * d);
+			weight *= (max)(chebyshev * chebyshev * chebyshev, 0.0f);
+		}
+
+		// Crush tiny weights to reduce light leaking
+		weight = (max)(weight, 1e-6f);
+		if (weight < 0.2f) weight *= weight * weight / 0.04f;
+		weight *= trilinear;
+
+		sum += sampleOctahedron(&m_irradiance[probeIdx * irradianceSize * irradianceSize], IrradianceTexels, nrm) * weight;
+		weightSum += weight;
+	}
+
+	return weightSum > 0.0f ? sum / weightSum : XMVectorZero();
+}
+
+XMVECTOR IrradianceProbeGrid::GetProbePosition(uint32_t x, uint32_t y, uint32_t z) const
+{
+	const auto pos = (XMVectorSet(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z), 0.0f) +
+		XMVectorReplicate(0.5f)) / static_cast<float>(m_probeGridSize) * 2.0f - XMVectorSplatOne();
+	const auto& offset = m_offsets[(m_probeGridSize * z + y) * m_probeGridSize + x];
+
+	return XMVector3Transform(pos, XMLoadFloat3x4(&m_volumeWorld)) + XMLoadHalf4(&offset);
+}
+
+const vector<uint32_t>& IrradianceProbeGrid::GetProbeIndices() const
+{
+	return m_probeIndices;
+}
+
+uint32_t IrradianceProbeGrid::GetProbeGridSize() const
+{
+	return m_probeGridSize;
+}
+
+const IrradianceProbeGrid::Stats& IrradianceProbeGrid::GetStats() const
+{
+	return m_stats;
+}
+
+XMFLOAT2 IrradianceProbeGrid::EncodeOctahedron(FXMVECTOR dir)
+{
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, dir / XMVectorGetX(XMVector3Dot(XMVectorAbs(dir), XMVectorSplatOne())));
+
+	XMFLOAT2 uv(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		uv.x = (1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		uv.y = (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	return uv;
+}
+
+XMVECTOR IrradianceProbeGrid::DecodeOctahedron(const XMFLOAT2& uv)
+{
+	XMFLOAT3 n(uv.x, uv.y, 1.0f - fabsf(uv.x) - fabsf(uv.y));
+	if (n.z < 0.0f)
+	{
+		n.x = (1.0f - fabsf(uv.y)) * (uv.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - fabsf(uv.x)) * (uv.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	return XMVector3Normalize(XMLoadFloat3(&n));
+}
+
+//--------------------------------------------------------------------------------------
+// Mirrored octahedral borders, so that bilinear filtering wraps across the seams
+//--------------------------------------------------------------------------------------
+template<typename T>
+void IrradianceProbeGrid::copyBorders(T* pTexels, uint32_t size)
+{
+	const auto stride = size + 2;
+	for (auto i = 1u; i <= size; ++i)
+	{
+		const auto mirror = size + 1 - i;
+		pTexels[i] = pTexels[stride + mirror];
+		pTexels[(size + 1) * stride + i] = pTexels[size * stride + mirror];
+		pTexels[i * stride] = pTexels[mirror * stride + 1];
+		pTexels[i * stride + size + 1] = pTexels[mirror * stride + size];
+	}
+
+	pTexels[0] = pTexels[size * stride + size];
+	pTexels[size + 1] = pTexels[size * stride + 1];
+	pTexels[(size + 1) * stride] = pTexels[stride + size];
+	pTexels[(size + 1) * stride + size + 1] = pTexels[stride + 1];
+}
+
+template<typename T>
+XMVECTOR IrradianceProbeGrid::sampleOctahedron(const T* pTexels, uint32_t size, FXMVECTOR dir)
+{
+	const auto stride = size + 2;
+	const auto uv = EncodeOctahedron(dir);
+
+	// Texel space of the bordered tile, minus the half-texel center offset
+	const auto u = (uv.x * 0.5f + 0.5f) * size + 0.5f;
+	const auto v = (uv.y * 0.5f + 0.5f) * size + 0.5f;
+	const auto u0 = (min)(static_cast<uint32_t>(u), size);
+	const auto v0 = (min)(static_cast<uint32_t>(v), size);
+	const auto fu = u - u0, fv = v - v0;
+
+	const auto load = [&](uint32_t x, uint32_t y) { return loadTexel(pTexels[y * stride + x]); };
+
+	return XMVectorLerp(XMVectorLerp(load(u0, v0), load(u0 + 1, v0), fu),
+		XMVectorLerp(load(u0, v0 + 1), load(u0 + 1, v0 + 1), fu), fv);
+}
+
+XMVECTOR IrradianceProbeGrid::loadTexel(const XMFLOAT3PK& texel)
+{
+	return XMLoadFloat3PK(&texel);
+}
+
+XMVECTOR IrradianceProbeGrid::loadTexel(const XMHALF2& texel)
+{
+	return XMLoadHalf2(&texel);
+}
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXPackedVector.h>
+#include "IrradianceMipBuilder.h"
+
+//--------------------------------------------------------------------------------------
+// Sparse irradiance probes on a coarse grid: probes are pushed out of geometry along the
+// SDF gradient, only those near surfaces are allocated, and each stores octahedral
+// irradiance and distance moments for visibility-weighted interpolation
+//--------------------------------------------------------------------------------------
+class IrradianceProbeGrid
+{
+public:
+	struct Stats
+	{
+		double RelocateTime;	// ms
+		double UpdateTime;		// ms
+		uint32_t ProbeCount;
+		uint32_t ActiveProbeCount;
+		uint32_t RelocatedProbeCount;
+		uint64_t ByteCount;
+	};
+
+	IrradianceProbeGrid();
+	virtual ~IrradianceProbeGrid();
+
+	void Init(const SDFVolume& volume, uint32_t probeSpacing = 8);
+	void Relocate(const SDFVolume& volume);
+	// rayCount probe rays for the distance moments, sampleCount TraceIndirect() samples per
+	// irradiance texel
+	void Update(const SDFVolume& volume, const IrradianceMipBuilder& irradiance,
+		uint32_t rayCount = 128, uint32_t sampleCount = 32);
+
+	// Cosine-weighted radiosity around the normal, in the same units as TraceIndirect()
+	DirectX::XMVECTOR Sample(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR nrm) const;
+
+	DirectX::XMVECTOR GetProbePosition(uint32_t x, uint32_t y, uint32_t z) const;
+	const std::vector<uint32_t>& GetProbeIndices() const;
+	uint32_t GetProbeGridSize() const;
+	const Stats& GetStats() const;
+
+	static DirectX::XMFLOAT2 EncodeOctahedron(DirectX::FXMVECTOR dir);
+	static DirectX::XMVECTOR DecodeOctahedron(const DirectX::XMFLOAT2& uv);
+
+	// Interior texels per side, stored as in the GPU atlases (R11G11B10 irradiance,
+	// RG16F distance moments) with a 1-texel octahedral border
+	static const uint32_t IrradianceTexels = 6;
+	static const uint32_t DistanceTexels = 14;
+
+protected:
+	template<typename T>
+	static void copyBorders(T* pTexels, uint32_t size);
+	template<typename T>
+	static DirectX::XMVECTOR sampleOctahedron(const T* pTexels, uint32_t size, DirectX::FXMVECTOR dir);
+	static DirectX::XMVECTOR loadTexel(const DirectX::PackedVector::XMFLOAT3PK& texel);
+	static DirectX::XMVECTOR loadTexel(const DirectX::PackedVector::XMHALF2& texel);
+
+	std::vector<uint32_t>							m_probeIndices;	// Grid cell to active probe, UINT32_MAX if none
+	std::vector<DirectX::PackedVector::XMHALF4>		m_offsets;		// Relocation offsets of all grid cells
+	std::vector<DirectX::PackedVector::XMFLOAT3PK>	m_irradiance;
+	std::vector<DirectX::PackedVector::XMHALF2>		m_distances;
+
+	DirectX::XMFLOAT3X4 m_volumeWorld;
+	DirectX::XMFLOAT3X4 m_volumeWorldI;
+	uint32_t	m_probeGridSize;
+	float		m_probeSpacing;	// World units
+
+	Stats m_stats;
+};
@@ -0,0 +1,220 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "IrradianceScheduler.h"
+
+using namespace std;
+using namespace DirectX;
+
+IrradianceScheduler::IrradianceScheduler() :
+	m_gridSize(0),
+	m_brickGridSize(0),
+	m_period(1),
+	m_stats()
+{
+}
+
+IrradianceScheduler::~IrradianceScheduler()
+{
+}
+
+void IrradianceScheduler::Init(uint32_t gridSize, uint8_t period)
+{
+	assert(period > 0 && period < UINT8_MAX);
+	m_gridSize = gridSize;
+	m_brickGridSize = (gridSize + BrickSize - 1) / BrickSize;
+	m_period = period;
+
+	// Stagger the initial ages, so that about 1/N of the voxels come of age every frame
+	const auto voxelCount = gridSize * gridSize * gridSize;
+	m_ages.resize(voxelCount);
+	for (auto i = 0u; i < voxelCount; ++i) m_ages[i] = static_cast<uint8_t>(i % period);
+
+	m_dirtyBricks.assign(m_brickGridSize * m_brickGridSize * m_brickGridSize, 0);
+	m_prevLightSources.clear();
+	m_prevDynamicBounds.clear();
+}
+
+void IrradianceScheduler::Update(const SDFVolume& volume, const vector<uint32_t>& surfaceVoxels,
+	const uint32_t* pDynamicMeshIds, const AABB* pMeshAABBs, const PerObject* pMatrices,
+	uint32_t meshCount, const LightSource* pLightSources, uint32_t lightSourceCount)
+{
+	assert(volume.GetGridSize() == m_gridSize);
+	const auto start = chrono::high_resolution_clock::now();
+
+	vector<AABB> relitBounds, sweptBounds;
+	collectChangedLights(pLightSources, lightSourceCount, relitBounds);
+	collectMovedMeshes(pDynamicMeshIds, pMeshAABBs, pMatrices, meshCount, sweptBounds);
+
+	m_refreshVoxels.clear();
+	fill(m_dirtyBricks.begin(), m_dirtyBricks.end(), 0);
+	m_stats.AgedCount = 0;
+	m_stats.DynamicCount = 0;
+	m_stats.RelitCount = 0;
+	m_stats.MotionCount = 0;
+
+	const auto pIds = volume.GetIds();
+	for (const auto& i : surfaceVoxels)
+	{
+		const auto x = i % m_gridSize;
+		const auto y = (i / m_gridSize) % m_gridSize;
+		const auto z = i / (m_gridSize * m_gridSize);
+
+		// Immediate refresh for dynamic meshes, then for changed lights and moving occluders,
+		// then by age
+		auto& age = m_ages[i];
+		if (age < UINT8_MAX) ++age;
+		if (pDynamicMeshIds[DecodeVisibility(pIds[i]).MeshId] != UINT32_MAX) ++m_stats.DynamicCount;
+		else
+		{
+			auto isRelit = false;
+			const auto pos = volume.GetVoxelCenter(x, y, z);
+			if (!relitBounds.empty())
+			{
+				for (const auto& bound : relitBounds)
+				{
+					if (XMVector3GreaterOrEqual(pos, XMLoadFloat3(&bound.Min)) &&
+						XMVector3LessOrEqual(pos, XMLoadFloat3(&bound.Max)))
+					{
+						isRelit = true;
+						break;
+					}
+				}
+			}
+
+			if (isRelit) ++m_stats.RelitCount;
+			else if (!sweptBounds.empty() && isShadowedByMotion(pos, sweptBounds, pLightSources, lightSourceCount))
+				++m_stats.MotionCount;
+			else if (age >= m_period)
+			{
+				++m_stats.AgedCount;
+				age = 0;
+			}
+			else continue;
+		}
+
+		// Forced refreshes leave the age alone, so that each voxel keeps its staggered phase
+		// and a global relight does not synchronize all voxels into the same frame of the period
+		m_refreshVoxels.emplace_back(i);
+		m_dirtyBricks[(m_brickGridSize * (z / BrickSize) + y / BrickSize) * m_brickGridSize + x / BrickSize] = 1;
+	}
+
+	m_stats.SurfaceVoxelCount = static_cast<uint32_t>(surfaceVoxels.size());
+	m_stats.RefreshCount = static_cast<uint32_t>(m_refreshVoxels.size());
+	m_stats.BrickCount = static_cast<uint32_t>(m_dirtyBricks.size());
+	m_stats.DirtyBrickCount = static_cast<uint32_t>(count(m_dirtyBricks.cbegin(), m_dirtyBricks.cend(), 1));
+	m_stats.UpdateTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+const vector<uint32_t>& IrradianceScheduler::GetRefreshVoxels() const
+{
+	return m_refreshVoxels;
+}
+
+const vector<uint8_t>& IrradianceScheduler::GetDirtyBricks() const
+{
+	return m_dirtyBricks;
+}
+
+const vector<uint8_t>& IrradianceScheduler::GetAges() const
+{
+	return m_ages;
+}
+
+uint32_t IrradianceScheduler::GetBrickGridSize() const
+{
+	return m_brickGridSize;
+}
+
+const IrradianceScheduler::Stats& IrradianceScheduler::GetStats() const
+{
+	return m_stats;
+}
+
+void IrradianceScheduler::collectChangedLights(const LightSource* pLightSources,
+	uint32_t lightSourceCount, vector<AABB>& relitBounds)
+{
+	// Both the old and the new placement of a changed light are relit within its impact range
+	// (half the impact distance, as for the dynamic meshes in CSUpdateSDF.hlsl)
+	const auto impactDist = XMVectorReplicate(GetImpactDistance() * 0.5f);
+	const auto addBounds = [&](const LightSource& lightSource)
+	{
+		auto aabb = GetLightBounds(lightSource);
+		XMStoreFloat3(&aabb.Min, XMLoadFloat3(&aabb.Min) - impactDist);
+		XMStoreFloat3(&aabb.Max, XMLoadFloat3(&aabb.Max) + impactDist);
+		relitBounds.emplace_back(aabb);
+	};
+
+	const auto prevCount = static_cast<uint32_t>(m_prevLightSources.size());
+	for (auto i = 0u; i < (max)(lightSourceCount, prevCount); ++i)
+	{
+		if (i < lightSourceCount && i < prevCount &&
+			memcmp(&pLightSources[i], &m_prevLightSources[i], sizeof(LightSource)) == 0)
+			continue;
+
+		if (i < prevCount) addBounds(m_prevLightSources[i]);
+		if (i < lightSourceCount) addBounds(pLightSources[i]);
+	}
+
+	m_prevLightSources.assign(pLightSources, pLightSources + lightSourceCount);
+}
+
+void IrradianceScheduler::collectMovedMeshes(const uint32_t* pDynamicMeshIds, const AABB* pMeshAABBs,
+	const PerObject* pMatrices, uint32_t meshCount, vector<AABB>& sweptBounds)
+{
+	// Last and current placement of each dynamic mesh that moved
+	vector<AABB> dynamicBounds;
+	for (auto i = 0u; i < meshCount; ++i)
+	{
+		const auto dynamicMeshId = pDynamicMeshIds[i];
+		if (dynamicMeshId == UINT32_MAX) continue;
+
+		if (dynamicMeshId >= dynamicBounds.size()) dynamicBounds.resize(dynamicMeshId + 1);
+		const auto& aabb = dynamicBounds[dynamicMeshId] = TransformBounds(pMeshAABBs[i], pMatrices[i].World);
+		if (dynamicMeshId >= m_prevDynamicBounds.size()) continue;
+
+		const auto& prevAABB = m_prevDynamicBounds[dynamicMeshId];
+		if (memcmp(&aabb, &prevAABB, sizeof(AABB)) == 0) continue;
+
+		AABB sweptAABB;
+		XMStoreFloat3(&sweptAABB.Min, XMVectorMin(XMLoadFloat3(&aabb.Min), XMLoadFloat3(&prevAABB.Min)));
+		XMStoreFloat3(&sweptAABB.Max, XMVectorMax(XMLoadFloat3(&aabb.Max), XMLoadFloat3(&prevAABB.Max)));
+		sweptBounds.emplace_back(sweptAABB);
+	}
+	m_prevDynamicBounds = dynamicBounds;
+}
+
+//--------------------------------------------------------------------------------------
+// A static voxel sees a moving mesh change its occlusion within the impact range of the
+// swept bounds, and its shadows where the segment to a light crosses those bounds
+// inflated by the light extent, as in ShadowCache
+//--------------------------------------------------------------------------------------
+bool IrradianceScheduler::isShadowedByMotion(FXMVECTOR pos, const vector<AABB>& sweptBounds,
+	const LightSource* pLightSources, uint32_t lightSourceCount) const
+{
+	const auto impactDist = XMVectorReplicate(GetImpactDistance() * 0.5f);
+	for (const auto& sweptAABB : sweptBounds)
+	{
+		const auto bMin = XMLoadFloat3(&sweptAABB.Min);
+		const auto bMax = XMLoadFloat3(&sweptAABB.Max);
+		if (XMVector3GreaterOrEqual(pos, bMin - impactDist) && XMVector3LessOrEqual(pos, bMax + impactDist))
+			return true;
+
+		for (auto i = 0u; i < lightSourceCount; ++i)
+		{
+			const auto lightAABB = GetLightBounds(pLightSources[i]);
+			const auto lMin = XMLoadFloat3(&lightAABB.Min);
+			const auto lMax = XMLoadFloat3(&lightAABB.Max);
+			const auto radius = XMVectorReplicate(XMVectorGetX(XMVector3Length(lMax - lMin)) * 0.5f);
+
+			AABB aabb;
+			XMStoreFloat3(&aabb.Min, bMin - radius);
+			XMStoreFloat3(&aabb.Max, bMax + radius);
+			if (IntersectSegment(pos, (lMin + lMax) * 0.5f, aabb)) return true;
+		}
+	}
+
+	return false;
+}
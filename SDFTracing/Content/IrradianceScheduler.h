@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SDFVolume.h"
+
+//--------------------------------------------------------------------------------------
+// Temporally amortized irradiance-volume updates: each surface voxel is refreshed at
+// least once every N frames (driven by its age), and immediately if it belongs to a
+// dynamic mesh, lies in range of a light whose inputs changed, or may be shadowed or
+// occluded differently by a moving dynamic mesh
+//--------------------------------------------------------------------------------------
+class IrradianceScheduler
+{
+public:
+	struct Stats
+	{
+		double UpdateTime;	// ms
+		uint32_t SurfaceVoxelCount;
+		uint32_t RefreshCount;
+		uint32_t AgedCount;
+		uint32_t DynamicCount;
+		uint32_t RelitCount;
+		uint32_t MotionCount;	// Static voxels near or shadowed by the swept dynamic meshes
+		uint32_t DirtyBrickCount;
+		uint32_t BrickCount;
+	};
+
+	IrradianceScheduler();
+	virtual ~IrradianceScheduler();
+
+	void Init(uint32_t gridSize, uint8_t period);
+	void Update(const SDFVolume& volume, const std::vector<uint32_t>& surfaceVoxels,
+		const uint32_t* pDynamicMeshIds, const AABB* pMeshAABBs, const PerObject* pMatrices,
+		uint32_t meshCount, const LightSource* pLightSources, uint32_t lightSourceCount);
+
+	const std::vector<uint32_t>& GetRefreshVoxels() const;
+	const std::vector<uint8_t>& GetDirtyBricks() const;
+	const std::vector<uint8_t>& GetAges() const;
+	uint32_t GetBrickGridSize() const;
+	const Stats& GetStats() const;
+
+	static const uint32_t BrickSize = 8;
+
+protected:
+	void collectChangedLights(const LightSource* pLightSources, uint32_t lightSourceCount,
+		std::vector<AABB>& relitBounds);
+	void collectMovedMeshes(const uint32_t* pDynamicMeshIds, const AABB* pMeshAABBs,
+		const PerObject* pMatrices, uint32_t meshCount, std::vector<AABB>& sweptBounds);
+	bool isShadowedByMotion(DirectX::FXMVECTOR pos, const std::vector<AABB>& sweptBounds,
+		const LightSource* pLightSources, uint32_t lightSourceCount) const;
+
+	std::vector<uint8_t>		m_ages;
+	std::vector<uint8_t>		m_dirtyBricks;
+	std::vector<uint32_t>		m_refreshVoxels;
+	std::vector<LightSource>	m_prevLightSources;
+	std::vector<AABB>			m_prevDynamicBounds;
+
+	uint32_t	m_gridSize;
+	uint32_t	m_brickGridSize;
+	uint8_t		m_period;
+
+	Stats m_stats;
+};
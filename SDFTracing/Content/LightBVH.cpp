@@ -0,0 +1,168 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "LightBVH.h"
+
+using namespace std;
+using namespace DirectX;
+
+LightBVH::LightBVH() :
+	m_buildTime(0.0)
+{
+}
+
+LightBVH::~LightBVH()
+{
+}
+
+void LightBVH::Build(const LightSource* pLightSources, uint32_t lightSourceCount)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	// The shaders weight a light by Emissive.xyz * Emissive.w without a distance falloff
+	m_lights.resize(lightSourceCount);
+	for (auto i = 0u; i < lightSourceCount; ++i)
+	{
+		const auto& lightSource = pLightSources[i];
+		auto& light = m_lights[i];
+		light.Bounds = GetLightBounds(lightSource);
+		XMStoreFloat3(&light.Centroid, (XMLoadFloat3(&light.Bounds.Min) + XMLoadFloat3(&light.Bounds.Max)) * 0.5f);
+		light.Power = (lightSource.Emissive.x + lightSource.Emissive.y + lightSource.Emissive.z) / 3.0f * lightSource.Emissive.w;
+	}
+
+	m_nodes.clear();
+	if (lightSourceCount > 0)
+	{
+		m_nodes.reserve(lightSourceCount * 2 - 1);
+		vector<uint32_t> indices(lightSourceCount);
+		for (auto i = 0u; i < lightSourceCount; ++i) indices[i] = i;
+		buildNode(indices.data(), lightSourceCount);
+	}
+
+	m_buildTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+//--------------------------------------------------------------------------------------
+// Top-down traversal, choosing a child in proportion to its importance; u is reused
+// after rescaling, and the probability of the whole path is returned in pdf
+//--------------------------------------------------------------------------------------
+uint32_t LightBVH::Sample(FXMVECTOR pos, FXMVECTOR nrm, float u, float& pdf) const
+{
+	pdf = 1.0f;
+	if (m_nodes.empty()) return UINT32_MAX;
+
+	auto i = 0u;
+	while (!(m_nodes[i].Next & LeafFlag))
+	{
+		const auto left = i + 1;
+		const auto right = m_nodes[i].Next;
+		const auto wLeft = importance(m_nodes[left], pos, nrm);
+		const auto wRight = importance(m_nodes[right], pos, nrm);
+		const auto wSum = wLeft + wRight;
+		if (wSum <= 0.0f) return UINT32_MAX;
+
+		const auto pLeft = wLeft / wSum;
+		if (u < pLeft)
+		{
+			u = (min)(u / pLeft, 1.0f - FLT_EPSILON);
+			pdf *= pLeft;
+			i = left;
+		}
+		else
+		{
+			u = (min)((u - pLeft) / (1.0f - pLeft), 1.0f - FLT_EPSILON);
+			pdf *= 1.0f - pLeft;
+			i = right;
+		}
+	}
+
+	return m_nodes[i].Next & ~LeafFlag;
+}
+
+const vector<LightBVH::Node>& LightBVH::GetNodes() const
+{
+	return m_nodes;
+}
+
+double LightBVH::GetBuildTime() const
+{
+	return m_buildTime;
+}
+
+//--------------------------------------------------------------------------------------
+// Depth-first layout: the left child directly follows its parent; split at the median
+// centroid along the longest axis of the centroid bounds
+//--------------------------------------------------------------------------------------
+uint32_t LightBVH::buildNode(uint32_t* pIndices, uint32_t count)
+{
+	const auto nodeIdx = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.emplace_back();
+
+	if (count == 1)
+	{
+		const auto& light = m_lights[pIndices[0]];
+		auto& node = m_nodes[nodeIdx];
+		node.Min = light.Bounds.Min;
+		node.Max = light.Bounds.Max;
+		node.Power = light.Power;
+		node.Next = pIndices[0] | LeafFlag;
+
+		return nodeIdx;
+	}
+
+	auto cMin = XMVectorReplicate(FLT_MAX);
+	auto cMax = XMVectorReplicate(-FLT_MAX);
+	for (auto i = 0u; i < count; ++i)
+	{
+		const auto centroid = XMLoadFloat3(&m_lights[pIndices[i]].Centroid);
+		cMin = XMVectorMin(cMin, centroid);
+		cMax = XMVectorMax(cMax, centroid);
+	}
+
+	XMFLOAT3 ext;
+	XMStoreFloat3(&ext, cMax - cMin);
+	const auto axis = ext.x >= ext.y && ext.x >= ext.z ? 0 : (ext.y >= ext.z ? 1 : 2);
+	const auto mid = count / 2;
+	nth_element(pIndices, pIndices + mid, pIndices + count, [&](uint32_t a, uint32_t b)
+	{
+		return (&m_lights[a].Centroid.x)[axis] < (&m_lights[b].Centroid.x)[axis];
+	});
+
+	const auto left = buildNode(pIndices, mid);
+	const auto right = buildNode(pIndices + mid, count - mid);
+
+	// Union of the bounds and the power of both children
+	const auto& l = m_nodes[left];
+	const auto& r = m_nodes[right];
+	Node node;
+	XMStoreFloat3(&node.Min, XMVectorMin(XMLoadFloat3(&l.Min), XMLoadFloat3(&r.Min)));
+	XMStoreFloat3(&node.Max, XMVectorMax(XMLoadFloat3(&l.Max), XMLoadFloat3(&r.Max)));
+	node.Power = l.Power + r.Power;
+	node.Next = right;
+	m_nodes[nodeIdx] = node;
+
+	return nodeIdx;
+}
+
+//--------------------------------------------------------------------------------------
+// Power times an upper bound of NoL over the node bounds, zero if the node is behind the
+// surface
+//--------------------------------------------------------------------------------------
+float LightBVH::importance(const Node& node, FXMVECTOR pos, FXMVECTOR nrm) const
+{
+	const auto nMin = XMLoadFloat3(&node.Min);
+	const auto nMax = XMLoadFloat3(&node.Max);
+	const auto disp = (nMin + nMax) * 0.5f - pos;
+	const auto dist = XMVectorGetX(XMVector3Length(disp));
+	const auto radius = XMVectorGetX(XMVector3Length(nMax - nMin)) * 0.5f;
+	if (dist <= radius) return node.Power;
+
+	const auto L = disp / dist;
+	const auto thetaB = asinf(radius / dist);
+	const auto theta = acosf((max)((min)(XMVectorGetX(XMVector3Dot(nrm, L)), 1.0f), -1.0f));
+	const auto cosBound = cosf((max)(theta - thetaB, 0.0f));
+
+	return cosBound > 0.0f ? node.Power * cosBound : 0.0f;
+}
@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SceneData.h"
+
+//--------------------------------------------------------------------------------------
+// Light BVH over the light-source AABBs for stochastic many-light sampling: each node
+// carries the aggregate power of its lights, and a traversal picks one light with
+// probability proportional to the estimated contribution. The shaders let every light
+// emit to both sides of its thin axis, so the nodes have no orientation cones.
+//--------------------------------------------------------------------------------------
+class LightBVH
+{
+public:
+	struct Node
+	{
+		DirectX::XMFLOAT3 Min;
+		float Power;
+		DirectX::XMFLOAT3 Max;
+		uint32_t Next;	// Right child of an inner node, or the light index of a leaf
+	};
+
+	LightBVH();
+	virtual ~LightBVH();
+
+	void Build(const LightSource* pLightSources, uint32_t lightSourceCount);
+	uint32_t Sample(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR nrm, float u, float& pdf) const;
+
+	const std::vector<Node>& GetNodes() const;
+	double GetBuildTime() const;
+
+	static const uint32_t LeafFlag = 0x80000000;
+
+protected:
+	struct LightInfo
+	{
+		AABB Bounds;
+		DirectX::XMFLOAT3 Centroid;
+		float Power;
+	};
+
+	uint32_t buildNode(uint32_t* pIndices, uint32_t count);
+	float importance(const Node& node, DirectX::FXMVECTOR pos, DirectX::FXMVECTOR nrm) const;
+
+	std::vector<Node>		m_nodes;
+	std::vector<LightInfo>	m_lights;
+
+	double m_buildTime;
+};
@@ -0,0 +1,204 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "LightClusters.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+LightClusters::LightClusters() :
+	m_gridSize(0),
+	m_clusterSize(1),
+	m_clusterGridSize(0),
+	m_stats()
+{
+}
+
+LightClusters::~LightClusters()
+{
+}
+
+void LightClusters::Init(uint32_t gridSize, uint32_t clusterSize)
+{
+	m_gridSize = gridSize;
+	m_clusterSize = clusterSize;
+	m_clusterGridSize = (gridSize + clusterSize - 1) / clusterSize;
+
+	const auto clusterCount = m_clusterGridSize * m_clusterGridSize * m_clusterGridSize;
+	m_bounds.resize(clusterCount);
+	m_clusterLights.resize(clusterCount);
+	m_clusters.resize(clusterCount);
+	m_stats.ClusterCount = clusterCount;
+}
+
+void LightClusters::Build(const SDFVolume& volume, const vector<uint32_t>& surfaceVoxels,
+	const MeshView* pMeshes, const PerObject* pMatrices, const LightSource* pLightSources,
+	uint32_t lightSourceCount, float impactRange)
+{
+	assert(volume.GetGridSize() == m_gridSize);
+	const auto start = chrono::high_resolution_clock::now();
+
+	computeBounds(volume, surfaceVoxels, pMeshes, pMatrices);
+
+	vector<AABB> lights(lightSourceCount);
+	for (auto i = 0u; i < lightSourceCount; ++i) lights[i] = GetLightBounds(pLightSources[i]);
+
+	// Cull the lights per occupied cluster
+	ParallelFor(m_stats.ClusterCount, 64, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto& clusterLights = m_clusterLights[i];
+			clusterLights.clear();
+			if (m_bounds[i].VoxelCount == 0) continue;
+
+			for (auto j = 0u; j < lightSourceCount; ++j)
+				if (isLightRelevant(m_bounds[i], lights[j], impactRange))
+					clusterLights.emplace_back(j);
+		}
+	});
+
+	// Flatten into the offset-count pairs and the light-index list
+	m_lightIndices.clear();
+	m_stats.OccupiedClusterCount = 0;
+	m_stats.MaxListLength = 0;
+	auto listLengthSum = 0.0;
+	for (auto i = 0u; i < m_stats.ClusterCount; ++i)
+	{
+		const auto& clusterLights = m_clusterLights[i];
+		const auto count = static_cast<uint32_t>(clusterLights.size());
+		m_clusters[i] = XMUINT2(static_cast<uint32_t>(m_lightIndices.size()), count);
+		m_lightIndices.insert(m_lightIndices.end(), clusterLights.cbegin(), clusterLights.cend());
+
+		if (m_bounds[i].VoxelCount > 0) ++m_stats.OccupiedClusterCount;
+		m_stats.MaxListLength = (max)(m_stats.MaxListLength, count);
+		listLengthSum += static_cast<double>(count) * m_bounds[i].VoxelCount;
+	}
+
+	m_stats.LightSourceCount = lightSourceCount;
+	m_stats.AverageListLength = surfaceVoxels.empty() ? 0.0 : listLengthSum / surfaceVoxels.size();
+	m_stats.BuildTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+uint32_t LightClusters::GetClusterIndex(uint32_t voxel) const
+{
+	const auto x = voxel % m_gridSize / m_clusterSize;
+	const auto y = voxel / m_gridSize % m_gridSize / m_clusterSize;
+	const auto z = voxel / (m_gridSize * m_gridSize) / m_clusterSize;
+
+	return (m_clusterGridSize * z + y) * m_clusterGridSize + x;
+}
+
+const uint32_t* LightClusters::GetLightIndices(uint32_t cluster, uint32_t& count) const
+{
+	count = m_clusters[cluster].y;
+
+	return m_lightIndices.data() + m_clusters[cluster].x;
+}
+
+const vector<XMUINT2>& LightClusters::GetClusters() const
+{
+	return m_clusters;
+}
+
+const vector<uint32_t>& LightClusters::GetLightIndexList() const
+{
+	return m_lightIndices;
+}
+
+const LightClusters::Stats& LightClusters::GetStats() const
+{
+	return m_stats;
+}
+
+void LightClusters::computeBounds(const SDFVolume& volume, const vector<uint32_t>& surfaceVoxels,
+	const MeshView* pMeshes, const PerObject* pMatrices)
+{
+	for (auto& bounds : m_bounds)
+	{
+		bounds.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		bounds.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		bounds.Axis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		bounds.CosAngle = 1.0f;
+		bounds.VoxelCount = 0;
+	}
+
+	// World-space normals as interpolated by CSShadeVolume
+	const auto voxelCount = static_cast<uint32_t>(surfaceVoxels.size());
+	m_normals.resize(voxelCount);
+	ParallelFor(voxelCount, 1024, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto voxel = surfaceVoxels[i];
+			const auto vis = DecodeVisibility(volume.GetIds()[voxel]);
+			const auto& mesh = pMeshes[vis.MeshId];
+			const auto& baryc = volume.GetBarycs()[voxel];
+			const auto baseIdx = vis.PrimId * 3;
+			const auto nrm = XMLoadFloat3(&mesh.Vertices[mesh.Indices[baseIdx]].Nrm) * (1.0f - (baryc.x + baryc.y)) +
+				XMLoadFloat3(&mesh.Vertices[mesh.Indices[baseIdx + 1]].Nrm) * baryc.x +
+				XMLoadFloat3(&mesh.Vertices[mesh.Indices[baseIdx + 2]].Nrm) * baryc.y;
+			XMStoreFloat3(&m_normals[i], XMVector3Normalize(XMVector3TransformNormal(nrm,
+				XMLoadFloat3x4(&pMatrices[vis.MeshId].WorldIT))));
+		}
+	});
+
+	// Voxel bounds and the average normal
+	const auto halfVoxel = XMVectorReplicate(volume.GetVoxelSize() * 0.5f);
+	for (auto i = 0u; i < voxelCount; ++i)
+	{
+		const auto voxel = surfaceVoxels[i];
+		auto& bounds = m_bounds[GetClusterIndex(voxel)];
+		const auto pos = volume.GetVoxelCenter(voxel % m_gridSize, voxel / m_gridSize % m_gridSize,
+			voxel / (m_gridSize * m_gridSize));
+		XMStoreFloat3(&bounds.Min, XMVectorMin(XMLoadFloat3(&bounds.Min), pos - halfVoxel));
+		XMStoreFloat3(&bounds.Max, XMVectorMax(XMLoadFloat3(&bounds.Max), pos + halfVoxel));
+		XMStoreFloat3(&bounds.Axis, XMLoadFloat3(&bounds.Axis) + XMLoadFloat3(&m_normals[i]));
+		++bounds.VoxelCount;
+	}
+
+	for (auto& bounds : m_bounds)
+	{
+		const auto axis = XMLoadFloat3(&bounds.Axis);
+		const auto len = XMVectorGetX(XMVector3Length(axis));
+		XMStoreFloat3(&bounds.Axis, len > 1e-3f ? axis / len : XMVectorZero());
+	}
+
+	// Cone angle around the average normal; a degenerate axis keeps the whole sphere
+	for (auto i = 0u; i < voxelCount; ++i)
+	{
+		auto& bounds = m_bounds[GetClusterIndex(surfaceVoxels[i])];
+		const auto cosAngle = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&bounds.Axis), XMLoadFloat3(&m_normals[i])));
+		bounds.CosAngle = (min)(bounds.CosAngle, cosAngle);
+	}
+}
+
+bool LightClusters::isLightRelevant(const ClusterBounds& bounds, const AABB& light, float impactRange) const
+{
+	const auto cMin = XMLoadFloat3(&bounds.Min);
+	const auto cMax = XMLoadFloat3(&bounds.Max);
+	const auto lMin = XMLoadFloat3(&light.Min);
+	const auto lMax = XMLoadFloat3(&light.Max);
+
+	// Impact range: box-to-box distance
+	const auto gap = XMVectorMax(XMVectorMax(lMin - cMax, cMin - lMax), XMVectorZero());
+	if (XMVectorGetX(XMVector3LengthSq(gap)) > impactRange * impactRange) return false;
+
+	// Hemisphere: the light is culled if it is behind every surface of the cluster, which
+	// holds when its direction deviates from the normal-cone axis by more than 90 degrees
+	// plus the cone angle plus the angle subtended by both bounding spheres
+	if (bounds.CosAngle <= 0.0f) return true;
+
+	const auto disp = (lMin + lMax - cMin - cMax) * 0.5f;
+	const auto dist = XMVectorGetX(XMVector3Length(disp));
+	const auto radius = XMVectorGetX(XMVector3Length(cMax - cMin) + XMVector3Length(lMax - lMin)) * 0.5f;
+	if (dist <= radius) return true;
+
+	const auto cosDir = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&bounds.Axis), disp)) / dist;
+	const auto angle = acosf((max)((min)(cosDir, 1.0f), -1.0f));
+
+	return angle <= XM_PIDIV2 + acosf(bounds.CosAngle) + asinf(radius / dist);
+}
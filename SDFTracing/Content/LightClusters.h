@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SDFVolume.h"
+
+//--------------------------------------------------------------------------------------
+// Clustered light lists on a coarse grid over the volume: each cluster keeps the lights
+// in impact range of its surface voxels that are not behind all of their normals
+//--------------------------------------------------------------------------------------
+class LightClusters
+{
+public:
+	struct Stats
+	{
+		double BuildTime;	// ms
+		uint32_t LightSourceCount;
+		uint32_t ClusterCount;
+		uint32_t OccupiedClusterCount;
+		uint32_t MaxListLength;
+		double AverageListLength;	// Over the surface voxels
+	};
+
+	LightClusters();
+	virtual ~LightClusters();
+
+	void Init(uint32_t gridSize, uint32_t clusterSize = 8);
+	void Build(const SDFVolume& volume, const std::vector<uint32_t>& surfaceVoxels,
+		const MeshView* pMeshes, const PerObject* pMatrices, const LightSource* pLightSources,
+		uint32_t lightSourceCount, float impactRange = GetImpactDistance());
+
+	uint32_t GetClusterIndex(uint32_t voxel) const;
+	const uint32_t* GetLightIndices(uint32_t cluster, uint32_t& count) const;
+
+	// Offset and count into the light-index list per cluster, as uploaded for the shaders
+	const std::vector<DirectX::XMUINT2>& GetClusters() const;
+	const std::vector<uint32_t>& GetLightIndexList() const;
+	const Stats& GetStats() const;
+
+protected:
+	// Surface bounds and normal cone of a cluster
+	struct ClusterBounds
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+		DirectX::XMFLOAT3 Axis;
+		float CosAngle;
+		uint32_t VoxelCount;
+	};
+
+	void computeBounds(const SDFVolume& volume, const std::vector<uint32_t>& surfaceVoxels,
+		const MeshView* pMeshes, const PerObject* pMatrices);
+	bool isLightRelevant(const ClusterBounds& bounds, const AABB& light, float impactRange) const;
+
+	std::vector<ClusterBounds>			m_bounds;
+	std::vector<std::vector<uint32_t>>	m_clusterLights;
+	std::vector<DirectX::XMUINT2>		m_clusters;
+	std::vector<uint32_t>				m_lightIndices;
+	std::vector<DirectX::XMFLOAT3>		m_normals;
+
+	uint32_t m_gridSize;
+	uint32_t m_clusterSize;
+	uint32_t m_clusterGridSize;
+
+	Stats m_stats;
+};
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+//--------------------------------------------------------------------------------------
+// CPU mirrors of MonteCarlo.hlsli
+//--------------------------------------------------------------------------------------
+// Random number [0:1] without sine, as hash() in MonteCarlo.hlsli
+inline float Hash(float p)
+{
+	const auto frac = [](float v) { return v - floorf(v); };
+
+	float p3[3];
+	for (auto& v : p3) v = frac(p * 0.1031f);
+	const auto d = p3[0] * (p3[1] + 19.19f) + p3[1] * (p3[2] + 19.19f) + p3[2] * (p3[0] + 19.19f);
+	for (auto& v : p3) v += d;
+
+	return frac((p3[0] + p3[1]) * p3[2]);
+}
+
+// Direction with uniform sphere distribution
+inline DirectX::XMVECTOR ComputeDirectionUS(float u, float v)
+{
+	const auto phi = DirectX::XM_2PI * u;
+	const auto cosTheta = 1.0f - 2.0f * v;
+	const auto sinTheta = sqrtf((std::max)(1.0f - cosTheta * cosTheta, 0.0f));
+
+	return DirectX::XMVectorSet(cosf(phi) * sinTheta, sinf(phi) * sinTheta, cosTheta, 0.0f);
+}
+
+// Cosine-distributed direction around the normal
+inline DirectX::XMVECTOR ComputeDirectionCos(DirectX::FXMVECTOR normal, float u, float v)
+{
+	return DirectX::XMVector3Normalize(normal + ComputeDirectionUS(u, v));
+}
@@ -0,0 +1,287 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "OccupancyPyramid.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+OccupancyPyramid::OccupancyPyramid() :
+	m_pVolume(nullptr),
+	m_blockGridSize(0),
+	m_summaryGridSize(0),
+	m_emptyDistance(0.0f),
+	m_stats()
+{
+}
+
+OccupancyPyramid::~OccupancyPyramid()
+{
+}
+
+void OccupancyPyramid::Build(const SDFVolume& volume, float emptyDistance)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	m_pVolume = &volume;
+	m_emptyDistance = emptyDistance;
+
+	const auto gridSize = volume.GetGridSize();
+	const auto pSDF = volume.GetSDF();
+	m_blockGridSize = (gridSize + BlockSize - 1) / BlockSize;
+	m_summaryGridSize = (m_blockGridSize + SummarySize - 1) / SummarySize;
+	const auto summaryCount = m_summaryGridSize * m_summaryGridSize * m_summaryGridSize;
+	m_blockWords.assign(summaryCount, 0);
+	m_summaryWords.assign((summaryCount + 63) / 64, 0);
+
+	// Trilinear samples inside a block interpolate its voxels and one more on each side; a
+	// slab of summary cells owns its words, so slabs build independently
+	atomic<uint32_t> occupiedBlockCount(0);
+	ParallelFor(m_summaryGridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		const auto getRange = [gridSize](uint32_t b, uint32_t& v0, uint32_t& v1)
+		{
+			v0 = b * BlockSize > 0 ? b * BlockSize - 1 : 0;
+			v1 = (min)((b + 1) * BlockSize, gridSize - 1);
+		};
+
+		uint32_t count = 0;
+		for (auto bz = begin * SummarySize; bz < (min)(end * SummarySize, m_blockGridSize); ++bz)
+			for (auto by = 0u; by < m_blockGridSize; ++by)
+				for (auto bx = 0u; bx < m_blockGridSize; ++bx)
+				{
+					uint32_t x0, x1, y0, y1, z0, z1;
+					getRange(bx, x0, x1);
+					getRange(by, y0, y1);
+					getRange(bz, z0, z1);
+
+					auto isOccupied = false;
+					for (auto k = z0; k <= z1 && !isOccupied; ++k)
+						for (auto j = y0; j <= y1 && !isOccupied; ++j)
+							for (auto i = x0; i <= x1 && !isOccupied; ++i)
+								isOccupied = pSDF[volume.GetVoxelIndex(i, j, k)] < emptyDistance;
+					if (!isOccupied) continue;
+
+					const auto summary = m_summaryGridSize * (m_summaryGridSize * (bz / SummarySize) + by / SummarySize) + bx / SummarySize;
+					m_blockWords[summary] |= 1ull << (((bz % SummarySize) * SummarySize + by % SummarySize) * SummarySize + bx % SummarySize);
+					++count;
+				}
+
+		occupiedBlockCount += count;
+	});
+
+	auto occupiedSummaryCount = 0u;
+	for (auto i = 0u; i < summaryCount; ++i)
+	{
+		if (!m_blockWords[i]) continue;
+		m_summaryWords[i / 64] |= 1ull << (i % 64);
+		++occupiedSummaryCount;
+	}
+
+	m_stats.BlockCount = m_blockGridSize * m_blockGridSize * m_blockGridSize;
+	m_stats.OccupiedBlockCount = occupiedBlockCount;
+	m_stats.SummaryCount = summaryCount;
+	m_stats.OccupiedSummaryCount = occupiedSummaryCount;
+	m_stats.ByteCount = static_cast<uint32_t>(sizeof(uint64_t) * (m_blockWords.size() + m_summaryWords.size()));
+	m_stats.BuildTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+//--------------------------------------------------------------------------------------
+// TraceCone() marching with empty cells skipped: samples in a cell that is empty are at
+// least emptyDistance, so they cannot lower the shadow term while the cone footprint t / k
+// stays below it
+//--------------------------------------------------------------------------------------
+XMFLOAT3 OccupancyPyramid::TraceCone(FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax,
+	float coneRadius, SphereTracingStats& stats) const
+{
+	const auto volumeWorldI = XMLoadFloat3x4(&m_pVolume->GetVolumeWorldI());
+	const auto one = XMVectorSplatOne();
+	const auto half = XMVectorReplicate(0.5f);
+	const auto ray = getGridRay(origin, dir);
+
+	const auto k = tMax / coneRadius;
+	const auto tEnd = tMax * 0.8f;
+	const auto tFootprint = m_emptyDistance * k;
+	auto r = 0.0f, pr = FLT_MAX / 2.0f, s = 1.0f / k;
+	auto t = tMin;
+	auto stepCount = 0u;
+
+	auto isHit = false;
+	while (t < tEnd)
+	{
+		const auto tSkip = skipEmpty(ray, t, tEnd, tFootprint, stats);
+		if (tSkip > t)
+		{
+			stepCount += 1;
+			t = tSkip;
+			pr = FLT_MAX / 2.0f;
+			continue;
+		}
+
+		const auto pos = XMVector3Transform(origin + t * dir, volumeWorldI);
+		if (!XMVector3InBounds(pos, one)) break;
+
+		r = m_pVolume->SampleLevel(pos * half + half);
+		++stats.SampleCount;
+		++stepCount;
+		if (r < 1e-4f)
+		{
+			isHit = true;
+			break;
+		}
+
+		// Skip the update where the shader would produce NaN or infinity
+		const auto r_sq = r * r;
+		const auto y = r_sq / (2.0f * pr);
+		const auto d_sq = r_sq - y * y;
+		const auto tY = t - y;
+		if (d_sq >= 0.0f && tY > 0.0f) s = (min)(sqrtf(d_sq) / tY, s);
+
+		pr = r;
+		t += r;
+	}
+
+	++stats.RayCount;
+	stats.StepCount += stepCount;
+	++stats.StepHistogram[(min)(stepCount / SphereTracingStats::HistogramBinWidth, SphereTracingStats::HistogramBinCount - 1)];
+
+	return isHit ? XMFLOAT3(t, r, 0.0f) : XMFLOAT3(t, r, s * k);
+}
+
+//--------------------------------------------------------------------------------------
+// SDFVolume::Intersect() with empty cells skipped; the 128-step budget only counts SDF samples
+//--------------------------------------------------------------------------------------
+bool OccupancyPyramid::Intersect(FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax, float& t,
+	SphereTracingStats& stats) const
+{
+	const auto volumeWorldI = XMLoadFloat3x4(&m_pVolume->GetVolumeWorldI());
+	const auto one = XMVectorSplatOne();
+	const auto half = XMVectorReplicate(0.5f);
+	const auto hitDist = m_pVolume->GetVoxelSize() * 0.25f;
+	const auto ray = getGridRay(origin, dir);
+
+	auto stepCount = 0u, sampleCount = 0u;
+	auto isHit = false;
+	t = tMin;
+	while (sampleCount < 128 && t < tMax)
+	{
+		const auto tSkip = skipEmpty(ray, t, tMax, FLT_MAX, stats);
+		if (tSkip > t)
+		{
+			++stepCount;
+			t = tSkip;
+			continue;
+		}
+
+		const auto pos = XMVector3Transform(origin + t * dir, volumeWorldI);
+		if (!XMVector3InBounds(pos, one)) break;
+
+		const auto r = m_pVolume->SampleLevel(pos * half + half);
+		++sampleCount;
+		++stepCount;
+		if (r < hitDist)
+		{
+			isHit = true;
+			break;
+		}
+		t += r;
+	}
+
+	++stats.RayCount;
+	stats.StepCount += stepCount;
+	stats.SampleCount += sampleCount;
+	++stats.StepHistogram[(min)(stepCount / SphereTracingStats::HistogramBinWidth, SphereTracingStats::HistogramBinCount - 1)];
+
+	return isHit;
+}
+
+bool OccupancyPyramid::IsBlockOccupied(uint32_t x, uint32_t y, uint32_t z) const
+{
+	const auto summary = m_summaryGridSize * (m_summaryGridSize * (z / SummarySize) + y / SummarySize) + x / SummarySize;
+
+	return (m_blockWords[summary] >> (((z % SummarySize) * SummarySize + y % SummarySize) * SummarySize + x % SummarySize)) & 1;
+}
+
+bool OccupancyPyramid::IsSummaryOccupied(uint32_t x, uint32_t y, uint32_t z) const
+{
+	const auto summary = m_summaryGridSize * (m_summaryGridSize * z + y) + x;
+
+	return (m_summaryWords[summary / 64] >> (summary % 64)) & 1;
+}
+
+const uint64_t* OccupancyPyramid::GetBlockWords() const
+{
+	return m_blockWords.data();
+}
+
+const uint64_t* OccupancyPyramid::GetSummaryWords() const
+{
+	return m_summaryWords.data();
+}
+
+const OccupancyPyramid::Stats& OccupancyPyramid::GetStats() const
+{
+	return m_stats;
+}
+
+OccupancyPyramid::GridRay OccupancyPyramid::getGridRay(FXMVECTOR origin, FXMVECTOR dir) const
+{
+	// Volume space [-1, 1] to voxel coordinates [0, gridSize]
+	const auto volumeWorldI = XMLoadFloat3x4(&m_pVolume->GetVolumeWorldI());
+	const auto gridSize = static_cast<float>(m_pVolume->GetGridSize());
+	const auto scale = XMVectorReplicate(0.5f * gridSize);
+
+	GridRay ray;
+	const auto gridDir = XMVector3TransformNormal(dir, volumeWorldI) * scale;
+	XMStoreFloat3(&ray.Origin, XMVector3Transform(origin, volumeWorldI) * scale + scale);
+	XMStoreFloat3(&ray.Dir, gridDir);
+	ray.Epsilon = 1e-3f / XMVectorGetX(XMVector3Length(gridDir));
+
+	return ray;
+}
+
+//--------------------------------------------------------------------------------------
+// DDA over the pyramid: from t, jump to the exit of each empty summary cell or block
+// while the exit stays before tEnd and tFootprint; returns t itself at an occupied block
+//--------------------------------------------------------------------------------------
+float OccupancyPyramid::skipEmpty(const GridRay& ray, float t, float tEnd, float tFootprint,
+	SphereTracingStats& stats) const
+{
+	const float* origin = &ray.Origin.x;
+	const float* dir = &ray.Dir.x;
+	const auto gridSize = static_cast<float>(m_pVolume->GetGridSize());
+
+	while (t < tEnd)
+	{
+		float g[3];
+		for (uint8_t i = 0; i < 3; ++i) g[i] = origin[i] + t * dir[i];
+		if (g[0] < 0.0f || g[1] < 0.0f || g[2] < 0.0f || g[0] >= gridSize || g[1] >= gridSize || g[2] >= gridSize) break;
+
+		uint32_t b[3];
+		for (uint8_t i = 0; i < 3; ++i) b[i] = static_cast<uint32_t>(g[i]) / BlockSize;
+
+		auto cellSize = 0u;
+		if (!IsSummaryOccupied(b[0] / SummarySize, b[1] / SummarySize, b[2] / SummarySize)) cellSize = BlockSize * SummarySize;
+		else if (!IsBlockOccupied(b[0], b[1], b[2])) cellSize = BlockSize;
+		else break;
+
+		// Exit of the cell along the ray
+		auto tExit = FLT_MAX;
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			if (dir[i] == 0.0f) continue;
+			const auto cell = static_cast<uint32_t>(g[i]) / cellSize;
+			const auto boundary = static_cast<float>(dir[i] > 0.0f ? (cell + 1) * cellSize : cell * cellSize);
+			tExit = (min)((boundary - origin[i]) / dir[i], tExit);
+		}
+
+		if (tExit > tFootprint) break;
+		t = (max)(tExit, t) + ray.Epsilon;
+		++stats.CoarseStepCount;
+	}
+
+	return t;
+}
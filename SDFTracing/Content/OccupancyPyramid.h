@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SphereTracer.h"
+
+//--------------------------------------------------------------------------------------
+// Bit-packed occupancy of the global SDF: one bit per 4^3-voxel block, set where the
+// block may be closer than emptyDistance to a surface, and one summary bit per 4^3
+// blocks. The 64 block bits of a summary cell share a word, so the whole pyramid is a
+// few kilobytes and can be uploaded as is. Marching skips empty cells with a DDA step
+// to the cell exit before sampling the SDF.
+//--------------------------------------------------------------------------------------
+class OccupancyPyramid
+{
+public:
+	struct Stats
+	{
+		double BuildTime;	// ms
+		uint32_t BlockCount;
+		uint32_t OccupiedBlockCount;
+		uint32_t SummaryCount;
+		uint32_t OccupiedSummaryCount;
+		uint32_t ByteCount;
+	};
+
+	OccupancyPyramid();
+	virtual ~OccupancyPyramid();
+
+	void Build(const SDFVolume& volume, float emptyDistance);
+
+	// Same results as SDFVolume::TraceCone() and SDFVolume::Intersect(), within the sampling tolerance
+	DirectX::XMFLOAT3 TraceCone(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMin, float tMax,
+		float coneRadius, SphereTracingStats& stats) const;
+	bool Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMin, float tMax, float& t,
+		SphereTracingStats& stats) const;
+
+	bool IsBlockOccupied(uint32_t x, uint32_t y, uint32_t z) const;
+	bool IsSummaryOccupied(uint32_t x, uint32_t y, uint32_t z) const;
+	const uint64_t* GetBlockWords() const;		// One word per summary cell, bit ((z * 4 + y) * 4 + x)
+	const uint64_t* GetSummaryWords() const;	// One bit per summary cell, linear order
+	const Stats& GetStats() const;
+
+	static const uint32_t BlockSize = 4;	// Voxels per block along each axis
+	static const uint32_t SummarySize = 4;	// Blocks per summary cell along each axis
+
+protected:
+	// Ray in voxel coordinates, affine in t
+	struct GridRay
+	{
+		DirectX::XMFLOAT3 Origin;
+		DirectX::XMFLOAT3 Dir;
+		float Epsilon;	// t offset past a cell boundary
+	};
+
+	GridRay getGridRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir) const;
+	float skipEmpty(const GridRay& ray, float t, float tEnd, float tFootprint, SphereTracingStats& stats) const;
+
+	const SDFVolume*		m_pVolume;
+	std::vector<uint64_t>	m_blockWords;
+	std::vector<uint64_t>	m_summaryWords;
+
+	uint32_t	m_blockGridSize;
+	uint32_t	m_summaryGridSize;
+	float		m_emptyDistance;
+
+	Stats m_stats;
+};
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+//--------------------------------------------------------------------------------------
+// Runs func(begin, end) over [0, count) in chunks pulled by all hardware threads
+//--------------------------------------------------------------------------------------
+template<typename Func>
+void ParallelFor(uint32_t count, uint32_t chunkSize, const Func& func)
+{
+	if (count == 0) return;
+
+	const auto chunkCount = (count + chunkSize - 1) / chunkSize;
+	const auto threadCount = (std::min)((std::max)(std::thread::hardware_concurrency(), 1u), chunkCount);
+
+	std::atomic<uint32_t> nextChunk(0);
+	const auto worker = [&]()
+	{
+		for (auto i = nextChunk++; i < chunkCount; i = nextChunk++)
+		{
+			const auto begin = i * chunkSize;
+			func(begin, (std::min)(begin + chunkSize, count));
+		}
+	};
+
+	std::vector<std::thread> threads(threadCount - 1);
+	for (auto& thread : threads) thread = std::thread(worker);
+	worker();
+	for (auto& thread : threads) thread.join();
+}
@@ -4,6 +4,7 @@
 
 #include "Renderer.h"
 #include "SharedConst.h"
+#include "AnalyticSDF.h"
 
 using namespace std;
 using namespace tiny;
@@ -21,26 +22,6 @@ struct CBPerFrame
 	uint32_t SampleIndex;
 };
 
-struct PerObject
-{
-	DirectX::XMFLOAT3X4 World;
-	DirectX::XMFLOAT3X4 WorldIT;
-};
-
-struct AABB
-{
-	DirectX::XMFLOAT3 Min;
-	DirectX::XMFLOAT3 Max;
-};
-
-struct LightSource
-{
-	DirectX::XMFLOAT4 Min;
-	DirectX::XMFLOAT4 Max;
-	DirectX::XMFLOAT4 Emissive;
-	DirectX::XMFLOAT3X4 World;
-};
-
 Renderer::Renderer() :
 	m_instances(),
 	m_textures(1),
@@ -69,7 +50,8 @@ bool Renderer::Init(RayTracing::EZ::CommandList* pCommandList, vector<Resource::
 
 	// Load scene
 	vector<GltfLoader::LightSource> lightSources(0);
-	loadScene(sceneReader, lightSources);
+	vector<GltfLoader::Material> materials(0);
+	XUSG_N_RETURN(loadScene(sceneReader, lightSources), false);
 
 	// create a null texture for place holder
 	m_textures[0] = Texture::MakeUnique();
@@ -84,7 +66,7 @@ bool Renderer::Init(RayTracing::EZ::CommandList* pCommandList, vector<Resource::
 	for (auto i = 0u; i < meshDescCount; ++i)
 	{
 		const auto startMeshId = static_cast<uint32_t>(m_meshes.size());
-		loadMesh(pCommandList, m_sceneDesc.Meshes[i], dynamicMeshIds, uploaders, lightSources);
+		XUSG_N_RETURN(loadMesh(pCommandList, m_sceneDesc.Meshes[i], dynamicMeshIds, uploaders, lightSources, materials), false);
 
 		for (auto j = 0u; j < m_meshes[startMeshId].MeshRes->NumSubsets; ++j)
 		{
@@ -145,6 +127,21 @@ bool Renderer::Init(RayTracing::EZ::CommandList* pCommandList, vector<Resource::
 			uploaders.back().get(), aabbs.data(), sizeof(AABB) * meshCount), false);
 	}
 
+#if VERTEX_QUANTIZATION
+	// Materials of the quantized vertices, with a default one for scenes without any vertices
+	{
+		if (materials.empty()) materials.push_back({ 0xffffffff, 0.0f });
+		const auto materialCount = static_cast<uint32_t>(materials.size());
+		m_materials = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_materials->Create(pDevice, materialCount, sizeof(GltfLoader::Material), ResourceFlag::NONE,
+			MemoryType::DEFAULT, 1, nullptr, 0, nullptr, MemoryFlag::NONE, L"Materials"), false);
+		uploaders.emplace_back(Resource::MakeUnique());
+
+		XUSG_N_RETURN(m_materials->Upload(pCommandList->AsCommandList(),
+			uploaders.back().get(), materials.data(), sizeof(GltfLoader::Material) * materialCount), false);
+	}
+#endif
+
 	// For dynamic meshes
 	const auto dynamicMeshCount = static_cast<uint32_t>(m_dynamicMeshes.size());
 	{
@@ -289,9 +286,14 @@ void Renderer::Render(RayTracing::EZ::CommandList* pCommandList, uint8_t frameIn
 }
 
 bool Renderer::loadMesh(XUSG::EZ::CommandList* pCommandList, const MeshDesc& meshDesc, vector<uint32_t>& dynamicMeshIds,
-	vector<Resource::uptr>& uploaders, vector<GltfLoader::LightSource>& lightSources)
+	vector<Resource::uptr>& uploaders, vector<GltfLoader::LightSource>& lightSources, vector<GltfLoader::Material>& materials)
 {
 	GltfLoader loader;
+	loader.SetCacheEnabled(true);
+	loader.SetVertexDeduplication(true);
+	loader.SetIndexReordering(true);
+	loader.SetNormalWelding(true);
+	loader.SetVertexQuantization(VERTEX_QUANTIZATION != 0);
 	if (!loader.Import(meshDesc.FileName.c_str(), true, true, true, meshDesc.InvertZ)) return false;
 
 	const auto startMeshId = static_cast<uint32_t>(m_meshes.size());
@@ -342,9 +344,36 @@ bool Renderer::loadMesh(XUSG::EZ::CommandList* pCommandList, const MeshDesc& mes
 		m_meshes[meshId].LightMapHeight = (min)(static_cast<uint32_t>(meshDesc.LightMapSize * pSubsets[i].LightMapScl.y), 1024u);
 	}
 
-	XUSG_N_RETURN(createMeshVB(pCommandList, *meshRes, loader.GetNumVertices(), loader.GetVertexStride(), loader.GetVertices(), uploaders), false);
-	XUSG_N_RETURN(createMeshIB(pCommandList, *meshRes, loader.GetNumIndices(), loader.GetIndices(), &m_meshes[startMeshId], numSubSets, uploaders), false);
-	XUSG_N_RETURN(createMeshTextures(pCommandList, loader.GetTextures(), loader.GetNumTextures(), uploaders), false);
+	// Take over the loader's buffers, so that each one is freed as soon as it has been staged
+	const auto stride = loader.GetVertexStride();
+	{
+#if VERTEX_QUANTIZATION
+		// Material indices rebased onto the materials of the whole scene; the shaders only take
+		// one vertex layout, so a mesh beyond the 15-bit material indices fails the scene
+		const auto materialOffset = static_cast<uint32_t>(materials.size());
+		const auto& meshMaterials = loader.GetMaterials();
+		if (materialOffset + meshMaterials.size() > GltfLoader::MaxMaterialCount) return false;
+		materials.insert(materials.end(), meshMaterials.cbegin(), meshMaterials.cend());
+
+		auto vertices = loader.DetachVertices();
+		const auto pVertices = reinterpret_cast<GltfLoader::QuantizedVertex*>(vertices.data());
+		for (size_t i = 0; i < vertices.size() / stride; ++i) pVertices[i].MaterialIdx += static_cast<uint16_t>(materialOffset);
+#else
+		const auto vertices = loader.DetachVertices();
+#endif
+
+		XUSG_N_RETURN(createMeshVB(pCommandList, *meshRes, static_cast<uint32_t>(vertices.size() / stride),
+			stride, vertices.data(), uploaders), false);
+	}
+
+	{
+		const auto indices = loader.DetachIndices();
+		XUSG_N_RETURN(createMeshIB(pCommandList, *meshRes, static_cast<uint32_t>(indices.size()), indices.data(),
+			&m_meshes[startMeshId], numSubSets, uploaders), false);
+	}
+
+	auto textures = loader.DetachTextures();
+	XUSG_N_RETURN(createMeshTextures(pCommandList, textures, uploaders), false);
 
 	const auto meshLightSources = loader.GetLightSources();
 	lightSources.insert(lightSources.end(), meshLightSources.cbegin(), meshLightSources.cend());
@@ -399,9 +428,11 @@ bool Renderer::createMeshCB(XUSG::EZ::CommandList* pCommandList, uint32_t meshId
 		uploaders.back().get(), &meshId, sizeof(meshId));
 }
 
-bool Renderer::createMeshTextures(XUSG::EZ::CommandList* pCommandList, const GltfLoader::Texture* pTextures,
-	uint32_t numTextures, std::vector<XUSG::Resource::uptr>& uploaders)
+bool Renderer::createMeshTextures(XUSG::EZ::CommandList* pCommandList, vector<GltfLoader::Texture>& textures,
+	std::vector<XUSG::Resource::uptr>& uploaders)
 {
+	const auto pTextures = textures.data();
+	const auto numTextures = static_cast<uint32_t>(textures.size());
 	const auto texIdxOffset = static_cast<uint32_t>(m_textures.size());
 	m_textures.resize(texIdxOffset + numTextures);
 	for (auto i = 0u; i < numTextures; ++i)
@@ -429,7 +460,8 @@ bool Renderer::createMeshTextures(XUSG::EZ::CommandList* pCommandList, const Glt
 		uploaders.emplace_back(Resource::MakeUnique());
 
 		XUSG_N_RETURN(m_textures[j]->Upload(pCommandList->AsCommandList(), uploaders.back().get(),
-			pTextures[i].Data.data(), pTextures[i].Channels), false);
+			pTextures[i].Data.get(), pTextures[i].Channels), false);
+		textures[i].Data.reset();
 	}
 
 	return true;
@@ -548,7 +580,8 @@ bool Renderer::buildAccelerationStructures(RayTracing::EZ::CommandList* pCommand
 		auto vbv = XUSG::EZ::GetVBV(pMeshRes->VertexBuffer.get());
 		auto ibv = XUSG::EZ::GetIBV(pMeshRes->IndexBuffer.get(), i - pMeshRes->StartMeshId);
 		const auto geometryFlag = mesh.AlphaMode == ALPHA_OPAQUE ? GeometryFlag::FULL_OPAQUE : GeometryFlag::NONE;
-		pCommandList->SetTriangleGeometries(geometries[i], 1, Format::R32G32B32_FLOAT, &vbv, &ibv, &geometryFlag);
+		pCommandList->SetTriangleGeometries(geometries[i], 1, VERTEX_QUANTIZATION ? Format::R16G16B16A16_SNORM :
+			Format::R32G32B32_FLOAT, &vbv, &ibv, &geometryFlag);
 
 		// Prebuild and allocate BLAS
 		mesh.BottomLevelAS = BottomLevelAS::MakeUnique();
@@ -576,7 +609,7 @@ bool Renderer::buildAccelerationStructures(RayTracing::EZ::CommandList* pCommand
 		const auto j = i + 1;
 		pCommandList->SetBLASDestination(m_meshes[i].BottomLevelAS.get(), dstBuffer, dstBufferOffsets[j], j);
 
-		XMStoreFloat3x4(&matrices[i], getWorldMatrix(i));
+		XMStoreFloat3x4(&matrices[i], getDequantizedWorldMatrix(i));
 		pTransforms[i] = reinterpret_cast<float*>(&matrices[i]);
 		pBottomLevelASes[i] = m_meshes[i].BottomLevelAS.get();
 	}
@@ -592,7 +625,7 @@ bool Renderer::buildAccelerationStructures(RayTracing::EZ::CommandList* pCommand
 	return true;
 }
 
-void Renderer::loadScene(TinyJson& sceneReader, vector<GltfLoader::LightSource>& lightSources)
+bool Renderer::loadScene(TinyJson& sceneReader, vector<GltfLoader::LightSource>& lightSources)
 {
 	float vecData[4];
 	m_sceneDesc.Name = sceneReader.Get<string>("Name");
@@ -619,6 +652,9 @@ void Renderer::loadScene(TinyJson& sceneReader, vector<GltfLoader::LightSource>&
 		}
 	}
 
+	// Analytic primitives; only AnalyticSDF on the CPU combines them with the mesh SDF so far
+	if (!AnalyticSDF::LoadPrimitives(sceneReader, m_sceneDesc.Primitives)) return false;
+
 	auto ambientBottom = sceneReader.Get<xarray>("AmbientBottom");
 	if (ambientBottom.Count() == 3)
 	{
@@ -675,6 +711,8 @@ void Renderer::loadScene(TinyJson& sceneReader, vector<GltfLoader::LightSource>&
 			m_lightSourceMeshIds.emplace_back(UINT32_MAX);
 		}
 	}
+
+	return true;
 }
 
 void Renderer::computeSceneAABB()
@@ -785,7 +823,7 @@ void Renderer::updateAccelerationStructures(RayTracing::EZ::CommandList* pComman
 	static vector<const BottomLevelAS*> pBottomLevelASes(meshCount);
 	for (auto i = 0u; i < meshCount; ++i)
 	{
-		XMStoreFloat3x4(&matrices[i], getWorldMatrix(i));
+		XMStoreFloat3x4(&matrices[i], getDequantizedWorldMatrix(i));
 		pTransforms[i] = reinterpret_cast<float*>(&matrices[i]);
 		pBottomLevelASes[i] = m_meshes[i].BottomLevelAS.get();
 	}
@@ -819,8 +857,14 @@ void Renderer::visibility(XUSG::EZ::CommandList* pCommandList, uint8_t frameInde
 	cbvs[1] = XUSG::EZ::GetCBV(m_cbPerFrame.get(), frameIndex);
 
 	// Set SRVs
-	const auto srv = XUSG::EZ::GetSRV(m_matrices[frameIndex].get());
-	pCommandList->SetResources(Shader::Stage::VS, DescriptorType::SRV, 0, 1, &srv);
+	const XUSG::EZ::ResourceView srvs[] =
+	{
+		XUSG::EZ::GetSRV(m_matrices[frameIndex].get()),
+#if VERTEX_QUANTIZATION
+		XUSG::EZ::GetSRV(m_meshAABBs.get())
+#endif
+	};
+	pCommandList->SetResources(Shader::Stage::VS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 
 	// Set vertex buffers
 	pCommandList->SetGraphicsDescriptorTable(Shader::Stage::VS, DescriptorType::SRV, m_srvTables[SRV_TABLE_VB], 1);
@@ -895,6 +939,10 @@ void Renderer::renderVolume(XUSG::EZ::CommandList* pCommandList, uint8_t frameIn
 			XUSG::EZ::GetSRV(m_globalSDF.get()),
 			XUSG::EZ::GetSRV(m_lightSources[frameIndex].get()),
 			XUSG::EZ::GetSRV(m_barycVolume.get()),
+#if VERTEX_QUANTIZATION
+			XUSG::EZ::GetSRV(m_meshAABBs.get()),
+			XUSG::EZ::GetSRV(m_materials.get())
+#endif
 		};
 		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 	}
@@ -935,7 +983,11 @@ void Renderer::render(XUSG::EZ::CommandList* pCommandList, uint8_t frameIndex)
 			XUSG::EZ::GetSRV(m_matrices[frameIndex].get()),
 			XUSG::EZ::GetSRV(m_globalSDF.get()),
 			XUSG::EZ::GetSRV(m_lightSources[frameIndex].get()),
-			XUSG::EZ::GetSRV(m_irradiance.get())
+			XUSG::EZ::GetSRV(m_irradiance.get()),
+#if VERTEX_QUANTIZATION
+			XUSG::EZ::GetSRV(m_meshAABBs.get()),
+			XUSG::EZ::GetSRV(m_materials.get())
+#endif
 		};
 		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 	}
@@ -1014,3 +1066,20 @@ FXMMATRIX Renderer::getWorldMatrix(uint32_t meshId) const
 
 	return scl * rot * tsl;
 }
+
+// The quantized positions of the vertex buffers, which the BLASes are built from, are in
+// [-1, 1] over the AABB of the mesh
+FXMMATRIX Renderer::getDequantizedWorldMatrix(uint32_t meshId) const
+{
+#if !VERTEX_QUANTIZATION
+	return getWorldMatrix(meshId);
+#else
+	const auto& pMeshRes = m_meshes[meshId].MeshRes.get();
+	const auto aabbMin = XMLoadFloat3(&pMeshRes->AABBMin);
+	const auto aabbMax = XMLoadFloat3(&pMeshRes->AABBMax);
+	const auto halfExtent = (aabbMax - aabbMin) * 0.5f;
+	const auto scale = XMVectorSelect(XMVectorSplatOne(), halfExtent, XMVectorGreater(halfExtent, XMVectorZero()));
+
+	return XMMatrixScalingFromVector(scale) * XMMatrixTranslationFromVector((aabbMin + aabbMax) * 0.5f) * getWorldMatrix(meshId);
+#endif
+}
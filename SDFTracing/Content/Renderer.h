@@ -8,6 +8,7 @@
 #include "Helper/XUSGRayTracing-EZ.h"
 #include "RayTracing/XUSGRayTracing.h"
 #include "Optional/XUSGGltfLoader.h"
+#include "SceneData.h"
 
 class Renderer
 {
@@ -24,6 +25,7 @@ public:
 	struct SceneDesc
 	{
 		std::vector<MeshDesc> Meshes;
+		std::vector<AnalyticPrimitive> Primitives;
 		std::string Name;
 		DirectX::XMFLOAT4 AmbientBottom;
 		DirectX::XMFLOAT4 AmbientTop;
@@ -131,21 +133,21 @@ protected:
 
 	bool loadMesh(XUSG::EZ::CommandList* pCommandList, const MeshDesc& meshDesc,
 		std::vector<uint32_t>& dynamicMeshIds, std::vector<XUSG::Resource::uptr>& uploaders,
-		std::vector<XUSG::GltfLoader::LightSource>& lightSources);
+		std::vector<XUSG::GltfLoader::LightSource>& lightSources, std::vector<XUSG::GltfLoader::Material>& materials);
 	bool createMeshVB(XUSG::EZ::CommandList* pCommandList, MeshResource& meshRes, uint32_t numVert,
 		uint32_t stride, const uint8_t* pData, std::vector<XUSG::Resource::uptr>& uploaders);
 	bool createMeshIB(XUSG::EZ::CommandList* pCommandList, MeshResource& meshRes, uint32_t numIndices, const uint32_t* pData,
 		const MeshSubset* pSubsets, uint32_t numSubsets, std::vector<XUSG::Resource::uptr>& uploaders);
 	bool createMeshCB(XUSG::EZ::CommandList* pCommandList, uint32_t meshId, std::vector<XUSG::Resource::uptr>& uploaders);
-	bool createMeshTextures(XUSG::EZ::CommandList* pCommandList, const XUSG::GltfLoader::Texture* pTextures,
-		uint32_t numTextures, std::vector<XUSG::Resource::uptr>& uploaders);
+	bool createMeshTextures(XUSG::EZ::CommandList* pCommandList, std::vector<XUSG::GltfLoader::Texture>& textures,
+		std::vector<XUSG::Resource::uptr>& uploaders);
 	bool createCBs(const XUSG::Device* pDevice);
 	bool createShaders();
 	bool createDescriptorTables(XUSG::EZ::CommandList* pCommandList);
 	bool buildAccelerationStructures(XUSG::RayTracing::EZ::CommandList* pCommandList,
 		std::vector<XUSG::RayTracing::GeometryBuffer>& geometries);
 
-	void loadScene(tiny::TinyJson& sceneReader, std::vector<XUSG::GltfLoader::LightSource>& lightSources);
+	bool loadScene(tiny::TinyJson& sceneReader, std::vector<XUSG::GltfLoader::LightSource>& lightSources);
 	void computeSceneAABB();
 	void buildSDF(XUSG::RayTracing::EZ::CommandList* pCommandList, uint8_t frameIndex);
 	void updateSDF(XUSG::RayTracing::EZ::CommandList* pCommandList, uint8_t frameIndex);
@@ -156,6 +158,7 @@ protected:
 	void antiAlias(XUSG::EZ::CommandList* pCommandList, XUSG::RenderTarget* pRenderTarget);
 
 	DirectX::FXMMATRIX getWorldMatrix(uint32_t meshId) const;
+	DirectX::FXMMATRIX getDequantizedWorldMatrix(uint32_t meshId) const;
 
 	SceneDesc m_sceneDesc;
 	std::vector<MeshSubset> m_meshes;
@@ -173,6 +176,7 @@ protected:
 	XUSG::ConstantBuffer::uptr	m_cbPerFrame;
 	XUSG::StructuredBuffer::uptr m_matrices[FrameCount];
 	XUSG::StructuredBuffer::uptr m_meshAABBs;
+	XUSG::StructuredBuffer::uptr m_materials;
 	XUSG::StructuredBuffer::uptr m_lightSources[FrameCount];
 	XUSG::StructuredBuffer::uptr m_dynamicMeshList;
 	XUSG::StructuredBuffer::uptr m_dynamicMeshIds;
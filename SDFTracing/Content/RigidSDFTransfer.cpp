@@ -0,0 +1,299 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "RigidSDFTransfer.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+RigidSDFTransfer::RigidSDFTransfer() :
+	m_brickGridSize(0),
+	m_voxelSize(0.0f),
+	m_stats()
+{
+}
+
+RigidSDFTransfer::~RigidSDFTransfer()
+{
+}
+
+void RigidSDFTransfer::Init(const SDFVolume& staticVolume)
+{
+	const auto voxelCount = staticVolume.GetVoxelCount();
+	m_staticSDF.assign(staticVolume.GetSDF(), staticVolume.GetSDF() + voxelCount);
+	m_staticIds.assign(staticVolume.GetIds(), staticVolume.GetIds() + voxelCount);
+	m_staticBarycs.assign(staticVolume.GetBarycs(), staticVolume.GetBarycs() + voxelCount);
+	m_voxelSize = staticVolume.GetVoxelSize();
+	m_objects.clear();
+	m_stats = {};
+
+	// Largest static distance per brick, to skip the bricks no object can get closer to
+	const auto gridSize = staticVolume.GetGridSize();
+	m_brickGridSize = (gridSize + BrickSize - 1) / BrickSize;
+	m_staticBrickMaxSDF.resize(m_brickGridSize * m_brickGridSize * m_brickGridSize);
+	ParallelFor(m_brickGridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto bz = begin; bz < end; ++bz)
+			for (auto by = 0u; by < m_brickGridSize; ++by)
+				for (auto bx = 0u; bx < m_brickGridSize; ++bx)
+				{
+					auto maxDist = -FLT_MAX;
+					for (auto z = bz * BrickSize; z < (min)((bz + 1) * BrickSize, gridSize); ++z)
+						for (auto y = by * BrickSize; y < (min)((by + 1) * BrickSize, gridSize); ++y)
+							for (auto x = bx * BrickSize; x < (min)((bx + 1) * BrickSize, gridSize); ++x)
+								maxDist = (max)(m_staticSDF[staticVolume.GetVoxelIndex(x, y, z)], maxDist);
+					m_staticBrickMaxSDF[m_brickGridSize * (m_brickGridSize * bz + by) + bx] = maxDist;
+				}
+	});
+}
+
+uint32_t RigidSDFTransfer::AddMesh(const MeshView& mesh, uint32_t meshId, const XMFLOAT3X4& restWorld,
+	uint32_t localGridSize, uint32_t marginVoxelCount)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	// Cubic bounds of the mesh at its rest pose
+	const auto world = XMLoadFloat3x4(&restWorld);
+	auto aabbMin = XMVectorReplicate(FLT_MAX), aabbMax = XMVectorReplicate(-FLT_MAX);
+	for (auto i = 0u; i < mesh.IndexCount; ++i)
+	{
+		const auto pos = XMVector3Transform(XMLoadFloat3(&mesh.Vertices[mesh.Indices[i]].Pos), world);
+		aabbMin = XMVectorMin(pos, aabbMin);
+		aabbMax = XMVectorMax(pos, aabbMax);
+	}
+
+	XMFLOAT3 center, extent;
+	XMStoreFloat3(&center, (aabbMin + aabbMax) * 0.5f);
+	XMStoreFloat3(&extent, (aabbMax - aabbMin) * 0.5f);
+	const auto halfSize = (max)(extent.x, (max)(extent.y, extent.z)) + m_voxelSize * marginVoxelCount;
+
+	const auto objectId = static_cast<uint32_t>(m_objects.size());
+	m_objects.emplace_back();
+	auto& object = m_objects.back();
+	object.RestWorld = restWorld;
+	object.Extent = XMFLOAT3(extent.x / halfSize, extent.y / halfSize, extent.z / halfSize);
+	object.Lo = XMUINT3(0, 0, 0);
+	object.Hi = XMUINT3(0, 0, 0);
+	object.MeshId = meshId;
+	object.IsWritten = false;
+	object.Stats = {};
+
+	// One-time voxelization of the mesh alone; its ids are rebased to the global mesh id
+	XMFLOAT3X4 volumeWorld;
+	XMStoreFloat3x4(&volumeWorld, XMMatrixScaling(halfSize, halfSize, halfSize) *
+		XMMatrixTranslation(center.x, center.y, center.z));
+	object.Volume.Init(localGridSize, volumeWorld);
+
+	PerObject matrices;
+	matrices.World = restWorld;
+	XMStoreFloat3x4(&matrices.WorldIT, XMMatrixTranspose(XMMatrixInverse(nullptr, world)));
+	object.Volume.Voxelize(&mesh, &matrices, 1);
+
+	const auto pIds = object.Volume.GetIds();
+	const auto localVoxelCount = object.Volume.GetVoxelCount();
+	for (auto i = 0u; i < localVoxelCount; ++i)
+		if (pIds[i]) pIds[i] = EncodeVisibility(meshId, DecodeVisibility(pIds[i]).PrimId);
+
+	m_stats.BakeTime += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	return objectId;
+}
+
+void RigidSDFTransfer::Update(SDFVolume& volume, const PerObject* pMatrices)
+{
+	// Every region written last frame goes back to the static field first, so that objects
+	// overlapping each other can all be min-combined afterwards
+	auto start = chrono::high_resolution_clock::now();
+	m_stats.RestoredVoxelCount = 0;
+	for (auto& object : m_objects)
+	{
+		if (!object.IsWritten) continue;
+		restore(volume, object);
+		m_stats.RestoredVoxelCount += (object.Hi.x - object.Lo.x + 1) * (object.Hi.y - object.Lo.y + 1) * (object.Hi.z - object.Lo.z + 1);
+	}
+	m_stats.RestoreTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	start = chrono::high_resolution_clock::now();
+	m_stats.ResampledVoxelCount = 0;
+	m_stats.ClampedVoxelCount = 0;
+	for (auto& object : m_objects)
+	{
+		resample(volume, object, pMatrices[object.MeshId]);
+		m_stats.ResampledVoxelCount += object.Stats.VoxelCount;
+		m_stats.ClampedVoxelCount += object.Stats.ClampedVoxelCount;
+	}
+	m_stats.ResampleTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+const SDFVolume& RigidSDFTransfer::GetLocalVolume(uint32_t objectId) const
+{
+	return m_objects[objectId].Volume;
+}
+
+const RigidSDFTransfer::ObjectStats& RigidSDFTransfer::GetObjectStats(uint32_t objectId) const
+{
+	return m_objects[objectId].Stats;
+}
+
+const RigidSDFTransfer::Stats& RigidSDFTransfer::GetStats() const
+{
+	return m_stats;
+}
+
+void RigidSDFTransfer::restore(SDFVolume& volume, const Object& object)
+{
+	const auto& lo = object.Lo;
+	const auto& hi = object.Hi;
+	const auto rowLength = hi.x - lo.x + 1;
+	for (auto z = lo.z; z <= hi.z; ++z)
+		for (auto y = lo.y; y <= hi.y; ++y)
+		{
+			const auto i = volume.GetVoxelIndex(lo.x, y, z);
+			copy_n(&m_staticSDF[i], rowLength, &volume.GetSDF()[i]);
+			copy_n(&m_staticIds[i], rowLength, &volume.GetIds()[i]);
+			copy_n(&m_staticBarycs[i], rowLength, &volume.GetBarycs()[i]);
+		}
+}
+
+//--------------------------------------------------------------------------------------
+// Trilinear lookups of the local SDF at the global voxel centers, carried to the rest pose
+// by world^-1 * restWorld; ids and barycentrics come from the closest-surface corner.
+// Voxels outside the local volume take min(current, distance to the mesh bounds), over
+// the bricks where that distance can fall below the static one
+//--------------------------------------------------------------------------------------
+void RigidSDFTransfer::resample(SDFVolume& volume, Object& object, const PerObject& matrices)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	const auto& local = object.Volume;
+	const auto localGridSize = local.GetGridSize();
+	const auto gridSize = volume.GetGridSize();
+
+	// Global voxel center -> local volume space in [-1, 1], and the uniform scale of the motion
+	const auto world = XMLoadFloat3x4(&matrices.World);
+	const auto motion = XMMatrixInverse(nullptr, world) * XMLoadFloat3x4(&object.RestWorld);
+	const auto toLocal = motion * XMLoadFloat3x4(&local.GetVolumeWorldI());
+	const auto distScale = 1.0f / XMVectorGetX(XMVector3Length(motion.r[0]));
+
+	// Distance to the mesh bounds, from local volume space back to global world units
+	const auto one = XMVectorSplatOne();
+	const auto extent = XMLoadFloat3(&object.Extent);
+	const auto boundsScale = XMVectorGetX(XMVector3Length(XMLoadFloat3x4(&local.GetVolumeWorld()).r[0])) * distScale;
+	const auto getBoundsDist = [&](FXMVECTOR pos)
+	{
+		return XMVectorGetX(XMVector3Length(XMVectorMax(XMVectorAbs(pos) - extent, XMVectorZero()))) * boundsScale;
+	};
+
+	// Bricks that the moved bounds may get closer to than the static field
+	vector<uint32_t> bricks;
+	auto lo = XMUINT3(UINT32_MAX, UINT32_MAX, UINT32_MAX), hi = XMUINT3(0, 0, 0);
+	for (auto bz = 0u; bz < m_brickGridSize; ++bz)
+		for (auto by = 0u; by < m_brickGridSize; ++by)
+			for (auto bx = 0u; bx < m_brickGridSize; ++bx)
+			{
+				const auto c0 = volume.GetVoxelCenter(bx * BrickSize, by * BrickSize, bz * BrickSize);
+				const auto c1 = volume.GetVoxelCenter((min)((bx + 1) * BrickSize, gridSize) - 1,
+					(min)((by + 1) * BrickSize, gridSize) - 1, (min)((bz + 1) * BrickSize, gridSize) - 1);
+				const auto radius = XMVectorGetX(XMVector3Length(c1 - c0)) * 0.5f;
+				const auto brickId = m_brickGridSize * (m_brickGridSize * bz + by) + bx;
+				if (getBoundsDist(XMVector3Transform((c0 + c1) * 0.5f, toLocal)) - radius >= m_staticBrickMaxSDF[brickId]) continue;
+
+				bricks.emplace_back(brickId);
+				lo = XMUINT3((min)(bx, lo.x), (min)(by, lo.y), (min)(bz, lo.z));
+				hi = XMUINT3((max)(bx, hi.x), (max)(by, hi.y), (max)(bz, hi.z));
+			}
+
+	object.IsWritten = !bricks.empty();
+	if (object.IsWritten)
+	{
+		object.Lo = XMUINT3(lo.x * BrickSize, lo.y * BrickSize, lo.z * BrickSize);
+		object.Hi = XMUINT3((min)((hi.x + 1) * BrickSize, gridSize) - 1, (min)((hi.y + 1) * BrickSize, gridSize) - 1,
+			(min)((hi.z + 1) * BrickSize, gridSize) - 1);
+	}
+
+	const auto surfaceDist = m_voxelSize * 0.5f * sqrtf(2.0f);
+	const auto pSDF = volume.GetSDF();
+	const auto pIds = volume.GetIds();
+	const auto pBarycs = volume.GetBarycs();
+	const auto pLocalSDF = local.GetSDF();
+	const auto pLocalIds = local.GetIds();
+	const auto pLocalBarycs = local.GetBarycs();
+
+	atomic<uint32_t> voxelCount(0), clampedVoxelCount(0);
+	ParallelFor(static_cast<uint32_t>(bricks.size()), 1, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t count = 0, clampedCount = 0;
+		for (auto b = begin; b < end; ++b)
+		{
+			const auto brickId = bricks[b];
+			const auto bx = brickId % m_brickGridSize;
+			const auto by = (brickId / m_brickGridSize) % m_brickGridSize;
+			const auto bz = brickId / (m_brickGridSize * m_brickGridSize);
+			const auto x0 = bx * BrickSize, x1 = (min)(x0 + BrickSize, gridSize);
+			for (auto z = bz * BrickSize; z < (min)((bz + 1) * BrickSize, gridSize); ++z)
+				for (auto y = by * BrickSize; y < (min)((by + 1) * BrickSize, gridSize); ++y)
+				{
+					// Local positions are affine in x along a row
+					const auto p0 = XMVector3Transform(volume.GetVoxelCenter(x0, y, z), toLocal);
+					const auto step = XMVector3TransformNormal(volume.GetVoxelCenter(1, y, z) - volume.GetVoxelCenter(0, y, z), toLocal);
+					for (auto x = x0; x < x1; ++x)
+					{
+						const auto pos = XMVectorMultiplyAdd(step, XMVectorReplicate(static_cast<float>(x - x0)), p0);
+						const auto i = volume.GetVoxelIndex(x, y, z);
+						if (!XMVector3LessOrEqual(XMVectorAbs(pos), one))
+						{
+							// The mesh lies inside the bounds, so this is a lower bound of its distance;
+							// ids stay, since no surface of the mesh is within the margin
+							const auto dist = getBoundsDist(pos);
+							if (dist < pSDF[i])
+							{
+								pSDF[i] = dist;
+								++clampedCount;
+							}
+							continue;
+						}
+
+						const auto uvw = pos * 0.5f + XMVectorReplicate(0.5f);
+						const auto dist = local.SampleLevel(uvw) * distScale;
+						if (dist >= pSDF[i]) continue;
+
+						pSDF[i] = dist;
+						if (fabsf(dist) < surfaceDist)
+						{
+							// The local narrow band shrinks with finer local grids, so take the
+							// trilinear corner closest to the surface that still carries an id
+							XMFLOAT3 coord;
+							XMStoreFloat3(&coord, XMVectorClamp(uvw * static_cast<float>(localGridSize) - XMVectorReplicate(0.5f),
+								XMVectorZero(), XMVectorReplicate(static_cast<float>(localGridSize - 1))));
+							auto minDist = FLT_MAX;
+							pIds[i] = 0;
+							for (uint8_t k = 0; k < 8; ++k)
+							{
+								const auto j = local.GetVoxelIndex((min)(static_cast<uint32_t>(coord.x) + (k & 1), localGridSize - 1),
+									(min)(static_cast<uint32_t>(coord.y) + ((k >> 1) & 1), localGridSize - 1),
+									(min)(static_cast<uint32_t>(coord.z) + (k >> 2), localGridSize - 1));
+								const auto cornerDist = fabsf(pLocalSDF[j]);
+								if (!pLocalIds[j] || cornerDist >= minDist) continue;
+
+								minDist = cornerDist;
+								pIds[i] = pLocalIds[j];
+								pBarycs[i] = pLocalBarycs[j];
+							}
+						}
+						else pIds[i] = 0;
+						++count;
+					}
+				}
+		}
+
+		voxelCount += count;
+		clampedVoxelCount += clampedCount;
+	});
+
+	object.Stats.VoxelCount = voxelCount;
+	object.Stats.ClampedVoxelCount = clampedVoxelCount;
+	object.Stats.ResampleTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
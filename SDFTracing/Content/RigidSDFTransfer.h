@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SDFVolume.h"
+
+//--------------------------------------------------------------------------------------
+// Rigid-motion transfer of dynamic meshes: each one is voxelized once into its own local
+// volume at its rest pose, and every frame the global SDF around it is rebuilt as
+// min(static SDF, local SDF resampled through the rest-to-current motion) instead of
+// re-tracing those voxels; outside the moved local volume, the distance to the mesh bounds
+// caps the static distances, so that the field never overestimates
+//--------------------------------------------------------------------------------------
+class RigidSDFTransfer
+{
+public:
+	struct ObjectStats
+	{
+		double ResampleTime;	// ms
+		uint32_t VoxelCount;
+		uint32_t ClampedVoxelCount;
+	};
+
+	struct Stats
+	{
+		double BakeTime;		// ms
+		double RestoreTime;		// ms
+		double ResampleTime;	// ms
+		uint32_t RestoredVoxelCount;
+		uint32_t ResampledVoxelCount;
+		uint32_t ClampedVoxelCount;
+	};
+
+	RigidSDFTransfer();
+	virtual ~RigidSDFTransfer();
+
+	// The static SDF, ids and barycentrics are copied from a volume holding the static meshes only
+	void Init(const SDFVolume& staticVolume);
+
+	// The local volume bounds the mesh at restWorld, padded by marginVoxelCount global voxels
+	uint32_t AddMesh(const MeshView& mesh, uint32_t meshId, const DirectX::XMFLOAT3X4& restWorld,
+		uint32_t localGridSize = 64, uint32_t marginVoxelCount = 4);
+	void Update(SDFVolume& volume, const PerObject* pMatrices);
+
+	const SDFVolume& GetLocalVolume(uint32_t objectId) const;
+	const ObjectStats& GetObjectStats(uint32_t objectId) const;
+	const Stats& GetStats() const;
+
+	static const uint32_t BrickSize = 8;	// Voxels per brick along each axis, for culling the clamping
+
+protected:
+	// World matrices only need to move rigidly (with uniform scale) away from RestWorld
+	struct Object
+	{
+		SDFVolume Volume;
+		DirectX::XMFLOAT3X4 RestWorld;
+		DirectX::XMFLOAT3 Extent;	// Half extents of the mesh bounds, in local volume space
+		DirectX::XMUINT3 Lo;	// Voxel range written last frame
+		DirectX::XMUINT3 Hi;
+		uint32_t MeshId;
+		bool IsWritten;
+		ObjectStats Stats;
+	};
+
+	void restore(SDFVolume& volume, const Object& object);
+	void resample(SDFVolume& volume, Object& object, const PerObject& matrices);
+
+	std::vector<float>				m_staticSDF;
+	std::vector<uint32_t>			m_staticIds;
+	std::vector<DirectX::XMFLOAT2>	m_staticBarycs;
+	std::vector<float>				m_staticBrickMaxSDF;
+	std::vector<Object>				m_objects;
+
+	uint32_t	m_brickGridSize;
+	float		m_voxelSize;
+
+	Stats m_stats;
+};
@@ -0,0 +1,366 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SDFVolume.h"
+#include "IrradianceMipBuilder.h"
+#include "MonteCarlo.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+SDFVolume::SDFVolume() :
+	m_gridSize(0)
+{
+}
+
+SDFVolume::~SDFVolume()
+{
+}
+
+void SDFVolume::Init(uint32_t gridSize, const XMFLOAT3X4& volumeWorld)
+{
+	m_gridSize = gridSize;
+	m_volumeWorld = volumeWorld;
+	XMStoreFloat3x4(&m_volumeWorldI, XMMatrixInverse(nullptr, XMLoadFloat3x4(&volumeWorld)));
+
+	const auto voxelCount = GetVoxelCount();
+	m_sdf.assign(voxelCount, FLT_MAX);
+	m_ids.assign(voxelCount, 0);
+	m_barycs.assign(voxelCount, XMFLOAT2(0.0f, 0.0f));
+}
+
+//--------------------------------------------------------------------------------------
+// Converged result of CSBuildSDF: signed distance to the closest triangle, positive on
+// the front side, with the id and barycentrics in the narrow band around the surface
+//--------------------------------------------------------------------------------------
+void SDFVolume::Voxelize(const MeshView* pMeshes, const PerObject* pMatrices, uint32_t meshCount)
+{
+	struct Triangle
+	{
+		XMFLOAT3 A, B, C, N;
+		XMFLOAT3 Center;
+		float Radius;
+		uint32_t Id;
+	};
+
+	vector<Triangle> triangles;
+	for (auto i = 0u; i < meshCount; ++i)
+	{
+		const auto& mesh = pMeshes[i];
+		const auto world = XMLoadFloat3x4(&pMatrices[i].World);
+		for (auto j = 0u; j < mesh.IndexCount / 3; ++j)
+		{
+			const auto a = XMVector3Transform(XMLoadFloat3(&mesh.Vertices[mesh.Indices[j * 3]].Pos), world);
+			const auto b = XMVector3Transform(XMLoadFloat3(&mesh.Vertices[mesh.Indices[j * 3 + 1]].Pos), world);
+			const auto c = XMVector3Transform(XMLoadFloat3(&mesh.Vertices[mesh.Indices[j * 3 + 2]].Pos), world);
+			const auto center = (a + b + c) / 3.0f;
+
+			Triangle triangle;
+			XMStoreFloat3(&triangle.A, a);
+			XMStoreFloat3(&triangle.B, b);
+			XMStoreFloat3(&triangle.C, c);
+			XMStoreFloat3(&triangle.N, XMVector3Normalize(XMVector3Cross(b - a, c - a)));
+			XMStoreFloat3(&triangle.Center, center);
+			triangle.Radius = XMVectorGetX(XMVectorMax(XMVector3Length(a - center),
+				XMVectorMax(XMVector3Length(b - center), XMVector3Length(c - center))));
+			triangle.Id = EncodeVisibility(i, j);
+			triangles.emplace_back(triangle);
+		}
+	}
+
+	const auto surfaceDist = GetVoxelSize() * 0.5f * sqrtf(2.0f);
+	ParallelFor(m_gridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto z = begin; z < end; ++z)
+			for (auto y = 0u; y < m_gridSize; ++y)
+				for (auto x = 0u; x < m_gridSize; ++x)
+				{
+					const auto p = GetVoxelCenter(x, y, z);
+					auto minDistSq = FLT_MAX;
+					auto closest = XMVectorZero();
+					XMFLOAT2 baryc(0.0f, 0.0f);
+					const Triangle* pClosest = nullptr;
+					for (const auto& triangle : triangles)
+					{
+						// Bounding-sphere rejection
+						const auto centerDist = XMVectorGetX(XMVector3Length(p - XMLoadFloat3(&triangle.Center))) - triangle.Radius;
+						if (centerDist > 0.0f && centerDist * centerDist >= minDistSq) continue;
+
+						// Closest point on the triangle, from Real-Time Collision Detection 5.1.5
+						const auto a = XMLoadFloat3(&triangle.A);
+						const auto b = XMLoadFloat3(&triangle.B);
+						const auto c = XMLoadFloat3(&triangle.C);
+						const auto ab = b - a, ac = c - a, ap = p - a, bp = p - b, cp = p - c;
+						const auto d1 = XMVectorGetX(XMVector3Dot(ab, ap)), d2 = XMVectorGetX(XMVector3Dot(ac, ap));
+						const auto d3 = XMVectorGetX(XMVector3Dot(ab, bp)), d4 = XMVectorGetX(XMVector3Dot(ac, bp));
+						const auto d5 = XMVectorGetX(XMVector3Dot(ab, cp)), d6 = XMVectorGetX(XMVector3Dot(ac, cp));
+						const auto va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+
+						float v, w;
+						if (d1 <= 0.0f && d2 <= 0.0f) v = 0.0f, w = 0.0f;
+						else if (d3 >= 0.0f && d4 <= d3) v = 1.0f, w = 0.0f;
+						else if (d6 >= 0.0f && d5 <= d6) v = 0.0f, w = 1.0f;
+						else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) v = d1 / (d1 - d3), w = 0.0f;
+						else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) v = 0.0f, w = d2 / (d2 - d6);
+						else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+						{
+							w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+							v = 1.0f - w;
+						}
+						else
+						{
+							const auto denom = 1.0f / (va + vb + vc);
+							v = vb * denom;
+							w = vc * denom;
+						}
+
+						const auto q = a + ab * v + ac * w;
+						const auto distSq = XMVectorGetX(XMVector3LengthSq(p - q));
+						if (distSq < minDistSq)
+						{
+							minDistSq = distSq;
+							closest = q;
+							baryc = XMFLOAT2(v, w);
+							pClosest = &triangle;
+						}
+					}
+
+					if (!pClosest) continue;
+
+					const auto i = GetVoxelIndex(x, y, z);
+					const auto dist = sqrtf(minDistSq);
+					const auto isFront = XMVectorGetX(XMVector3Dot(p - closest, XMLoadFloat3(&pClosest->N))) >= 0.0f;
+					m_sdf[i] = isFront ? dist : -dist;
+					if (dist < surfaceDist)
+					{
+						m_ids[i] = pClosest->Id;
+						m_barycs[i] = baryc;
+					}
+				}
+	});
+}
+
+float SDFVolume::SampleLevel(FXMVECTOR uvw) const
+{
+	// Texel space with LINEAR_CLAMP addressing
+	const auto maxCoord = static_cast<float>(m_gridSize - 1);
+	XMFLOAT3 coord;
+	XMStoreFloat3(&coord, XMVectorClamp(uvw * static_cast<float>(m_gridSize) - XMVectorReplicate(0.5f),
+		XMVectorZero(), XMVectorReplicate(maxCoord)));
+
+	const auto x0 = static_cast<uint32_t>(coord.x);
+	const auto y0 = static_cast<uint32_t>(coord.y);
+	const auto z0 = static_cast<uint32_t>(coord.z);
+	const auto x1 = (min)(x0 + 1, m_gridSize - 1);
+	const auto y1 = (min)(y0 + 1, m_gridSize - 1);
+	const auto z1 = (min)(z0 + 1, m_gridSize - 1);
+	const auto fx = coord.x - x0;
+	const auto fy = coord.y - y0;
+	const auto fz = coord.z - z0;
+
+	const auto c00 = fetch(x0, y0, z0) + (fetch(x1, y0, z0) - fetch(x0, y0, z0)) * fx;
+	const auto c10 = fetch(x0, y1, z0) + (fetch(x1, y1, z0) - fetch(x0, y1, z0)) * fx;
+	const auto c01 = fetch(x0, y0, z1) + (fetch(x1, y0, z1) - fetch(x0, y0, z1)) * fx;
+	const auto c11 = fetch(x0, y1, z1) + (fetch(x1, y1, z1) - fetch(x0, y1, z1)) * fx;
+	const auto c0 = c00 + (c10 - c00) * fy;
+	const auto c1 = c01 + (c11 - c01) * fy;
+
+	return c0 + (c1 - c0) * fz;
+}
+
+float SDFVolume::Sample(FXMVECTOR pos) const
+{
+	const auto volumeWorldI = XMLoadFloat3x4(&m_volumeWorldI);
+	const auto uvw = XMVector3Transform(pos, volumeWorldI) * 0.5f + XMVectorReplicate(0.5f);
+
+	return SampleLevel(uvw);
+}
+
+//--------------------------------------------------------------------------------------
+// Same marching as TraceCone() in ConeTrace.hlsli; returns (t, r, shadow)
+//--------------------------------------------------------------------------------------
+XMFLOAT3 SDFVolume::TraceCone(FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax, float coneRadius) const
+{
+	const auto volumeWorldI = XMLoadFloat3x4(&m_volumeWorldI);
+	const auto one = XMVectorSplatOne();
+	const auto half = XMVectorReplicate(0.5f);
+
+	const auto k = tMax / coneRadius;
+	auto r = 0.0f, pr = FLT_MAX / 2.0f, s = 1.0f / k;
+	auto t = tMin;
+	for (; t < tMax * 0.8f; t += r)
+	{
+		const auto pos = XMVector3Transform(origin + t * dir, volumeWorldI);
+		if (!XMVector3InBounds(pos, one)) break;
+
+		r = SampleLevel(pos * half + half);
+		if (r < 1e-4f) return XMFLOAT3(t, r, 0.0f);
+
+		// Skip the update where the shader would produce NaN or infinity
+		const auto r_sq = r * r;
+		const auto y = r_sq / (2.0f * pr);
+		const auto d_sq = r_sq - y * y;
+		const auto tY = t - y;
+		if (d_sq >= 0.0f && tY > 0.0f) s = (min)(sqrtf(d_sq) / tY, s);
+
+		pr = r;
+	}
+
+	s *= k;
+
+	return XMFLOAT3(t, r, s);
+}
+
+//--------------------------------------------------------------------------------------
+// Plain sphere tracing to within a quarter voxel of the surface; t is the hit distance,
+// or where the ray left the volume
+//--------------------------------------------------------------------------------------
+bool SDFVolume::Intersect(FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax, float& t) const
+{
+	const auto volumeWorldI = XMLoadFloat3x4(&m_volumeWorldI);
+	const auto one = XMVectorSplatOne();
+	const auto half = XMVectorReplicate(0.5f);
+	const auto hitDist = GetVoxelSize() * 0.25f;
+
+	t = tMin;
+	for (uint8_t i = 0; i < 128 && t < tMax; ++i)
+	{
+		const auto pos = XMVector3Transform(origin + t * dir, volumeWorldI);
+		if (!XMVector3InBounds(pos, one)) return false;
+
+		const auto r = SampleLevel(pos * half + half);
+		if (r < hitDist) return true;
+		t += r;
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------
+// Same sampling as TraceIndirect() in ConeTrace.hlsli; returns (radiosity, t). A
+// nonzero firstSample selects a later subset of the sequence, for temporal reuse
+//--------------------------------------------------------------------------------------
+XMVECTOR SDFVolume::TraceIndirect(FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax,
+	const IrradianceMipBuilder& irradiance, uint32_t sampleCount, uint32_t firstSample) const
+{
+	const auto volumeWorldI = XMLoadFloat3x4(&m_volumeWorldI);
+	const auto half = XMVectorReplicate(0.5f);
+	const auto toVoxels = XMVectorGetX(XMVector3Length(volumeWorldI.r[1])) * 0.5f * m_gridSize;
+
+	auto ambient = irradiance.SampleLevel(half, 16.0f);
+	ambient /= XMVectorGetW(ambient);
+
+	const auto lMax = tMax - tMin;
+	const auto getSamplePos = [&](uint32_t i, float& t)
+	{
+		t = tMin + Hash(static_cast<float>(firstSample + i)) * lMax;
+		const auto sampleDir = ComputeDirectionCos(dir, Hash(t + 1.0f), Hash(t + 2.0f));
+
+		return XMVector3Transform(origin + t * sampleDir, volumeWorldI) * 0.5f + half;
+	};
+
+	// Mip level from the largest empty-space radius in voxels
+	auto t = tMin, level = 0.0f;
+	for (auto i = 0u; i < sampleCount; ++i)
+	{
+		const auto r = (max)(SampleLevel(getSamplePos(i, t)), 0.0f) * toVoxels;
+		level = (max)(log2f(r), level);
+	}
+
+	auto radiosity = XMVectorZero();
+	auto occ = 0.0f;
+	for (auto i = 0u; i < sampleCount; ++i)
+	{
+		const auto uvw = getSamplePos(i, t);
+		const auto r = (max)(SampleLevel(uvw), 0.0f);
+		const auto oc = (t - r) / t;
+		occ += oc;
+
+		auto sample = irradiance.SampleLevel(uvw, level);
+		const auto w = XMVectorGetW(sample);
+		if (w) sample /= w;
+		radiosity += XMVectorSetW(sample * oc, w ? 1.0f : 0.0f);
+	}
+
+	const auto ao = (min)((max)(1.0f - occ / sampleCount, 0.0f), 1.0f);
+	// No covered sample happens with small subsets; the shader would return NaN there
+	const auto coveredCount = XMVectorGetW(radiosity);
+	radiosity = coveredCount > 0.0f ? radiosity / coveredCount : XMVectorZero();
+
+	return XMVectorSetW(radiosity + ambient * ao, t);
+}
+
+XMVECTOR SDFVolume::GetVoxelCenter(uint32_t x, uint32_t y, uint32_t z) const
+{
+	const auto gridSize = static_cast<float>(m_gridSize);
+	const auto uvw = XMVectorSet(x + 0.5f, y + 0.5f, z + 0.5f, 0.0f) / gridSize;
+
+	return XMVector3Transform(uvw * 2.0f - XMVectorSplatOne(), XMLoadFloat3x4(&m_volumeWorld));
+}
+
+uint32_t SDFVolume::GetVoxelIndex(uint32_t x, uint32_t y, uint32_t z) const
+{
+	return (m_gridSize * z + y) * m_gridSize + x;
+}
+
+uint32_t SDFVolume::GetGridSize() const
+{
+	return m_gridSize;
+}
+
+uint32_t SDFVolume::GetVoxelCount() const
+{
+	return m_gridSize * m_gridSize * m_gridSize;
+}
+
+float SDFVolume::GetVoxelSize() const
+{
+	return 2.0f * m_volumeWorld.m[1][1] / m_gridSize;
+}
+
+const XMFLOAT3X4& SDFVolume::GetVolumeWorld() const
+{
+	return m_volumeWorld;
+}
+
+const XMFLOAT3X4& SDFVolume::GetVolumeWorldI() const
+{
+	return m_volumeWorldI;
+}
+
+float* SDFVolume::GetSDF()
+{
+	return m_sdf.data();
+}
+
+uint32_t* SDFVolume::GetIds()
+{
+	return m_ids.data();
+}
+
+XMFLOAT2* SDFVolume::GetBarycs()
+{
+	return m_barycs.data();
+}
+
+const float* SDFVolume::GetSDF() const
+{
+	return m_sdf.data();
+}
+
+const uint32_t* SDFVolume::GetIds() const
+{
+	return m_ids.data();
+}
+
+const XMFLOAT2* SDFVolume::GetBarycs() const
+{
+	return m_barycs.data();
+}
+
+float SDFVolume::fetch(uint32_t x, uint32_t y, uint32_t z) const
+{
+	return m_sdf[GetVoxelIndex(x, y, z)];
+}
@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SceneData.h"
+
+class IrradianceMipBuilder;
+
+//--------------------------------------------------------------------------------------
+// CPU copy of the global SDF, id and barycentrics volumes, with the same sampling
+// conventions as ConeTrace.hlsli (LINEAR_CLAMP, volume space in [-1, 1])
+//--------------------------------------------------------------------------------------
+class SDFVolume
+{
+public:
+	SDFVolume();
+	virtual ~SDFVolume();
+
+	void Init(uint32_t gridSize, const DirectX::XMFLOAT3X4& volumeWorld);
+	void Voxelize(const MeshView* pMeshes, const PerObject* pMatrices, uint32_t meshCount);
+
+	float SampleLevel(DirectX::FXMVECTOR uvw) const;
+	float Sample(DirectX::FXMVECTOR pos) const;
+	DirectX::XMFLOAT3 TraceCone(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir,
+		float tMin, float tMax, float coneRadius) const;
+	bool Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMin, float tMax, float& t) const;
+	DirectX::XMVECTOR TraceIndirect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMin, float tMax,
+		const IrradianceMipBuilder& irradiance, uint32_t sampleCount = 32, uint32_t firstSample = 0) const;
+
+	DirectX::XMVECTOR GetVoxelCenter(uint32_t x, uint32_t y, uint32_t z) const;
+	uint32_t GetVoxelIndex(uint32_t x, uint32_t y, uint32_t z) const;
+	uint32_t GetGridSize() const;
+	uint32_t GetVoxelCount() const;
+	float GetVoxelSize() const;
+	const DirectX::XMFLOAT3X4& GetVolumeWorld() const;
+	const DirectX::XMFLOAT3X4& GetVolumeWorldI() const;
+
+	float* GetSDF();
+	uint32_t* GetIds();
+	DirectX::XMFLOAT2* GetBarycs();
+	const float* GetSDF() const;
+	const uint32_t* GetIds() const;
+	const DirectX::XMFLOAT2* GetBarycs() const;
+
+protected:
+	float fetch(uint32_t x, uint32_t y, uint32_t z) const;
+
+	std::vector<float>				m_sdf;
+	std::vector<uint32_t>			m_ids;
+	std::vector<DirectX::XMFLOAT2>	m_barycs;
+
+	DirectX::XMFLOAT3X4 m_volumeWorld;
+	DirectX::XMFLOAT3X4 m_volumeWorldI;
+	uint32_t m_gridSize;
+};
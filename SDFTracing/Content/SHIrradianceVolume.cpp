@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <DirectXPackedVector.h>
+#include "SHIrradianceVolume.h"
+#include "MonteCarlo.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace PackedVector;
+
+// Real SH basis constants of bands 0 and 1
+static const float g_shY0 = 0.282095f;
+static const float g_shY1 = 0.488603f;
+
+SHIrradianceVolume::SHIrradianceVolume() :
+	m_ambient(0.0f, 0.0f, 0.0f),
+	m_gridSize(0),
+	m_stats()
+{
+}
+
+SHIrradianceVolume::~SHIrradianceVolume()
+{
+}
+
+void SHIrradianceVolume::Init(uint32_t gridSize)
+{
+	m_gridSize = gridSize;
+	m_voxels.assign(gridSize * gridSize * gridSize, PackedVoxel());
+	m_stats.VoxelCount = static_cast<uint32_t>(m_voxels.size());
+	m_stats.ByteCount = sizeof(PackedVoxel) * m_voxels.size();
+}
+
+void SHIrradianceVolume::Build(const SDFVolume& volume, const IrradianceMipBuilder& irradiance, uint32_t directionCount)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	m_volumeWorldI = volume.GetVolumeWorldI();
+	const auto volumeWorld = XMLoadFloat3x4(&volume.GetVolumeWorld());
+	const auto volumeWorldI = XMLoadFloat3x4(&m_volumeWorldI);
+	const auto half = XMVectorReplicate(0.5f);
+	const auto toVoxels = XMVectorGetX(XMVector3Length(volumeWorldI.r[1])) * 0.5f * volume.GetGridSize();
+
+	auto ambient = irradiance.SampleLevel(half, 16.0f);
+	XMStoreFloat3(&m_ambient, ambient / XMVectorGetW(ambient));
+
+	// Same ray extent as CSShade, starting one SH voxel away from the probe
+	const auto voxelSize = 2.0f * volume.GetVolumeWorld().m[1][1] / m_gridSize;
+	const auto tMin = voxelSize;
+	const auto lMax = XMVectorGetX(XMVector3Length(volumeWorld.r[1])) * 0.5f - tMin;
+
+	// Fibonacci sphere directions with equal solid angles
+	vector<XMFLOAT3> dirs(directionCount);
+	for (auto i = 0u; i < directionCount; ++i)
+	{
+		const auto z = 1.0f - 2.0f * (i + 0.5f) / directionCount;
+		const auto r = sqrtf(1.0f - z * z);
+		const auto phi = XM_PI * (3.0f - sqrtf(5.0f)) * i;
+		dirs[i] = XMFLOAT3(r * cosf(phi), r * sinf(phi), z);
+	}
+	const auto weight = 4.0f * XM_PI / directionCount;
+
+	atomic<uint32_t> projectedVoxelCount(0);
+	ParallelFor(m_gridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		vector<XMFLOAT4> uvws(directionCount);
+		vector<float> ts(directionCount);
+		uint32_t count = 0;
+		for (auto z = begin; z < end; ++z)
+			for (auto y = 0u; y < m_gridSize; ++y)
+				for (auto x = 0u; x < m_gridSize; ++x)
+				{
+					auto& voxel = m_voxels[(m_gridSize * z + y) * m_gridSize + x];
+					voxel = PackedVoxel();
+
+					// Only probes in the empty narrow band around the surfaces are projected
+					const auto uvw = (XMVectorSet(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z), 0.0f) + half) / static_cast<float>(m_gridSize);
+					const auto dist = volume.SampleLevel(uvw);
+					if (dist < 0.0f || dist >= 2.0f * voxelSize) continue;
+
+					const auto origin = XMVector3Transform(uvw * 2.0f - XMVectorReplicate(1.0f), volumeWorld);
+
+					auto level = 0.0f;
+					for (auto i = 0u; i < directionCount; ++i)
+					{
+						ts[i] = tMin + Hash(static_cast<float>(i)) * lMax;
+						const auto sampleUVW = XMVector3Transform(origin + ts[i] * XMLoadFloat3(&dirs[i]), volumeWorldI) * 0.5f + half;
+						XMStoreFloat4(&uvws[i], sampleUVW);
+						const auto r = (max)(volume.SampleLevel(sampleUVW), 0.0f) * toVoxels;
+						level = (max)(log2f(r), level);
+					}
+
+					XMFLOAT4 coeffs[NUM_CHANNEL] = {};
+					for (auto i = 0u; i < directionCount; ++i)
+					{
+						const auto dir = XMLoadFloat3(&dirs[i]);
+						const auto sampleUVW = XMLoadFloat4(&uvws[i]);
+						const auto r = (max)(volume.SampleLevel(sampleUVW), 0.0f);
+						const auto oc = (min)((max)((ts[i] - r) / ts[i], 0.0f), 1.0f);
+
+						auto sample = irradiance.SampleLevel(sampleUVW, level);
+						const auto w = XMVectorGetW(sample);
+						if (w) sample /= w;
+
+						XMFLOAT3 radiosity;
+						XMStoreFloat3(&radiosity, sample * oc);
+						Project(dir, radiosity.x, weight, coeffs[CHANNEL_R]);
+						Project(dir, radiosity.y, weight, coeffs[CHANNEL_G]);
+						Project(dir, radiosity.z, weight, coeffs[CHANNEL_B]);
+						Project(dir, w ? 1.0f : 0.0f, weight, coeffs[CHANNEL_COVERAGE]);
+						Project(dir, oc, weight, coeffs[CHANNEL_OCCLUSION]);
+					}
+
+					pack(coeffs, voxel);
+					++count;
+				}
+
+		projectedVoxelCount += count;
+	});
+
+	m_stats.ProjectedVoxelCount = projectedVoxelCount;
+	m_stats.BuildTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+XMVECTOR SHIrradianceVolume::Evaluate(FXMVECTOR pos, FXMVECTOR nrm) const
+{
+	const auto uvw = XMVector3Transform(pos, XMLoadFloat3x4(&m_volumeWorldI)) * 0.5f + XMVectorReplicate(0.5f);
+
+	XMFLOAT3 coord;
+	XMStoreFloat3(&coord, XMVectorClamp(uvw * static_cast<float>(m_gridSize) - XMVectorReplicate(0.5f),
+		XMVectorZero(), XMVectorReplicate(static_cast<float>(m_gridSize - 1))));
+
+	const uint32_t c0[] = { static_cast<uint32_t>(coord.x), static_cast<uint32_t>(coord.y), static_cast<uint32_t>(coord.z) };
+	const uint32_t c1[] = { (min)(c0[0] + 1, m_gridSize - 1), (min)(c0[1] + 1, m_gridSize - 1), (min)(c0[2] + 1, m_gridSize - 1) };
+	const float f[] = { coord.x - c0[0], coord.y - c0[1], coord.z - c0[2] };
+
+	// Trilinear filtering renormalized over the valid probes
+	XMVECTOR coeffs[NUM_CHANNEL] = {};
+	auto weightSum = 0.0f;
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		const auto x = i & 1 ? c1[0] : c0[0];
+		const auto y = i & 2 ? c1[1] : c0[1];
+		const auto z = i & 4 ? c1[2] : c0[2];
+		const auto weight = (i & 1 ? f[0] : 1.0f - f[0]) * (i & 2 ? f[1] : 1.0f - f[1]) * (i & 4 ? f[2] : 1.0f - f[2]);
+
+		XMFLOAT4 voxelCoeffs[NUM_CHANNEL];
+		if (weight <= 0.0f || !unpack(m_voxels[(m_gridSize * z + y) * m_gridSize + x], voxelCoeffs)) continue;
+		for (uint8_t j = 0; j < NUM_CHANNEL; ++j) coeffs[j] += XMLoadFloat4(&voxelCoeffs[j]) * weight;
+		weightSum += weight;
+	}
+
+	if (weightSum <= 0.0f) return XMVectorZero();
+
+	float values[NUM_CHANNEL];
+	for (uint8_t i = 0; i < NUM_CHANNEL; ++i)
+	{
+		XMFLOAT4 channelCoeffs;
+		XMStoreFloat4(&channelCoeffs, coeffs[i] / weightSum);
+		values[i] = (max)(EvaluateCosine(channelCoeffs, nrm), 0.0f);
+	}
+
+	const auto coverage = values[CHANNEL_COVERAGE];
+	auto radiosity = XMVectorSet(values[CHANNEL_R], values[CHANNEL_G], values[CHANNEL_B], 0.0f);
+	radiosity = coverage > 0.0f ? radiosity / coverage : XMVectorZero();
+	const auto ao = (min)((max)(1.0f - values[CHANNEL_OCCLUSION], 0.0f), 1.0f);
+
+	return radiosity + XMLoadFloat3(&m_ambient) * ao;
+}
+
+const SHIrradianceVolume::PackedVoxel* SHIrradianceVolume::GetVoxels() const
+{
+	return m_voxels.data();
+}
+
+uint32_t SHIrradianceVolume::GetGridSize() const
+{
+	return m_gridSize;
+}
+
+const SHIrradianceVolume::Stats& SHIrradianceVolume::GetStats() const
+{
+	return m_stats;
+}
+
+// Coefficients are stored as (L0, L1 along x, y, z)
+void SHIrradianceVolume::Project(FXMVECTOR dir, float value, float weight, XMFLOAT4& coeffs)
+{
+	XMFLOAT3 d;
+	XMStoreFloat3(&d, dir);
+	value *= weight;
+	coeffs.x += value * g_shY0;
+	coeffs.y += value * g_shY1 * d.x;
+	coeffs.z += value * g_shY1 * d.y;
+	coeffs.w += value * g_shY1 * d.z;
+}
+
+// Irradiance over pi, i.e. the cosine-weighted mean, with the band factors pi and 2pi/3
+float SHIrradianceVolume::EvaluateCosine(const XMFLOAT4& coeffs, FXMVECTOR nrm)
+{
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, nrm);
+
+	return coeffs.x * g_shY0 + (2.0f / 3.0f) * g_shY1 * (coeffs.y * n.x + coeffs.z * n.y + coeffs.w * n.z);
+}
+
+void SHIrradianceVolume::pack(const XMFLOAT4* pCoeffs, PackedVoxel& voxel) const
+{
+	// For a non-negative function |L1| <= sqrt(3) * L0
+	for (uint8_t i = 0; i < NUM_CHANNEL; ++i)
+	{
+		const auto& coeffs = pCoeffs[i];
+		voxel.L0[i] = XMConvertFloatToHalf(coeffs.x);
+
+		const auto scale = coeffs.x > 0.0f ? 127.0f / (coeffs.x * sqrtf(3.0f)) : 0.0f;
+		const float l1[] = { coeffs.y, coeffs.z, coeffs.w };
+		for (uint8_t j = 0; j < 3; ++j)
+			voxel.L1[i * 3 + j] = static_cast<int8_t>(roundf((min)((max)(l1[j] * scale, -127.0f), 127.0f)));
+	}
+	voxel.L1[15] = 127;
+}
+
+bool SHIrradianceVolume::unpack(const PackedVoxel& voxel, XMFLOAT4* pCoeffs) const
+{
+	if (!voxel.L1[15]) return false;
+
+	for (uint8_t i = 0; i < NUM_CHANNEL; ++i)
+	{
+		const auto l0 = XMConvertHalfToFloat(voxel.L0[i]);
+		const auto scale = l0 * sqrtf(3.0f) / 127.0f;
+		pCoeffs[i] = XMFLOAT4(l0, voxel.L1[i * 3] * scale, voxel.L1[i * 3 + 1] * scale, voxel.L1[i * 3 + 2] * scale);
+	}
+
+	return true;
+}
@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "IrradianceMipBuilder.h"
+
+//--------------------------------------------------------------------------------------
+// L1 spherical-harmonics irradiance volume at half the SDF resolution: the indirect
+// samples of TraceIndirect() are projected once per voxel, so that a pixel evaluates
+// directional irradiance from 8 trilinear fetches instead of 32 cone samples
+//--------------------------------------------------------------------------------------
+class SHIrradianceVolume
+{
+public:
+	// Projected channels: radiosity RGB of covered samples, coverage and occlusion
+	enum Channel : uint8_t
+	{
+		CHANNEL_R,
+		CHANNEL_G,
+		CHANNEL_B,
+		CHANNEL_COVERAGE,
+		CHANNEL_OCCLUSION,
+
+		NUM_CHANNEL
+	};
+
+	// 28 bytes per voxel; on the GPU it maps to an RGBA16F + RG16F pair for L0 (the spare
+	// half is unused) and 4 RGBA8_SNORM volumes for L1, scaled by L0 * sqrt(3), whose
+	// last byte holds the validity
+	struct PackedVoxel
+	{
+		uint16_t L0[6];
+		int8_t L1[16];
+	};
+
+	struct Stats
+	{
+		double BuildTime;	// ms
+		uint32_t VoxelCount;
+		uint32_t ProjectedVoxelCount;
+		uint64_t ByteCount;
+	};
+
+	SHIrradianceVolume();
+	virtual ~SHIrradianceVolume();
+
+	void Init(uint32_t gridSize);
+	void Build(const SDFVolume& volume, const IrradianceMipBuilder& irradiance, uint32_t directionCount = 64);
+
+	// Cosine-weighted radiosity around the normal, in the same units as TraceIndirect()
+	DirectX::XMVECTOR Evaluate(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR nrm) const;
+
+	const PackedVoxel* GetVoxels() const;
+	uint32_t GetGridSize() const;
+	const Stats& GetStats() const;
+
+	// L1 projection of a sample with its solid-angle weight, and clamped-cosine convolution
+	static void Project(DirectX::FXMVECTOR dir, float value, float weight, DirectX::XMFLOAT4& coeffs);
+	static float EvaluateCosine(const DirectX::XMFLOAT4& coeffs, DirectX::FXMVECTOR nrm);
+
+protected:
+	void pack(const DirectX::XMFLOAT4* pCoeffs, PackedVoxel& voxel) const;
+	bool unpack(const PackedVoxel& voxel, DirectX::XMFLOAT4* pCoeffs) const;
+
+	std::vector<PackedVoxel> m_voxels;
+
+	DirectX::XMFLOAT3X4	m_volumeWorldI;
+	DirectX::XMFLOAT3	m_ambient;
+	uint32_t			m_gridSize;
+
+	Stats m_stats;
+};
@@ -0,0 +1,169 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#define PRIMITIVE_BITS 20
+
+// Quantized 32-byte mesh vertices and SNORM16 BLAS positions; off until validated on a GPU,
+// and must match VertexLayout.hlsli
+#define VERTEX_QUANTIZATION 0
+
+//--------------------------------------------------------------------------------------
+// CPU mirrors of the structures shared with the shaders
+//--------------------------------------------------------------------------------------
+struct Vertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Nrm;
+	DirectX::XMFLOAT2 UV0;
+	DirectX::XMFLOAT2 UV1;
+	DirectX::XMFLOAT4 Tan;
+	uint32_t Color;
+	float Emissive;
+};
+
+struct PerObject
+{
+	DirectX::XMFLOAT3X4 World;
+	DirectX::XMFLOAT3X4 WorldIT;
+};
+
+struct AABB
+{
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+};
+
+struct LightSource
+{
+	DirectX::XMFLOAT4 Min;
+	DirectX::XMFLOAT4 Max;
+	DirectX::XMFLOAT4 Emissive;
+	DirectX::XMFLOAT3X4 World;
+};
+
+struct Visibility
+{
+	uint32_t MeshId;
+	uint32_t PrimId;
+};
+
+// Analytic SDF primitive; distances stay exact under rotation, translation and uniform scaling
+enum AnalyticPrimitiveType : uint32_t
+{
+	PRIMITIVE_BOX,
+	PRIMITIVE_SPHERE,
+	PRIMITIVE_CAPSULE
+};
+
+struct AnalyticPrimitive
+{
+	DirectX::XMFLOAT3X4 World;
+	DirectX::XMFLOAT3 Size;	// Box half extents; sphere radius in x; capsule radius in x and half height along y in y
+	uint32_t Type;
+};
+
+// Per-mesh (subset) geometry as bound to g_vertexBuffers[] and g_indexBuffers[]
+struct MeshView
+{
+	const Vertex* Vertices;
+	const uint32_t* Indices;
+	uint32_t IndexCount;
+};
+
+//--------------------------------------------------------------------------------------
+// Decode visibility-buffer and id-volume values
+//--------------------------------------------------------------------------------------
+inline Visibility DecodeVisibility(uint32_t v)
+{
+	Visibility vis;
+
+	--v;
+	vis.MeshId = v >> PRIMITIVE_BITS;
+	vis.PrimId = v & ((1u << PRIMITIVE_BITS) - 1);
+
+	return vis;
+}
+
+inline uint32_t EncodeVisibility(uint32_t meshId, uint32_t primId)
+{
+	return ((meshId << PRIMITIVE_BITS) | primId) + 1;
+}
+
+//--------------------------------------------------------------------------------------
+// Light impact range, as getImpactDistance() in ImpactRange.hlsli (filter model 3)
+//--------------------------------------------------------------------------------------
+inline float GetImpactDistance(float attenuation = 0.0067f)
+{
+	return -logf(attenuation);
+}
+
+inline AABB GetLightBounds(const LightSource& lightSource)
+{
+	const auto world = DirectX::XMLoadFloat3x4(&lightSource.World);
+	const auto lMin = DirectX::XMVector4Transform(DirectX::XMLoadFloat4(&lightSource.Min), world);
+	const auto lMax = DirectX::XMVector4Transform(DirectX::XMLoadFloat4(&lightSource.Max), world);
+
+	AABB aabb;
+	DirectX::XMStoreFloat3(&aabb.Min, DirectX::XMVectorMin(lMin, lMax));
+	DirectX::XMStoreFloat3(&aabb.Max, DirectX::XMVectorMax(lMin, lMax));
+
+	return aabb;
+}
+
+//--------------------------------------------------------------------------------------
+// World bounds of a mesh AABB, and the slab test of the segment p0-p1 against bounds
+//--------------------------------------------------------------------------------------
+inline AABB TransformBounds(const AABB& meshAABB, const DirectX::XMFLOAT3X4& world)
+{
+	const auto m = DirectX::XMLoadFloat3x4(&world);
+	auto bMin = DirectX::XMVectorReplicate(FLT_MAX);
+	auto bMax = DirectX::XMVectorReplicate(-FLT_MAX);
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		const auto corner = DirectX::XMVectorSet(i & 1 ? meshAABB.Max.x : meshAABB.Min.x,
+			i & 2 ? meshAABB.Max.y : meshAABB.Min.y, i & 4 ? meshAABB.Max.z : meshAABB.Min.z, 1.0f);
+		const auto pos = DirectX::XMVector3Transform(corner, m);
+		bMin = DirectX::XMVectorMin(bMin, pos);
+		bMax = DirectX::XMVectorMax(bMax, pos);
+	}
+
+	AABB aabb;
+	DirectX::XMStoreFloat3(&aabb.Min, bMin);
+	DirectX::XMStoreFloat3(&aabb.Max, bMax);
+
+	return aabb;
+}
+
+inline bool IntersectSegment(DirectX::FXMVECTOR p0, DirectX::FXMVECTOR p1, const AABB& aabb)
+{
+	DirectX::XMFLOAT3 origin, dir;
+	DirectX::XMStoreFloat3(&origin, p0);
+	DirectX::XMStoreFloat3(&dir, DirectX::XMVectorSubtract(p1, p0));
+
+	// Slab test over t in [0, 1]
+	auto tMin = 0.0f, tMax = 1.0f;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto o = (&origin.x)[i];
+		const auto d = (&dir.x)[i];
+		const auto bMin = (&aabb.Min.x)[i];
+		const auto bMax = (&aabb.Max.x)[i];
+		if (fabsf(d) < 1e-8f)
+		{
+			if (o < bMin || o > bMax) return false;
+			continue;
+		}
+
+		auto t0 = (bMin - o) / d;
+		auto t1 = (bMax - o) / d;
+		if (t0 > t1) std::swap(t0, t1);
+		tMin = (std::max)(tMin, t0);
+		tMax = (std::min)(tMax, t1);
+		if (tMin > tMax) return false;
+	}
+
+	return true;
+}
@@ -22,12 +22,6 @@ struct DynamicMesh
 	uint MeshId;
 };
 
-struct AABB
-{
-	float3 Min;
-	float3 Max;
-};
-
 //--------------------------------------------------------------------------------------
 // Constant buffer
 //--------------------------------------------------------------------------------------
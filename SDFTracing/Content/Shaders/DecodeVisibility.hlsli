@@ -39,7 +39,13 @@ struct PerObject
 Texture2D<uint> g_txVisibility : register (t0, space0);
 StructuredBuffer<PerObject> g_matrices : register (t1, space0);
 Buffer<uint> g_indexBuffers[] : register (t0, space1);
+#if VERTEX_QUANTIZATION
+StructuredBuffer<AABB> g_meshAABBs : register (t5, space0);
+StructuredBuffer<Material> g_materials : register (t6, space0);
+StructuredBuffer<QuantizedVertex> g_vertexBuffers[] : register (t0, space2);
+#else
 StructuredBuffer<Vertex> g_vertexBuffers[] : register (t0, space2);
+#endif
 
 //--------------------------------------------------------------------------------------
 // Decode visibility-buffer values
@@ -96,9 +102,19 @@ void getVertices(out Vertex vertices[3], uint meshIdx, uint primIdx)
 	};
 
 	// Retrieve corresponding vertex normals for the triangle vertices.
+#if VERTEX_QUANTIZATION
+	const AABB aabb = g_meshAABBs[meshIdx];
+	[unroll]
+	for (uint i = 0; i < 3; ++i)
+	{
+		const QuantizedVertex vertex = g_vertexBuffers[NonUniformResourceIndex(meshIdx)][indices[i]];
+		vertices[i] = DecodeVertex(vertex, aabb, g_materials[GetMaterialIndex(vertex)]);
+	}
+#else
 	[unroll]
 	for (uint i = 0; i < 3; ++i)
 		vertices[i] = g_vertexBuffers[NonUniformResourceIndex(meshIdx)][indices[i]];
+#endif
 }
 
 //--------------------------------------------------------------------------------------
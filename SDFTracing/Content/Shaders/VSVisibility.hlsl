@@ -36,13 +36,22 @@ cbuffer cbPerFrame
 // Buffers
 //--------------------------------------------------------------------------------------
 StructuredBuffer<PerObject> g_matrices		: register (t0, space0);
+#if VERTEX_QUANTIZATION
+StructuredBuffer<AABB> g_meshAABBs			: register (t1, space0);
+StructuredBuffer<QuantizedVertex> g_vertexBuffers[]	: register (t0, space1);
+#else
 StructuredBuffer<Vertex> g_vertexBuffers[]	: register (t0, space1);
+#endif
 
 VSOut main(uint vid : SV_VERTEXID)
 {
 	VSOut output;
 
+#if VERTEX_QUANTIZATION
+	const Vertex vertex = DecodeVertex(g_vertexBuffers[g_meshId][vid], g_meshAABBs[g_meshId], (Material)0);
+#else
 	const Vertex vertex = g_vertexBuffers[g_meshId][vid];
+#endif
 	float4 pos = float4(vertex.Pos, 1.0);
 	pos.xyz = mul(pos, g_matrices[g_meshId].World);
 
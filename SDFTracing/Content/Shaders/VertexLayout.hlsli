@@ -6,6 +6,9 @@
 typedef float FLOAT;
 #include "D3DX_DXGIFormatConvert.inl"
 
+// Must match SceneData.h
+#define VERTEX_QUANTIZATION 0
+
 //--------------------------------------------------------------------------------------
 // Structure
 //--------------------------------------------------------------------------------------
@@ -19,3 +22,70 @@ struct Vertex
 	uint	Color;
 	float	Emissive;
 };
+
+// 32 bytes: SNORM16 position relative to the mesh AABB and a material index in
+// PosMtl (bit 31 for a negative tangent handedness), octahedral SNORM16 normal and
+// tangent, and half-float UVs
+struct QuantizedVertex
+{
+	uint2	PosMtl;
+	uint	Nrm;
+	uint	Tan;
+	uint	UV0;
+	uint	UV1;
+	uint2	Padding;
+};
+
+struct AABB
+{
+	float3 Min;
+	float3 Max;
+};
+
+struct Material
+{
+	uint	Color;
+	float	Emissive;
+};
+
+//--------------------------------------------------------------------------------------
+// Decode octahedral unit vectors
+//--------------------------------------------------------------------------------------
+float3 decodeOctahedron(uint v)
+{
+	const float2 e = D3DX_R16G16_SNORM_to_FLOAT2(v);
+	float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+	const float t = max(-n.z, 0.0);
+	n.xy += n.xy >= 0.0 ? -t : t;
+
+	return normalize(n);
+}
+
+//--------------------------------------------------------------------------------------
+// Decode quantized vertices, same as GltfLoader::DecodeVertex()
+//--------------------------------------------------------------------------------------
+uint GetMaterialIndex(QuantizedVertex vertex)
+{
+	return (vertex.PosMtl.y >> 16) & 0x7fff;
+}
+
+Vertex DecodeVertex(QuantizedVertex vertex, AABB aabb, Material material)
+{
+	const float3 center = (aabb.Min + aabb.Max) * 0.5;
+	float3 scale = (aabb.Max - aabb.Min) * 0.5;
+	scale = scale > 0.0 ? scale : 1.0;
+
+	const float3 pos = float3(D3DX_R16G16_SNORM_to_FLOAT2(vertex.PosMtl.x), D3DX_R16G16_SNORM_to_FLOAT2(vertex.PosMtl.y).x);
+
+	Vertex result;
+	result.Pos = pos * scale + center;
+	result.Nrm = decodeOctahedron(vertex.Nrm);
+	result.UV0 = D3DX_R16G16_FLOAT_to_FLOAT2(vertex.UV0);
+	result.UV1 = D3DX_R16G16_FLOAT_to_FLOAT2(vertex.UV1);
+	result.Tan.xyz = vertex.Tan != 0x80008000 ? decodeOctahedron(vertex.Tan) : 0.0;
+	result.Tan.w = vertex.PosMtl.y & 0x80000000 ? -1.0 : 1.0;
+	result.Color = material.Color;
+	result.Emissive = material.Emissive;
+
+	return result;
+}
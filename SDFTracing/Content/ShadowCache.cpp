@@ -0,0 +1,219 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "ShadowCache.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+ShadowCache::ShadowCache() :
+	m_lookupCount(0),
+	m_hitCount(0),
+	m_stats()
+{
+}
+
+ShadowCache::~ShadowCache()
+{
+}
+
+void ShadowCache::Init(uint32_t voxelCount)
+{
+	m_slots.assign(voxelCount, UINT32_MAX);
+	m_slotIds.clear();
+	m_origins.clear();
+	m_visibilities.clear();
+	m_prevLightSources.clear();
+	m_prevDynamicBounds.clear();
+}
+
+void ShadowCache::Update(const SDFVolume& volume, const uint32_t* pVoxels, uint32_t voxelCount,
+	const uint32_t* pDynamicMeshIds, const AABB* pMeshAABBs, const PerObject* pMatrices,
+	uint32_t meshCount, const LightSource* pLightSources, uint32_t lightSourceCount)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	// A change of the light count drops the whole cache
+	const auto prevLightSourceCount = static_cast<uint32_t>(m_prevLightSources.size());
+	if (lightSourceCount != prevLightSourceCount)
+	{
+		fill(m_slots.begin(), m_slots.end(), UINT32_MAX);
+		m_slotIds.clear();
+		m_origins.clear();
+		m_visibilities.clear();
+	}
+
+	// Allocate the slots of static receivers; a receiver whose id changed starts over. A voxel
+	// taken by a dynamic mesh keeps its slot, emptied, for when the static surface returns
+	const auto pIds = volume.GetIds();
+	for (auto i = 0u; i < voxelCount; ++i)
+	{
+		const auto voxel = pVoxels[i];
+		const auto id = pIds[voxel];
+		auto& slot = m_slots[voxel];
+		if (pDynamicMeshIds[DecodeVisibility(id).MeshId] != UINT32_MAX)
+		{
+			if (slot != UINT32_MAX && m_slotIds[slot] != DynamicId)
+			{
+				m_slotIds[slot] = DynamicId;
+				fill_n(m_visibilities.begin() + slot * lightSourceCount, lightSourceCount, uint8_t(Invalid));
+			}
+		}
+		else if (slot == UINT32_MAX)
+		{
+			slot = static_cast<uint32_t>(m_slotIds.size());
+			m_slotIds.emplace_back(id);
+			m_origins.emplace_back(0.0f, 0.0f, 0.0f);
+			m_visibilities.resize(m_visibilities.size() + lightSourceCount, uint8_t(Invalid));
+		}
+		else if (m_slotIds[slot] != id)
+		{
+			m_slotIds[slot] = id;
+			fill_n(m_visibilities.begin() + slot * lightSourceCount, lightSourceCount, uint8_t(Invalid));
+		}
+	}
+	const auto slotCount = static_cast<uint32_t>(m_slotIds.size());
+
+	// Lights with a changed World matrix invalidate their column
+	vector<uint32_t> changedLights;
+	m_lightPositions.resize(lightSourceCount);
+	m_lightRadii.resize(lightSourceCount);
+	for (auto i = 0u; i < lightSourceCount; ++i)
+	{
+		const auto& lightSource = pLightSources[i];
+		if (lightSourceCount == prevLightSourceCount &&
+			memcmp(&lightSource.World, &m_prevLightSources[i].World, sizeof(XMFLOAT3X4)) != 0)
+			changedLights.emplace_back(i);
+
+		const auto aabb = GetLightBounds(lightSource);
+		const auto lMin = XMLoadFloat3(&aabb.Min);
+		const auto lMax = XMLoadFloat3(&aabb.Max);
+		XMStoreFloat3(&m_lightPositions[i], (lMin + lMax) * 0.5f);
+		m_lightRadii[i] = XMVectorGetX(XMVector3Length(lMax - lMin)) * 0.5f;
+	}
+	m_prevLightSources.assign(pLightSources, pLightSources + lightSourceCount);
+
+	// Swept bounds of the dynamic meshes: last and current placement
+	vector<AABB> dynamicBounds;
+	m_sweptBounds.clear();
+	for (auto i = 0u; i < meshCount; ++i)
+	{
+		const auto dynamicMeshId = pDynamicMeshIds[i];
+		if (dynamicMeshId == UINT32_MAX) continue;
+
+		if (dynamicMeshId >= dynamicBounds.size()) dynamicBounds.resize(dynamicMeshId + 1);
+		dynamicBounds[dynamicMeshId] = TransformBounds(pMeshAABBs[i], pMatrices[i].World);
+		auto bMin = XMLoadFloat3(&dynamicBounds[dynamicMeshId].Min);
+		auto bMax = XMLoadFloat3(&dynamicBounds[dynamicMeshId].Max);
+
+		if (dynamicMeshId < m_prevDynamicBounds.size())
+		{
+			const auto& prevAABB = m_prevDynamicBounds[dynamicMeshId];
+			bMin = XMVectorMin(bMin, XMLoadFloat3(&prevAABB.Min));
+			bMax = XMVectorMax(bMax, XMLoadFloat3(&prevAABB.Max));
+		}
+
+		AABB sweptAABB;
+		XMStoreFloat3(&sweptAABB.Min, bMin);
+		XMStoreFloat3(&sweptAABB.Max, bMax);
+		m_sweptBounds.emplace_back(sweptAABB);
+	}
+	m_prevDynamicBounds = dynamicBounds;
+
+	// Invalidate eagerly, so that entries not shaded this frame cannot go stale
+	atomic<uint64_t> lightInvalidations(0), motionInvalidations(0);
+	ParallelFor(slotCount, 256, [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t lightCount = 0, motionCount = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto pVisibilities = &m_visibilities[i * lightSourceCount];
+			for (const auto& j : changedLights)
+			{
+				if (pVisibilities[j] != Invalid) ++lightCount;
+				pVisibilities[j] = Invalid;
+			}
+
+			if (m_sweptBounds.empty()) continue;
+
+			const auto origin = XMLoadFloat3(&m_origins[i]);
+			for (auto j = 0u; j < lightSourceCount; ++j)
+			{
+				if (pVisibilities[j] == Invalid) continue;
+
+				// Inflate the bounds by the light extent to cover the whole shadow cone
+				const auto lightPos = XMLoadFloat3(&m_lightPositions[j]);
+				const auto radius = XMVectorReplicate(m_lightRadii[j]);
+				for (const auto& sweptAABB : m_sweptBounds)
+				{
+					AABB aabb;
+					XMStoreFloat3(&aabb.Min, XMLoadFloat3(&sweptAABB.Min) - radius);
+					XMStoreFloat3(&aabb.Max, XMLoadFloat3(&sweptAABB.Max) + radius);
+					if (IntersectSegment(origin, lightPos, aabb))
+					{
+						pVisibilities[j] = Invalid;
+						++motionCount;
+						break;
+					}
+				}
+			}
+		}
+
+		lightInvalidations += lightCount;
+		motionInvalidations += motionCount;
+	});
+
+	m_stats.SlotCount = slotCount;
+	m_stats.ChangedLightCount = static_cast<uint32_t>(changedLights.size());
+	m_stats.LightInvalidations = lightInvalidations;
+	m_stats.MotionInvalidations = motionInvalidations;
+	m_lookupCount = 0;
+	m_hitCount = 0;
+	m_stats.UpdateTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+uint8_t* ShadowCache::GetVisibilities(uint32_t voxel, FXMVECTOR origin)
+{
+	const auto slot = m_slots[voxel];
+	if (slot == UINT32_MAX || m_slotIds[slot] == DynamicId) return nullptr;
+
+	// The shading origin of a static receiver does not move
+	XMStoreFloat3(&m_origins[slot], origin);
+
+	return &m_visibilities[slot * m_prevLightSources.size()];
+}
+
+void ShadowCache::RecordLookups(uint32_t lookupCount, uint32_t hitCount)
+{
+	m_lookupCount += lookupCount;
+	m_hitCount += hitCount;
+}
+
+// Lookups and hits are counted from the last Update()
+uint64_t ShadowCache::GetLookupCount() const
+{
+	return m_lookupCount;
+}
+
+uint64_t ShadowCache::GetHitCount() const
+{
+	return m_hitCount;
+}
+
+const ShadowCache::Stats& ShadowCache::GetStats() const
+{
+	return m_stats;
+}
+
+uint8_t ShadowCache::Quantize(float visibility)
+{
+	return static_cast<uint8_t>((min)((max)(visibility, 0.0f), 1.0f) * 254.0f + 0.5f);
+}
+
+float ShadowCache::Dequantize(uint8_t visibility)
+{
+	return visibility / 254.0f;
+}
@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include "SDFVolume.h"
+
+//--------------------------------------------------------------------------------------
+// Per-(voxel, light) soft-shadow cache with 8-bit visibility: entries of static receivers
+// survive until the light's World matrix changes or the swept bounds of a dynamic mesh
+// intersect the shadow segment
+//--------------------------------------------------------------------------------------
+class ShadowCache
+{
+public:
+	struct Stats
+	{
+		double UpdateTime;	// ms
+		uint32_t SlotCount;
+		uint32_t ChangedLightCount;
+		uint64_t LightInvalidations;
+		uint64_t MotionInvalidations;
+	};
+
+	ShadowCache();
+	virtual ~ShadowCache();
+
+	void Init(uint32_t voxelCount);
+	void Update(const SDFVolume& volume, const uint32_t* pVoxels, uint32_t voxelCount,
+		const uint32_t* pDynamicMeshIds, const AABB* pMeshAABBs, const PerObject* pMatrices,
+		uint32_t meshCount, const LightSource* pLightSources, uint32_t lightSourceCount);
+
+	// Visibility row of a voxel, or nullptr for receivers that are not cached
+	uint8_t* GetVisibilities(uint32_t voxel, DirectX::FXMVECTOR origin);
+	void RecordLookups(uint32_t lookupCount, uint32_t hitCount);
+	uint64_t GetLookupCount() const;
+	uint64_t GetHitCount() const;
+	const Stats& GetStats() const;
+
+	static uint8_t Quantize(float visibility);
+	static float Dequantize(uint8_t visibility);
+
+	static const uint8_t Invalid = 0xff;
+
+protected:
+	static const uint32_t DynamicId = UINT32_MAX;	// Slot id while a dynamic mesh covers the voxel
+
+	std::vector<uint32_t>			m_slots;
+	std::vector<uint32_t>			m_slotIds;
+	std::vector<DirectX::XMFLOAT3>	m_origins;
+	std::vector<uint8_t>			m_visibilities;
+	std::vector<LightSource>		m_prevLightSources;
+	std::vector<DirectX::XMFLOAT3>	m_lightPositions;
+	std::vector<float>				m_lightRadii;
+	std::vector<AABB>				m_prevDynamicBounds;
+	std::vector<AABB>				m_sweptBounds;
+
+	std::atomic<uint64_t> m_lookupCount;
+	std::atomic<uint64_t> m_hitCount;
+
+	Stats m_stats;
+};
@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SphereTracer.h"
+
+using namespace std;
+using namespace DirectX;
+
+SphereTracingStats& SphereTracingStats::operator+=(const SphereTracingStats& stats)
+{
+	RayCount += stats.RayCount;
+	StepCount += stats.StepCount;
+	SampleCount += stats.SampleCount;
+	CoarseStepCount += stats.CoarseStepCount;
+	RejectedStepCount += stats.RejectedStepCount;
+	for (auto i = 0u; i < HistogramBinCount; ++i) StepHistogram[i] += stats.StepHistogram[i];
+
+	return *this;
+}
+
+template<SphereTracingMode Mode>
+const float SphereTracer<Mode>::Relaxation = 1.6f;
+
+template<SphereTracingMode Mode>
+const float SphereTracer<Mode>::RelaxationMargin = 2.0f;
+
+template<SphereTracingMode Mode>
+SphereTracer<Mode>::SphereTracer() :
+	m_pVolume(nullptr)
+{
+}
+
+template<SphereTracingMode Mode>
+SphereTracer<Mode>::~SphereTracer()
+{
+}
+
+template<SphereTracingMode Mode>
+void SphereTracer<Mode>::Init(const SDFVolume& volume)
+{
+	m_pVolume = &volume;
+}
+
+//--------------------------------------------------------------------------------------
+// The plain variant is the same marching as SDFVolume::TraceCone(); the over-relaxed one
+// only changes how t advances, and keeps its penumbra estimate on the accepted samples
+//--------------------------------------------------------------------------------------
+template<SphereTracingMode Mode>
+XMFLOAT3 SphereTracer<Mode>::TraceCone(FXMVECTOR origin, FXMVECTOR dir, float tMin, float tMax,
+	float coneRadius, SphereTracingStats& stats) const
+{
+	const auto volumeWorldI = XMLoadFloat3x4(&m_pVolume->GetVolumeWorldI());
+	const auto one = XMVectorSplatOne();
+	const auto half = XMVectorReplicate(0.5f);
+
+	const auto k = tMax / coneRadius;
+	auto r = 0.0f, pr = FLT_MAX / 2.0f, s = 1.0f / k;
+	auto t = tMin;
+	auto stepCount = 0u;
+
+	// Over-relaxation state: the last accepted sample and the step taken from it
+	auto tPrev = tMin, rPrev = 0.0f, step = 0.0f;
+	auto isRelaxed = false;
+
+	auto isHit = false;
+	while (t < tMax * 0.8f)
+	{
+		const auto pos = XMVector3Transform(origin + t * dir, volumeWorldI);
+		if (!XMVector3InBounds(pos, one)) break;
+
+		const auto uvw = pos * half + half;
+		++stepCount;
+
+		r = m_pVolume->SampleLevel(uvw);
+		++stats.SampleCount;
+
+		// Overshoot: the spheres of the previous and the current sample leave a gap, or the
+		// sample is inside geometry; redo a plain step from the previous sample
+		if (isRelaxed && (r < 0.0f || r + rPrev < step))
+		{
+			t = tPrev + rPrev;
+			isRelaxed = false;
+			++stats.RejectedStepCount;
+			continue;
+		}
+
+		if (r < 1e-4f)
+		{
+			isHit = true;
+			break;
+		}
+
+		// Skip the update where the shader would produce NaN or infinity
+		const auto r_sq = r * r;
+		const auto y = pr < FLT_MAX / 2.0f ? r_sq / (2.0f * pr) : 0.0f;	// Avoids denormals
+		const auto d_sq = r_sq - y * y;
+		const auto tY = t - y;
+		if (d_sq >= 0.0f && tY > 0.0f) s = (min)(sqrtf(d_sq) / tY, s);
+
+		// Samples that could lower s are taken at the plain spacing, so that the penumbra
+		// matches TraceCone(); relaxed steps only cross the space well outside the cone
+		isRelaxed = Mode == OVER_RELAXED_SPHERE_TRACING && r > RelaxationMargin * s * t;
+
+		// Aaltonen's estimate assumes the plain spacing from the previous sample
+		pr = isRelaxed ? FLT_MAX / 2.0f : r;
+		tPrev = t;
+		rPrev = r;
+		step = isRelaxed ? Relaxation * r : r;
+		t += step;
+	}
+
+	++stats.RayCount;
+	stats.StepCount += stepCount;
+	++stats.StepHistogram[(min)(stepCount / SphereTracingStats::HistogramBinWidth, SphereTracingStats::HistogramBinCount - 1)];
+
+	return isHit ? XMFLOAT3(t, r, 0.0f) : XMFLOAT3(t, r, s * k);
+}
+
+template class SphereTracer<PLAIN_SPHERE_TRACING>;
+template class SphereTracer<OVER_RELAXED_SPHERE_TRACING>;
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SDFVolume.h"
+
+enum SphereTracingMode : uint8_t
+{
+	PLAIN_SPHERE_TRACING,
+	OVER_RELAXED_SPHERE_TRACING
+};
+
+// Step counts of a batch of rays, merged per thread chunk
+struct SphereTracingStats
+{
+	static const uint32_t HistogramBinCount = 16;
+	static const uint32_t HistogramBinWidth = 4;	// Steps; the last bin is open-ended
+
+	uint64_t RayCount;
+	uint64_t StepCount;
+	uint64_t SampleCount;		// Trilinear SDF samples
+	uint64_t CoarseStepCount;	// Steps taken on a coarse level only
+	uint64_t RejectedStepCount;	// Over-relaxed steps that were taken back
+	uint64_t StepHistogram[HistogramBinCount];
+
+	SphereTracingStats& operator+=(const SphereTracingStats& stats);
+};
+
+//--------------------------------------------------------------------------------------
+// Variants of the TraceCone() marching, selected at compile time:
+// - plain: advances by the sampled distance r, as ConeTrace.hlsli
+// - over-relaxed: advances by Relaxation * r while r exceeds RelaxationMargin times the
+//   current penumbra cone, and goes back to a plain step when the unbounding spheres of
+//   consecutive samples do not overlap (Keinert et al. 2014)
+//--------------------------------------------------------------------------------------
+template<SphereTracingMode Mode>
+class SphereTracer
+{
+public:
+	SphereTracer();
+	virtual ~SphereTracer();
+
+	void Init(const SDFVolume& volume);
+
+	// Returns (t, r, shadow), like SDFVolume::TraceCone()
+	DirectX::XMFLOAT3 TraceCone(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMin, float tMax,
+		float coneRadius, SphereTracingStats& stats) const;
+
+	static const float Relaxation;
+	static const float RelaxationMargin;
+
+protected:
+	const SDFVolume* m_pVolume;
+};
@@ -0,0 +1,159 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "TemporalAccumulator.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+TemporalAccumulator::TemporalAccumulator() :
+	m_width(0),
+	m_height(0),
+	m_maxHistoryLength(32),
+	m_historyIndex(0),
+	m_stats()
+{
+}
+
+TemporalAccumulator::~TemporalAccumulator()
+{
+}
+
+void TemporalAccumulator::Init(uint32_t width, uint32_t height, uint8_t maxHistoryLength)
+{
+	m_width = width;
+	m_height = height;
+	m_maxHistoryLength = maxHistoryLength;
+
+	const auto pixelCount = width * height;
+	for (auto& history : m_history) history.resize(pixelCount);
+	for (auto& historyLengths : m_historyLengths) historyLengths.resize(pixelCount);
+	m_prevVisibility.resize(pixelCount);
+	m_prevDepths.resize(pixelCount);
+	Reset();
+}
+
+void TemporalAccumulator::Accumulate(const VisibilityBuffer& visibility, const PerObject* pMatrices,
+	const PerObject* pPrevMatrices, uint32_t meshCount, CXMMATRIX prevViewProj, const XMFLOAT4* pCurrent,
+	XMFLOAT4* pResult)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	// Current world space to last frame's clip space, per mesh
+	vector<XMFLOAT4X4> reprojections(meshCount);
+	for (auto i = 0u; i < meshCount; ++i)
+	{
+		const auto world = XMLoadFloat3x4(&pMatrices[i].World);
+		const auto prevWorld = XMLoadFloat3x4(&pPrevMatrices[i].World);
+		XMStoreFloat4x4(&reprojections[i], XMMatrixInverse(nullptr, world) * prevWorld * prevViewProj);
+	}
+
+	const auto& prevHistory = m_history[m_historyIndex];
+	const auto& prevHistoryLengths = m_historyLengths[m_historyIndex];
+	auto& history = m_history[m_historyIndex ^ 1];
+	auto& historyLengths = m_historyLengths[m_historyIndex ^ 1];
+
+	const auto pVisibility = visibility.GetVisibility();
+	const auto pPositions = visibility.GetPositions();
+	const auto pDepths = visibility.GetDepths();
+
+	atomic<uint32_t> coveredPixelCount(0), disoccludedPixelCount(0);
+	atomic<uint64_t> historyLengthSum(0);
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t coveredCount = 0, disoccludedCount = 0;
+		uint64_t lengthSum = 0;
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = m_width * y + x;
+				const auto current = XMLoadFloat4(&pCurrent[i]);
+				const auto id = pVisibility[i];
+				if (!id)
+				{
+					history[i] = pCurrent[i];
+					historyLengths[i] = 0;
+					pResult[i] = pCurrent[i];
+					continue;
+				}
+
+				// Position of the same surface point in the previous frame
+				const auto meshId = DecodeVisibility(id).MeshId;
+				XMFLOAT4 prevClip;
+				XMStoreFloat4(&prevClip, XMVector3Transform(XMLoadFloat3(&pPositions[i]), XMLoadFloat4x4(&reprojections[meshId])));
+				const auto u = (prevClip.x / prevClip.w * 0.5f + 0.5f) * m_width - 0.5f;
+				const auto v = (0.5f - prevClip.y / prevClip.w * 0.5f) * m_height - 0.5f;
+				const auto expectedDepth = prevClip.w;
+
+				// Bilinear taps that saw the same triangle, or the same mesh at a consistent depth
+				auto prev = XMVectorZero();
+				auto prevLength = 0.0f, weightSum = 0.0f;
+				const auto x0 = static_cast<int32_t>(floorf(u)), y0 = static_cast<int32_t>(floorf(v));
+				const auto fu = u - x0, fv = v - y0;
+				for (uint8_t k = 0; k < 4 && prevClip.w > 0.0f; ++k)
+				{
+					const auto tx = x0 + (k & 1), ty = y0 + (k >> 1);
+					if (tx < 0 || ty < 0 || tx >= static_cast<int32_t>(m_width) || ty >= static_cast<int32_t>(m_height)) continue;
+
+					const auto j = m_width * ty + tx;
+					const auto prevId = m_prevVisibility[j];
+					if (!prevId || !prevHistoryLengths[j]) continue;
+					if (prevId != id && (DecodeVisibility(prevId).MeshId != meshId ||
+						fabsf(m_prevDepths[j] - expectedDepth) > 0.05f * expectedDepth)) continue;
+
+					const auto weight = (k & 1 ? fu : 1.0f - fu) * (k & 2 ? fv : 1.0f - fv);
+					prev += XMLoadFloat4(&prevHistory[j]) * weight;
+					prevLength += prevHistoryLengths[j] * weight;
+					weightSum += weight;
+				}
+
+				uint8_t historyLength = 1;
+				auto result = current;
+				if (weightSum > 0.01f)
+				{
+					historyLength = static_cast<uint8_t>((min)(prevLength / weightSum + 1.5f, static_cast<float>(m_maxHistoryLength)));
+					result = XMVectorLerp(prev / weightSum, current, 1.0f / historyLength);
+				}
+				else ++disoccludedCount;
+
+				XMStoreFloat4(&history[i], result);
+				historyLengths[i] = historyLength;
+				pResult[i] = history[i];
+				lengthSum += historyLength;
+				++coveredCount;
+			}
+
+		coveredPixelCount += coveredCount;
+		disoccludedPixelCount += disoccludedCount;
+		historyLengthSum += lengthSum;
+	});
+
+	m_prevVisibility.assign(pVisibility, pVisibility + m_width * m_height);
+	m_prevDepths.assign(pDepths, pDepths + m_width * m_height);
+	m_historyIndex ^= 1;
+
+	m_stats.CoveredPixelCount = coveredPixelCount;
+	m_stats.DisoccludedPixelCount = disoccludedPixelCount;
+	m_stats.AverageHistoryLength = coveredPixelCount ? historyLengthSum / static_cast<double>(coveredPixelCount) : 0.0;
+	m_stats.AccumulateTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void TemporalAccumulator::Reset()
+{
+	for (auto& historyLengths : m_historyLengths) fill(historyLengths.begin(), historyLengths.end(), uint8_t(0));
+	fill(m_prevVisibility.begin(), m_prevVisibility.end(), 0u);
+	fill(m_prevDepths.begin(), m_prevDepths.end(), 0.0f);
+}
+
+const uint8_t* TemporalAccumulator::GetHistoryLengths() const
+{
+	return m_historyLengths[m_historyIndex].data();
+}
+
+const TemporalAccumulator::Stats& TemporalAccumulator::GetStats() const
+{
+	return m_stats;
+}
@@ -0,0 +1,50 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VisibilityBuffer.h"
+
+//--------------------------------------------------------------------------------------
+// Screen-space temporal reuse of the indirect lighting: last frame's result is
+// reprojected with the previous viewProj and World matrices, bilinear taps are rejected
+// on mesh-id or depth mismatches (disocclusions), and a per-pixel history length drives
+// the blend factor
+//--------------------------------------------------------------------------------------
+class TemporalAccumulator
+{
+public:
+	struct Stats
+	{
+		double AccumulateTime;	// ms
+		uint32_t CoveredPixelCount;
+		uint32_t DisoccludedPixelCount;
+		double AverageHistoryLength;
+	};
+
+	TemporalAccumulator();
+	virtual ~TemporalAccumulator();
+
+	void Init(uint32_t width, uint32_t height, uint8_t maxHistoryLength = 32);
+	void Accumulate(const VisibilityBuffer& visibility, const PerObject* pMatrices, const PerObject* pPrevMatrices,
+		uint32_t meshCount, DirectX::CXMMATRIX prevViewProj, const DirectX::XMFLOAT4* pCurrent,
+		DirectX::XMFLOAT4* pResult);
+	void Reset();
+
+	const uint8_t* GetHistoryLengths() const;
+	const Stats& GetStats() const;
+
+protected:
+	std::vector<DirectX::XMFLOAT4>	m_history[2];
+	std::vector<uint8_t>			m_historyLengths[2];
+	std::vector<uint32_t>			m_prevVisibility;
+	std::vector<float>				m_prevDepths;
+
+	uint32_t	m_width;
+	uint32_t	m_height;
+	uint8_t		m_maxHistoryLength;
+	uint8_t		m_historyIndex;
+
+	Stats m_stats;
+};
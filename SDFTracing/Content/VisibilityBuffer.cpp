@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "VisibilityBuffer.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+VisibilityBuffer::VisibilityBuffer() :
+	m_width(0),
+	m_height(0),
+	m_stats()
+{
+}
+
+VisibilityBuffer::~VisibilityBuffer()
+{
+}
+
+void VisibilityBuffer::Init(uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+
+	const auto pixelCount = width * height;
+	m_visibility.resize(pixelCount);
+	m_zBuffer.resize(pixelCount);
+	m_positions.resize(pixelCount);
+	m_normals.resize(pixelCount);
+	m_depths.resize(pixelCount);
+}
+
+void VisibilityBuffer::Render(const MeshView* pMeshes, const PerObject* pMatrices, uint32_t meshCount, CXMMATRIX viewProj)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	// Screen-space triangles; those crossing the near plane are dropped
+	struct Triangle
+	{
+		XMFLOAT3 P[3];	// Pixel x, y and NDC z
+		XMINT4 Rect;
+		uint32_t Id;
+	};
+
+	vector<Triangle> triangles;
+	for (auto i = 0u; i < meshCount; ++i)
+	{
+		const auto& mesh = pMeshes[i];
+		const auto worldViewProj = XMLoadFloat3x4(&pMatrices[i].World) * viewProj;
+		for (auto j = 0u; j < mesh.IndexCount / 3; ++j)
+		{
+			Triangle triangle;
+			auto isVisible = true;
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				XMFLOAT4 p;
+				const auto& pos = mesh.Vertices[mesh.Indices[j * 3 + k]].Pos;
+				XMStoreFloat4(&p, XMVector4Transform(XMVectorSet(pos.x, pos.y, pos.z, 1.0f), worldViewProj));
+				if (p.w <= 1e-4f)
+				{
+					isVisible = false;
+					break;
+				}
+				triangle.P[k] = XMFLOAT3((p.x / p.w * 0.5f + 0.5f) * m_width, (0.5f - p.y / p.w * 0.5f) * m_height, p.z / p.w);
+			}
+			if (!isVisible) continue;
+
+			const auto xMin = (min)(triangle.P[0].x, (min)(triangle.P[1].x, triangle.P[2].x));
+			const auto xMax = (max)(triangle.P[0].x, (max)(triangle.P[1].x, triangle.P[2].x));
+			const auto yMin = (min)(triangle.P[0].y, (min)(triangle.P[1].y, triangle.P[2].y));
+			const auto yMax = (max)(triangle.P[0].y, (max)(triangle.P[1].y, triangle.P[2].y));
+			triangle.Rect.x = (max)(static_cast<int32_t>(floorf(xMin)), 0);
+			triangle.Rect.y = (max)(static_cast<int32_t>(floorf(yMin)), 0);
+			triangle.Rect.z = (min)(static_cast<int32_t>(ceilf(xMax)), static_cast<int32_t>(m_width) - 1);
+			triangle.Rect.w = (min)(static_cast<int32_t>(ceilf(yMax)), static_cast<int32_t>(m_height) - 1);
+			if (triangle.Rect.x > triangle.Rect.z || triangle.Rect.y > triangle.Rect.w) continue;
+
+			triangle.Id = EncodeVisibility(i, j);
+			triangles.emplace_back(triangle);
+		}
+	}
+
+	// Bands of rows rasterize independently; no culling, like the visibility pipeline
+	const auto bandHeight = 16u;
+	ParallelFor((m_height + bandHeight - 1) / bandHeight, 1, [&](uint32_t begin, uint32_t end)
+	{
+		const auto yBegin = static_cast<int32_t>(begin * bandHeight);
+		const auto yEnd = static_cast<int32_t>((min)(end * bandHeight, m_height));
+		fill(m_visibility.begin() + yBegin * m_width, m_visibility.begin() + yEnd * m_width, 0u);
+		fill(m_zBuffer.begin() + yBegin * m_width, m_zBuffer.begin() + yEnd * m_width, 1.0f);
+
+		for (const auto& triangle : triangles)
+		{
+			const auto y0 = (max)(triangle.Rect.y, yBegin);
+			const auto y1 = (min)(triangle.Rect.w, yEnd - 1);
+			if (y0 > y1) continue;
+
+			const auto& a = triangle.P[0];
+			const auto& b = triangle.P[1];
+			const auto& c = triangle.P[2];
+			const auto area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (fabsf(area) < 1e-12f) continue;
+			const auto areaInv = 1.0f / area;
+
+			for (auto y = y0; y <= y1; ++y)
+				for (auto x = triangle.Rect.x; x <= triangle.Rect.z; ++x)
+				{
+					const auto px = x + 0.5f, py = y + 0.5f;
+					const auto w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * areaInv;
+					const auto w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * areaInv;
+					const auto w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+					const auto z = w0 * a.z + w1 * b.z + w2 * c.z;
+					const auto i = m_width * y + x;
+					if (z < 0.0f || z >= m_zBuffer[i]) continue;
+
+					m_zBuffer[i] = z;
+					m_visibility[i] = triangle.Id;
+				}
+		}
+	});
+
+	m_stats.RenderTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	start = chrono::high_resolution_clock::now();
+	decode(pMeshes, pMatrices, viewProj);
+	m_stats.DecodeTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+const uint32_t* VisibilityBuffer::GetVisibility() const
+{
+	return m_visibility.data();
+}
+
+const XMFLOAT3* VisibilityBuffer::GetPositions() const
+{
+	return m_positions.data();
+}
+
+const XMFLOAT3* VisibilityBuffer::GetNormals() const
+{
+	return m_normals.data();
+}
+
+const float* VisibilityBuffer::GetDepths() const
+{
+	return m_depths.data();
+}
+
+uint32_t VisibilityBuffer::GetWidth() const
+{
+	return m_width;
+}
+
+uint32_t VisibilityBuffer::GetHeight() const
+{
+	return m_height;
+}
+
+const VisibilityBuffer::Stats& VisibilityBuffer::GetStats() const
+{
+	return m_stats;
+}
+
+XMFLOAT2 VisibilityBuffer::CalcBarycentrics(const XMFLOAT4 p[3], const XMFLOAT2& ndc)
+{
+	const XMFLOAT3 invW(1.0f / p[0].w, 1.0f / p[1].w, 1.0f / p[2].w);
+
+	const XMFLOAT2 ndc0(p[0].x * invW.x, p[0].y * invW.x);
+	const XMFLOAT2 ndc1(p[1].x * invW.y, p[1].y * invW.y);
+	const XMFLOAT2 ndc2(p[2].x * invW.z, p[2].y * invW.z);
+
+	const auto invDet = 1.0f / ((ndc2.x - ndc1.x) * (ndc0.y - ndc1.y) - (ndc2.y - ndc1.y) * (ndc0.x - ndc1.x));
+	const XMFLOAT3 dPdx((ndc1.y - ndc2.y) * invDet, (ndc2.y - ndc0.y) * invDet, (ndc0.y - ndc1.y) * invDet);
+	const XMFLOAT3 dPdy((ndc2.x - ndc1.x) * invDet, (ndc0.x - ndc2.x) * invDet, (ndc1.x - ndc0.x) * invDet);
+
+	const XMFLOAT2 deltaVec(ndc.x - ndc0.x, ndc.y - ndc0.y);
+	const auto interpInvW = invW.x + deltaVec.x * (invW.x * dPdx.x + invW.y * dPdx.y + invW.z * dPdx.z) +
+		deltaVec.y * (invW.x * dPdy.x + invW.y * dPdy.y + invW.z * dPdy.z);
+	const auto interpW = 1.0f / interpInvW;
+
+	return XMFLOAT2(interpW * (deltaVec.x * dPdx.y * invW.y + deltaVec.y * dPdy.y * invW.y),
+		interpW * (deltaVec.x * dPdx.z * invW.z + deltaVec.y * dPdy.z * invW.z));
+}
+
+void VisibilityBuffer::decode(const MeshView* pMeshes, const PerObject* pMatrices, CXMMATRIX viewProj)
+{
+	atomic<uint32_t> coveredPixelCount(0);
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t count = 0;
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = m_width * y + x;
+				const auto visibility = m_visibility[i];
+				if (!visibility)
+				{
+					m_positions[i] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+					m_normals[i] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+					m_depths[i] = 0.0f;
+					continue;
+				}
+
+				const auto vis = DecodeVisibility(visibility);
+				const auto& mesh = pMeshes[vis.MeshId];
+				const auto world = XMLoadFloat3x4(&pMatrices[vis.MeshId].World);
+				const Vertex* vertices[3];
+				XMFLOAT4 p[3];
+				for (uint8_t k = 0; k < 3; ++k)
+				{
+					vertices[k] = &mesh.Vertices[mesh.Indices[vis.PrimId * 3 + k]];
+					XMStoreFloat4(&p[k], XMVector4Transform(XMVector3Transform(XMLoadFloat3(&vertices[k]->Pos), world), viewProj));
+				}
+
+				// Invert Y for Y-up-style NDC
+				const XMFLOAT2 ndc((x + 0.5f) / m_width * 2.0f - 1.0f, 1.0f - (y + 0.5f) / m_height * 2.0f);
+				const auto barycentrics = CalcBarycentrics(p, ndc);
+				const XMFLOAT3 baryWeights(1.0f - (barycentrics.x + barycentrics.y), barycentrics.x, barycentrics.y);
+
+				const auto pos = XMLoadFloat3(&vertices[0]->Pos) * baryWeights.x +
+					XMLoadFloat3(&vertices[1]->Pos) * baryWeights.y + XMLoadFloat3(&vertices[2]->Pos) * baryWeights.z;
+				const auto nrm = XMLoadFloat3(&vertices[0]->Nrm) * baryWeights.x +
+					XMLoadFloat3(&vertices[1]->Nrm) * baryWeights.y + XMLoadFloat3(&vertices[2]->Nrm) * baryWeights.z;
+				XMStoreFloat3(&m_positions[i], XMVector3Transform(pos, world));
+				XMStoreFloat3(&m_normals[i], XMVector3Normalize(XMVector3TransformNormal(nrm,
+					XMLoadFloat3x4(&pMatrices[vis.MeshId].WorldIT))));
+				m_depths[i] = p[0].w * baryWeights.x + p[1].w * baryWeights.y + p[2].w * baryWeights.z;
+				++count;
+			}
+
+		coveredPixelCount += count;
+	});
+
+	m_stats.CoveredPixelCount = coveredPixelCount;
+}
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SceneData.h"
+
+//--------------------------------------------------------------------------------------
+// CPU mirror of the visibility pass (PSVisibility) and of GetPixelAttrib() in
+// DecodeVisibility.hlsli: ids are rasterized with a depth test, then every covered
+// pixel gets its world position, normal and linear depth
+//--------------------------------------------------------------------------------------
+class VisibilityBuffer
+{
+public:
+	struct Stats
+	{
+		double RenderTime;	// ms
+		double DecodeTime;	// ms
+		uint32_t CoveredPixelCount;
+	};
+
+	VisibilityBuffer();
+	virtual ~VisibilityBuffer();
+
+	void Init(uint32_t width, uint32_t height);
+	void Render(const MeshView* pMeshes, const PerObject* pMatrices, uint32_t meshCount, DirectX::CXMMATRIX viewProj);
+
+	const uint32_t* GetVisibility() const;
+	const DirectX::XMFLOAT3* GetPositions() const;
+	const DirectX::XMFLOAT3* GetNormals() const;
+	const float* GetDepths() const;	// View-space depth, 0 for background
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+	const Stats& GetStats() const;
+
+	// Perspective-correct barycentrics of the NDC position, as calcBarycentrics()
+	static DirectX::XMFLOAT2 CalcBarycentrics(const DirectX::XMFLOAT4 p[3], const DirectX::XMFLOAT2& ndc);
+
+protected:
+	void decode(const MeshView* pMeshes, const PerObject* pMatrices, DirectX::CXMMATRIX viewProj);
+
+	std::vector<uint32_t>			m_visibility;
+	std::vector<float>				m_zBuffer;
+	std::vector<DirectX::XMFLOAT3>	m_positions;
+	std::vector<DirectX::XMFLOAT3>	m_normals;
+	std::vector<float>				m_depths;
+
+	uint32_t m_width;
+	uint32_t m_height;
+
+	Stats m_stats;
+};
@@ -0,0 +1,329 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "VolumeShader.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+enum VoxelAttrib : uint8_t
+{
+	ATTRIB_POS_X,
+	ATTRIB_POS_Y,
+	ATTRIB_POS_Z,
+	ATTRIB_NRM_X,
+	ATTRIB_NRM_Y,
+	ATTRIB_NRM_Z,
+	ATTRIB_COLOR_R,
+	ATTRIB_COLOR_G,
+	ATTRIB_COLOR_B,
+	ATTRIB_EMISSIVE,
+
+	NUM_VOXEL_ATTRIB
+};
+
+// PCG hash, for the per-voxel random numbers
+static uint32_t pcgHash(uint32_t v)
+{
+	const auto state = v * 747796405u + 2891336453u;
+	const auto word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+
+	return (word >> 22) ^ word;
+}
+
+VolumeShader::VolumeShader() :
+	m_pLightClusters(nullptr),
+	m_pLightBVH(nullptr),
+	m_lightSampleCount(1),
+	m_pShadowCache(nullptr),
+	m_stats()
+{
+}
+
+VolumeShader::~VolumeShader()
+{
+}
+
+void VolumeShader::Compact(const SDFVolume& volume)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	// Compact each z-slice independently, then concatenate in slice order
+	const auto gridSize = volume.GetGridSize();
+	const auto pIds = volume.GetIds();
+	vector<vector<uint32_t>> sliceVoxels(gridSize);
+	vector<vector<uint32_t>> sliceBoundaries(gridSize);
+	ParallelFor(gridSize, 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto z = begin; z < end; ++z)
+		{
+			auto& voxels = sliceVoxels[z];
+			auto& boundaries = sliceBoundaries[z];
+			const auto isBoundaryZ = z == 0 || z + 1 >= gridSize;
+			for (auto y = 0u; y < gridSize; ++y)
+			{
+				const auto isBoundaryYZ = isBoundaryZ || y == 0 || y + 1 >= gridSize;
+				for (auto x = 0u; x < gridSize; ++x)
+				{
+					const auto i = volume.GetVoxelIndex(x, y, z);
+					if (pIds[i]) voxels.emplace_back(i);
+					else if (isBoundaryYZ || x == 0 || x + 1 >= gridSize) boundaries.emplace_back(i);
+				}
+			}
+		}
+	});
+
+	m_surfaceVoxels.clear();
+	m_boundaryVoxels.clear();
+	for (auto z = 0u; z < gridSize; ++z)
+	{
+		m_surfaceVoxels.insert(m_surfaceVoxels.end(), sliceVoxels[z].cbegin(), sliceVoxels[z].cend());
+		m_boundaryVoxels.insert(m_boundaryVoxels.end(), sliceBoundaries[z].cbegin(), sliceBoundaries[z].cend());
+	}
+
+	m_stats.VoxelCount = volume.GetVoxelCount();
+	m_stats.SurfaceVoxelCount = static_cast<uint32_t>(m_surfaceVoxels.size());
+	m_stats.BoundaryVoxelCount = static_cast<uint32_t>(m_boundaryVoxels.size());
+	m_stats.CompactTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void VolumeShader::Shade(const SDFVolume& volume, const MeshView* pMeshes, const PerObject* pMatrices,
+	const LightSource* pLightSources, uint32_t lightSourceCount, XMFLOAT4* pIrradiance)
+{
+	// Empty voxels on the volume boundary are kept black, as CSShadeVolume does
+	for (const auto& i : m_boundaryVoxels) pIrradiance[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	Shade(volume, m_surfaceVoxels.data(), static_cast<uint32_t>(m_surfaceVoxels.size()),
+		pMeshes, pMatrices, pLightSources, lightSourceCount, pIrradiance);
+}
+
+void VolumeShader::Shade(const SDFVolume& volume, const uint32_t* pVoxels, uint32_t voxelCount,
+	const MeshView* pMeshes, const PerObject* pMatrices, const LightSource* pLightSources,
+	uint32_t lightSourceCount, XMFLOAT4* pIrradiance)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	prepareLights(pLightSources, lightSourceCount);
+	ParallelFor(voxelCount, ChunkSize, [&](uint32_t begin, uint32_t end)
+	{
+		shadeChunk(volume, &pVoxels[begin], end - begin, pMeshes, pMatrices, pIrradiance);
+	});
+
+	m_stats.ShadeTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void VolumeShader::ShadePoints(const SDFVolume& volume, const XMFLOAT3* pPositions, const XMFLOAT3* pNormals,
+	uint32_t pointCount, const LightSource* pLightSources, uint32_t lightSourceCount, XMFLOAT3* pIrradiance)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	prepareLights(pLightSources, lightSourceCount);
+	const auto voxel = volume.GetVoxelSize();
+	ParallelFor(pointCount, ChunkSize, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto origin = XMLoadFloat3(&pPositions[i]);
+			const auto N = XMLoadFloat3(&pNormals[i]);
+			const auto shadeLight = [&](uint32_t lightIdx)
+			{
+				const auto& light = m_lights[lightIdx];
+				const auto disp = XMLoadFloat3(&light.Pos) - origin;
+				const auto L = XMVector3Normalize(disp);
+				const auto NoL = XMVectorGetX(XMVector3Dot(N, L));
+
+				if (NoL <= 0.0f) return XMVectorZero();
+
+				const auto coneRadius = fabsf(XMVectorGetX(XMVector3Dot(XMLoadFloat3(&light.Orient), L))) * light.MaxDim;
+				const auto tMax = XMVectorGetX(XMVector3Length(disp));
+				const auto visibility = volume.TraceCone(origin, L, voxel, tMax, coneRadius).z;
+
+				return XMLoadFloat3(&light.Color) * (NoL * visibility);
+			};
+
+			auto irradiance = XMVectorZero();
+			if (m_pLightBVH)
+			{
+				for (auto j = 0u; j < m_lightSampleCount; ++j)
+				{
+					auto pdf = 0.0f;
+					const auto u = (pcgHash(i * m_lightSampleCount + j) >> 8) / 16777216.0f;
+					const auto lightIdx = m_pLightBVH->Sample(origin, N, u, pdf);
+					if (lightIdx != UINT32_MAX) irradiance += shadeLight(lightIdx) / (pdf * m_lightSampleCount);
+				}
+			}
+			else for (auto j = 0u; j < lightSourceCount; ++j) irradiance += shadeLight(j);
+
+			XMStoreFloat3(&pIrradiance[i], irradiance);
+		}
+	});
+
+	m_stats.ShadeTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void VolumeShader::SetLightClusters(const LightClusters* pLightClusters)
+{
+	m_pLightClusters = pLightClusters;
+}
+
+void VolumeShader::SetLightBVH(const LightBVH* pLightBVH, uint32_t sampleCount)
+{
+	m_pLightBVH = pLightBVH;
+	m_lightSampleCount = sampleCount;
+}
+
+void VolumeShader::SetShadowCache(ShadowCache* pShadowCache)
+{
+	m_pShadowCache = pShadowCache;
+}
+
+const vector<uint32_t>& VolumeShader::GetSurfaceVoxels() const
+{
+	return m_surfaceVoxels;
+}
+
+const VolumeShader::Stats& VolumeShader::GetStats() const
+{
+	return m_stats;
+}
+
+void VolumeShader::prepareLights(const LightSource* pLightSources, uint32_t lightSourceCount)
+{
+	m_lights.resize(lightSourceCount);
+	for (auto i = 0u; i < lightSourceCount; ++i)
+	{
+		const auto& lightSource = pLightSources[i];
+		const auto world = XMLoadFloat3x4(&lightSource.World);
+		const auto lMin = XMVector4Transform(XMLoadFloat4(&lightSource.Min), world);
+		const auto lMax = XMVector4Transform(XMLoadFloat4(&lightSource.Max), world);
+
+		XMFLOAT3 lightExt;
+		XMStoreFloat3(&lightExt, (lMax - lMin) * 0.5f);
+		const auto lMinDim = (min)(lightExt.x, (min)(lightExt.y, lightExt.z));
+
+		auto& light = m_lights[i];
+		XMStoreFloat3(&light.Pos, (lMin + lMax) * 0.5f);
+		light.Orient = XMFLOAT3(lightExt.x <= lMinDim, lightExt.y <= lMinDim, lightExt.z <= lMinDim);
+		light.Color = XMFLOAT3(lightSource.Emissive.x * lightSource.Emissive.w,
+			lightSource.Emissive.y * lightSource.Emissive.w, lightSource.Emissive.z * lightSource.Emissive.w);
+		light.MaxDim = (max)(lightExt.x, (max)(lightExt.y, lightExt.z));
+	}
+}
+
+void VolumeShader::shadeChunk(const SDFVolume& volume, const uint32_t* pVoxels, uint32_t voxelCount,
+	const MeshView* pMeshes, const PerObject* pMatrices, XMFLOAT4* pIrradiance) const
+{
+	assert(voxelCount <= ChunkSize);
+
+	// Gather the triangle vertices of the chunk into SoA streams
+	float weights[3][ChunkSize];
+	float vertexAttribs[3][NUM_VOXEL_ATTRIB][ChunkSize];
+	uint32_t meshIds[ChunkSize];
+	const auto pIds = volume.GetIds();
+	const auto pBarycs = volume.GetBarycs();
+	for (auto i = 0u; i < voxelCount; ++i)
+	{
+		const auto vis = DecodeVisibility(pIds[pVoxels[i]]);
+		const auto& mesh = pMeshes[vis.MeshId];
+		const auto& baryc = pBarycs[pVoxels[i]];
+		meshIds[i] = vis.MeshId;
+		weights[0][i] = 1.0f - (baryc.x + baryc.y);
+		weights[1][i] = baryc.x;
+		weights[2][i] = baryc.y;
+
+		const auto baseIdx = vis.PrimId * 3;
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			const auto& vertex = mesh.Vertices[mesh.Indices[baseIdx + j]];
+			auto& attribs = vertexAttribs[j];
+			attribs[ATTRIB_POS_X][i] = vertex.Pos.x;
+			attribs[ATTRIB_POS_Y][i] = vertex.Pos.y;
+			attribs[ATTRIB_POS_Z][i] = vertex.Pos.z;
+			attribs[ATTRIB_NRM_X][i] = vertex.Nrm.x;
+			attribs[ATTRIB_NRM_Y][i] = vertex.Nrm.y;
+			attribs[ATTRIB_NRM_Z][i] = vertex.Nrm.z;
+			attribs[ATTRIB_COLOR_R][i] = (vertex.Color & 0xff) / 255.0f;
+			attribs[ATTRIB_COLOR_G][i] = ((vertex.Color >> 8) & 0xff) / 255.0f;
+			attribs[ATTRIB_COLOR_B][i] = ((vertex.Color >> 16) & 0xff) / 255.0f;
+			attribs[ATTRIB_EMISSIVE][i] = vertex.Emissive;
+		}
+	}
+
+	// Interpolate triangle sample attributes, one stream at a time
+	float attribs[NUM_VOXEL_ATTRIB][ChunkSize];
+	for (uint8_t j = 0; j < NUM_VOXEL_ATTRIB; ++j)
+		for (auto i = 0u; i < voxelCount; ++i)
+			attribs[j][i] = weights[0][i] * vertexAttribs[0][j][i] +
+				weights[1][i] * vertexAttribs[1][j][i] + weights[2][i] * vertexAttribs[2][j][i];
+
+	// Shadow
+	const auto voxel = volume.GetVoxelSize();
+	auto lookupCount = 0u, hitCount = 0u;
+	for (auto i = 0u; i < voxelCount; ++i)
+	{
+		const auto& matrices = pMatrices[meshIds[i]];
+		const auto pos = XMVectorSet(attribs[ATTRIB_POS_X][i], attribs[ATTRIB_POS_Y][i], attribs[ATTRIB_POS_Z][i], 1.0f);
+		const auto nrm = XMVectorSet(attribs[ATTRIB_NRM_X][i], attribs[ATTRIB_NRM_Y][i], attribs[ATTRIB_NRM_Z][i], 0.0f);
+		const auto origin = XMVector3Transform(pos, XMLoadFloat3x4(&matrices.World));
+		const auto N = XMVector3Normalize(XMVector3TransformNormal(nrm, XMLoadFloat3x4(&matrices.WorldIT)));
+
+		const auto pVisibilities = m_pShadowCache ? m_pShadowCache->GetVisibilities(pVoxels[i], origin) : nullptr;
+		const auto shadeLight = [&](uint32_t lightIdx)
+		{
+			const auto& light = m_lights[lightIdx];
+			const auto disp = XMLoadFloat3(&light.Pos) - origin;
+			const auto L = XMVector3Normalize(disp);
+			const auto NoL = XMVectorGetX(XMVector3Dot(N, L));
+
+			if (NoL <= 0.0f) return XMVectorZero();
+
+			auto visibility = 0.0f;
+			if (pVisibilities && pVisibilities[lightIdx] != ShadowCache::Invalid)
+			{
+				visibility = ShadowCache::Dequantize(pVisibilities[lightIdx]);
+				++hitCount;
+			}
+			else
+			{
+				const auto coneRadius = fabsf(XMVectorGetX(XMVector3Dot(XMLoadFloat3(&light.Orient), L))) * light.MaxDim;
+				const auto tMax = XMVectorGetX(XMVector3Length(disp));
+				visibility = volume.TraceCone(origin, L, voxel, tMax, coneRadius).z;
+				if (pVisibilities) pVisibilities[lightIdx] = ShadowCache::Quantize(visibility);
+			}
+			if (pVisibilities) ++lookupCount;
+
+			return XMLoadFloat3(&light.Color) * (NoL * visibility);
+		};
+
+		auto irradiance = XMVectorZero();
+		if (m_pLightBVH)
+		{
+			// One-sample estimates, each divided by the selection probability
+			for (auto j = 0u; j < m_lightSampleCount; ++j)
+			{
+				auto pdf = 0.0f;
+				const auto u = (pcgHash(pVoxels[i] * m_lightSampleCount + j) >> 8) / 16777216.0f;
+				const auto lightIdx = m_pLightBVH->Sample(origin, N, u, pdf);
+				if (lightIdx != UINT32_MAX) irradiance += shadeLight(lightIdx) / (pdf * m_lightSampleCount);
+			}
+		}
+		else
+		{
+			auto lightCount = static_cast<uint32_t>(m_lights.size());
+			const auto pLightIndices = m_pLightClusters ?
+				m_pLightClusters->GetLightIndices(m_pLightClusters->GetClusterIndex(pVoxels[i]), lightCount) : nullptr;
+			for (auto j = 0u; j < lightCount; ++j)
+				irradiance += shadeLight(pLightIndices ? pLightIndices[j] : j);
+		}
+
+		const auto emissive = attribs[ATTRIB_EMISSIVE][i];
+		const auto color = XMVectorSet(attribs[ATTRIB_COLOR_R][i], attribs[ATTRIB_COLOR_G][i], attribs[ATTRIB_COLOR_B][i], 0.0f);
+		const auto radiosity = emissive > 0.0f ? color * emissive : color * irradiance;
+		XMStoreFloat4(&pIrradiance[pVoxels[i]], XMVectorSetW(radiosity, 1.0f));
+	}
+
+	if (m_pShadowCache) m_pShadowCache->RecordLookups(lookupCount, hitCount);
+}
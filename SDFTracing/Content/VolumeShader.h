@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "LightClusters.h"
+#include "LightBVH.h"
+#include "ShadowCache.h"
+
+//--------------------------------------------------------------------------------------
+// CPU implementation of CSShadeVolume over a compacted surface-voxel list, and of the
+// direct-light loop of CSShade at given surface points
+//--------------------------------------------------------------------------------------
+class VolumeShader
+{
+public:
+	struct Stats
+	{
+		double CompactTime;	// ms
+		double ShadeTime;	// ms
+		uint32_t VoxelCount;
+		uint32_t SurfaceVoxelCount;
+		uint32_t BoundaryVoxelCount;
+	};
+
+	VolumeShader();
+	virtual ~VolumeShader();
+
+	void Compact(const SDFVolume& volume);
+	void Shade(const SDFVolume& volume, const MeshView* pMeshes, const PerObject* pMatrices,
+		const LightSource* pLightSources, uint32_t lightSourceCount, DirectX::XMFLOAT4* pIrradiance);
+	void Shade(const SDFVolume& volume, const uint32_t* pVoxels, uint32_t voxelCount,
+		const MeshView* pMeshes, const PerObject* pMatrices, const LightSource* pLightSources,
+		uint32_t lightSourceCount, DirectX::XMFLOAT4* pIrradiance);
+	// World-space points and normals, e.g. the pixels of a VisibilityBuffer; only the light
+	// BVH applies here, since the clusters and the shadow cache are indexed by voxel
+	void ShadePoints(const SDFVolume& volume, const DirectX::XMFLOAT3* pPositions, const DirectX::XMFLOAT3* pNormals,
+		uint32_t pointCount, const LightSource* pLightSources, uint32_t lightSourceCount, DirectX::XMFLOAT3* pIrradiance);
+
+	// Optional clustered light lists; all lights are iterated without them
+	void SetLightClusters(const LightClusters* pLightClusters);
+	// Optional stochastic light selection, taking sampleCount lights per voxel
+	void SetLightBVH(const LightBVH* pLightBVH, uint32_t sampleCount = 1);
+	// Optional cache of the shadow terms, updated by the caller before shading
+	void SetShadowCache(ShadowCache* pShadowCache);
+
+	const std::vector<uint32_t>& GetSurfaceVoxels() const;
+	const Stats& GetStats() const;
+
+	static const uint32_t ChunkSize = 64;
+
+protected:
+	// Light data that only depends on the light, hoisted out of the voxel loop
+	struct LightCache
+	{
+		DirectX::XMFLOAT3 Pos;
+		DirectX::XMFLOAT3 Orient;
+		DirectX::XMFLOAT3 Color;
+		float MaxDim;
+	};
+
+	void prepareLights(const LightSource* pLightSources, uint32_t lightSourceCount);
+	void shadeChunk(const SDFVolume& volume, const uint32_t* pVoxels, uint32_t voxelCount,
+		const MeshView* pMeshes, const PerObject* pMatrices, DirectX::XMFLOAT4* pIrradiance) const;
+
+	std::vector<uint32_t>	m_surfaceVoxels;
+	std::vector<uint32_t>	m_boundaryVoxels;
+	std::vector<LightCache>	m_lights;
+
+	const LightClusters* m_pLightClusters;
+	const LightBVH* m_pLightBVH;
+	uint32_t m_lightSampleCount;
+	ShadowCache* m_pShadowCache;
+
+	Stats m_stats;
+};
@@ -16,5 +16,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 {
 	SDFTracing sdfTracing(1920, 1080, L"SDF Tracing");
 
+	// The CPU benchmarks run on their own, without creating the window and the renderer
+	int argc;
+	const auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	sdfTracing.ParseCommandLineArgs(argv, argc);
+	LocalFree(argv);
+	if (sdfTracing.IsBenchmarking()) return sdfTracing.RunBenchmarks() ? 0 : 1;
+
 	return Win32Application::Run(&sdfTracing, hInstance, nCmdShow);
 }
@@ -10,6 +10,7 @@
 //*********************************************************
 
 #include "SDFTracing.h"
+#include "Benchmark.h"
 #include "stb_image_write.h"
 
 using namespace std;
@@ -33,6 +34,7 @@ SDFTracing::SDFTracing(uint32_t width, uint32_t height, std::wstring name) :
 	m_deviceType(DEVICE_DISCRETE),
 	m_showFPS(true),
 	m_isPaused(false),
+	m_benchmark(false),
 	m_tracking(false),
 	m_screenShot(0)
 {
@@ -454,9 +456,38 @@ void SDFTracing::ParseCommandLineArgs(wchar_t* argv[], int argc)
 		else if (wcsncmp(argv[i], L"-uma", wcslen(argv[i])) == 0 ||
 			wcsncmp(argv[i], L"/uma", wcslen(argv[i])) == 0)
 			m_deviceType = DEVICE_UMA;
+		else if (wcsncmp(argv[i], L"-benchmark", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/benchmark", wcslen(argv[i])) == 0)
+		{
+			m_benchmark = true;
+
+			// Optional comma-separated names, e.g. -benchmark gltfCaching,vertexWelding
+			if (i + 1 < argc && argv[i + 1][0] != L'-' && argv[i + 1][0] != L'/')
+			{
+				m_benchmarkNames.emplace_back();
+				for (auto pName = argv[++i]; *pName; ++pName)
+				{
+					if (*pName == L',') m_benchmarkNames.emplace_back();
+					else m_benchmarkNames.back() += static_cast<char>(*pName);
+				}
+			}
+		}
 	}
 }
 
+bool SDFTracing::IsBenchmarking() const
+{
+	return m_benchmark;
+}
+
+bool SDFTracing::RunBenchmarks()
+{
+	// CPU reference benchmarks
+	ofstream ofs("SDFTracing_Benchmark.txt", ios::out);
+
+	return Benchmark::Run(ofs, m_benchmarkNames);
+}
+
 void SDFTracing::PopulateCommandList()
 {
 	// Command list allocators can only be reset when the associated 
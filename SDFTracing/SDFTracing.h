@@ -45,6 +45,9 @@ public:
 
 	virtual void ParseCommandLineArgs(wchar_t* argv[], int argc);
 
+	bool IsBenchmarking() const;
+	bool RunBenchmarks();
+
 private:
 	enum DeviceType : uint8_t
 	{
@@ -90,6 +93,8 @@ private:
 	StepTimer	m_timer;
 	bool		m_showFPS;
 	bool		m_isPaused;
+	bool		m_benchmark;
+	std::vector<std::string> m_benchmarkNames;
 
 	// User camera interactions
 	bool m_tracking;
@@ -2,6 +2,13 @@
 // Copyright (c) XU, Tianchen. All rights reserved.
 //--------------------------------------------------------------------------------------
 
+#include <array>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#if defined(__AVX2__) || defined(__AVX__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
 #include "XUSGGltfLoader.h"
 
 #define CGLTF_IMPLEMENTATION
@@ -14,7 +21,247 @@
 using namespace std;
 using namespace XUSG;
 
-GltfLoader::GltfLoader()
+//--------------------------------------------------------------------------------------
+// cgltf file reads through read-only file mappings instead of copies, for the .gltf/.glb
+// itself and for external buffers; the accessors then read the binary chunk of a .glb and
+// .bin buffers straight from the mapped pages
+//--------------------------------------------------------------------------------------
+static cgltf_result mapFile(const cgltf_memory_options*, const cgltf_file_options*, const char* path, cgltf_size* pSize, void** ppData)
+{
+	const auto hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) return cgltf_result_file_not_found;
+
+	LARGE_INTEGER fileSize;
+	auto result = GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0 ? cgltf_result_success : cgltf_result_io_error;
+	if (result == cgltf_result_success && *pSize > static_cast<cgltf_size>(fileSize.QuadPart)) result = cgltf_result_data_too_short;
+
+	// The view keeps the mapping alive once both handles are closed
+	void* pData = nullptr;
+	if (result == cgltf_result_success)
+	{
+		const auto hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (hMapping)
+		{
+			pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(hMapping);
+		}
+		if (!pData) result = cgltf_result_io_error;
+	}
+	CloseHandle(hFile);
+
+	if (result == cgltf_result_success)
+	{
+		if (!*pSize) *pSize = static_cast<cgltf_size>(fileSize.QuadPart);
+		*ppData = pData;
+	}
+
+	return result;
+}
+
+static void unmapFile(const cgltf_memory_options*, const cgltf_file_options*, void* pData)
+{
+	UnmapViewOfFile(pData);
+}
+
+//--------------------------------------------------------------------------------------
+// Mesh cache: a header, the dependencies on external files, then the vertices, indices,
+// subsets, light sources, materials, texture headers and texels back to back
+//--------------------------------------------------------------------------------------
+static const uint32_t CacheMagic = 0x4853454d;	// "MESH"
+static const uint32_t CacheVersion = 2;
+
+struct CacheHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t Key;
+	uint32_t Stride;
+	uint32_t VertexCount;
+	uint32_t IndexCount;
+	uint32_t SubsetCount;
+	uint32_t LightSourceCount;
+	uint32_t MaterialCount;
+	uint32_t TextureCount;
+	uint32_t DependencyCount;
+	GltfLoader::AABB AABB;
+};
+
+// External buffers and images are tracked by size and last write time, not by contents
+struct CacheDependency
+{
+	uint64_t Size;
+	uint64_t WriteTime;
+	uint32_t PathLength;
+};
+
+struct CacheTexture
+{
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t Channels;
+};
+
+static bool getFileStamp(const string& path, uint64_t& size, uint64_t& writeTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) return false;
+	size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	writeTime = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+	return true;
+}
+
+// Blocks of items taken by a pool of workers, including the calling thread; 0 threads for
+// all hardware threads
+template<typename Func>
+static void forEachBlock(uint32_t threadCount, size_t itemCount, const Func& func)
+{
+	static const size_t blockSize = 4096;
+
+	const auto blockCount = (itemCount + blockSize - 1) / blockSize;
+	atomic<size_t> nextBlock(0);
+	const auto processBlocks = [&]()
+	{
+		for (auto i = nextBlock++; i < blockCount; i = nextBlock++)
+			func(blockSize * i, (min)(blockSize * (i + 1), itemCount));
+	};
+
+	if (!threadCount) threadCount = (max)(thread::hardware_concurrency(), 1u);
+	const auto workerCount = (min)(static_cast<size_t>(threadCount), blockCount);
+	vector<thread> workers(workerCount > 1 ? workerCount - 1 : 0);
+	for (auto& worker : workers) worker = thread(processBlocks);
+	processBlocks();
+	for (auto& worker : workers) worker.join();
+}
+
+// Spatial hash of integer cell coordinates
+static uint64_t hashCell(const int32_t* pCell)
+{
+	auto hash = static_cast<uint32_t>(pCell[0]) * 0x9e3779b97f4a7c15ull ^
+		static_cast<uint32_t>(pCell[1]) * 0xc2b2ae3d27d4eb4full ^ static_cast<uint32_t>(pCell[2]) * 0x165667b19e3779f9ull;
+
+	return hash ^ (hash >> 32);
+}
+
+// 64-bit multiply-xorshift over 8-byte words; a change detector, not a cryptographic hash
+static uint64_t hashBytes(const uint8_t* pData, size_t size, uint64_t seed)
+{
+	auto hash = seed ^ (size * 0x9e3779b97f4a7c15ull);
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, &pData[i], sizeof(uint64_t));
+		hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, &pData[i], size - i);
+	hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+
+	return hash ^ (hash >> 29);
+}
+
+// Round to nearest even; NaNs are kept quiet, and overflows go to infinity
+static uint16_t floatToHalf(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(float));
+	const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	bits &= 0x7fffffff;
+
+	if (bits > 0x7f800000) return sign | 0x7e00;
+	if (bits >= 0x477ff000) return sign | 0x7c00;
+	if (bits < 0x38800000)
+	{
+		// Subnormal halves, in steps of 2^-24
+		const auto v = static_cast<uint16_t>(lrintf(fabsf(f) * 16777216.0f));
+
+		return sign | v;
+	}
+
+	const auto half = (bits - 0x38000000) + 0xfff + ((bits >> 13) & 1);
+
+	return sign | static_cast<uint16_t>(half >> 13);
+}
+
+static float halfToFloat(uint16_t h)
+{
+	const auto sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	const auto exponent = (h >> 10) & 0x1f;
+	const auto mantissa = h & 0x3ff;
+
+	float f;
+	if (!exponent) f = static_cast<float>(mantissa) / 16777216.0f;
+	else
+	{
+		const auto bits = exponent == 0x1f ? 0x7f800000 | (mantissa << 13) : ((exponent + 112) << 23) | (mantissa << 13);
+		memcpy(&f, &bits, sizeof(float));
+	}
+
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(float));
+	bits |= sign;
+	memcpy(&f, &bits, sizeof(float));
+
+	return f;
+}
+
+// Same rounding and clamping as D3DX_FLOAT_to_SNORM16 in the shaders
+static uint16_t floatToSnorm16(float f)
+{
+	return static_cast<uint16_t>(static_cast<int16_t>(roundf((min)((max)(f, -1.0f), 1.0f) * 32767.0f)));
+}
+
+static float snorm16ToFloat(uint16_t v)
+{
+	return (max)(static_cast<int16_t>(v) / 32767.0f, -1.0f);
+}
+
+// Octahedral unit vector (Meyer et al. 2010): the L1-normalized vector, with the lower
+// hemisphere folded over the diagonals, in SNORM16 x 2
+static uint32_t encodeOctahedron(float x, float y, float z)
+{
+	const auto l1 = fabsf(x) + fabsf(y) + fabsf(z);
+	if (l1 <= 0.0f) return 0;
+
+	x /= l1;
+	y /= l1;
+	if (z < 0.0f)
+	{
+		const auto foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+	}
+
+	return floatToSnorm16(x) | (static_cast<uint32_t>(floatToSnorm16(y)) << 16);
+}
+
+static void decodeOctahedron(uint32_t v, float& x, float& y, float& z)
+{
+	x = snorm16ToFloat(static_cast<uint16_t>(v));
+	y = snorm16ToFloat(static_cast<uint16_t>(v >> 16));
+	z = 1.0f - fabsf(x) - fabsf(y);
+
+	const auto t = (max)(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+
+	const auto l = sqrtf(x * x + y * y + z * z);
+	x /= l;
+	y /= l;
+	z /= l;
+}
+
+GltfLoader::GltfLoader() :
+	m_threadCount(0),
+	m_isCacheEnabled(false),
+	m_isIndexReorderingEnabled(false),
+	m_isVertexDeduplicationEnabled(false),
+	m_isNormalWeldingEnabled(false),
+	m_isVertexQuantizationEnabled(false),
+	m_normalWeldEpsilon(0.0f)
 {
 }
 
@@ -24,14 +271,51 @@ GltfLoader::~GltfLoader()
 
 bool GltfLoader::Import(const char* pszFilename, bool needNorm, bool needColor, bool needAABB, bool invertZ)
 {
+	// The cache key covers the contents of the source file and the options
+	uint64_t cacheKey = 0;
+	const auto cachePath = string(pszFilename) + ".meshcache";
+	if (m_isCacheEnabled)
+	{
+		cgltf_size size = 0;
+		void* pSource = nullptr;
+		if (mapFile(nullptr, nullptr, pszFilename, &size, &pSource) != cgltf_result_success) return false;
+		const uint64_t options = (needNorm ? 1 : 0) | (needColor ? 2 : 0) | (needAABB ? 4 : 0) | (invertZ ? 8 : 0) |
+			(m_isIndexReorderingEnabled ? 16 : 0) | (m_isVertexDeduplicationEnabled ? 32 : 0) | (m_isNormalWeldingEnabled ? 64 : 0) |
+			(m_isVertexQuantizationEnabled ? 128 : 0);
+		cacheKey = hashBytes(static_cast<const uint8_t*>(pSource), size, options | (static_cast<uint64_t>(CacheVersion) << 32));
+		cacheKey = hashBytes(reinterpret_cast<const uint8_t*>(&m_normalWeldEpsilon), sizeof(float), cacheKey);
+		unmapFile(nullptr, nullptr, pSource);
+
+		if (loadCache(cachePath, cacheKey)) return true;
+	}
+
 	m_indices.clear();
 	m_lightSources.clear();
+	m_materials.clear();
+	vector<string> dependencies;
+	vector<Primitive> primitives;
 
 	cgltf_options options;
 	memset(&options, 0, sizeof(cgltf_options));
+	options.file.read = mapFile;
+	options.file.release = unmapFile;
 	cgltf_data* pData = nullptr;
 	cgltf_result result = cgltf_parse_file(&options, pszFilename, &pData);
 
+	// Embedded data-URI buffers are decoded here, so that cgltf_load_buffers() skips them
+	for (size_t i = 0; result == cgltf_result_success && i < pData->buffers_count; ++i)
+	{
+		auto& buffer = pData->buffers[i];
+		const auto pComma = buffer.uri && !buffer.data && strncmp(buffer.uri, "data:", 5) == 0 ? strchr(buffer.uri, ',') : nullptr;
+		if (!pComma || pComma - buffer.uri < 7 || strncmp(pComma - 7, ";base64", 7) != 0) continue;
+
+		buffer.data = malloc(buffer.size);
+		buffer.data_free_method = cgltf_data_free_method_memory_free;
+		if (!buffer.data) result = cgltf_result_out_of_memory;
+		else if (!DecodeBase64(static_cast<uint8_t*>(buffer.data), buffer.size, pComma + 1, strlen(pComma + 1)))
+			result = cgltf_result_io_error;
+	}
+
 	if (result == cgltf_result_success)
 	{
 		result = cgltf_load_buffers(&options, pData, pszFilename);
@@ -50,40 +334,74 @@ bool GltfLoader::Import(const char* pszFilename, bool needNorm, bool needColor,
 		const auto pathDirEnd = pathDir.rfind('/');
 		pathDir = pathDir.substr(0, pathDirEnd + 1);
 
-		// Load textures
-		m_textures.resize(pData->images_count);
-		for (size_t i = 0; i < pData->images_count; ++i)
+		// Load texture headers; the sizes are needed by the light-map atlases below
+		const auto imageCount = pData->images_count;
+		m_textures.resize(imageCount);
+		vector<string> texFilePaths(imageCount);
+		for (size_t i = 0; i < imageCount; ++i)
 		{
-			const auto texFilePath = pathDir + pData->images[i].uri;
+			// Images of a .glb are embedded in buffer views
+			const auto pView = pData->images[i].buffer_view;
+			if (!pView) texFilePaths[i] = pathDir + pData->images[i].uri;
 			int width, height, channels;
-			const auto infoStat = stbi_info(texFilePath.c_str(), &width, &height, &channels);
+			const auto infoStat = pView ? stbi_info_from_memory(cgltf_buffer_view_data(pView), static_cast<int>(pView->size),
+				&width, &height, &channels) : stbi_info(texFilePaths[i].c_str(), &width, &height, &channels);
 			assert(infoStat);
-			const auto reqChannels = channels != 3 ? channels : 4;
-			const auto pTexData = stbi_load(texFilePath.c_str(), &width, &height, &channels, reqChannels);
-			const auto size = sizeof(uint8_t) * reqChannels * width * height;
-			m_textures[i].Data.resize(size);
-			memcpy(m_textures[i].Data.data(), pTexData, size);
-			STBI_FREE(pTexData);
 			m_textures[i].Width = width;
 			m_textures[i].Height = height;
-			m_textures[i].Channels = reqChannels;
+			m_textures[i].Channels = channels != 3 ? channels : 4;
 
 			m_texIndexMap[&pData->images[i]] = static_cast<uint32_t>(i);
 		}
 
-		m_stride = 0;
-		m_posOffset = m_stride;
-		m_stride += sizeof(float3);		// position
-		m_nrmOffset = m_stride;
-		m_stride += sizeof(float3);		// normal
-		m_txcOffset = m_stride;
-		m_stride += sizeof(float4);		// texcoord
-		m_tanOffset = m_stride;
-		m_stride += sizeof(float4);		// tangentUV1
-		m_colorOffset = m_stride;
-		m_stride += sizeof(uint32_t);	// color
-		m_scalarOffset = m_stride;
-		m_stride += sizeof(float);		// emissiveStrength scalar
+		for (const auto& texFilePath : texFilePaths)
+			if (!texFilePath.empty()) dependencies.emplace_back(texFilePath);
+		for (size_t i = 0; i < pData->buffers_count; ++i)
+		{
+			const auto uri = pData->buffers[i].uri;
+			if (uri && strncmp(uri, "data:", 5) != 0) dependencies.emplace_back(pathDir + uri);
+		}
+
+		// Decode the images on worker threads into their final slots, overlapping the geometry
+		// processing on this thread, which joins the decoding once it is done
+		atomic<size_t> nextImage(0);
+		const auto decodeImages = [&]()
+		{
+			for (auto i = nextImage++; i < imageCount; i = nextImage++)
+			{
+				auto& texture = m_textures[i];
+				const auto pView = pData->images[i].buffer_view;
+				int width, height, channels;
+				texture.Data.reset(pView ? stbi_load_from_memory(cgltf_buffer_view_data(pView), static_cast<int>(pView->size),
+					&width, &height, &channels, texture.Channels) : stbi_load(texFilePaths[i].c_str(), &width, &height, &channels,
+					texture.Channels));
+				assert(texture.Data);
+			}
+		};
+
+		const auto hardwareThreadCount = (max)(thread::hardware_concurrency(), 1u);
+		const auto threadCount = (min)(m_threadCount ? m_threadCount : hardwareThreadCount, static_cast<uint32_t>(imageCount));
+		vector<thread> decoders(threadCount > 1 ? threadCount - 1 : 0);
+		for (auto& decoder : decoders) decoder = thread(decodeImages);
+
+		initVertexLayout();
+
+		// Reserve for all primitives at once; only the light-map atlases may add vertices later
+		size_t vertexCount = 0, indexCount = 0;
+		for (auto i = 0u; i < pData->meshes_count; ++i)
+		{
+			const auto& mesh = pData->meshes[i];
+			for (auto j = 0u; j < mesh.primitives_count; ++j)
+			{
+				const auto& primitive = mesh.primitives[j];
+				for (auto k = 0u; k < primitive.attributes_count; ++k)
+					if (primitive.attributes[k].type == cgltf_attribute_type_position)
+						vertexCount += primitive.attributes[k].data->count;
+				indexCount += primitive.indices ? primitive.indices->count : 0;
+			}
+		}
+		m_vertices.reserve(m_vertices.size() + m_stride * vertexCount);
+		m_indices.reserve(indexCount);
 
 		for (auto i = 0u; i < pData->meshes_count; ++i)
 		{
@@ -131,64 +449,50 @@ bool GltfLoader::Import(const char* pszFilename, bool needNorm, bool needColor,
 				}
 
 				const uint32_t vertexOffset = static_cast<uint32_t>(m_vertices.size() / m_stride);
+				const uint32_t indexOffset = static_cast<uint32_t>(m_indices.size());
 				const uint32_t vertexBufferOffset = static_cast<uint32_t>(m_vertices.size());
 				const uint32_t vertexCount = pPosition ? static_cast<uint32_t>(pPosition->count) : 0;
 				m_vertices.resize(vertexBufferOffset + vertexCount * m_stride);
-				{
-					assert(pPosition);
-					for (uint32_t i = 0; i < pPosition->count; ++i)
-					{
-						float3 p;
-						cgltf_accessor_read_float(pPosition, i, &p.x, cgltf_num_components(cgltf_type_vec3));
-						p.z = invertZ ? -p.z : p.z;
-						getPosition(vertexOffset + i) = p;
-					}
-				}
+
+				// Sign flips of z (and w for tangents) for invertZ
+				const auto zSign = invertZ ? -1.0f : 1.0f;
+				const float scales[] = { 1.0f, 1.0f, zSign, zSign };
+				assert(pPosition);
+				readFloats(pPosition, vertexOffset, m_posOffset, 3, scales);
 
 				if (pNormal)
 				{
 					assert(vertexCount == pNormal->count);
-					for (uint32_t i = 0; i < pNormal->count; ++i)
-					{
-						float3 n;
-						cgltf_accessor_read_float(pNormal, i, &n.x, cgltf_num_components(cgltf_type_vec3));
-						n.z = invertZ ? -n.z : n.z;
-						getNormal(vertexOffset + i) = n;
-					}
+					readFloats(pNormal, vertexOffset, m_nrmOffset, 3, scales);
 				}
 
-				if (pNormal)
+				if (pTexcoord)
 				{
+					// Both the material and the light-map texcoords start from TEXCOORD_0
 					assert(vertexCount == pTexcoord->count);
-					for (uint32_t i = 0; i < pTexcoord->count; ++i)
-					{
-						float2 t;
-						cgltf_accessor_read_float(pTexcoord, i, &t.x, cgltf_num_components(cgltf_type_vec2));
-						getTexcoord(vertexOffset + i) = float4(t.x, t.y, t.x, t.y);
-					}
+					readFloats(pTexcoord, vertexOffset, m_txcOffset, 2, scales);
+					readFloats(pTexcoord, vertexOffset, m_txcOffset + sizeof(float2), 2, scales);
 				}
 
 				if (pTangent)
 				{
 					assert(vertexCount == pTangent->count);
-					for (uint32_t i = 0; i < pTangent->count; ++i)
-					{
-						float4 t;
-						cgltf_accessor_read_float(pTangent, i, &t.x, cgltf_num_components(cgltf_type_vec4));
-						t.z = invertZ ? -t.z : t.z;
-						t.w = invertZ ? -t.w : t.w;
-						getTangent(vertexOffset + i) = t;
-					}
+					readFloats(pTangent, vertexOffset, m_tanOffset, 4, scales);
 				}
 				else for (uint32_t i = 0; i < vertexCount; ++i) getTangent(vertexOffset + i) = float4(0.0f);
 
 				if (pColor)
 				{
 					assert(vertexCount == pColor->count);
+					const auto pBufferData = pColor->buffer_view ? cgltf_buffer_view_data(pColor->buffer_view) : nullptr;
+					const auto isPacked = pBufferData && !pColor->is_sparse && pColor->type == cgltf_type_vec3 &&
+						pColor->component_type == cgltf_component_type_r_32f && pColor->stride == sizeof(float3);
+					const auto pSrc = isPacked ? reinterpret_cast<const float3*>(pBufferData + pColor->offset) : nullptr;
 					for (uint32_t i = 0; i < pColor->count; ++i)
 					{
 						float3 c;
-						cgltf_accessor_read_float(pColor, i, &c.x, cgltf_num_components(cgltf_type_vec3));
+						if (pSrc) c = pSrc[i];
+						else cgltf_accessor_read_float(pColor, i, &c.x, cgltf_num_components(cgltf_type_vec3));
 						getVertexColor(vertexOffset + i) = float4_to_rgba8(float4(c.x, c.y, c.z, 1.0f));
 					}
 				}
@@ -205,13 +509,8 @@ bool GltfLoader::Import(const char* pszFilename, bool needNorm, bool needColor,
 					subset.NormalTexIdx = UINT32_MAX;
 					subset.MtlRghTexIdx = UINT32_MAX;
 				}
-				m_indices.reserve(m_indices.size() + pIndices->count);
-				for (size_t i = 0; i < pIndices->count; ++i)
-				{
-					assert(pIndices->component_type == cgltf_component_type_r_16u || pIndices->component_type == cgltf_component_type_r_32u);
-					const auto index = cgltf_accessor_read_index(pIndices, i);
-					m_indices.emplace_back(vertexOffset + static_cast<uint32_t>(index));
-				}
+				assert(pIndices->component_type == cgltf_component_type_r_16u || pIndices->component_type == cgltf_component_type_r_32u);
+				readIndices(pIndices, vertexOffset);
 
 				// Material and textures
 				if (pData->textures_count && primitive.material)
@@ -263,12 +562,9 @@ bool GltfLoader::Import(const char* pszFilename, bool needNorm, bool needColor,
 
 							m_lightSources.push_back({ float4(FLT_MAX, 1.0f), float4(-FLT_MAX, 1.0f) });
 							auto& lightSource = m_lightSources.back();
-							for (uint32_t i = 0; i < pPosition->count; ++i)
+							for (uint32_t i = 0; i < vertexCount; ++i)
 							{
-								float3 p;
-								cgltf_accessor_read_float(pPosition, i, &p.x, cgltf_num_components(cgltf_type_vec3));
-								p.z = invertZ ? -p.z : p.z;
-
+								const auto& p = getPosition(vertexOffset + i);
 								lightSource.Min.x = (min)(p.x, lightSource.Min.x);
 								lightSource.Min.y = (min)(p.y, lightSource.Min.y);
 								lightSource.Min.z = (min)(p.z, lightSource.Min.z);
@@ -292,13 +588,29 @@ bool GltfLoader::Import(const char* pszFilename, bool needNorm, bool needColor,
 					fillVertexColors(vertexOffset, vertexCount, vertexColor);
 					fillVertexScalars(vertexOffset, vertexCount, vertexScalar);
 				}
-				if (needNorm && !pNormal) recomputeNormals();
+				if (needNorm && !pNormal) recomputeNormals(vertexOffset, vertexCount, indexOffset);
 				if (needAABB) computeAABB();
 
-				// Light-map texcoord/procedural texcoord
-				if (pData->textures_count || !pTexcoord) regenerateUV1(vertexOffset, vertexCount, pTexcoord);
+				// Light-map texcoord/procedural texcoord, unwrapped for all primitives at once below
+				Primitive prim;
+				prim.VertexOffset = vertexOffset;
+				prim.VertexCount = vertexCount;
+				prim.IndexOffset = indexOffset;
+				prim.IndexCount = static_cast<uint32_t>(pIndices->count);
+				prim.SubsetIdx = pData->textures_count ? static_cast<uint32_t>(m_subsets.size() - 1) : UINT32_MAX;
+				prim.NeedsAtlas = (pData->textures_count || !pTexcoord) && prim.IndexCount > 0;
+				prim.UseInputMeshUvs = pTexcoord != nullptr;
+				primitives.emplace_back(prim);
 			}
 		}
+		regenerateUV1(primitives);
+
+		if (m_isVertexDeduplicationEnabled)
+		{
+			const auto vertexCount = DeduplicateVertices(m_vertices.data(), GetNumVertices(), m_stride,
+				m_indices.data(), m_indices.size(), m_threadCount);
+			m_vertices.resize(m_stride * vertexCount);
+		}
 
 		if (!pData->textures_count)
 		{
@@ -323,13 +635,74 @@ bool GltfLoader::Import(const char* pszFilename, bool needNorm, bool needColor,
 				m_indices[i * 3 + 2] = tmp;
 			}
 		}
+
+		// Subsets are reordered independently of each other by a pool of workers
+		if (m_isIndexReorderingEnabled)
+		{
+			atomic<size_t> nextSubset(0);
+			const auto reorderSubsets = [&]()
+			{
+				for (auto i = nextSubset++; i < m_subsets.size(); i = nextSubset++)
+					if (m_subsets[i].NumIndices) ReorderIndices(&m_indices[m_subsets[i].IndexOffset],
+						m_subsets[i].NumIndices, &m_vertices[m_posOffset], m_stride);
+			};
+
+			const auto workerCount = (min)(m_threadCount ? m_threadCount : hardwareThreadCount, static_cast<uint32_t>(m_subsets.size()));
+			vector<thread> workers(workerCount > 1 ? workerCount - 1 : 0);
+			for (auto& worker : workers) worker = thread(reorderSubsets);
+			reorderSubsets();
+			for (auto& worker : workers) worker.join();
+		}
+
+		// Last, since everything above reads the full-precision vertices
+		if (m_isVertexQuantizationEnabled)
+		{
+			if (!needAABB) computeAABB();
+			if (!quantizeVertices()) result = cgltf_result_invalid_options;
+		}
+
+		decodeImages();
+		for (auto& decoder : decoders) decoder.join();
 	}
 
 	cgltf_free(pData);
 
+	if (result == cgltf_result_success && m_isCacheEnabled) saveCache(cachePath, cacheKey, dependencies);
+
 	return result == cgltf_result_success;
 }
 
+void GltfLoader::SetThreadCount(uint32_t threadCount)
+{
+	m_threadCount = threadCount;
+}
+
+void GltfLoader::SetCacheEnabled(bool isEnabled)
+{
+	m_isCacheEnabled = isEnabled;
+}
+
+void GltfLoader::SetIndexReordering(bool isEnabled)
+{
+	m_isIndexReorderingEnabled = isEnabled;
+}
+
+void GltfLoader::SetVertexDeduplication(bool isEnabled)
+{
+	m_isVertexDeduplicationEnabled = isEnabled;
+}
+
+void GltfLoader::SetNormalWelding(bool isEnabled, float epsilon)
+{
+	m_isNormalWeldingEnabled = isEnabled;
+	m_normalWeldEpsilon = epsilon;
+}
+
+void GltfLoader::SetVertexQuantization(bool isEnabled)
+{
+	m_isVertexQuantizationEnabled = isEnabled;
+}
+
 const uint32_t GltfLoader::GetNumVertices() const
 {
 	return static_cast<uint32_t>(m_vertices.size() / GetVertexStride());
@@ -385,6 +758,865 @@ const vector<GltfLoader::LightSource>& GltfLoader::GetLightSources() const
 	return m_lightSources;
 }
 
+const vector<GltfLoader::Material>& GltfLoader::GetMaterials() const
+{
+	return m_materials;
+}
+
+vector<uint8_t> GltfLoader::DetachVertices()
+{
+	return move(m_vertices);
+}
+
+vector<uint32_t> GltfLoader::DetachIndices()
+{
+	return move(m_indices);
+}
+
+vector<GltfLoader::Texture> GltfLoader::DetachTextures()
+{
+	m_texIndexMap.clear();
+
+	return move(m_textures);
+}
+
+//--------------------------------------------------------------------------------------
+// Tipsify: fan out all live triangles around the current vertex, then continue from the
+// candidate that stays longest in the cache without being evicted by its own remaining
+// triangles, or from the most recent dead end. Clusters end at dead ends (hard boundaries)
+// and at fan transitions once they are big enough that a cache flush costs little; they are
+// sorted by how far they face away from the mesh centroid, after the paper's linear-speed
+// overdraw ordering
+//--------------------------------------------------------------------------------------
+void GltfLoader::ReorderIndices(uint32_t* pIndices, uint32_t indexCount, const uint8_t* pPositions,
+	uint32_t positionStride, uint32_t cacheSize)
+{
+	static const uint32_t minClusterSize = 256;
+
+	const auto triangleCount = indexCount / 3;
+	if (triangleCount < 2) return;
+
+	uint32_t vertexMin = UINT32_MAX, vertexMax = 0;
+	for (auto i = 0u; i < indexCount; ++i)
+	{
+		vertexMin = (min)(pIndices[i], vertexMin);
+		vertexMax = (max)(pIndices[i], vertexMax);
+	}
+	const auto vertexCount = vertexMax - vertexMin + 1;
+
+	// Triangles around each vertex
+	vector<uint32_t> liveCounts(vertexCount, 0), adjacencyOffsets(vertexCount + 1, 0), adjacency(indexCount);
+	for (auto i = 0u; i < indexCount; ++i) ++liveCounts[pIndices[i] - vertexMin];
+	for (auto i = 0u; i < vertexCount; ++i) adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveCounts[i];
+	{
+		auto cursors = adjacencyOffsets;
+		for (auto i = 0u; i < indexCount; ++i) adjacency[cursors[pIndices[i] - vertexMin]++] = i / 3;
+	}
+
+	vector<uint32_t> timeStamps(vertexCount, 0), deadEnds, candidates, triangles, clusterStarts(1, 0);
+	vector<uint8_t> isEmitted(triangleCount, 0);
+	deadEnds.reserve(indexCount);
+	triangles.reserve(triangleCount);
+	auto time = cacheSize + 1, cursor = 0u;
+	auto fanningVertex = static_cast<int64_t>(pIndices[0] - vertexMin);
+	while (fanningVertex >= 0)
+	{
+		candidates.clear();
+		for (auto i = adjacencyOffsets[fanningVertex]; i < adjacencyOffsets[fanningVertex + 1]; ++i)
+		{
+			const auto t = adjacency[i];
+			if (isEmitted[t]) continue;
+
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto v = pIndices[t * 3 + j] - vertexMin;
+				deadEnds.emplace_back(v);
+				candidates.emplace_back(v);
+				--liveCounts[v];
+				if (time - timeStamps[v] > cacheSize) timeStamps[v] = time++;
+			}
+			isEmitted[t] = 1;
+			triangles.emplace_back(t);
+		}
+
+		// Next fanning vertex
+		int64_t nextVertex = -1, bestPriority = -1;
+		for (const auto v : candidates)
+		{
+			if (!liveCounts[v]) continue;
+
+			int64_t priority = 0;
+			if (time - timeStamps[v] + 2 * liveCounts[v] <= cacheSize) priority = time - timeStamps[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				nextVertex = v;
+			}
+		}
+
+		const auto clusterSize = static_cast<uint32_t>(triangles.size()) - clusterStarts.back();
+		if (nextVertex < 0)
+		{
+			while (!deadEnds.empty() && nextVertex < 0)
+			{
+				const auto v = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveCounts[v]) nextVertex = v;
+			}
+			for (; nextVertex < 0 && cursor < vertexCount; ++cursor)
+				if (liveCounts[cursor]) nextVertex = cursor;
+			if (nextVertex >= 0 && clusterSize) clusterStarts.emplace_back(static_cast<uint32_t>(triangles.size()));
+		}
+		else if (clusterSize >= minClusterSize) clusterStarts.emplace_back(static_cast<uint32_t>(triangles.size()));
+
+		fanningVertex = nextVertex;
+	}
+	assert(triangles.size() == triangleCount);
+	clusterStarts.emplace_back(triangleCount);
+
+	// Area-weighted centroids and normals of the clusters and the whole subset
+	const auto clusterCount = static_cast<uint32_t>(clusterStarts.size() - 1);
+	vector<float4> centroids(clusterCount), normals(clusterCount);
+	float4 meshCentroid(0.0f);
+	for (auto c = 0u; c < clusterCount; ++c)
+	{
+		float4 centroid(0.0f), normal(0.0f);
+		for (auto i = clusterStarts[c]; i < clusterStarts[c + 1]; ++i)
+		{
+			const auto pIndex = &pIndices[triangles[i] * 3];
+			const auto& p0 = reinterpret_cast<const float3&>(pPositions[positionStride * pIndex[0]]);
+			const auto& p1 = reinterpret_cast<const float3&>(pPositions[positionStride * pIndex[1]]);
+			const auto& p2 = reinterpret_cast<const float3&>(pPositions[positionStride * pIndex[2]]);
+			const float3 e1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z), e2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+			const float3 n(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+			const auto area = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+			centroid.x += (p0.x + p1.x + p2.x) * area;
+			centroid.y += (p0.y + p1.y + p2.y) * area;
+			centroid.z += (p0.z + p1.z + p2.z) * area;
+			centroid.w += 3.0f * area;
+			normal.x += n.x;
+			normal.y += n.y;
+			normal.z += n.z;
+		}
+		meshCentroid.x += centroid.x;
+		meshCentroid.y += centroid.y;
+		meshCentroid.z += centroid.z;
+		meshCentroid.w += centroid.w;
+		centroids[c] = centroid;
+		normals[c] = normal;
+	}
+
+	vector<float> sortKeys(clusterCount);
+	const auto meshWeight = meshCentroid.w > 0.0f ? 1.0f / meshCentroid.w : 0.0f;
+	for (auto c = 0u; c < clusterCount; ++c)
+	{
+		const auto& centroid = centroids[c];
+		const auto& n = normals[c];
+		const auto weight = centroid.w > 0.0f ? 1.0f / centroid.w : 0.0f;
+		const auto length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+		sortKeys[c] = length > 0.0f ? ((centroid.x * weight - meshCentroid.x * meshWeight) * n.x +
+			(centroid.y * weight - meshCentroid.y * meshWeight) * n.y +
+			(centroid.z * weight - meshCentroid.z * meshWeight) * n.z) / length : 0.0f;
+	}
+
+	vector<uint32_t> clusterOrder(clusterCount);
+	for (auto c = 0u; c < clusterCount; ++c) clusterOrder[c] = c;
+	stable_sort(clusterOrder.begin(), clusterOrder.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	vector<uint32_t> indices(indexCount);
+	auto pDst = indices.data();
+	for (const auto c : clusterOrder)
+		for (auto i = clusterStarts[c]; i < clusterStarts[c + 1]; ++i, pDst += 3)
+			memcpy(pDst, &pIndices[triangles[i] * 3], sizeof(uint32_t) * 3);
+	memcpy(pIndices, indices.data(), sizeof(uint32_t) * indexCount);
+}
+
+//--------------------------------------------------------------------------------------
+// Open addressing with linear probing over a power-of-two table of twice the vertex count;
+// each slot holds the upper half of the vertex hash and the merged index of the first
+// vertex with it, so that most mismatches are rejected without touching the vertices.
+// The hashes are computed in parallel; the insertions are serial, in vertex order, which
+// keeps the output independent of the thread count
+//--------------------------------------------------------------------------------------
+uint32_t GltfLoader::DeduplicateVertices(uint8_t* pVertices, uint32_t vertexCount, uint32_t stride,
+	uint32_t* pIndices, size_t indexCount, uint32_t threadCount)
+{
+	static const uint64_t emptySlot = UINT64_MAX;
+
+	if (vertexCount < 2) return vertexCount;
+
+	vector<uint64_t> hashes(vertexCount);
+	forEachBlock(threadCount, vertexCount, [&](size_t begin, size_t end)
+	{
+		for (auto i = begin; i < end; ++i) hashes[i] = hashBytes(&pVertices[stride * i], stride, 0);
+	});
+
+	// Unique vertices are compacted as they are found; a unique vertex only ever moves down
+	// to slots of vertices that have already been visited
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2ull) tableSize <<= 1;
+	const auto mask = tableSize - 1;
+	vector<uint64_t> table(tableSize, emptySlot);
+	vector<uint32_t> remap(vertexCount);
+	auto uniqueCount = 0u;
+	for (auto i = 0u; i < vertexCount; ++i)
+	{
+		const auto pVertex = &pVertices[stride * i];
+		const auto tag = hashes[i] & 0xffffffff00000000ull;
+		for (auto slot = hashes[i] & mask; ; slot = (slot + 1) & mask)
+		{
+			auto& entry = table[slot];
+			if (entry == emptySlot)
+			{
+				if (uniqueCount < i) memcpy(&pVertices[stride * uniqueCount], pVertex, stride);
+				entry = tag | uniqueCount;
+				remap[i] = uniqueCount++;
+				break;
+			}
+
+			const auto first = static_cast<uint32_t>(entry);
+			if ((entry & 0xffffffff00000000ull) == tag && !memcmp(&pVertices[stride * first], pVertex, stride))
+			{
+				remap[i] = first;
+				break;
+			}
+		}
+	}
+
+	forEachBlock(threadCount, indexCount, [&](size_t begin, size_t end)
+	{
+		for (auto i = begin; i < end; ++i) pIndices[i] = remap[pIndices[i]];
+	});
+
+	return uniqueCount;
+}
+
+//--------------------------------------------------------------------------------------
+// A position within epsilon of p lies in one of the 2x2x2 cells of size 2 * epsilon around
+// the corner of its own cell that is nearest to p; each cell may hold several
+// representatives, all of them in the same probe run of the open-addressing table. The
+// cells are computed in parallel, the lookups and insertions serially in vertex order
+//--------------------------------------------------------------------------------------
+void GltfLoader::WeldPositions(const uint8_t* pPositions, uint32_t vertexCount, uint32_t stride,
+	float epsilon, uint32_t* pRemap, uint32_t threadCount)
+{
+	static const uint32_t emptySlot = UINT32_MAX;
+
+	// Exact welds use the bits of the positions as the cells
+	const auto cellScale = epsilon > 0.0f ? 0.5f / epsilon : 0.0f;
+	const auto getPosition = [pPositions, stride](uint32_t i) { return reinterpret_cast<const float*>(&pPositions[stride * i]); };
+	vector<array<int32_t, 3>> cells(vertexCount);
+	vector<uint8_t> neighborSigns(vertexCount, 0);
+	forEachBlock(threadCount, vertexCount, [&](size_t begin, size_t end)
+	{
+		for (auto i = static_cast<uint32_t>(begin); i < end; ++i)
+		{
+			const auto p = getPosition(i);
+			auto& cell = cells[i];
+			if (cellScale <= 0.0f)
+			{
+				memcpy(cell.data(), p, sizeof(float3));
+				continue;
+			}
+
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				cell[k] = static_cast<int32_t>(floorf(p[k] * cellScale));
+				neighborSigns[i] |= p[k] * cellScale - cell[k] < 0.5f ? 0 : 1 << k;
+			}
+		}
+	});
+
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2ull) tableSize <<= 1;
+	const auto mask = tableSize - 1;
+	vector<uint32_t> table(tableSize, emptySlot);
+	for (auto i = 0u; i < vertexCount; ++i)
+	{
+		const auto p = getPosition(i);
+		const auto& cell = cells[i];
+
+		// Search the neighboring cells (only the own one for exact welds)
+		pRemap[i] = i;
+		for (uint8_t n = 0; n < (cellScale > 0.0f ? 8 : 1) && pRemap[i] == i; ++n)
+		{
+			int32_t neighbor[3];
+			for (uint8_t k = 0; k < 3; ++k)
+				neighbor[k] = cell[k] + (n & (1 << k) ? (neighborSigns[i] & (1 << k) ? 1 : -1) : 0);
+
+			for (auto slot = hashCell(neighbor) & mask; table[slot] != emptySlot; slot = (slot + 1) & mask)
+			{
+				const auto j = table[slot];
+				if (memcmp(cells[j].data(), neighbor, sizeof(neighbor))) continue;
+
+				const auto q = getPosition(j);
+				if (fabsf(q[0] - p[0]) <= epsilon && fabsf(q[1] - p[1]) <= epsilon && fabsf(q[2] - p[2]) <= epsilon)
+				{
+					pRemap[i] = j;
+					break;
+				}
+			}
+		}
+
+		// New representative in its own cell
+		if (pRemap[i] == i)
+		{
+			auto slot = hashCell(cell.data()) & mask;
+			while (table[slot] != emptySlot) slot = (slot + 1) & mask;
+			table[slot] = i;
+		}
+	}
+}
+
+// Per-axis scales of the quantized positions; flat axes keep a unit scale
+static GltfLoader::float3 getQuantizationScale(const GltfLoader::AABB& aabb, GltfLoader::float3& center)
+{
+	center = GltfLoader::float3((aabb.Min.x + aabb.Max.x) * 0.5f, (aabb.Min.y + aabb.Max.y) * 0.5f, (aabb.Min.z + aabb.Max.z) * 0.5f);
+	const auto x = (aabb.Max.x - aabb.Min.x) * 0.5f;
+	const auto y = (aabb.Max.y - aabb.Min.y) * 0.5f;
+	const auto z = (aabb.Max.z - aabb.Min.z) * 0.5f;
+
+	return GltfLoader::float3(x > 0.0f ? x : 1.0f, y > 0.0f ? y : 1.0f, z > 0.0f ? z : 1.0f);
+}
+
+void GltfLoader::EncodeVertex(QuantizedVertex& dst, const AABB& aabb, const float3& pos, const float3& nrm,
+	const float4& texcoord, const float4& tangent, uint16_t materialIdx)
+{
+	float3 center;
+	const auto scale = getQuantizationScale(aabb, center);
+	dst.Pos[0] = static_cast<int16_t>(floatToSnorm16((pos.x - center.x) / scale.x));
+	dst.Pos[1] = static_cast<int16_t>(floatToSnorm16((pos.y - center.y) / scale.y));
+	dst.Pos[2] = static_cast<int16_t>(floatToSnorm16((pos.z - center.z) / scale.z));
+	dst.MaterialIdx = materialIdx | (tangent.w < 0.0f ? 0x8000 : 0);
+	dst.Nrm = encodeOctahedron(nrm.x, nrm.y, nrm.z);
+
+	// Encoded coordinates are clamped to +-32767, so the sentinel never collides with them
+	const auto hasTangent = tangent.x != 0.0f || tangent.y != 0.0f || tangent.z != 0.0f;
+	dst.Tan = hasTangent ? encodeOctahedron(tangent.x, tangent.y, tangent.z) : NoTangent;
+
+	dst.UV0[0] = floatToHalf(texcoord.x);
+	dst.UV0[1] = floatToHalf(texcoord.y);
+	dst.UV1[0] = floatToHalf(texcoord.z);
+	dst.UV1[1] = floatToHalf(texcoord.w);
+	dst.Padding[0] = 0;
+	dst.Padding[1] = 0;
+}
+
+void GltfLoader::DecodeVertex(const QuantizedVertex& src, const AABB& aabb, float3& pos, float3& nrm,
+	float4& texcoord, float4& tangent, uint16_t& materialIdx)
+{
+	float3 center;
+	const auto scale = getQuantizationScale(aabb, center);
+	pos.x = snorm16ToFloat(static_cast<uint16_t>(src.Pos[0])) * scale.x + center.x;
+	pos.y = snorm16ToFloat(static_cast<uint16_t>(src.Pos[1])) * scale.y + center.y;
+	pos.z = snorm16ToFloat(static_cast<uint16_t>(src.Pos[2])) * scale.z + center.z;
+	materialIdx = src.MaterialIdx & 0x7fff;
+	decodeOctahedron(src.Nrm, nrm.x, nrm.y, nrm.z);
+
+	tangent = float4(0.0f);
+	if (src.Tan != NoTangent) decodeOctahedron(src.Tan, tangent.x, tangent.y, tangent.z);
+	tangent.w = src.MaterialIdx & 0x8000 ? -1.0f : 1.0f;
+
+	texcoord.x = halfToFloat(src.UV0[0]);
+	texcoord.y = halfToFloat(src.UV0[1]);
+	texcoord.z = halfToFloat(src.UV1[0]);
+	texcoord.w = halfToFloat(src.UV1[1]);
+}
+
+//--------------------------------------------------------------------------------------
+// Base64 decoding: each vector of characters is validated and translated to 6-bit values
+// by nibble lookups, then packed to bytes by multiply-adds and a shuffle, after W. Mula and
+// D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions"; the tail that
+// a full vector store would overrun goes through a table. Every loop is bounded by the
+// characters given, and text ending within the last quad needed is rejected up front
+//--------------------------------------------------------------------------------------
+bool GltfLoader::DecodeBase64(uint8_t* pDst, size_t size, const char* pBase64, size_t length)
+{
+	// 4 characters per 3 bytes, and 2 or 3 characters for the last 1 or 2 bytes
+	const auto charCount = size / 3 * 4 + (size % 3 ? size % 3 + 1 : 0);
+	if (length < charCount) return false;
+
+	size_t i = 0;
+	auto pSrc = reinterpret_cast<const uint8_t*>(pBase64);
+	const auto pEnd = pSrc + charCount;
+
+#if defined(__AVX2__)
+	{
+		const auto lutLo = _mm256_setr_epi8(
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+		const auto lutHi = _mm256_setr_epi8(
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+		const auto lutRoll = _mm256_setr_epi8(
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const auto lutPack = _mm256_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+		const auto nibbleMask = _mm256_set1_epi8(0x0f);
+		const auto slash = _mm256_set1_epi8('/');
+
+		// 32 characters to 24 bytes per iteration, stored as 32
+		for (; i + 32 <= size && pSrc + 32 <= pEnd; i += 24, pSrc += 32)
+		{
+			auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc));
+			const auto hiNibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), nibbleMask);
+			const auto loNibbles = _mm256_and_si256(chars, nibbleMask);
+			const auto lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+			const auto hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+			if (!_mm256_testz_si256(lo, hi)) return false;
+
+			const auto roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(chars, slash), hiNibbles));
+			chars = _mm256_add_epi8(chars, roll);
+
+			// 4 x 6 bits to 24 bits per 32-bit lane, then the 3 bytes of each lane to the front
+			auto bytes = _mm256_maddubs_epi16(chars, _mm256_set1_epi32(0x01400140));
+			bytes = _mm256_madd_epi16(bytes, _mm256_set1_epi32(0x00011000));
+			bytes = _mm256_shuffle_epi8(bytes, lutPack);
+			bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&pDst[i]), bytes);
+		}
+	}
+#elif defined(__AVX__) || defined(__SSSE3__)
+	{
+		const auto lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+		const auto lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+		const auto lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const auto lutPack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+		const auto nibbleMask = _mm_set1_epi8(0x0f);
+		const auto slash = _mm_set1_epi8('/');
+
+		// 16 characters to 12 bytes per iteration, stored as 16
+		for (; i + 16 <= size && pSrc + 16 <= pEnd; i += 12, pSrc += 16)
+		{
+			auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+			const auto hiNibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), nibbleMask);
+			const auto loNibbles = _mm_and_si128(chars, nibbleMask);
+			const auto lo = _mm_shuffle_epi8(lutLo, loNibbles);
+			const auto hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff) return false;
+
+			const auto roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(chars, slash), hiNibbles));
+			chars = _mm_add_epi8(chars, roll);
+
+			auto bytes = _mm_maddubs_epi16(chars, _mm_set1_epi32(0x01400140));
+			bytes = _mm_madd_epi16(bytes, _mm_set1_epi32(0x00011000));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&pDst[i]), _mm_shuffle_epi8(bytes, lutPack));
+		}
+	}
+#endif
+
+	// 0xff marks characters outside of the alphabet
+	static const auto lut = []()
+	{
+		array<uint8_t, 256> lut;
+		lut.fill(0xff);
+		for (uint8_t j = 0; j < 26; ++j)
+		{
+			lut['A' + j] = j;
+			lut['a' + j] = j + 26;
+		}
+		for (uint8_t j = 0; j < 10; ++j) lut['0' + j] = j + 52;
+		lut['+'] = 62;
+		lut['/'] = 63;
+
+		return lut;
+	}();
+
+	for (; i + 3 <= size && pSrc + 4 <= pEnd; i += 3, pSrc += 4)
+	{
+		const uint8_t a = lut[pSrc[0]], b = lut[pSrc[1]], c = lut[pSrc[2]], d = lut[pSrc[3]];
+		if ((a | b | c | d) == 0xff) return false;
+
+		pDst[i] = (a << 2) | (b >> 4);
+		pDst[i + 1] = (b << 4) | (c >> 2);
+		pDst[i + 2] = (c << 6) | d;
+	}
+
+	// The last 1 or 2 bytes need 2 or 3 characters
+	if (i < size)
+	{
+		uint32_t bits = 0;
+		const auto tailCount = static_cast<uint8_t>(pEnd - pSrc);
+		for (uint8_t j = 0; j < tailCount; ++j)
+		{
+			const auto value = lut[pSrc[j]];
+			if (value == 0xff) return false;
+			bits = (bits << 6) | value;
+		}
+		bits <<= 6 * (4 - tailCount);
+		pDst[i] = static_cast<uint8_t>(bits >> 16);
+		if (i + 1 < size) pDst[i + 1] = static_cast<uint8_t>(bits >> 8);
+	}
+
+	return true;
+}
+
+void GltfLoader::ImageDeleter::operator()(uint8_t* pData) const
+{
+	stbi_image_free(pData);
+}
+
+//--------------------------------------------------------------------------------------
+// Attribute stream into the interleaved vertices, each component multiplied by its scale;
+// tightly packed float accessors are copied directly instead of per element through
+// cgltf_accessor_read_float(), with SSE multiplies over 4 floats at a time under AVX2.
+// Stores stay within the attribute, since the next one may already be written
+//--------------------------------------------------------------------------------------
+void GltfLoader::readFloats(const cgltf_accessor* pAccessor, uint32_t vertexOffset, uint32_t attribOffset,
+	uint8_t componentCount, const float* pScales)
+{
+	const auto count = static_cast<uint32_t>(pAccessor->count);
+	const auto pBufferData = pAccessor->buffer_view ? cgltf_buffer_view_data(pAccessor->buffer_view) : nullptr;
+	const auto isPacked = pBufferData && !pAccessor->is_sparse && pAccessor->component_type == cgltf_component_type_r_32f &&
+		cgltf_num_components(pAccessor->type) == componentCount && pAccessor->stride == sizeof(float) * componentCount;
+
+	auto pDst = &getVertex(vertexOffset)[attribOffset];
+	if (isPacked)
+	{
+		auto pSrc = reinterpret_cast<const float*>(pBufferData + pAccessor->offset);
+		auto i = 0u;
+		switch (componentCount)
+		{
+		case 2:
+#if defined(__AVX2__)
+			{
+				// 2 vertices per iteration
+				const auto scales = _mm_setr_ps(pScales[0], pScales[1], pScales[0], pScales[1]);
+				for (; i + 2 <= count; i += 2, pSrc += 4, pDst += 2 * m_stride)
+				{
+					const auto values = _mm_mul_ps(_mm_loadu_ps(pSrc), scales);
+					_mm_storel_pi(reinterpret_cast<__m64*>(pDst), values);
+					_mm_storeh_pi(reinterpret_cast<__m64*>(pDst + m_stride), values);
+				}
+			}
+#endif
+			for (; i < count; ++i, pSrc += 2, pDst += m_stride)
+			{
+				const auto pOut = reinterpret_cast<float*>(pDst);
+				pOut[0] = pSrc[0] * pScales[0];
+				pOut[1] = pSrc[1] * pScales[1];
+			}
+			break;
+		case 3:
+#if defined(__AVX2__)
+			{
+				// 4 vertices in 3 vectors per iteration, the scales rotated to match
+				const auto scales0 = _mm_setr_ps(pScales[0], pScales[1], pScales[2], pScales[0]);
+				const auto scales1 = _mm_setr_ps(pScales[1], pScales[2], pScales[0], pScales[1]);
+				const auto scales2 = _mm_setr_ps(pScales[2], pScales[0], pScales[1], pScales[2]);
+				for (; i + 4 <= count; i += 4, pSrc += 12, pDst += 4 * m_stride)
+				{
+					const auto v0 = _mm_mul_ps(_mm_loadu_ps(pSrc), scales0);		// x0 y0 z0 x1
+					const auto v1 = _mm_mul_ps(_mm_loadu_ps(pSrc + 4), scales1);	// y1 z1 x2 y2
+					const auto v2 = _mm_mul_ps(_mm_loadu_ps(pSrc + 8), scales2);	// z2 x3 y3 z3
+
+					const auto pOut0 = pDst, pOut1 = pOut0 + m_stride, pOut2 = pOut1 + m_stride, pOut3 = pOut2 + m_stride;
+					_mm_storel_pi(reinterpret_cast<__m64*>(pOut0), v0);
+					_mm_store_ss(reinterpret_cast<float*>(pOut0) + 2, _mm_movehl_ps(v0, v0));
+					_mm_store_ss(reinterpret_cast<float*>(pOut1), _mm_shuffle_ps(v0, v0, _MM_SHUFFLE(3, 3, 3, 3)));
+					_mm_storel_pi(reinterpret_cast<__m64*>(reinterpret_cast<float*>(pOut1) + 1), v1);
+					_mm_storeh_pi(reinterpret_cast<__m64*>(pOut2), v1);
+					_mm_store_ss(reinterpret_cast<float*>(pOut2) + 2, v2);
+					_mm_storel_pi(reinterpret_cast<__m64*>(pOut3), _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 2, 1)));
+					_mm_store_ss(reinterpret_cast<float*>(pOut3) + 2, _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 3, 3)));
+				}
+			}
+#endif
+			for (; i < count; ++i, pSrc += 3, pDst += m_stride)
+			{
+				const auto pOut = reinterpret_cast<float*>(pDst);
+				pOut[0] = pSrc[0] * pScales[0];
+				pOut[1] = pSrc[1] * pScales[1];
+				pOut[2] = pSrc[2] * pScales[2];
+			}
+			break;
+#if defined(__AVX2__)
+		case 4:
+			{
+				const auto scales = _mm_loadu_ps(pScales);
+				for (; i < count; ++i, pSrc += 4, pDst += m_stride)
+					_mm_storeu_ps(reinterpret_cast<float*>(pDst), _mm_mul_ps(_mm_loadu_ps(pSrc), scales));
+			}
+			break;
+#endif
+		default:
+			for (; i < count; ++i, pSrc += componentCount, pDst += m_stride)
+			{
+				const auto pOut = reinterpret_cast<float*>(pDst);
+				for (uint8_t j = 0; j < componentCount; ++j) pOut[j] = pSrc[j] * pScales[j];
+			}
+		}
+	}
+	else
+	{
+		float element[4];
+		for (auto i = 0u; i < count; ++i, pDst += m_stride)
+		{
+			cgltf_accessor_read_float(pAccessor, i, element, componentCount);
+			const auto pOut = reinterpret_cast<float*>(pDst);
+			for (uint8_t j = 0; j < componentCount; ++j) pOut[j] = element[j] * pScales[j];
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Index stream offset by the first vertex of the primitive; tightly packed u16 and u32
+// accessors are widened and offset 8 indices at a time under AVX2
+//--------------------------------------------------------------------------------------
+void GltfLoader::readIndices(const cgltf_accessor* pAccessor, uint32_t vertexOffset)
+{
+	const auto count = static_cast<uint32_t>(pAccessor->count);
+	const auto indexOffset = m_indices.size();
+	m_indices.resize(indexOffset + count);
+	const auto pDst = m_indices.data() + indexOffset;
+
+	const auto pBufferData = pAccessor->buffer_view ? cgltf_buffer_view_data(pAccessor->buffer_view) : nullptr;
+	const auto isPacked = pBufferData && !pAccessor->is_sparse && pAccessor->stride == cgltf_component_size(pAccessor->component_type);
+	auto i = 0u;
+#if defined(__AVX2__)
+	const auto offsets = _mm256_set1_epi32(static_cast<int>(vertexOffset));
+#endif
+	if (isPacked && pAccessor->component_type == cgltf_component_type_r_32u)
+	{
+		const auto pSrc = reinterpret_cast<const uint32_t*>(pBufferData + pAccessor->offset);
+#if defined(__AVX2__)
+		for (; i + 8 <= count; i += 8)
+		{
+			const auto indices = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&pSrc[i]));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&pDst[i]), _mm256_add_epi32(indices, offsets));
+		}
+#endif
+		for (; i < count; ++i) pDst[i] = vertexOffset + pSrc[i];
+	}
+	else if (isPacked && pAccessor->component_type == cgltf_component_type_r_16u)
+	{
+		const auto pSrc = reinterpret_cast<const uint16_t*>(pBufferData + pAccessor->offset);
+#if defined(__AVX2__)
+		for (; i + 8 <= count; i += 8)
+		{
+			const auto indices = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&pSrc[i])));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&pDst[i]), _mm256_add_epi32(indices, offsets));
+		}
+#endif
+		for (; i < count; ++i) pDst[i] = vertexOffset + pSrc[i];
+	}
+	else for (; i < count; ++i)
+		pDst[i] = vertexOffset + static_cast<uint32_t>(cgltf_accessor_read_index(pAccessor, i));
+}
+
+void GltfLoader::initVertexLayout()
+{
+	m_stride = 0;
+	m_posOffset = m_stride;
+	m_stride += sizeof(float3);		// position
+	m_nrmOffset = m_stride;
+	m_stride += sizeof(float3);		// normal
+	m_txcOffset = m_stride;
+	m_stride += sizeof(float4);		// texcoord
+	m_tanOffset = m_stride;
+	m_stride += sizeof(float4);		// tangentUV1
+	m_colorOffset = m_stride;
+	m_stride += sizeof(uint32_t);	// color
+	m_scalarOffset = m_stride;
+	m_stride += sizeof(float);		// emissiveStrength scalar
+}
+
+//--------------------------------------------------------------------------------------
+// Rewrites the vertices as QuantizedVertex against the AABB of the mesh; the distinct
+// pairs of color and emissive strength become the materials, in order of first use
+//--------------------------------------------------------------------------------------
+bool GltfLoader::quantizeVertices()
+{
+	const auto vertexCount = GetNumVertices();
+	vector<uint16_t> materialIndices(vertexCount);
+	unordered_map<uint64_t, uint16_t> materialMap;
+	auto prevKey = UINT64_MAX;
+	uint16_t materialIdx = 0;
+	for (auto i = 0u; i < vertexCount; ++i)
+	{
+		// Runs of vertices in a primitive share the same material
+		const auto& scalar = getVertexScalar(i);
+		uint32_t scalarBits;
+		memcpy(&scalarBits, &scalar, sizeof(float));
+		const auto key = getVertexColor(i) | (static_cast<uint64_t>(scalarBits) << 32);
+		if (key != prevKey)
+		{
+			const auto inserted = materialMap.emplace(key, static_cast<uint16_t>(m_materials.size()));
+			if (inserted.second)
+			{
+				if (m_materials.size() >= MaxMaterialCount) return false;
+				m_materials.push_back({ getVertexColor(i), scalar });
+			}
+			materialIdx = inserted.first->second;
+			prevKey = key;
+		}
+		materialIndices[i] = materialIdx;
+	}
+
+	vector<uint8_t> vertices(sizeof(QuantizedVertex) * vertexCount);
+	const auto pVertices = reinterpret_cast<QuantizedVertex*>(vertices.data());
+	forEachBlock(m_threadCount, vertexCount, [&](size_t begin, size_t end)
+	{
+		for (auto i = static_cast<uint32_t>(begin); i < end; ++i)
+			EncodeVertex(pVertices[i], m_aabb, getPosition(i), getNormal(i), getTexcoord(i), getTangent(i), materialIndices[i]);
+	});
+
+	m_vertices = move(vertices);
+	m_stride = sizeof(QuantizedVertex);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Reads a mapped cache back into the loader's storage; false if the cache is missing,
+// truncated, from another key or layout, or any external dependency has changed
+//--------------------------------------------------------------------------------------
+bool GltfLoader::loadCache(const string& cachePath, uint64_t key)
+{
+	cgltf_size size = 0;
+	void* pCache = nullptr;
+	if (mapFile(nullptr, nullptr, cachePath.c_str(), &size, &pCache) != cgltf_result_success) return false;
+
+	auto pData = static_cast<const uint8_t*>(pCache);
+	const auto pEnd = pData + size;
+	const auto read = [&pData, pEnd](void* pDst, size_t byteCount)
+	{
+		if (static_cast<size_t>(pEnd - pData) < byteCount) return false;
+		memcpy(pDst, pData, byteCount);
+		pData += byteCount;
+
+		return true;
+	};
+
+	initVertexLayout();
+	if (m_isVertexQuantizationEnabled) m_stride = sizeof(QuantizedVertex);
+	CacheHeader header;
+	auto isValid = read(&header, sizeof(header)) && header.Magic == CacheMagic && header.Version == CacheVersion &&
+		header.Key == key && header.Stride == m_stride;
+
+	for (auto i = 0u; isValid && i < header.DependencyCount; ++i)
+	{
+		CacheDependency dependency;
+		isValid = read(&dependency, sizeof(dependency));
+		string path(isValid ? dependency.PathLength : 0, '\0');
+		isValid = isValid && read(&path[0], path.size());
+
+		uint64_t fileSize, writeTime;
+		isValid = isValid && getFileStamp(path, fileSize, writeTime) && fileSize == dependency.Size && writeTime == dependency.WriteTime;
+	}
+
+	if (isValid)
+	{
+		m_vertices.resize(static_cast<size_t>(m_stride) * header.VertexCount);
+		m_indices.resize(header.IndexCount);
+		m_subsets.resize(header.SubsetCount);
+		m_lightSources.resize(header.LightSourceCount);
+		m_materials.resize(header.MaterialCount);
+		isValid = read(m_vertices.data(), m_vertices.size()) && read(m_indices.data(), sizeof(uint32_t) * m_indices.size()) &&
+			read(m_subsets.data(), sizeof(Subset) * m_subsets.size()) &&
+			read(m_lightSources.data(), sizeof(LightSource) * m_lightSources.size()) &&
+			read(m_materials.data(), sizeof(Material) * m_materials.size());
+	}
+
+	vector<CacheTexture> textures(isValid ? header.TextureCount : 0);
+	isValid = isValid && read(textures.data(), sizeof(CacheTexture) * textures.size());
+	m_textures.clear();
+	m_textures.resize(textures.size());
+	for (size_t i = 0; isValid && i < textures.size(); ++i)
+	{
+		// Allocated like stb_image's own results, which ImageDeleter frees
+		auto& texture = m_textures[i];
+		texture.Width = textures[i].Width;
+		texture.Height = textures[i].Height;
+		texture.Channels = static_cast<uint8_t>(textures[i].Channels);
+		const auto byteCount = static_cast<size_t>(texture.Width) * texture.Height * texture.Channels;
+		texture.Data.reset(static_cast<uint8_t*>(malloc(byteCount)));
+		isValid = texture.Data && read(texture.Data.get(), byteCount);
+	}
+
+	unmapFile(nullptr, nullptr, pCache);
+
+	if (isValid)
+	{
+		m_aabb = header.AABB;
+		m_texIndexMap.clear();
+	}
+	else
+	{
+		m_vertices.clear();
+		m_indices.clear();
+		m_subsets.clear();
+		m_lightSources.clear();
+		m_materials.clear();
+		m_textures.clear();
+	}
+
+	return isValid;
+}
+
+void GltfLoader::saveCache(const string& cachePath, uint64_t key, const vector<string>& dependencies) const
+{
+	// Written to a temporary file first, so that an interrupted write never leaves a cache behind
+	const auto tempPath = cachePath + ".tmp";
+	auto isWritten = true;
+	{
+		ofstream file(tempPath, ios::binary);
+
+		const auto write = [&file](const void* pData, size_t byteCount)
+		{
+			file.write(static_cast<const char*>(pData), byteCount);
+		};
+
+		CacheHeader header = {};
+		header.Magic = CacheMagic;
+		header.Version = CacheVersion;
+		header.Key = key;
+		header.Stride = m_stride;
+		header.VertexCount = GetNumVertices();
+		header.IndexCount = GetNumIndices();
+		header.SubsetCount = GetNumSubSets();
+		header.LightSourceCount = static_cast<uint32_t>(m_lightSources.size());
+		header.MaterialCount = static_cast<uint32_t>(m_materials.size());
+		header.TextureCount = GetNumTextures();
+		header.DependencyCount = static_cast<uint32_t>(dependencies.size());
+		header.AABB = m_aabb;
+		write(&header, sizeof(header));
+
+		for (const auto& path : dependencies)
+		{
+			CacheDependency dependency = {};
+			isWritten = isWritten && getFileStamp(path, dependency.Size, dependency.WriteTime);
+			dependency.PathLength = static_cast<uint32_t>(path.size());
+			write(&dependency, sizeof(dependency));
+			write(path.data(), path.size());
+		}
+
+		write(m_vertices.data(), m_vertices.size());
+		write(m_indices.data(), sizeof(uint32_t) * m_indices.size());
+		write(m_subsets.data(), sizeof(Subset) * m_subsets.size());
+		write(m_lightSources.data(), sizeof(LightSource) * m_lightSources.size());
+		write(m_materials.data(), sizeof(Material) * m_materials.size());
+		for (const auto& texture : m_textures)
+		{
+			const CacheTexture cacheTexture = { texture.Width, texture.Height, texture.Channels };
+			write(&cacheTexture, sizeof(cacheTexture));
+		}
+		for (const auto& texture : m_textures)
+			write(texture.Data.get(), static_cast<size_t>(texture.Width) * texture.Height * texture.Channels);
+
+		isWritten = isWritten && file.good();
+	}
+
+	if (isWritten)
+	{
+		remove(cachePath.c_str());
+		rename(tempPath.c_str(), cachePath.c_str());
+	}
+	else remove(tempPath.c_str());
+}
+
 void GltfLoader::fillVertexColors(uint32_t offset, uint32_t size, float4 color)
 {
 	for (auto i = 0u; i < size; ++i)
@@ -401,16 +1633,40 @@ void GltfLoader::fillVertexScalars(uint32_t offset, uint32_t size, float scalar)
 	}
 }
 
-void GltfLoader::recomputeNormals()
+//--------------------------------------------------------------------------------------
+// Face normals of the primitive are summed on one representative per welded position and
+// then shared with all the vertices mapped to it, so that seams where the source splits
+// vertices (by UVs, or as a triangle soup) do not turn out faceted
+//--------------------------------------------------------------------------------------
+void GltfLoader::recomputeNormals(uint32_t vertexOffset, uint32_t vertexCount, uint32_t indexOffset)
 {
 	float3 e1, e2, n;
 
-	const auto numTri = static_cast<uint32_t>(m_indices.size()) / 3;
+	vector<uint32_t> remap(vertexCount);
+	if (m_isNormalWeldingEnabled)
+	{
+		float3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+		for (auto i = 0u; i < vertexCount; ++i)
+		{
+			const auto& p = getPosition(vertexOffset + i);
+			minPos = float3((min)(p.x, minPos.x), (min)(p.y, minPos.y), (min)(p.z, minPos.z));
+			maxPos = float3((max)(p.x, maxPos.x), (max)(p.y, maxPos.y), (max)(p.z, maxPos.z));
+		}
+		const float3 diag(maxPos.x - minPos.x, maxPos.y - minPos.y, maxPos.z - minPos.z);
+		const auto epsilon = vertexCount ? m_normalWeldEpsilon * sqrt(diag.x * diag.x + diag.y * diag.y + diag.z * diag.z) : 0.0f;
+		WeldPositions(m_vertices.data() + m_stride * vertexOffset + m_posOffset, vertexCount, m_stride, epsilon, remap.data(), m_threadCount);
+	}
+	else for (auto i = 0u; i < vertexCount; ++i) remap[i] = i;
+
+	for (auto i = 0u; i < vertexCount; ++i) getNormal(vertexOffset + i) = float3(0.0f);
+
+	const auto numTri = static_cast<uint32_t>(m_indices.size() - indexOffset) / 3;
+	const auto pIndices = m_indices.data() + indexOffset;
 	for (auto i = 0u; i < numTri; i++)
 	{
-		const auto pv0 = &getPosition(m_indices[i * 3]);
-		const auto pv1 = &getPosition(m_indices[i * 3 + 1]);
-		const auto pv2 = &getPosition(m_indices[i * 3 + 2]);
+		const auto pv0 = &getPosition(pIndices[i * 3]);
+		const auto pv1 = &getPosition(pIndices[i * 3 + 1]);
+		const auto pv2 = &getPosition(pIndices[i * 3 + 2]);
 		e1.x = pv1->x - pv0->x;
 		e1.y = pv1->y - pv0->y;
 		e1.z = pv1->z - pv0->z;
@@ -421,13 +1677,14 @@ void GltfLoader::recomputeNormals()
 		n.y = e1.z * e2.x - e1.x * e2.z;
 		n.z = e1.x * e2.y - e1.y * e2.x;
 		const auto l = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+		if (l <= 0.0f) continue;
 		n.x /= l;
 		n.y /= l;
 		n.z /= l;
 
-		const auto pVn0 = &getNormal(m_indices[i * 3]);
-		const auto pVn1 = &getNormal(m_indices[i * 3 + 1]);
-		const auto pVn2 = &getNormal(m_indices[i * 3 + 2]);
+		const auto pVn0 = &getNormal(vertexOffset + remap[pIndices[i * 3] - vertexOffset]);
+		const auto pVn1 = &getNormal(vertexOffset + remap[pIndices[i * 3 + 1] - vertexOffset]);
+		const auto pVn2 = &getNormal(vertexOffset + remap[pIndices[i * 3 + 2] - vertexOffset]);
 		pVn0->x += n.x;
 		pVn0->y += n.y;
 		pVn0->z += n.z;
@@ -439,11 +1696,18 @@ void GltfLoader::recomputeNormals()
 		pVn2->z += n.z;
 	}
 
-	const auto numVert = GetNumVertices();
-	for (auto i = 0u; i < numVert; ++i)
+	// Representatives come first, as they map to themselves
+	for (auto i = 0u; i < vertexCount; ++i)
 	{
-		const auto pVn = &getNormal(i);
+		const auto pVn = &getNormal(vertexOffset + i);
+		if (remap[i] != i)
+		{
+			*pVn = getNormal(vertexOffset + remap[i]);
+			continue;
+		}
+
 		const auto l = sqrt(pVn->x * pVn->x + pVn->y * pVn->y + pVn->z * pVn->z);
+		if (l <= 0.0f) continue;
 		pVn->x /= l;
 		pVn->y /= l;
 		pVn->z /= l;
@@ -482,15 +1746,100 @@ void GltfLoader::computeAABB()
 	m_aabb.Max = float3(xMax, yMax, zMax);
 }
 
-void GltfLoader::regenerateUV1(uint32_t vertexOffset, uint32_t vertexCount, bool useInputMeshUvs)
+//--------------------------------------------------------------------------------------
+// Light-map atlases of all primitives, generated concurrently by a bounded pool of workers;
+// xatlas is built with XA_MULTITHREADED=0, since every atlas would otherwise start its own
+// task scheduler with a thread per core. The results are spliced back in primitive order,
+// so that the output does not depend on the thread count
+//--------------------------------------------------------------------------------------
+void GltfLoader::regenerateUV1(const vector<Primitive>& primitives)
+{
+	vector<xatlas::Atlas*> atlases(primitives.size(), nullptr);
+	atomic<size_t> nextPrimitive(0);
+	const auto generateAtlases = [&]()
+	{
+		for (auto i = nextPrimitive++; i < primitives.size(); i = nextPrimitive++)
+			if (primitives[i].NeedsAtlas) atlases[i] = generateAtlas(primitives[i]);
+	};
+
+	size_t atlasCount = 0;
+	for (const auto& primitive : primitives) atlasCount += primitive.NeedsAtlas ? 1 : 0;
+	if (!atlasCount) return;
+
+	const auto hardwareThreadCount = (max)(thread::hardware_concurrency(), 1u);
+	const auto threadCount = (min)(m_threadCount ? m_threadCount : hardwareThreadCount, static_cast<uint32_t>(atlasCount));
+	vector<thread> workers(threadCount > 1 ? threadCount - 1 : 0);
+	for (auto& worker : workers) worker = thread(generateAtlases);
+	generateAtlases();
+	for (auto& worker : workers) worker.join();
+
+	// Atlases duplicate vertices along chart seams, shifting all the vertices behind them
+	const auto vertices = move(m_vertices);
+	m_vertices.clear();
+	m_vertices.reserve(vertices.size());
+	for (size_t i = 0; i < primitives.size(); ++i)
+	{
+		const auto& primitive = primitives[i];
+		const auto vertexOffset = static_cast<uint32_t>(m_vertices.size() / m_stride);
+		const auto pAtlas = atlases[i];
+		if (!pAtlas)
+		{
+			const auto pSrc = vertices.data() + m_stride * primitive.VertexOffset;
+			m_vertices.insert(m_vertices.end(), pSrc, pSrc + m_stride * primitive.VertexCount);
+			for (auto j = 0u; j < primitive.IndexCount; ++j)
+				m_indices[primitive.IndexOffset + j] += vertexOffset - primitive.VertexOffset;
+
+			// Atlas failures keep the input UVs at the full light-map size
+			if (primitive.NeedsAtlas && primitive.SubsetIdx != UINT32_MAX) m_subsets[primitive.SubsetIdx].LightMapScl = float2(1.0f);
+			continue;
+		}
+
+		assert(pAtlas->atlasCount == 1);
+		assert(pAtlas->meshCount == 1);
+		const auto& mesh = pAtlas->meshes[0];
+		assert(mesh.indexCount == primitive.IndexCount);
+		const auto vertexCount = mesh.vertexCount;
+		m_vertices.resize(m_stride * (vertexOffset + vertexCount));
+		for (uint32_t j = 0; j < vertexCount; ++j)
+		{
+			const auto& vertex = mesh.vertexArray[j];
+			memcpy(getVertex(vertexOffset + j), &vertices[m_stride * (primitive.VertexOffset + vertex.xref)], m_stride);
+			auto& uv = getTexcoord(vertexOffset + j);
+			uv.z = vertex.uv[0] / static_cast<float>(pAtlas->width);
+			uv.w = vertex.uv[1] / static_cast<float>(pAtlas->height);
+			if (!primitive.UseInputMeshUvs)
+			{
+				uv.x = uv.z;
+				uv.y = uv.w;
+			}
+		}
+
+		for (uint32_t j = 0; j < primitive.IndexCount; ++j)
+			m_indices[primitive.IndexOffset + j] = vertexOffset + mesh.indexArray[j];
+
+		if (primitive.SubsetIdx != UINT32_MAX)
+		{
+			auto& subset = m_subsets[primitive.SubsetIdx];
+			const auto& texture = m_textures[subset.BaseColorTexIdx];
+			subset.LightMapScl.x = pAtlas->width / static_cast<float>(texture.Width);
+			subset.LightMapScl.y = pAtlas->height / static_cast<float>(texture.Height);
+			subset.LightMapScl.x = exp2f(roundf(log2f(subset.LightMapScl.x)));
+			subset.LightMapScl.y = exp2f(roundf(log2f(subset.LightMapScl.y)));
+		}
+
+		xatlas::Destroy(pAtlas);
+	}
+}
+
+xatlas::Atlas* GltfLoader::generateAtlas(const Primitive& primitive) const
 {
-	auto& subset = m_subsets.back();
+	const auto pVertex = &m_vertices[m_stride * primitive.VertexOffset];
 
 	xatlas::MeshDecl meshDecl;
-	meshDecl.vertexPositionData = &getPosition(vertexOffset);
-	meshDecl.vertexNormalData = &getNormal(vertexOffset);
-	meshDecl.vertexUvData = &getTexcoord(vertexOffset); // optional. The input UVs are provided as a hint to the chart generator.
-	meshDecl.indexData = &m_indices[subset.IndexOffset];
+	meshDecl.vertexPositionData = &pVertex[m_posOffset];
+	meshDecl.vertexNormalData = &pVertex[m_nrmOffset];
+	meshDecl.vertexUvData = &pVertex[m_txcOffset]; // optional. The input UVs are provided as a hint to the chart generator.
+	meshDecl.indexData = &m_indices[primitive.IndexOffset];
 
 	// Optional. Must be faceCount in length.
 	// Don't atlas faces set to true. Ignored faces still exist in the output meshes, Vertex uv is set to (0, 0) and Vertex atlasIndex to -1.
@@ -504,12 +1853,12 @@ void GltfLoader::regenerateUV1(uint32_t vertexOffset, uint32_t vertexCount, bool
 	// Polygon / n-gon support. Faces are assumed to be triangles if this is null.
 	//meshDecl.faceVertexCount = nullptr;
 
-	meshDecl.vertexCount = vertexCount;
+	meshDecl.vertexCount = primitive.VertexCount;
 	meshDecl.vertexPositionStride = m_stride;
 	meshDecl.vertexNormalStride = m_stride;
 	meshDecl.vertexUvStride = m_stride; // optional
-	meshDecl.indexCount = subset.NumIndices;
-	meshDecl.indexOffset = -static_cast<int32_t>(vertexOffset); // optional. Add this offset to all indices.
+	meshDecl.indexCount = primitive.IndexCount;
+	meshDecl.indexOffset = -static_cast<int32_t>(primitive.VertexOffset); // optional. Add this offset to all indices.
 	//meshDecl.faceCount = 0; // Optional if faceVertexCount is null. Otherwise assumed to be indexCount / 3.
 	meshDecl.indexFormat = xatlas::IndexFormat::UInt32;
 
@@ -517,53 +1866,17 @@ void GltfLoader::regenerateUV1(uint32_t vertexOffset, uint32_t vertexCount, bool
 	xatlas::AddMeshError error = xatlas::AddMesh(pAtlas, meshDecl);
 	if (error != xatlas::AddMeshError::Success)
 	{
-		subset.LightMapScl = float2(1.0f);
 		xatlas::Destroy(pAtlas);
-		return;
+		return nullptr;
 	}
 
-	const auto& texture = m_textures[subset.BaseColorTexIdx];
 	xatlas::ChartOptions chartOptions;
 	//chartOptions.maxIterations = 4;
-	chartOptions.useInputMeshUvs = useInputMeshUvs;
+	chartOptions.useInputMeshUvs = primitive.UseInputMeshUvs;
 	//chartOptions.fixWinding = true;
-	xatlas::PackOptions packOptions;
-	//packOptions.padding = 1;
-	//packOptions.bruteForce = true;
-	packOptions.blockAlign = true;
-	packOptions.resolution = (max)(texture.Width, texture.Height);
 	xatlas::Generate(pAtlas, chartOptions);
 
-	assert(pAtlas->atlasCount == 1);
-	assert(pAtlas->meshCount == 1);
-	assert(pAtlas->meshes[0].indexCount == subset.NumIndices);
-	vector<uint8_t> vertices(m_stride * vertexCount);
-	memcpy(vertices.data(), &m_vertices[m_stride * vertexOffset], vertices.size());
-	vertexCount = pAtlas->meshes[0].vertexCount;
-	m_vertices.resize(m_stride * (vertexOffset + vertexCount));
-	for (uint32_t i = 0; i < vertexCount; ++i)
-	{
-		const auto& vertex = pAtlas->meshes[0].vertexArray[i];
-		memcpy(getVertex(vertexOffset + i), &vertices[m_stride * vertex.xref], m_stride);
-		auto& uv = getTexcoord(vertexOffset + i);
-		uv.z = vertex.uv[0] / static_cast<float>(pAtlas->width);
-		uv.w = vertex.uv[1] / static_cast<float>(pAtlas->height);
-		if (!useInputMeshUvs)
-		{
-			uv.x = uv.z;
-			uv.y = uv.w;
-		}
-	}
-
-	for (uint32_t i = 0; i < subset.NumIndices; ++i)
-		m_indices[subset.IndexOffset + i] = vertexOffset + pAtlas->meshes[0].indexArray[i];
-
-	subset.LightMapScl.x = pAtlas->width / static_cast<float>(texture.Width);
-	subset.LightMapScl.y = pAtlas->height / static_cast<float>(texture.Height);
-	subset.LightMapScl.x = exp2f(roundf(log2f(subset.LightMapScl.x)));
-	subset.LightMapScl.y = exp2f(roundf(log2f(subset.LightMapScl.y)));
-
-	xatlas::Destroy(pAtlas);
+	return pAtlas;
 }
 
 uint8_t* GltfLoader::getVertex(uint32_t i)
@@ -5,6 +5,10 @@
 #pragma once
 
 #include <map>
+#include <memory>
+
+struct cgltf_accessor;
+namespace xatlas { struct Atlas; }
 
 namespace XUSG
 {
@@ -61,12 +65,18 @@ namespace XUSG
 			float4& operator= (const float4& v) { x = v.x; y = v.y; z = v.z; w = v.w; return *this; }
 		};
 
+		// Decoded pixels stay in the image decoder's own allocation
+		struct ImageDeleter
+		{
+			void operator()(uint8_t* pData) const;
+		};
+
 		struct Texture
 		{
 			uint32_t Width;
 			uint32_t Height;
 			uint8_t Channels;
-			std::vector<uint8_t> Data;
+			std::unique_ptr<uint8_t, ImageDeleter> Data;
 		};
 
 		struct Subset
@@ -93,12 +103,58 @@ namespace XUSG
 			float3 Max;
 		}; 
 
+		// 32-byte vertex of SetVertexQuantization(): position in SNORM16 relative to the center
+		// and half extents of the AABB, octahedral normal and tangent in SNORM16 x 2, and half-float
+		// texcoords; colors and emissive strengths are moved to a table of materials
+		struct QuantizedVertex
+		{
+			int16_t Pos[3];
+			uint16_t MaterialIdx;	// Bit 15 is set for a negative tangent handedness
+			uint32_t Nrm;
+			uint32_t Tan;			// NoTangent if the vertex has none
+			uint16_t UV0[2];
+			uint16_t UV1[2];
+			uint32_t Padding[2];	// To one aligned 32-byte memory sector per vertex
+		};
+
+		struct Material
+		{
+			uint32_t Color;
+			float Emissive;
+		};
+
+		static const uint32_t NoTangent = 0x80008000;
+		static const uint32_t MaxMaterialCount = 0x8000;
+
 		GltfLoader();
 		virtual ~GltfLoader();
 
 		bool Import(const char* pszFilename, bool needNorm = true, bool needColor = true,
 			bool needBound = true, bool invertZ = true);
 
+		// Worker threads for image decoding, light-map atlases, index reordering and vertex
+		// deduplication, including the calling thread; 0 uses all hardware threads
+		void SetThreadCount(uint32_t threadCount);
+
+		// The final vertices, indices, subsets, light sources, materials and decoded textures are cached in
+		// <file>.meshcache next to the source, keyed by its contents and the import options;
+		// a valid cache replaces the whole import
+		void SetCacheEnabled(bool isEnabled);
+
+		// Triangles of each subset reordered for the post-transform vertex cache and overdraw
+		void SetIndexReordering(bool isEnabled);
+
+		// Vertices with identical attributes merged after the light-map atlases
+		void SetVertexDeduplication(bool isEnabled);
+
+		// Generated normals are smooth across vertices whose positions are within epsilon,
+		// relative to the bounding-box diagonal of the primitive; 0 welds identical positions
+		void SetNormalWelding(bool isEnabled, float epsilon = 0.0f);
+
+		// Vertices encoded as QuantizedVertex, half of the stride, as the last step of the import;
+		// the import fails on more than MaxMaterialCount distinct colors and emissive strengths
+		void SetVertexQuantization(bool isEnabled);
+
 		const uint32_t GetNumVertices() const;
 		const uint32_t GetNumIndices() const;
 		const uint32_t GetNumSubSets() const;
@@ -111,14 +167,69 @@ namespace XUSG
 
 		const AABB& GetAABB() const;
 
+		// Ownership transfer without copies; the loader's storage is left empty
+		std::vector<uint8_t> DetachVertices();
+		std::vector<uint32_t> DetachIndices();
+		std::vector<Texture> DetachTextures();
+
 		const std::vector<LightSource>& GetLightSources() const;
+		const std::vector<Material>& GetMaterials() const;
+
+		// Tipsify (Sander et al. 2007): triangles fanned around vertices picked by their cache
+		// age and remaining valence, in clusters sorted to draw outward-facing ones first;
+		// linear in the triangle count, triangle windings preserved
+		static void ReorderIndices(uint32_t* pIndices, uint32_t indexCount, const uint8_t* pPositions,
+			uint32_t positionStride, uint32_t cacheSize = 16);
+
+		// Merges byte-identical vertices into the first one of each, in place, keeping their
+		// order, and remaps the indices; hashing and remapping run on threadCount threads
+		// (0 for all hardware threads), and the vertex count after merging is returned
+		static uint32_t DeduplicateVertices(uint8_t* pVertices, uint32_t vertexCount, uint32_t stride,
+			uint32_t* pIndices, size_t indexCount, uint32_t threadCount = 0);
+
+		// Maps each position to the first one within epsilon of it (per axis), looked up in
+		// a spatial hash of 2 * epsilon cells; 0 maps only identical positions together
+		static void WeldPositions(const uint8_t* pPositions, uint32_t vertexCount, uint32_t stride,
+			float epsilon, uint32_t* pRemap, uint32_t threadCount = 0);
+
+		// Quantized vertex codec; the decoded values are within half a quantization step of the
+		// originals, per component of the position, UVs and octahedral coordinates
+		static void EncodeVertex(QuantizedVertex& dst, const AABB& aabb, const float3& pos, const float3& nrm,
+			const float4& texcoord, const float4& tangent, uint16_t materialIdx);
+		static void DecodeVertex(const QuantizedVertex& src, const AABB& aabb, float3& pos, float3& nrm,
+			float4& texcoord, float4& tangent, uint16_t& materialIdx);
+
+		// Decodes size bytes of base64 text, vectorized with AVX2 or SSSE3 where the build enables
+		// them; no more than length characters are read, and false on characters outside of the
+		// alphabet or on text too short for size bytes
+		static bool DecodeBase64(uint8_t* pDst, size_t size, const char* pBase64, size_t length);
 
 	protected:
+		// Vertex and index ranges of an imported primitive, and whether it needs a light-map atlas
+		struct Primitive
+		{
+			uint32_t VertexOffset;
+			uint32_t VertexCount;
+			uint32_t IndexOffset;
+			uint32_t IndexCount;
+			uint32_t SubsetIdx;
+			bool NeedsAtlas;
+			bool UseInputMeshUvs;
+		};
+
+		void readFloats(const cgltf_accessor* pAccessor, uint32_t vertexOffset, uint32_t attribOffset,
+			uint8_t componentCount, const float* pScales);
+		void readIndices(const cgltf_accessor* pAccessor, uint32_t vertexOffset);
 		void fillVertexColors(uint32_t offset, uint32_t size, float4 color);
 		void fillVertexScalars(uint32_t offset, uint32_t size, float scalar);
-		void recomputeNormals();
+		void recomputeNormals(uint32_t vertexOffset, uint32_t vertexCount, uint32_t indexOffset);
 		void computeAABB();
-		void regenerateUV1(uint32_t vertexOffset, uint32_t texcoordCount, bool useInputMeshUvs);
+		void regenerateUV1(const std::vector<Primitive>& primitives);
+		xatlas::Atlas* generateAtlas(const Primitive& primitive) const;
+		void initVertexLayout();
+		bool quantizeVertices();
+		bool loadCache(const std::string& cachePath, uint64_t key);
+		void saveCache(const std::string& cachePath, uint64_t key, const std::vector<std::string>& dependencies) const;
 
 		uint8_t* getVertex(uint32_t i);
 		float3& getPosition(uint32_t i);
@@ -136,6 +247,7 @@ namespace XUSG
 		std::vector<uint32_t>	m_indices;
 		std::vector<Subset>		m_subsets;
 		std::vector<LightSource> m_lightSources;
+		std::vector<Material>	m_materials;
 
 		std::vector<Texture>	m_textures;
 		std::map<void*, uint32_t> m_texIndexMap;
@@ -148,6 +260,14 @@ namespace XUSG
 		uint32_t	m_colorOffset;
 		uint32_t	m_scalarOffset;
 
+		uint32_t	m_threadCount;
+		bool		m_isCacheEnabled;
+		bool		m_isIndexReorderingEnabled;
+		bool		m_isVertexDeduplicationEnabled;
+		bool		m_isNormalWeldingEnabled;
+		bool		m_isVertexQuantizationEnabled;
+		float		m_normalWeldEpsilon;
+
 		AABB m_aabb;
 	};
 }